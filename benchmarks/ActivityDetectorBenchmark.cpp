@@ -0,0 +1,323 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * ActivityDetector test and benchmark.
+  *
+  * Feeds frames of synthetic signals at 16kHz to an ActivityDetector, one frame per buffer: a quiet noise background,
+  * a voiced sound (a 150Hz fundamental with harmonics), a pure tone and loud white noise. It reports the spectral
+  * flatness of each, checks the frames on which activity starts and ends, and reports the time taken per sample,
+  * which depends on the host and compiler.
+  *
+  * Usage: ActivityDetectorBenchmark [frames per measurement]
+  *
+  * Exits with a failure if a tone is not much less flat than noise, if activity does not start after the onset period
+  * and end after the hangover period, if a brief pause ends it, if a single loud frame or (with a flatness limit)
+  * a burst of loud noise starts it, or if a steady DC offset is not removed.
+  */
+
+#include "HostTarget.h"
+#include "ActivityDetector.h"
+#include <math.h>
+
+using namespace codal;
+
+#define ACTIVITY_BENCHMARK_RATE             16000
+#define ACTIVITY_BENCHMARK_FRAME            ACTIVITY_DETECTOR_DEFAULT_FRAME_SIZE
+#define ACTIVITY_BENCHMARK_QUIET            40      // Peak amplitude of the background noise, which is below the threshold.
+#define ACTIVITY_BENCHMARK_LOUD             8000    // Peak amplitude of the loud signals.
+#define ACTIVITY_BENCHMARK_TONAL_FLATNESS   300     // Greatest flatness accepted for a tone or voiced sound.
+#define ACTIVITY_BENCHMARK_NOISE_FLATNESS   800     // Least flatness accepted for white noise.
+#define ACTIVITY_BENCHMARK_NOISE_LIMIT      600     // Flatness limit used to reject noise.
+#define ACTIVITY_BENCHMARK_DC               2000    // DC offset added to the background.
+
+enum ActivitySignal
+{
+    SignalQuiet = 0,
+    SignalVoiced,
+    SignalTone,
+    SignalNoise
+};
+
+static const char *signalNames[] = { "quiet noise", "voiced", "1kHz tone", "white noise" };
+
+static uint32_t seed = 1;
+static uint32_t position = 0;
+static int frame = 0;
+static int startFrame = -1;
+static int endFrame = -1;
+static int startCount = 0;
+static int endCount = 0;
+
+static uint32_t benchmark_random(uint32_t range)
+{
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 8) % range;
+}
+
+/*
+ * Records the frame on which each activity event is raised.
+ */
+static void record_events(Event evt, void *)
+{
+    if (evt.source != DEVICE_ID_ACTIVITY_DETECTOR)
+        return;
+
+    if (evt.value == ACTIVITY_DETECTOR_EVT_START)
+    {
+        startFrame = frame;
+        startCount++;
+    }
+
+    if (evt.value == ACTIVITY_DETECTOR_EVT_END)
+    {
+        endFrame = frame;
+        endCount++;
+    }
+}
+
+/*
+ * A source that provides whichever frame the test has generated most recently.
+ */
+struct FrameSource : public DataSource
+{
+    ManagedBuffer buffer;
+    int offset;
+
+    FrameSource() : buffer(ACTIVITY_BENCHMARK_FRAME * 2), offset(0)
+    {
+    }
+
+    virtual ManagedBuffer pull()
+    {
+        return buffer;
+    }
+
+    virtual DataStreamFormat getFormat()
+    {
+        return DataStreamFormat(2, 16, true, 1, ACTIVITY_BENCHMARK_RATE);
+    }
+
+    /*
+     * Generates the next frame of the given signal, plus any DC offset. Tones continue in phase from one frame to the next.
+     */
+    void generate(ActivitySignal signal)
+    {
+        int16_t *out = (int16_t *)buffer.getBytes();
+
+        for (int i = 0; i < ACTIVITY_BENCHMARK_FRAME; i++, position++)
+        {
+            double t = (double)position / ACTIVITY_BENCHMARK_RATE;
+            double v = 0;
+
+            switch (signal)
+            {
+                case SignalQuiet:
+                    v = (int)benchmark_random(2 * ACTIVITY_BENCHMARK_QUIET + 1) - ACTIVITY_BENCHMARK_QUIET;
+                    break;
+
+                case SignalVoiced:
+                    v = ACTIVITY_BENCHMARK_LOUD * (0.6 * sin(2 * M_PI * 150 * t) + 0.3 * sin(2 * M_PI * 300 * t) + 0.1 * sin(2 * M_PI * 450 * t));
+                    break;
+
+                case SignalTone:
+                    v = ACTIVITY_BENCHMARK_LOUD * sin(2 * M_PI * 1000 * t);
+                    break;
+
+                case SignalNoise:
+                    v = (int)benchmark_random(2 * ACTIVITY_BENCHMARK_LOUD + 1) - ACTIVITY_BENCHMARK_LOUD;
+                    break;
+            }
+
+            out[i] = (int16_t)lrint(v + offset);
+        }
+    }
+};
+
+/*
+ * Feeds the given number of frames of a signal to a detector.
+ */
+static void feed(FrameSource &source, ActivityDetector &detector, ActivitySignal signal, int frames)
+{
+    for (int i = 0; i < frames; i++)
+    {
+        source.generate(signal);
+        detector.pullRequest();
+        frame++;
+    }
+}
+
+/*
+ * Determines the flatness of the last of a run of frames of a signal.
+ */
+static int flatness(ActivitySignal signal)
+{
+    FrameSource source;
+    ActivityDetector detector(source);
+
+    feed(source, detector, signal, 4);
+    return detector.getFlatness();
+}
+
+/*
+ * Clears the events recorded, and numbers frames from zero.
+ */
+static void reset_events()
+{
+    frame = 0;
+    startFrame = endFrame = -1;
+    startCount = endCount = 0;
+}
+
+/*
+ * Plays a voiced burst, a brief pause, and a second burst over a quiet background, and checks that activity starts
+ * after the onset period, survives the pause, and ends after the hangover period.
+ */
+static bool check_bursts()
+{
+    FrameSource source;
+    ActivityDetector detector(source);
+
+    feed(source, detector, SignalQuiet, 30);
+    reset_events();
+
+    feed(source, detector, SignalVoiced, 20);
+    feed(source, detector, SignalQuiet, 3);
+    feed(source, detector, SignalVoiced, 20);
+    feed(source, detector, SignalQuiet, 40);
+
+    int expectedStart = ACTIVITY_DETECTOR_DEFAULT_ONSET - 1;
+    int expectedEnd = 43 + ACTIVITY_DETECTOR_DEFAULT_HANGOVER - 1;
+
+    printf("\nvoiced bursts, %d ms frames\n\n", detector.getFrameDuration() / 1000);
+    printf("%-24s %6d (expected %d)\n", "start frame", startFrame, expectedStart);
+    printf("%-24s %6d (expected %d)\n", "end frame", endFrame, expectedEnd);
+    printf("%-24s %6d %6d\n", "start and end events", startCount, endCount);
+
+    return startFrame == expectedStart && endFrame == expectedEnd && startCount == 1 && endCount == 1;
+}
+
+/*
+ * Checks that a single loud frame does not start activity, nor, with a flatness limit, does a burst of loud noise,
+ * while a voiced sound still does.
+ */
+static bool check_rejection()
+{
+    FrameSource source;
+    ActivityDetector detector(source);
+
+    feed(source, detector, SignalQuiet, 30);
+    reset_events();
+
+    feed(source, detector, SignalTone, 1);
+    feed(source, detector, SignalQuiet, 30);
+    int clickStarts = startCount;
+
+    detector.setFlatnessLimit(ACTIVITY_BENCHMARK_NOISE_LIMIT);
+    feed(source, detector, SignalNoise, 20);
+    feed(source, detector, SignalQuiet, 10);
+    int noiseStarts = startCount - clickStarts;
+
+    feed(source, detector, SignalVoiced, 10);
+    int voicedStarts = startCount - clickStarts - noiseStarts;
+
+    printf("\n%-24s %6s\n", "single loud frame", clickStarts ? "STARTED" : "ignored");
+    printf("%-24s %6s\n", "noise burst, limit 600", noiseStarts ? "STARTED" : "ignored");
+    printf("%-24s %6s\n", "voiced, limit 600", voicedStarts ? "started" : "IGNORED");
+
+    return clickStarts == 0 && noiseStarts == 0 && voicedStarts == 1;
+}
+
+/*
+ * Checks that a steady DC offset is removed, so that a quiet background with an offset is not mistaken for activity.
+ */
+static bool check_offset()
+{
+    FrameSource source;
+    ActivityDetector detector(source);
+
+    source.offset = ACTIVITY_BENCHMARK_DC;
+    reset_events();
+
+    feed(source, detector, SignalQuiet, 8 * ACTIVITY_DETECTOR_OFFSET_PERIOD);
+    int level = detector.getLevel();
+
+    printf("%-24s %6d, after %d frames\n", "level with DC offset", level, frame);
+
+    return level < ACTIVITY_DETECTOR_DEFAULT_THRESHOLD / 2 && !detector.isActive();
+}
+
+/*
+ * Measures the time taken per sample, over frames of a voiced sound.
+ */
+static double cost(int frames)
+{
+    FrameSource source;
+    ActivityDetector detector(source);
+
+    source.generate(SignalVoiced);
+
+    uint64_t start = host_time_ns();
+
+    for (int i = 0; i < frames; i++)
+        detector.pullRequest();
+
+    return (double)(host_time_ns() - start) / ((double)frames * ACTIVITY_BENCHMARK_FRAME);
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 20000;
+    bool ok = true;
+
+    HostEventBus bus;
+    bus.setHandler(record_events);
+
+    printf("ActivityDetector at %d Hz, %d sample frames\n\n", ACTIVITY_BENCHMARK_RATE, ACTIVITY_BENCHMARK_FRAME);
+    printf("%-24s %6s\n", "signal", "flatness");
+
+    int values[4];
+    for (int s = SignalQuiet; s <= SignalNoise; s++)
+    {
+        values[s] = flatness((ActivitySignal)s);
+        printf("%-24s %6d\n", signalNames[s], values[s]);
+    }
+
+    ok &= values[SignalVoiced] <= ACTIVITY_BENCHMARK_TONAL_FLATNESS && values[SignalTone] <= ACTIVITY_BENCHMARK_TONAL_FLATNESS;
+    ok &= values[SignalQuiet] >= ACTIVITY_BENCHMARK_NOISE_FLATNESS && values[SignalNoise] >= ACTIVITY_BENCHMARK_NOISE_FLATNESS;
+
+    ok &= check_bursts();
+    ok &= check_rejection();
+    ok &= check_offset();
+
+    printf("\n%-24s %6.2f\n", "ns/sample", cost(frames));
+
+    if (!ok)
+    {
+        printf("\nFAIL\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,384 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * IMA ADPCM benchmark.
+  *
+  * Measures the cost of AdpcmEncoder::encodeBlock() and AdpcmDecoder::decodeBlock() per sample, then streams a test signal
+  * (440Hz and 1234Hz tones with noise, at 16kHz) through an AdpcmEncoder and AdpcmDecoder in buffers of pseudo random
+  * sizes, and reports the compression ratio and the signal to noise ratio of the decoded output. Finally it checks that
+  * MemorySource::playAdpcm() plays the encoded data the given number of times, exactly as decodeBlock() decodes it, and
+  * that a playout repeating forever ends when MemorySource::stop() is called, and returns at once when there is nothing to
+  * play, from memory or from flash.
+  *
+  * Times depend on the host and compiler; the compression and SNR figures do not.
+  *
+  * Usage: AdpcmBenchmark [block size in bytes]
+  *
+  * Exits with a failure if the stream is not reproduced in order, the SNR is below ADPCM_BENCHMARK_MINIMUM_SNR, the
+  * compression ratio is below ADPCM_BENCHMARK_MINIMUM_RATIO, playAdpcm() does not match decodeBlock(), or a playout
+  * repeating forever does not stop or queues data when there is nothing to play.
+  */
+
+#include "HostTarget.h"
+#include "HostSource.h"
+#include "Adpcm.h"
+#include "MemorySource.h"
+#include "FlashSource.h"
+#include "SimulatedSPIFlash.h"
+#include "StreamProfiler.h"
+#include <math.h>
+
+using namespace codal;
+
+#define ADPCM_BENCHMARK_SAMPLE_RATE         16000
+#define ADPCM_BENCHMARK_SAMPLES             (ADPCM_BENCHMARK_SAMPLE_RATE * 10)
+#define ADPCM_BENCHMARK_MAXIMUM_BUFFER      1000
+#define ADPCM_BENCHMARK_TIMING_PASSES       20
+#define ADPCM_BENCHMARK_MINIMUM_SNR         25.0
+#define ADPCM_BENCHMARK_MINIMUM_RATIO       3.5
+
+static int16_t signal[ADPCM_BENCHMARK_SAMPLES];
+static uint32_t seed = 1;
+
+static uint32_t benchmark_random(uint32_t range)
+{
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 8) % range;
+}
+
+/*
+ * Provides the test signal in buffers of 1 to ADPCM_BENCHMARK_MAXIMUM_BUFFER samples.
+ */
+class RaggedSource : public DataSource
+{
+    int position;
+
+    public:
+    DataSink *downStream;
+
+    RaggedSource() : position(0), downStream(NULL) {}
+
+    virtual ManagedBuffer pull()
+    {
+        int size = min(1 + (int)benchmark_random(ADPCM_BENCHMARK_MAXIMUM_BUFFER), ADPCM_BENCHMARK_SAMPLES - position);
+        ManagedBuffer b((uint8_t *)&signal[position], size * 2);
+
+        position += size;
+        return b;
+    }
+
+    virtual void connect(DataSink &sink)
+    {
+        downStream = &sink;
+    }
+
+    virtual DataStreamFormat getFormat()
+    {
+        return DataStreamFormat(2, 16, true, 1, ADPCM_BENCHMARK_SAMPLE_RATE);
+    }
+
+    bool finished()
+    {
+        return position >= ADPCM_BENCHMARK_SAMPLES;
+    }
+};
+
+/*
+ * Collects every sample it is given, as signed 16 bit values.
+ */
+class CollectingSink : public DataSink
+{
+    DataSource &upstream;
+
+    public:
+    int16_t *samples;
+    int count;
+    int capacity;
+
+    CollectingSink(DataSource &source, int capacity) : upstream(source), count(0), capacity(capacity)
+    {
+        samples = (int16_t *)malloc(capacity * sizeof(int16_t));
+        source.connect(*this);
+    }
+
+    virtual int pullRequest()
+    {
+        ManagedBuffer b = upstream.pull();
+        int n = min(b.length() / 2, capacity - count);
+
+        memcpy(&samples[count], b.getBytes(), n * 2);
+        count += n;
+        return DEVICE_OK;
+    }
+};
+
+/*
+ * Determines the SNR of a decoded signal against the original, in dB.
+ */
+static double snr(const int16_t *decoded, int count)
+{
+    double signalPower = 0, noisePower = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        double e = (double)decoded[i] - signal[i];
+        signalPower += (double)signal[i] * signal[i];
+        noisePower += e * e;
+    }
+
+    return noisePower > 0 ? 10 * log10(signalPower / noisePower) : 200;
+}
+
+/*
+ * Times the block functions over the whole signal, several times over.
+ */
+static void time_blocks(int blockSize)
+{
+    int samplesPerBlock = ADPCM_SAMPLES_PER_BLOCK(blockSize);
+    int blocks = ADPCM_BENCHMARK_SAMPLES / samplesPerBlock;
+    uint8_t *encoded = (uint8_t *)malloc(blocks * blockSize);
+    int16_t *decoded = (int16_t *)malloc(samplesPerBlock * sizeof(int16_t));
+    int32_t check = 0;
+
+    uint64_t start = host_time_ns();
+
+    for (int pass = 0; pass < ADPCM_BENCHMARK_TIMING_PASSES; pass++)
+    {
+        int index = 0;
+
+        for (int b = 0; b < blocks; b++)
+            AdpcmEncoder::encodeBlock(signal[b * samplesPerBlock], &signal[b * samplesPerBlock + 1], samplesPerBlock - 1, &encoded[b * blockSize], index);
+    }
+
+    uint64_t encodeTime = host_time_ns() - start;
+    start = host_time_ns();
+
+    for (int pass = 0; pass < ADPCM_BENCHMARK_TIMING_PASSES; pass++)
+    {
+        for (int b = 0; b < blocks; b++)
+        {
+            AdpcmDecoder::decodeBlock(&encoded[b * blockSize], blockSize, decoded);
+            check += decoded[samplesPerBlock - 1];
+        }
+    }
+
+    uint64_t decodeTime = host_time_ns() - start;
+    double samples = (double)blocks * samplesPerBlock * ADPCM_BENCHMARK_TIMING_PASSES;
+
+    printf("encodeBlock: %6.2f ns/sample\n", encodeTime / samples);
+    printf("decodeBlock: %6.2f ns/sample (checksum %d)\n", decodeTime / samples, (int)check);
+
+    free(encoded);
+    free(decoded);
+}
+
+/*
+ * Plays ADPCM data through a MemorySource, and compares the output with the data decoded block by block.
+ *
+ * @return true if the output matched, for every repeat.
+ */
+static bool check_playout(const uint8_t *data, int length, int blockSize, int loop, int expand)
+{
+    const int maximum = 1023;
+    int expected = AdpcmDecoder::sampleCount(length, blockSize) * expand * loop;
+
+    MemorySource source(maximum);
+    CollectingSink sink(source.output, expected + 1);
+
+    source.playAdpcm(data, length, loop, expand, blockSize);
+
+    int16_t *block = (int16_t *)malloc(ADPCM_SAMPLES_PER_BLOCK(blockSize) * sizeof(int16_t));
+    int position = 0;
+    bool ok = sink.count == expected;
+
+    for (int pass = 0; pass < loop && ok; pass++)
+    {
+        for (int offset = 0; offset + ADPCM_BLOCK_HEADER_SIZE <= length && ok; offset += blockSize)
+        {
+            int n = AdpcmDecoder::decodeBlock(&data[offset], min(blockSize, length - offset), block);
+
+            for (int i = 0; i < n * expand && ok; i++)
+                ok = (uint16_t)sink.samples[position++] == (uint16_t)(((uint32_t)(block[i / expand] + 32768) * maximum) >> 16);
+        }
+    }
+
+    printf("playAdpcm(loop %d, expand %d): %d samples, %s\n", loop, expand, sink.count, ok ? "matches decodeBlock()" : "MISMATCH");
+
+    free(block);
+    free(sink.samples);
+    return ok;
+}
+
+/*
+ * Collects samples from a MemorySource, and stops it once a given number of samples have arrived.
+ */
+class StoppingSink : public CollectingSink
+{
+    MemorySource &source;
+    int limit;
+
+    public:
+    StoppingSink(MemorySource &source, int limit) : CollectingSink(source.output, limit + 1), source(source), limit(limit)
+    {
+    }
+
+    virtual int pullRequest()
+    {
+        CollectingSink::pullRequest();
+
+        if (count >= limit)
+            source.stop();
+
+        return DEVICE_OK;
+    }
+};
+
+/*
+ * Plays ADPCM data through a MemorySource repeating forever, and stops it part way through the third repeat.
+ *
+ * @return true if playAdpcm() returned once stop() was called, without queueing any further blocks.
+ */
+static bool check_stop(const uint8_t *data, int length, int blockSize)
+{
+    int samplesPerBlock = ADPCM_SAMPLES_PER_BLOCK(blockSize);
+    int limit = AdpcmDecoder::sampleCount(length, blockSize) * 2 + samplesPerBlock;
+
+    MemorySource source(1023);
+    StoppingSink sink(source, limit);
+
+    // The sink consumes each buffer as it is queued, so stop() takes effect before the next block is queued.
+    source.playAdpcm(data, length, 0, 1, blockSize);
+
+    bool ok = sink.count == limit;
+
+    printf("playAdpcm(loop forever): stopped after %d samples, %s\n", sink.count, ok ? "as requested" : "LATE");
+
+    free(sink.samples);
+    return ok;
+}
+
+/*
+ * Plays data too short to hold a single sample or ADPCM block header, repeating forever. Each playout queues nothing,
+ * so it must return at once rather than spin.
+ *
+ * @return true if every playout returned without queueing any samples, and FlashSource rejected each one.
+ */
+static bool check_empty(const uint8_t *data)
+{
+    SimulatedSPIFlash flash(1);
+    MemorySource memory(1023);
+    FlashSource source(flash, 1023);
+    CollectingSink memorySink(memory.output, 1);
+    CollectingSink flashSink(source.output, 1);
+
+    memory.play(data, 0, 0);
+    memory.play((const uint16_t *)data, 0, 0);
+    memory.playAdpcm(data, ADPCM_BLOCK_HEADER_SIZE - 1, 0);
+
+    uint32_t address = 0;
+    bool ok = source.play(address, 0, 0) == DEVICE_INVALID_PARAMETER;
+    ok &= source.play16(address, 0, 0) == DEVICE_INVALID_PARAMETER;
+    ok &= source.playAdpcm(address, ADPCM_BLOCK_HEADER_SIZE - 1, 0) == DEVICE_INVALID_PARAMETER;
+    ok &= memorySink.count == 0 && flashSink.count == 0;
+
+    printf("empty playout (loop forever): %s\n", ok ? "returned at once" : "QUEUED DATA");
+
+    free(memorySink.samples);
+    free(flashSink.samples);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    int blockSize = argc > 1 ? atoi(argv[1]) : ADPCM_BLOCK_SIZE;
+    bool ok = true;
+
+    HostEventBus bus;
+
+    for (int i = 0; i < ADPCM_BENCHMARK_SAMPLES; i++)
+    {
+        double t = (double)i / ADPCM_BENCHMARK_SAMPLE_RATE;
+        double v = 9000 * sin(2 * M_PI * 440 * t) + 6000 * sin(2 * M_PI * 1234 * t) + (int)benchmark_random(2001) - 1000;
+
+        signal[i] = (int16_t)lrint(v);
+    }
+
+    printf("IMA ADPCM, %d byte blocks, %d Hz test signal\n\n", blockSize, ADPCM_BENCHMARK_SAMPLE_RATE);
+
+    time_blocks(blockSize);
+
+    // Stream the signal through an encoder and decoder, measuring the encoded size between them.
+    RaggedSource source;
+    AdpcmEncoder encoder(source, blockSize);
+    StreamProfiler encoded(encoder, "encoded");
+    AdpcmDecoder decoder(encoded, blockSize);
+    CollectingSink sink(decoder, ADPCM_BENCHMARK_SAMPLES);
+
+    while (!source.finished())
+        source.downStream->pullRequest();
+
+    StreamProfile profile;
+    encoded.getProfile(&profile);
+
+    double ratio = (double)ADPCM_BENCHMARK_SAMPLES * 2 / profile.bytes;
+    double quality = snr(sink.samples, sink.count);
+
+    printf("stream: %d samples in %u buffers, %u encoded bytes, %.2f:1, SNR %.1f dB\n", sink.count, profile.pulls, profile.bytes, ratio, quality);
+
+    // At most one sample is still held by the encoder at the end of the stream.
+    if (sink.count < ADPCM_BENCHMARK_SAMPLES - 1 || ratio < ADPCM_BENCHMARK_MINIMUM_RATIO || quality < ADPCM_BENCHMARK_MINIMUM_SNR)
+        ok = false;
+
+    // Play back two seconds of the signal, with a short final block, from a block aligned copy.
+    int samples = ADPCM_BENCHMARK_SAMPLE_RATE * 2;
+    int samplesPerBlock = ADPCM_SAMPLES_PER_BLOCK(blockSize);
+    int blocks = (samples + samplesPerBlock - 1) / samplesPerBlock;
+    uint8_t *data = (uint8_t *)malloc(blocks * blockSize);
+    int length = 0;
+    int index = 0;
+
+    for (int b = 0; b < blocks; b++)
+    {
+        int count = min(samplesPerBlock, samples - b * samplesPerBlock) | 1;
+        length += AdpcmEncoder::encodeBlock(signal[b * samplesPerBlock], &signal[b * samplesPerBlock + 1], count - 1, &data[length], index);
+    }
+
+    printf("\n");
+    ok &= check_playout(data, length, blockSize, 1, 1);
+    ok &= check_playout(data, length, blockSize, 2, 3);
+    ok &= check_stop(data, length, blockSize);
+    ok &= check_empty(data);
+
+    free(data);
+    free(sink.samples);
+
+    if (!ok)
+    {
+        printf("\nFAIL\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,214 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Arena allocator test and benchmark.
+  *
+  * Checks Arena::alloc(), mark() and release(), ArenaScope, and ManagedBuffer(int, Arena &): that buffers are placed in
+  * the arena while it has space and fall back to the heap once it is full, and that RefCounted::destroy() leaves buffers
+  * held in an arena to be reclaimed by the arena rather than passing them to free(). Then reports the cost of creating
+  * and releasing a short lived ManagedBuffer from the heap and from an arena. Times depend on the host and compiler.
+  *
+  * Usage: ArenaBenchmark [buffer size in bytes] [iterations]
+  *
+  * Exits with a failure if any check fails.
+  */
+
+#include "HostTarget.h"
+#include "CodalArena.h"
+#include "ManagedBuffer.h"
+
+using namespace codal;
+
+#define ARENA_BENCHMARK_SIZE                1024
+#define ARENA_BENCHMARK_CANARY              0xA5
+
+static int failures = 0;
+
+static void check(bool condition, const char *description)
+{
+    printf("%-64s %s\n", description, condition ? "ok" : "FAILED");
+
+    if (!condition)
+        failures++;
+}
+
+/*
+ * Checks allocation, marks and release on an arena over a static buffer.
+ */
+static void test_alloc()
+{
+    static PROCESSOR_WORD_TYPE storage[ARENA_BENCHMARK_SIZE / sizeof(PROCESSOR_WORD_TYPE)];
+    Arena arena(storage, sizeof(storage));
+
+    uint8_t *a = (uint8_t *)arena.alloc(3);
+    uint8_t *b = (uint8_t *)arena.alloc(5);
+
+    check(a == (uint8_t *)storage && b == a + sizeof(PROCESSOR_WORD_TYPE), "alloc() is linear and word aligned");
+    check(arena.alloc(0) == NULL && arena.alloc(-1) == NULL, "alloc() of zero or negative size returns NULL");
+    check(Arena::owner(a) == &arena && Arena::owner(&arena) == NULL, "owner() finds the arena holding a pointer");
+
+    int mark = arena.mark();
+    arena.alloc(100);
+    arena.alloc(100);
+    int used = arena.getUsed();
+    arena.release(mark);
+
+    check(arena.getUsed() == mark && arena.getHighWaterMark() == used, "release() returns to the mark, high water is kept");
+
+    arena.release(used + 1);
+    check(arena.getUsed() == mark, "release() ignores a mark beyond the allocation point");
+
+    check(arena.alloc(ARENA_BENCHMARK_SIZE) == NULL, "alloc() returns NULL when the arena is full");
+
+    {
+        ArenaScope scope(arena);
+        arena.alloc(64);
+        check(arena.getUsed() > mark, "ArenaScope allocations come from the arena");
+    }
+
+    check(arena.getUsed() == mark, "ArenaScope releases on destruction");
+
+    arena.reset();
+    check(arena.getUsed() == 0, "reset() releases everything");
+
+    void *p;
+    {
+        Arena heapArena(64);
+        p = heapArena.alloc(8);
+        check(p != NULL && Arena::owner(p) == &heapArena, "an arena can allocate its storage from the heap");
+    }
+
+    // owner() only compares addresses, so may be asked about memory that has since been freed.
+    check(Arena::owner(p) == NULL && Arena::owner(a) == &arena, "a destroyed arena is removed from the list of live arenas");
+}
+
+/*
+ * Checks ManagedBuffers allocated from an arena.
+ */
+static void test_buffers()
+{
+    static PROCESSOR_WORD_TYPE storage[ARENA_BENCHMARK_SIZE / sizeof(PROCESSOR_WORD_TYPE)];
+    Arena arena(storage, sizeof(storage));
+
+    memset(storage, 0xFF, sizeof(storage));
+
+    {
+        ArenaScope scope(arena);
+        ManagedBuffer b(100, arena);
+
+        bool zeroed = true;
+        for (int i = 0; i < b.length(); i++)
+            zeroed &= b[i] == 0;
+
+        check(b.length() == 100 && arena.contains(b.getBytes()) && zeroed, "ManagedBuffer(int, Arena &) uses the arena");
+
+        // Place a canary directly after the buffer, then drop the last reference. RefCounted::destroy() must not pass
+        // the buffer to free(): the host C library would abort, or reuse the memory and overwrite the canary.
+        uint8_t *canary = (uint8_t *)arena.alloc(16);
+        memset(canary, ARENA_BENCHMARK_CANARY, 16);
+
+        int used = arena.getUsed();
+        {
+            ManagedBuffer copy = b;
+            b = ManagedBuffer();
+        }
+
+        bool intact = true;
+        for (int i = 0; i < 16; i++)
+            intact &= canary[i] == ARENA_BENCHMARK_CANARY;
+
+        check(intact && arena.getUsed() == used, "destroying an arena buffer leaves it to the arena");
+    }
+
+    check(arena.getUsed() == 0, "the buffer is reclaimed when the scope ends");
+
+    {
+        ArenaScope scope(arena);
+        ManagedBuffer inside(ARENA_BENCHMARK_SIZE / 2, arena);
+        ManagedBuffer outside(ARENA_BENCHMARK_SIZE, arena);
+
+        check(arena.contains(inside.getBytes()) && !arena.contains(outside.getBytes()) && outside.length() == ARENA_BENCHMARK_SIZE,
+            "ManagedBuffer falls back to the heap when the arena is full");
+
+        outside[0] = 1;
+        ManagedBuffer copy = outside;
+        check(copy[0] == 1 && Arena::owner(copy.getBytes()) == NULL, "a heap fallback buffer is reference counted as normal");
+    }
+
+    ManagedBuffer empty(0, arena);
+    check(empty.length() == 0 && arena.getUsed() == 0, "an empty buffer takes no arena space");
+}
+
+/*
+ * Times creating and releasing a buffer, from the heap and from an arena.
+ */
+static void time_buffers(int size, int iterations)
+{
+    Arena arena(size + 64);
+    uint32_t check = 0;
+
+    uint64_t start = host_time_ns();
+
+    for (int i = 0; i < iterations; i++)
+    {
+        ManagedBuffer b(size);
+        b[0] = i;
+        check += b[0];
+    }
+
+    uint64_t heapTime = host_time_ns() - start;
+    start = host_time_ns();
+
+    for (int i = 0; i < iterations; i++)
+    {
+        ArenaScope scope(arena);
+        ManagedBuffer b(size, arena);
+        b[0] = i;
+        check += b[0];
+    }
+
+    uint64_t arenaTime = host_time_ns() - start;
+
+    printf("\n%d byte ManagedBuffer: heap %.1f ns, arena %.1f ns (checksum %u)\n", size, (double)heapTime / iterations,
+        (double)arenaTime / iterations, check);
+}
+
+int main(int argc, char **argv)
+{
+    int size = argc > 1 ? atoi(argv[1]) : 256;
+    int iterations = argc > 2 ? atoi(argv[2]) : 1000000;
+
+    test_alloc();
+    test_buffers();
+    time_buffers(size, iterations);
+
+    if (failures)
+    {
+        printf("\nFAIL\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,278 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * FlashRecorder test, against a SimulatedSPIFlash.
+  *
+  * Records buffers of pseudo random sizes holding a known byte pattern, and checks what reaches the flash. The writer
+  * fiber runs under host_run_fibers(), and each time it goes idle the next buffer is delivered, so the writer always
+  * keeps up. Each scenario reports the flash operations used, which do not depend on the host:
+  *
+  *   small rows   recording with the default erase ahead distance, which erases 4k rows.
+  *   big rows     recording with an erase ahead distance of SPIFLASH_BIG_ROW_SIZE, into a 64k aligned region.
+  *   full         recording more data than the region holds, which must stop with FLASH_RECORDER_EVT_FULL.
+  *   error        recording to a flash that fails part way through, which must stop with FLASH_RECORDER_EVT_ERROR.
+  *   destroyed    deleting a FlashRecorder whose writer has not yet run, which must wait for the data to be written.
+  *
+  * Usage: FlashRecorderBenchmark
+  *
+  * Exits with a failure if any scenario loses, reorders or corrupts data, uses the flash incorrectly, or does not stop
+  * as expected.
+  */
+
+#include "HostTarget.h"
+#include "FlashRecorder.h"
+#include "SimulatedSPIFlash.h"
+
+using namespace codal;
+
+#define FLASH_BENCHMARK_PAGES               512
+#define FLASH_BENCHMARK_MAXIMUM_BUFFER      600
+#define FLASH_BENCHMARK_RECORD_BYTES        40000
+
+static uint32_t seed = 1;
+
+static uint32_t benchmark_random(uint32_t range)
+{
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 8) % range;
+}
+
+/*
+ * The byte expected at the given offset of a recording. Varies between pages, so that misplaced pages are detected.
+ */
+static uint8_t pattern(uint32_t offset)
+{
+    return (uint8_t)(offset * 7 + (offset >> 8) * 13);
+}
+
+/*
+ * Provides the pattern in buffers of 1 to FLASH_BENCHMARK_MAXIMUM_BUFFER bytes, one each time push() is called.
+ */
+class PatternSource : public DataSource
+{
+    uint32_t position;
+    DataSink *downStream;
+
+    public:
+    int remaining;
+
+    PatternSource(int buffers) : position(0), downStream(NULL), remaining(buffers) {}
+
+    virtual ManagedBuffer pull()
+    {
+        ManagedBuffer b(1 + benchmark_random(FLASH_BENCHMARK_MAXIMUM_BUFFER));
+
+        for (int i = 0; i < b.length(); i++)
+            b[i] = pattern(position++);
+
+        return b;
+    }
+
+    virtual void connect(DataSink &sink)
+    {
+        downStream = &sink;
+    }
+
+    void push()
+    {
+        remaining--;
+        downStream->pullRequest();
+    }
+};
+
+struct Recording
+{
+    PatternSource *source;
+    FlashRecorder *recorder;
+};
+
+/*
+ * Delivers the next buffer when the writer goes idle, or stops the recording once every buffer has been delivered.
+ */
+static void feed(void *context)
+{
+    Recording *r = (Recording *)context;
+
+    if (r->source->remaining > 0)
+        r->source->push();
+    else
+        r->recorder->stop();
+}
+
+/*
+ * Runs the writer fiber of a FlashRecorder being destroyed.
+ */
+static void run_writer(void *)
+{
+    host_run_fibers();
+}
+
+static int fullEvents = 0;
+static int errorEvents = 0;
+
+static void count_events(Event evt, void *)
+{
+    if (evt.source == DEVICE_ID_FLASH_RECORDER && evt.value == FLASH_RECORDER_EVT_FULL)
+        fullEvents++;
+
+    if (evt.source == DEVICE_ID_FLASH_RECORDER && evt.value == FLASH_RECORDER_EVT_ERROR)
+        errorEvents++;
+}
+
+/*
+ * Checks that the first length bytes of the region hold the pattern.
+ */
+static bool check_contents(SimulatedSPIFlash &flash, uint32_t start, uint32_t length)
+{
+    const uint8_t *bytes = flash.getBytes();
+
+    for (uint32_t i = 0; i < length; i++)
+        if (bytes[start + i] != pattern(i))
+            return false;
+
+    return true;
+}
+
+/*
+ * Records into a new flash, and checks the outcome.
+ *
+ * @param name the name of the scenario.
+ * @param start the flash address of the region.
+ * @param length the length of the region.
+ * @param eraseAhead the erase ahead distance, or 0 for the default.
+ * @param buffers the number of buffers to deliver before stopping.
+ * @param failAfter the number of flash operations to allow before one fails, or -1.
+ * @param expectedEvent the event the recording should stop with, or 0 if it should run until stopped.
+ *
+ * @return true if the scenario behaved as expected.
+ */
+static bool run_scenario(const char *name, uint32_t start, uint32_t length, uint32_t eraseAhead, int buffers, int failAfter, int expectedEvent)
+{
+    SimulatedSPIFlash flash(FLASH_BENCHMARK_PAGES);
+    PatternSource source(buffers);
+    FlashRecorder recorder(source, flash, start, length);
+    Recording r = { &source, &recorder };
+
+    if (eraseAhead)
+        recorder.setEraseAhead(eraseAhead);
+
+    flash.failAfter(failAfter);
+    fullEvents = 0;
+    errorEvents = 0;
+
+    if (recorder.record() != DEVICE_OK)
+    {
+        printf("%-12s record() failed\n", name);
+        return false;
+    }
+
+    host_set_idle_hook(feed, &r);
+    host_run_fibers();
+    host_set_idle_hook(NULL);
+
+    bool ok = !recorder.isWriting() && recorder.getDropCount() == 0;
+
+    if (expectedEvent == FLASH_RECORDER_EVT_ERROR)
+    {
+        ok &= errorEvents == 1 && fullEvents == 0 && recorder.getBytesWritten() < recorder.getLength();
+        ok &= check_contents(flash, start, recorder.getBytesWritten());
+    }
+    else
+    {
+        ok &= errorEvents == 0 && fullEvents == (expectedEvent == FLASH_RECORDER_EVT_FULL ? 1 : 0);
+        ok &= recorder.getBytesWritten() == recorder.getLength() && check_contents(flash, start, recorder.getLength());
+    }
+
+    ok &= flash.getViolationCount() == 0;
+
+    // A recording that stops by itself must do so before every buffer has been delivered.
+    if (expectedEvent)
+        ok &= source.remaining > 0 && recorder.getLength() <= length;
+    else
+        ok &= source.remaining == 0;
+
+    printf("%-12s %6u bytes, %3u page writes, %2u small and %u big row erases, %u dropped: %s\n", name, recorder.getLength(),
+        flash.getWriteCount(), flash.getSmallRowEraseCount(), flash.getBigRowEraseCount(), recorder.getDropCount(), ok ? "ok" : "FAILED");
+
+    return ok;
+}
+
+/*
+ * Deletes a FlashRecorder before its writer fiber has run, and checks that the data it accepted is still written.
+ */
+static bool run_destroyed()
+{
+    SimulatedSPIFlash flash(FLASH_BENCHMARK_PAGES);
+    PatternSource source(10);
+    FlashRecorder *recorder = new FlashRecorder(source, flash, 0, 16 * SPIFLASH_SMALL_ROW_SIZE);
+
+    if (recorder->record() != DEVICE_OK)
+    {
+        printf("%-12s record() failed\n", "destroyed");
+        return false;
+    }
+
+    while (source.remaining > 0)
+        source.push();
+
+    uint32_t length = recorder->getLength();
+
+    // The destructor waits for the writer, which only runs when the host schedules it.
+    host_set_idle_hook(run_writer);
+    delete recorder;
+    host_set_idle_hook(NULL);
+
+    bool ok = check_contents(flash, 0, length) && flash.getViolationCount() == 0;
+
+    printf("%-12s %6u bytes, %3u page writes, %2u small and %u big row erases: %s\n", "destroyed", length,
+        flash.getWriteCount(), flash.getSmallRowEraseCount(), flash.getBigRowEraseCount(), ok ? "ok" : "FAILED");
+
+    return ok;
+}
+
+int main()
+{
+    int buffers = 2 * FLASH_BENCHMARK_RECORD_BYTES / FLASH_BENCHMARK_MAXIMUM_BUFFER;
+    bool ok = true;
+
+    HostEventBus bus;
+    bus.setHandler(count_events);
+
+    printf("FlashRecorder, %d byte chunks, %d byte flash\n\n", FLASH_RECORDER_CHUNK_SIZE, FLASH_BENCHMARK_PAGES * SPIFLASH_PAGE_SIZE);
+
+    ok &= run_scenario("small rows", SPIFLASH_SMALL_ROW_SIZE, 15 * SPIFLASH_SMALL_ROW_SIZE, 0, buffers, -1, 0);
+    ok &= run_scenario("big rows", SPIFLASH_BIG_ROW_SIZE, SPIFLASH_BIG_ROW_SIZE, SPIFLASH_BIG_ROW_SIZE, buffers, -1, 0);
+    ok &= run_scenario("full", 0, 2 * SPIFLASH_SMALL_ROW_SIZE, 0, buffers, -1, FLASH_RECORDER_EVT_FULL);
+    ok &= run_scenario("error", 0, 15 * SPIFLASH_SMALL_ROW_SIZE, 0, buffers, 40, FLASH_RECORDER_EVT_ERROR);
+    ok &= run_destroyed();
+
+    if (!ok)
+    {
+        printf("\nFAIL\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,278 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Heap allocator interrupt latency benchmark.
+  *
+  * Fragments a heap into alternating used and free blocks, so that a large allocation must examine every fragment, and
+  * reports the longest run of blocks examined, and the longest time spent, with interrupts disabled. As the host may be
+  * interrupted at any time, the time reported is the median over many allocations of the longest section in each. Built twice: once
+  * with DEVICE_HEAP_CRITICAL_SECTION_BLOCKS set to 0, where one allocation examines every fragment in a single critical
+  * section, and once with it set, where critical sections must be no longer than that many blocks.
+  *
+  * A second pass simulates an interrupt handler that allocates memory each time interrupts are briefly enabled, which
+  * forces bounded scans to restart, and checks that the heap is still consistent afterwards. After the permitted number
+  * of restarts a scan completes without yielding, so this pass is not bounded.
+  *
+  * The allocator replaces malloc() when linked, so these executables use it only through device_malloc_in() and
+  * device_free(), built with DEVICE_HEAP_REPLACE_LIBC disabled, and provide their own interrupt control functions in
+  * place of codal-host. Times depend on the host and compiler, and include the cost of reading the clock.
+  *
+  * Usage: HeapBenchmark [fragments]
+  *
+  * Exits with a failure if the heap is inconsistent, if critical sections exceed the configured bound, or if (with
+  * the bound disabled) the fragmented allocation did not need a longer critical section than the bounded build allows.
+  */
+
+#include "CodalConfig.h"
+#include "CodalHeapAllocator.h"
+#include "ErrorNo.h"
+#include <time.h>
+#include <algorithm>
+
+#define HEAP_BENCHMARK_SIZE                 (256 * 1024)
+#define HEAP_BENCHMARK_FRAGMENT_SIZE        24
+#define HEAP_BENCHMARK_LARGE_SIZE           4096
+#define HEAP_BENCHMARK_PASSES               100
+#define HEAP_BENCHMARK_INTERRUPT_PERIOD     5
+#define HEAP_BENCHMARK_MAXIMUM_INTERRUPTS   256
+
+// The critical section bound the unbounded build is compared against, when DEVICE_HEAP_CRITICAL_SECTION_BLOCKS is 0.
+#define HEAP_BENCHMARK_REFERENCE_BOUND      32
+
+// The allocator's internals, which are not declared in CodalHeapAllocator.h.
+extern HeapDefinition heap[DEVICE_MAXIMUM_HEAPS];
+void *device_malloc_in(size_t size, HeapDefinition &heap);
+
+// The start of the default heap, normally provided by the linker script. It is never used, as that heap is only created
+// by device_malloc().
+PROCESSOR_WORD_TYPE codal_heap_start;
+
+static PROCESSOR_WORD_TYPE storage[HEAP_BENCHMARK_SIZE / sizeof(PROCESSOR_WORD_TYPE)];
+
+static bool disabled = false;
+static bool inInterrupt = false;
+static bool interruptsEnabled = false;
+static uint64_t disabledAt = 0;
+static uint64_t maximumDisabledTime = 0;
+static uint64_t passTimes[HEAP_BENCHMARK_PASSES];
+static int enables = 0;
+static void *interruptBlocks[HEAP_BENCHMARK_MAXIMUM_INTERRUPTS];
+static int interruptCount = 0;
+
+static uint64_t time_ns()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/*
+ * Fills an allocation with a pattern derived from its address, so that overlapping allocations can be detected.
+ */
+static void fill(void *p, int size)
+{
+    for (int i = 0; i < size; i++)
+        ((uint8_t *)p)[i] = (uint8_t)((uintptr_t)p + i);
+}
+
+static bool filled(void *p, int size)
+{
+    for (int i = 0; i < size; i++)
+        if (((uint8_t *)p)[i] != (uint8_t)((uintptr_t)p + i))
+            return false;
+
+    return true;
+}
+
+extern "C" void target_disable_irq()
+{
+    if (!disabled)
+    {
+        disabled = true;
+        disabledAt = time_ns();
+    }
+}
+
+/*
+ * Re-enables interrupts, recording how long they were disabled. If simulated interrupts are enabled, every few calls
+ * an interrupt handler runs and allocates a block, as a real handler might between two critical sections of a scan.
+ */
+extern "C" void target_enable_irq()
+{
+    if (disabled)
+    {
+        uint64_t t = time_ns() - disabledAt;
+
+        if (t > maximumDisabledTime)
+            maximumDisabledTime = t;
+
+        disabled = false;
+    }
+
+    if (interruptsEnabled && !inInterrupt && ++enables % HEAP_BENCHMARK_INTERRUPT_PERIOD == 0 && interruptCount < HEAP_BENCHMARK_MAXIMUM_INTERRUPTS)
+    {
+        inInterrupt = true;
+
+        void *p = device_malloc_in(HEAP_BENCHMARK_FRAGMENT_SIZE, heap[0]);
+        if (p)
+            fill(p, HEAP_BENCHMARK_FRAGMENT_SIZE);
+
+        interruptBlocks[interruptCount++] = p;
+        inInterrupt = false;
+    }
+}
+
+extern "C" void target_panic(int statusCode)
+{
+    fprintf(stderr, "*** CODAL PANIC : [%d]\n", statusCode);
+    exit(1);
+}
+
+/*
+ * Walks the heap, checking that its blocks exactly cover it.
+ *
+ * @return true if the heap is consistent.
+ */
+static bool heap_consistent()
+{
+    PROCESSOR_WORD_TYPE *block = heap[0].heap_start;
+
+    while (block < heap[0].heap_end)
+    {
+        PROCESSOR_WORD_TYPE size = *block & ~DEVICE_HEAP_BLOCK_FREE;
+
+        if (size == 0)
+            return false;
+
+        block += size;
+    }
+
+    return block == heap[0].heap_end;
+}
+
+/*
+ * Allocates and frees a large block HEAP_BENCHMARK_PASSES times, recording the longest critical section.
+ *
+ * @return true if every allocation succeeded without disturbing the fragments, and the heap remained consistent.
+ */
+static bool run_pass(const char *name, void **fragments, int count, HeapStatistics *stats)
+{
+    bool ok = true;
+
+    memset(&heap[0].stats, 0, sizeof(HeapStatistics));
+
+    for (int pass = 0; pass < HEAP_BENCHMARK_PASSES && ok; pass++)
+    {
+        maximumDisabledTime = 0;
+        void *p = device_malloc_in(HEAP_BENCHMARK_LARGE_SIZE, heap[0]);
+        passTimes[pass] = maximumDisabledTime;
+
+        ok = p != NULL;
+
+        if (ok)
+        {
+            fill(p, HEAP_BENCHMARK_LARGE_SIZE);
+            device_free(p);
+        }
+    }
+
+    for (int i = 0; i < count; i += 2)
+        ok &= filled(fragments[i], HEAP_BENCHMARK_FRAGMENT_SIZE);
+
+    for (int i = 0; i < interruptCount; i++)
+        ok &= interruptBlocks[i] != NULL && filled(interruptBlocks[i], HEAP_BENCHMARK_FRAGMENT_SIZE);
+
+    ok &= heap_consistent();
+
+    device_heap_statistics(0, stats);
+
+    std::sort(passTimes, passTimes + HEAP_BENCHMARK_PASSES);
+
+    printf("%-24s %5u blocks and %6.2f us with interrupts disabled, %3u restarts: %s\n", name, stats->max_critical_blocks,
+        passTimes[HEAP_BENCHMARK_PASSES / 2] / 1000.0, stats->restarts, ok ? "ok" : "FAILED");
+
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 2000;
+    void **fragments = (void **)malloc(count * sizeof(void *));
+    HeapStatistics stats;
+    bool ok = true;
+
+    device_create_heap((PROCESSOR_WORD_TYPE)storage, (PROCESSOR_WORD_TYPE)storage + sizeof(storage));
+
+    // Fragment the heap: allocate a run of small blocks, then free every other one, so that no free blocks can merge.
+    for (int i = 0; i < count; i++)
+    {
+        fragments[i] = device_malloc_in(HEAP_BENCHMARK_FRAGMENT_SIZE, heap[0]);
+
+        if (fragments[i] == NULL)
+        {
+            printf("heap too small for %d fragments\n", count);
+            return 1;
+        }
+
+        fill(fragments[i], HEAP_BENCHMARK_FRAGMENT_SIZE);
+    }
+
+    for (int i = 1; i < count; i += 2)
+        device_free(fragments[i]);
+
+    printf("Heap allocation, DEVICE_HEAP_CRITICAL_SECTION_BLOCKS %d, %d fragments\n\n", DEVICE_HEAP_CRITICAL_SECTION_BLOCKS, count);
+
+    ok &= run_pass("fragmented", fragments, count, &stats);
+
+#if (DEVICE_HEAP_CRITICAL_SECTION_BLOCKS > 0)
+    ok &= stats.max_critical_blocks <= DEVICE_HEAP_CRITICAL_SECTION_BLOCKS;
+#else
+    ok &= stats.max_critical_blocks > HEAP_BENCHMARK_REFERENCE_BOUND;
+#endif
+
+    interruptsEnabled = true;
+    ok &= run_pass("with interrupts", fragments, count, &stats);
+    interruptsEnabled = false;
+
+    for (int i = 0; i < interruptCount; i++)
+        device_free(interruptBlocks[i]);
+
+#if (DEVICE_HEAP_CRITICAL_SECTION_BLOCKS > 0)
+    ok &= stats.restarts > 0;
+#endif
+
+    ok &= heap_consistent();
+
+    free(fragments);
+
+    if (!ok)
+    {
+        printf("\nFAIL\n");
+        return 1;
+    }
+
+    return 0;
+}
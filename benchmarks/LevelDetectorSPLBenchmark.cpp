@@ -0,0 +1,256 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * LevelDetectorSPL accuracy and cost benchmark.
+  *
+  * Feeds sine waves of known amplitude and frequency to a LevelDetectorSPL, and compares the level it reports with the
+  * level expected from the amplitude and gain: 20 * log10(A / sqrt(2) / 32767 * gain / 20uPa), less the nominal IEC 61672
+  * weighting at that frequency. Also reports the time taken per sample, which depends on the host and compiler.
+  *
+  * Usage: LevelDetectorSPLBenchmark [buffers per measurement]
+  *
+  * Exits with a failure if any level at 1kHz differs from that expected by more than SPL_BENCHMARK_AMPLITUDE_TOLERANCE,
+  * if a weighted level differs from the nominal response by more than SPL_BENCHMARK_WEIGHTING_TOLERANCE, or if the
+  * threshold events are not raised as the level crosses them.
+  */
+
+#include "HostTarget.h"
+#include "HostSource.h"
+#include "LevelDetector.h"
+#include "LevelDetectorSPL.h"
+#include <math.h>
+
+using namespace codal;
+
+#define SPL_BENCHMARK_RATE                  16000
+#define SPL_BENCHMARK_GAIN                  10.0f   // Pascals at full scale.
+#define SPL_BENCHMARK_AMPLITUDE_TOLERANCE   0.05    // dB.
+#define SPL_BENCHMARK_WEIGHTING_TOLERANCE   1.0     // dB, for frequencies well below Nyquist.
+#define SPL_BENCHMARK_SETTLE_BUFFERS        20
+
+/*
+ * Nominal IEC 61672 A and C weightings, in dB.
+ */
+struct Weighting
+{
+    int frequency;
+    double a;
+    double c;
+};
+
+static const Weighting weightings[] = {
+    { 50, -30.2, -1.3 },
+    { 100, -19.1, -0.3 },
+    { 500, -3.2, 0.0 },
+    { 1000, 0.0, 0.0 },
+    { 2000, 1.2, -0.2 },
+    { 4000, 1.0, -0.8 },
+};
+
+static const char *names[] = { "Z", "A", "C" };
+
+static uint32_t events[2];
+
+/*
+ * Counts the threshold events raised.
+ */
+static void count_events(Event evt, void *)
+{
+    if (evt.source == DEVICE_ID_SYSTEM_LEVEL_DETECTOR_SPL && (evt.value == LEVEL_THRESHOLD_LOW || evt.value == LEVEL_THRESHOLD_HIGH))
+        events[evt.value - LEVEL_THRESHOLD_LOW]++;
+}
+
+/*
+ * Generates 100ms of a sine wave at the given frequency and amplitude. Every test frequency fits a whole number of cycles.
+ */
+static ManagedBuffer sine(int frequency, int amplitude)
+{
+    int samples = SPL_BENCHMARK_RATE / 10;
+    ManagedBuffer b(samples * 2);
+
+    for (int i = 0; i < samples; i++)
+        ((int16_t *)b.getBytes())[i] = (int16_t)lrint(amplitude * sin(2 * M_PI * frequency * i / SPL_BENCHMARK_RATE));
+
+    return b;
+}
+
+/*
+ * The level a sine wave of the given amplitude should read, unweighted.
+ */
+static double expected_level(int amplitude)
+{
+    return 20 * log10(amplitude / sqrt(2.0) / 32767 * SPL_BENCHMARK_GAIN / 0.00002);
+}
+
+/*
+ * Measures the level of a sine wave, once any transient in the weighting filter has decayed.
+ */
+static double measure(int frequency, int amplitude, int weighting, int windowSize)
+{
+    DataStreamFormat format(2, 16, true, 1, SPL_BENCHMARK_RATE);
+    HostSource source(sine(frequency, amplitude), format);
+    LevelDetectorSPL detector(source, 200, 0, SPL_BENCHMARK_GAIN, 0);
+
+    detector.setWindowSize(windowSize);
+    detector.setWeighting(weighting);
+
+    for (int i = 0; i < SPL_BENCHMARK_SETTLE_BUFFERS; i++)
+        source.pullRequest();
+
+    return detector.getValue();
+}
+
+/*
+ * Measures the time taken per sample with the given weighting, over buffers of 10ms.
+ */
+static double cost(int weighting, int buffers)
+{
+    DataStreamFormat format(2, 16, true, 1, SPL_BENCHMARK_RATE);
+    ManagedBuffer tone = sine(1000, 10000);
+    HostSource source(ManagedBuffer(tone.getBytes(), SPL_BENCHMARK_RATE / 50), format);
+    LevelDetectorSPL detector(source, 200, 0, SPL_BENCHMARK_GAIN, 0);
+
+    detector.setWeighting(weighting);
+
+    uint64_t start = host_time_ns();
+
+    for (int i = 0; i < buffers; i++)
+        source.pullRequest();
+
+    return (double)(host_time_ns() - start) / ((double)buffers * SPL_BENCHMARK_RATE / 100);
+}
+
+/*
+ * A source that alternates between a loud and a quiet tone under the control of the test.
+ */
+struct SwitchedSource : public DataSource
+{
+    ManagedBuffer tones[2];
+    DataSink *downStream;
+    bool loud;
+
+    SwitchedSource() : downStream(NULL), loud(false)
+    {
+        tones[0] = sine(1000, 200);
+        tones[1] = sine(1000, 20000);
+    }
+
+    virtual ManagedBuffer pull()
+    {
+        return tones[loud];
+    }
+
+    virtual void connect(DataSink &sink)
+    {
+        downStream = &sink;
+    }
+
+    virtual DataStreamFormat getFormat()
+    {
+        return DataStreamFormat(2, 16, true, 1, SPL_BENCHMARK_RATE);
+    }
+};
+
+/*
+ * Checks that the threshold events are raised once each time the level crosses a threshold.
+ */
+static bool check_thresholds()
+{
+    SwitchedSource source;
+    double low = expected_level(200), high = expected_level(20000);
+    LevelDetectorSPL detector(source, (float)(high - 10), (float)(low + 10), SPL_BENCHMARK_GAIN, 0);
+
+    events[0] = events[1] = 0;
+
+    for (int cycle = 0; cycle < 6; cycle++)
+    {
+        source.loud = !source.loud;
+
+        for (int i = 0; i < 5; i++)
+            detector.pullRequest();
+    }
+
+    printf("\nthresholds: %u high and %u low events over 3 loud/quiet cycles\n", events[1], events[0]);
+
+    return events[0] == 3 && events[1] == 3;
+}
+
+int main(int argc, char **argv)
+{
+    int buffers = argc > 1 ? atoi(argv[1]) : 20000;
+    static const int amplitudes[] = { 30000, 10000, 3000, 1000, 300, 100 };
+    bool ok = true;
+
+    HostEventBus bus;
+    bus.setHandler(count_events);
+    host_start_clock();
+
+    printf("LevelDetectorSPL accuracy at %d Hz, gain %.0f Pa\n\n", SPL_BENCHMARK_RATE, SPL_BENCHMARK_GAIN);
+    printf("%9s %9s %9s %9s %9s\n", "amplitude", "expected", "Z error", "A error", "C error");
+
+    for (unsigned i = 0; i < sizeof(amplitudes) / sizeof(amplitudes[0]); i++)
+    {
+        double expected = expected_level(amplitudes[i]);
+        printf("%9d %9.2f", amplitudes[i], expected);
+
+        for (int w = 0; w < 3; w++)
+        {
+            double error = measure(1000, amplitudes[i], w, LEVEL_DETECTOR_SPL_DEFAULT_WINDOW_SIZE) - expected;
+            ok &= fabs(error) <= SPL_BENCHMARK_AMPLITUDE_TOLERANCE;
+            printf(" %9.3f", error);
+        }
+
+        printf("\n");
+    }
+
+    // Measure over windows of 100ms, so that each holds whole cycles of the lowest frequency.
+    printf("\n%9s %9s %9s %9s %9s\n", "Hz", "A", "nominal", "C", "nominal");
+
+    for (unsigned i = 0; i < sizeof(weightings) / sizeof(weightings[0]); i++)
+    {
+        const Weighting &w = weightings[i];
+        double expected = expected_level(10000);
+        double a = measure(w.frequency, 10000, LEVEL_DETECTOR_SPL_WEIGHTING_A, SPL_BENCHMARK_RATE / 10) - expected;
+        double c = measure(w.frequency, 10000, LEVEL_DETECTOR_SPL_WEIGHTING_C, SPL_BENCHMARK_RATE / 10) - expected;
+
+        ok &= fabs(a - w.a) <= SPL_BENCHMARK_WEIGHTING_TOLERANCE && fabs(c - w.c) <= SPL_BENCHMARK_WEIGHTING_TOLERANCE;
+        printf("%9d %9.2f %9.1f %9.2f %9.1f\n", w.frequency, a, w.a, c, w.c);
+    }
+
+    printf("\n%9s %9s\n", "weighting", "ns/sample");
+
+    for (int w = 0; w < 3; w++)
+        printf("%9s %9.2f\n", names[w], cost(w, buffers));
+
+    ok &= check_thresholds();
+
+    if (!ok)
+    {
+        printf("\nFAIL\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,212 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Mixer throughput benchmark.
+  *
+  * Mixes 1 to 16 channels of pseudo random 10 bit samples, fed through DataStreams from synthetic sources, and reports the
+  * output rate of Mixer::pull() alongside that of the previous implementation, which saturated after adding each channel.
+  * Both read the same streams, so the figures differ only in the mixing itself. The results depend on the host and compiler.
+  *
+  * Usage: MixerBenchmark [samples per buffer] [buffers per measurement]
+  *
+  * Exits with a failure if the mix differs from the sum of the channels, saturated once, or if the mixer does not reuse
+  * its output buffer once released, or reuses one still held downstream.
+  */
+
+#include "HostTarget.h"
+#include "HostSource.h"
+#include "Mixer.h"
+
+using namespace codal;
+
+#define MIXER_BENCHMARK_MAXIMUM_CHANNELS    16
+
+struct MixerBenchmarkChannel
+{
+    HostSource *source;
+    DataStream *stream;
+    MixerChannel *channel;
+};
+
+static MixerBenchmarkChannel channels[MIXER_BENCHMARK_MAXIMUM_CHANNELS];
+
+/*
+ * The body of Mixer::pull() before channels were mixed with 32 bit accumulators, for comparison.
+ */
+static ManagedBuffer legacy_pull(int count)
+{
+    ManagedBuffer sum;
+
+    for (int i = count - 1; i >= 0; i--)
+    {
+        bool isSigned = channels[i].channel->isSigned;
+        int vol = channels[i].channel->volume;
+        ManagedBuffer data = channels[i].stream->pull();
+        if (sum.length() < data.length()) {
+            ManagedBuffer newsum(data.length());
+            newsum.writeBuffer(0, sum);
+            sum = newsum;
+        }
+        auto d = (int16_t*)&data[0];
+        auto s = (int16_t*)&sum[0];
+        auto len = data.length() >> 1;
+        while (len--) {
+            int v = isSigned ? *d : *(uint16_t*)d - 512;
+            v = ((v * vol) + (*s << 10)) >> 10;
+            if (v < -512) v = -512;
+            if (v > 511) v = 511;
+            *s = v;
+            d++;
+            s++;
+        }
+    }
+
+    auto s = (int16_t*)&sum[0];
+    auto len = sum.length() >> 1;
+    while (len--)
+        *s++ += 512;
+
+    return sum;
+}
+
+/*
+ * Gives every channel's stream its next buffer.
+ */
+static void fill(int count)
+{
+    for (int i = 0; i < count; i++)
+        channels[i].stream->pullRequest();
+}
+
+/*
+ * Determines the sample the mixer should produce at the given index: the volume scaled sum of all channels, saturated once.
+ */
+static int expected_sample(int count, int index)
+{
+    int32_t total = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        ManagedBuffer b = channels[i].source->pull();
+        int32_t v = ((int16_t *)b.getBytes())[index];
+
+        if (!channels[i].channel->isSigned)
+            v -= 512;
+
+        total += v * channels[i].channel->volume;
+    }
+
+    total >>= 10;
+    return min(max(total, -512), 511) + 512;
+}
+
+/*
+ * Measures the output rate of one implementation, in millions of samples per second.
+ */
+static double measure(Mixer &mixer, int count, int samples, int buffers, bool legacy)
+{
+    uint64_t start = host_time_ns();
+
+    for (int i = 0; i < buffers; i++)
+    {
+        fill(count);
+        ManagedBuffer out = legacy ? legacy_pull(count) : mixer.pull();
+
+        if (out.length() != samples * 2)
+        {
+            printf("mixed %d bytes, expected %d\n", out.length(), samples * 2);
+            exit(1);
+        }
+    }
+
+    uint64_t elapsed = host_time_ns() - start;
+    return elapsed ? (double)samples * buffers * 1000.0 / elapsed : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int samples = argc > 1 ? atoi(argv[1]) : 256;
+    int buffers = argc > 2 ? atoi(argv[2]) : 20000;
+    int errors = 0;
+
+    HostEventBus bus;
+    Mixer mixer;
+
+    printf("Mixer output rate, %d sample buffers, in millions of samples per second\n\n", samples);
+    printf("%8s %10s %10s\n", "channels", "previous", "current");
+
+    for (int count = 1; count <= MIXER_BENCHMARK_MAXIMUM_CHANNELS; count *= 2)
+    {
+        // Add channels up to the count needed. Alternate channels are unsigned, and each has a different volume.
+        for (int i = 0; i < count; i++)
+        {
+            if (channels[i].source)
+                continue;
+
+            DataStreamFormat format(2, 10, i % 2 == 0, 1, 44100);
+            channels[i].source = new HostSource(host_generate_samples(samples, format, i + 1), format);
+            channels[i].stream = new DataStream(*channels[i].source);
+            channels[i].channel = mixer.addChannel(*channels[i].stream);
+            channels[i].channel->volume = 1024 - 48 * i;
+        }
+
+        double previous = measure(mixer, count, samples, buffers, true);
+        double current = measure(mixer, count, samples, buffers, false);
+
+        printf("%8d %10.0f %10.0f\n", count, previous, current);
+
+        fill(count);
+        ManagedBuffer out = mixer.pull();
+
+        for (int i = 0; i < samples; i++)
+            if (((int16_t *)out.getBytes())[i] != expected_sample(count, i))
+                errors++;
+    }
+
+    // The mixer reuses its output buffer once downstream has released it, but never one that is still held.
+    int count = MIXER_BENCHMARK_MAXIMUM_CHANNELS;
+    fill(count);
+    ManagedBuffer held = mixer.pull();
+    fill(count);
+    uint8_t *next = mixer.pull().getBytes();
+    fill(count);
+    bool reused = mixer.pull().getBytes() == next && next != held.getBytes();
+
+    printf("\noutput buffer %s\n", reused ? "reused once released" : "NOT REUSED CORRECTLY");
+
+    if (errors)
+    {
+        printf("\nFAIL: %d mixed samples differ from the saturated sum of their channels\n", errors);
+        return 1;
+    }
+
+    if (!reused)
+    {
+        printf("\nFAIL: the output buffer was not reused, or was reused while still held\n");
+        return 1;
+    }
+
+    return 0;
+}
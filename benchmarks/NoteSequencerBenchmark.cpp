@@ -0,0 +1,224 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * NoteSequencer timing test.
+  *
+  * Plays a looping note list with rests through a PolySynthesizer, rendered by its own fiber into a recording sink,
+  * and compares every sample of the first two seconds against the note list. Each note is a square wave with no attack
+  * or release, so every sample is silent exactly when no note is scheduled over it: a note starting or ending on
+  * the wrong sample, or a gap between legato notes, shows up as a mismatch. Note boundaries are expected at
+  * floor(t * rate), where t is the total time of the list so far.
+  *
+  * It then plays a one shot list, and checks that the rendering fiber finishes in the buffer in which the release
+  * of the last note ends.
+  *
+  * Usage: NoteSequencerBenchmark [sample rate] [samples per buffer]
+  *
+  * Exits with a failure if any sample differs from the note list, if the one shot list renders more or fewer buffers
+  * than it needs, or if a looping list with no duration is accepted.
+  */
+
+#include "HostTarget.h"
+#include "NoteSequencer.h"
+
+using namespace codal;
+
+#define NOTE_SEQUENCER_BENCHMARK_MAXIMUM_RATE   48000
+#define NOTE_SEQUENCER_BENCHMARK_RELEASE_MS     20
+
+// Long enough for the sequencer to carry whole seconds of elapsed time into its start time.
+#define NOTE_SEQUENCER_BENCHMARK_SECONDS        2
+
+// Durations that are not a whole number of samples at common rates, with rests between some notes and not others.
+static const SequencerNote melody[] = {
+    { 440, 123, 255, 0 },
+    { 0, 37, 0, 0 },
+    { 660, 91, 255, 0 },
+    { 550, 53, 255, 0 },
+    { 0, 29, 0, 0 },
+    { 880, 77, 255, 0 },
+};
+
+#define NOTE_SEQUENCER_BENCHMARK_NOTES          (sizeof(melody) / sizeof(SequencerNote))
+
+static const SequencerNote silence[] = {
+    { 0, 0, 0, 0 },
+};
+
+/*
+ * Records the samples delivered by a synthesizer, and stops a sequencer once a given number have been recorded.
+ */
+struct RecordingSink : public DataSink
+{
+    DataSource &source;
+    NoteSequencer *sequencer;
+    uint16_t *samples;
+    int capacity;
+    int count;
+    int buffers;
+
+    RecordingSink(DataSource &source, uint16_t *samples, int capacity) : source(source)
+    {
+        this->sequencer = NULL;
+        this->samples = samples;
+        this->capacity = capacity;
+        this->count = 0;
+        this->buffers = 0;
+    }
+
+    virtual int pullRequest()
+    {
+        ManagedBuffer b = source.pull();
+        int n = b.length() / 2;
+
+        if (count + n > capacity)
+            n = capacity - count;
+
+        memcpy(&samples[count], b.getBytes(), n * 2);
+        count += n;
+        buffers++;
+
+        if (sequencer && count == capacity)
+            sequencer->stop();
+
+        return DEVICE_OK;
+    }
+};
+
+static uint16_t recording[NOTE_SEQUENCER_BENCHMARK_MAXIMUM_RATE * NOTE_SEQUENCER_BENCHMARK_SECONDS];
+
+/*
+ * Determines whether the note list schedules a note over the given sample, when played from time zero.
+ */
+static bool sounding(int sample, int rate)
+{
+    uint64_t elapsed = 0;
+
+    for (int i = 0; ; i = (i + 1) % NOTE_SEQUENCER_BENCHMARK_NOTES)
+    {
+        uint64_t end = elapsed + melody[i].duration;
+
+        if ((int64_t)sample < (int64_t)(end * rate / 1000))
+            return melody[i].frequency != 0;
+
+        elapsed = end;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int rate = argc > 1 ? atoi(argv[1]) : 44100;
+    int samples = argc > 2 ? atoi(argv[2]) : 256;
+    int errors = 0;
+
+    if (rate <= 0 || rate > NOTE_SEQUENCER_BENCHMARK_MAXIMUM_RATE || samples <= 0)
+    {
+        printf("sample rate must be 1..%d Hz\n", NOTE_SEQUENCER_BENCHMARK_MAXIMUM_RATE);
+        return 1;
+    }
+
+    HostEventBus bus;
+    uint16_t *square = PolySynthesizer::createWavetable(Synthesizer::SquareWaveTone);
+
+    // A looping list, recorded from the rendering fiber.
+    PolySynthesizer synth(rate);
+    NoteSequencer sequencer(synth);
+    RecordingSink sink(synth.output, recording, rate * NOTE_SEQUENCER_BENCHMARK_SECONDS);
+
+    synth.setBufferSize(samples * 2);
+    synth.output.connect(sink);
+    sequencer.setInstrument(0, square, 0, 0, 1024, 0);
+    sink.sequencer = &sequencer;
+
+    sequencer.play(melody, NOTE_SEQUENCER_BENCHMARK_NOTES, true);
+    host_run_fibers();
+
+    int mismatches = 0;
+    int onsets = 0;
+
+    for (int i = 0; i < sink.capacity; i++)
+    {
+        bool expected = sounding(i, rate);
+
+        if (expected != (recording[i] != 512))
+            mismatches++;
+
+        if (expected && (i == 0 || !sounding(i - 1, rate)))
+            onsets++;
+    }
+
+    printf("looping list at %d Hz, %d sample buffers\n\n", rate, samples);
+    printf("%-28s %8d\n", "samples recorded", sink.count);
+    printf("%-28s %8d\n", "onsets after silence", onsets);
+    printf("%-28s %8d\n", "samples not as scheduled", mismatches);
+
+    if (sink.count != sink.capacity || mismatches)
+        errors++;
+
+    // A one shot list stops the rendering fiber in the buffer in which its last release ends.
+    PolySynthesizer once(rate);
+    NoteSequencer onceSequencer(once);
+    RecordingSink onceSink(once.output, recording, rate);
+
+    once.setBufferSize(samples * 2);
+    once.output.connect(onceSink);
+    onceSequencer.setInstrument(0, square, 0, 0, 1024, NOTE_SEQUENCER_BENCHMARK_RELEASE_MS);
+
+    onceSequencer.play(melody, NOTE_SEQUENCER_BENCHMARK_NOTES);
+    host_run_fibers();
+
+    uint32_t total = 0;
+    for (unsigned i = 0; i < NOTE_SEQUENCER_BENCHMARK_NOTES; i++)
+        total += melody[i].duration;
+
+    // The last note is released at the end of the list, and is silent once its release has run its course.
+    uint32_t silentFrom = once.samplesFromMs(total) + once.samplesFromMs(NOTE_SEQUENCER_BENCHMARK_RELEASE_MS);
+    int expectedBuffers = (silentFrom + samples - 1) / samples;
+
+    printf("\none shot list\n\n");
+    printf("%-28s %8d (expected %d)\n", "buffers rendered", onceSink.buffers, expectedBuffers);
+    printf("%-28s %8s\n", "sequencer", onceSequencer.isPlaying() ? "PLAYING" : "stopped");
+    printf("%-28s %8d\n", "active voices", once.getActiveVoiceCount());
+
+    if (onceSink.buffers != expectedBuffers || onceSequencer.isPlaying() || once.getActiveVoiceCount())
+        errors++;
+
+    // A looping list that takes no time could never finish being scheduled.
+    int result = onceSequencer.play(silence, 1, true);
+    printf("%-28s %8s\n", "zero length loop", result == DEVICE_INVALID_PARAMETER ? "rejected" : "ACCEPTED");
+
+    if (result != DEVICE_INVALID_PARAMETER)
+        errors++;
+
+    free(square);
+
+    if (errors)
+    {
+        printf("\nFAIL: %d checks did not match the note list\n", errors);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,245 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * PolySynthesizer benchmark.
+  *
+  * Plays an eight note chord for the same length of time on a PolySynthesizer, and on eight Synthesizers whose
+  * DataStreams are combined by a Mixer, and reports the cost of each in nanoseconds per output sample. The Synthesizers
+  * are driven synchronously, one buffer per note, so neither measurement includes any scheduling. The results depend on
+  * the host and compiler.
+  *
+  * It also checks that notes start on exactly the sample they were scheduled for, that attack and release ramps last
+  * as long as the envelope says, and that a 440Hz note has 440 cycles per second.
+  *
+  * Usage: PolySynthesizerBenchmark [buffers per measurement]
+  *
+  * Exits with a failure if any of those checks fail.
+  */
+
+#include "HostTarget.h"
+#include "PolySynthesizer.h"
+#include "Synthesizer.h"
+#include "Mixer.h"
+
+using namespace codal;
+
+// A sample period of exactly 25us, so a Synthesizer plays a 25ms note as exactly one 1000 sample buffer.
+#define POLY_SYNTHESIZER_BENCHMARK_RATE         40000
+#define POLY_SYNTHESIZER_BENCHMARK_NOTE_MS      25
+#define POLY_SYNTHESIZER_BENCHMARK_SAMPLES      1000
+
+static const float chord[POLY_SYNTHESIZER_VOICES] = { 130.8f, 164.8f, 196.0f, 261.6f, 329.6f, 392.0f, 523.3f, 659.3f };
+
+static uint16_t output[POLY_SYNTHESIZER_BENCHMARK_RATE];
+
+/*
+ * Measures the cost of rendering the chord on a PolySynthesizer, in nanoseconds per output sample.
+ */
+static double measure_poly(int buffers)
+{
+    PolySynthesizer synth(POLY_SYNTHESIZER_BENCHMARK_RATE);
+
+    synth.setEnvelope(POLY_SYNTHESIZER_ALL_VOICES, 0, 0, 1024, 0);
+    for (int i = 0; i < POLY_SYNTHESIZER_VOICES; i++)
+        synth.noteOn(i, chord[i], 128);
+
+    uint64_t start = host_time_ns();
+
+    for (int i = 0; i < buffers; i++)
+        synth.render(output, POLY_SYNTHESIZER_BENCHMARK_SAMPLES);
+
+    uint64_t elapsed = host_time_ns() - start;
+    return (double)elapsed / ((double)buffers * POLY_SYNTHESIZER_BENCHMARK_SAMPLES);
+}
+
+/*
+ * Measures the cost of playing the chord on one Synthesizer per note, mixed by a Mixer, in nanoseconds per output sample.
+ */
+static double measure_mixer(int buffers)
+{
+    Synthesizer *synths[POLY_SYNTHESIZER_VOICES];
+    Mixer mixer;
+
+    for (int i = 0; i < POLY_SYNTHESIZER_VOICES; i++)
+    {
+        synths[i] = new Synthesizer(POLY_SYNTHESIZER_BENCHMARK_RATE);
+        synths[i]->setTone(Synthesizer::SineTone);
+        synths[i]->setVolume(128);
+        synths[i]->setBufferSize(POLY_SYNTHESIZER_BENCHMARK_SAMPLES * 2);
+        mixer.addChannel(synths[i]->output);
+    }
+
+    // Each note fills one buffer, which is queued on its stream by the next note. Play one round first, so every
+    // round measured queues and mixes a full set of buffers.
+    uint64_t start = 0;
+
+    for (int i = 0; i <= buffers; i++)
+    {
+        if (i == 1)
+            start = host_time_ns();
+
+        for (int j = 0; j < POLY_SYNTHESIZER_VOICES; j++)
+            synths[j]->setFrequency(chord[j], POLY_SYNTHESIZER_BENCHMARK_NOTE_MS);
+
+        ManagedBuffer out = mixer.pull();
+
+        if (i > 0 && out.length() != POLY_SYNTHESIZER_BENCHMARK_SAMPLES * 2)
+        {
+            printf("mixed %d bytes, expected %d\n", out.length(), POLY_SYNTHESIZER_BENCHMARK_SAMPLES * 2);
+            exit(1);
+        }
+    }
+
+    uint64_t elapsed = host_time_ns() - start;
+
+    for (int i = 0; i < POLY_SYNTHESIZER_VOICES; i++)
+        delete synths[i];
+
+    return (double)elapsed / ((double)buffers * POLY_SYNTHESIZER_BENCHMARK_SAMPLES);
+}
+
+/*
+ * Finds the first sample at or after the given index that is not silent, or -1 if there is none.
+ */
+static int first_sound(int from, int to)
+{
+    for (int i = from; i < to; i++)
+        if (output[i] != 512)
+            return i;
+
+    return -1;
+}
+
+/*
+ * Finds the largest distance from silence in a run of samples.
+ */
+static int peak(int from, int to)
+{
+    int p = 0;
+
+    for (int i = from; i < to; i++)
+        p = max(p, abs((int)output[i] - 512));
+
+    return p;
+}
+
+int main(int argc, char **argv)
+{
+    int buffers = argc > 1 ? atoi(argv[1]) : 2000;
+    int errors = 0;
+
+    HostEventBus bus;
+
+    double poly = measure_poly(buffers);
+    double mixed = measure_mixer(buffers);
+
+    printf("%d voices at %d Hz, in nanoseconds per output sample\n\n", POLY_SYNTHESIZER_VOICES, POLY_SYNTHESIZER_BENCHMARK_RATE);
+    printf("%-28s %8.1f\n", "Synthesizers and a Mixer", mixed);
+    printf("%-28s %8.1f\n", "PolySynthesizer", poly);
+    printf("%-28s %8.1fx\n\n", "speedup", poly > 0 ? mixed / poly : 0);
+
+    // A square wave with no attack starts at full scale on exactly the sample scheduled, and with no release stops
+    // on exactly the sample it is released.
+    uint16_t *square = PolySynthesizer::createWavetable(Synthesizer::SquareWaveTone);
+    PolySynthesizer synth(POLY_SYNTHESIZER_BENCHMARK_RATE);
+
+    synth.setWavetable(POLY_SYNTHESIZER_ALL_VOICES, square);
+    synth.setEnvelope(POLY_SYNTHESIZER_ALL_VOICES, 0, 0, 1024, 0);
+    synth.noteOn(0, 1000, 1024, 1234);
+    synth.noteOff(0, 1734);
+    synth.render(output, 1000);
+    synth.render(&output[1000], 1000);
+
+    int onset = first_sound(0, 2000);
+    int end = first_sound(1734, 2000);
+
+    printf("%-28s %8d (scheduled 1234)\n", "onset", onset);
+    printf("%-28s %8d (released 1734)\n", "last sample", end < 0 ? (1734 - 1) : end);
+
+    if (onset != 1234 || output[1234] != 1023 || end >= 0 || first_sound(1733, 1734) != 1733)
+        errors++;
+
+    // A 10ms attack rises over 400 samples, one 40 sample period of the wave at a time, and a 10ms release falls to
+    // silence over the next 400 samples after the note is released.
+    synth.setEnvelope(POLY_SYNTHESIZER_ALL_VOICES, 10, 0, 1024, 10);
+    uint32_t now = synth.getTime();
+    synth.noteOn(0, 1000, 1024, now);
+    synth.noteOff(0, now + 1000);
+    synth.render(output, 2000);
+
+    bool rising = true;
+    for (int i = 40; i < 400; i += 40)
+        if (peak(i, i + 40) <= peak(i - 40, i))
+            rising = false;
+
+    bool falling = true;
+    for (int i = 1040; i < 1400; i += 40)
+        if (peak(i, i + 40) >= peak(i - 40, i))
+            falling = false;
+
+    int attackPeak = peak(400, 1000);
+    int releaseEnd = first_sound(1400, 2000);
+
+    printf("%-28s %8s, reaching %d\n", "attack", rising ? "rising" : "NOT RISING", attackPeak);
+    printf("%-28s %8s, %s after 400 samples\n", "release", falling ? "falling" : "NOT FALLING", releaseEnd < 0 ? "silent" : "NOT SILENT");
+
+    if (!rising || !falling || attackPeak != 512 || releaseEnd >= 0 || synth.getActiveVoiceCount() != 0)
+        errors++;
+
+    // A 440Hz sine wave crosses the midpoint upwards 440 times a second.
+    synth.setWavetable(POLY_SYNTHESIZER_ALL_VOICES, NULL);
+    synth.setEnvelope(POLY_SYNTHESIZER_ALL_VOICES, 0, 0, 1024, 0);
+    synth.noteOn(0, 440, 1024, synth.getTime());
+
+    int crossings = 0;
+    int previous = 512;
+    for (int i = 0; i < POLY_SYNTHESIZER_BENCHMARK_RATE / POLY_SYNTHESIZER_BENCHMARK_SAMPLES; i++)
+    {
+        synth.render(output, POLY_SYNTHESIZER_BENCHMARK_SAMPLES);
+
+        for (int j = 0; j < POLY_SYNTHESIZER_BENCHMARK_SAMPLES; j++)
+        {
+            if (previous < 512 && output[j] >= 512)
+                crossings++;
+
+            previous = output[j];
+        }
+    }
+
+    printf("%-28s %8d per second\n", "440Hz rising crossings", crossings);
+
+    if (crossings != 440)
+        errors++;
+
+    free(square);
+
+    if (errors)
+    {
+        printf("\nFAIL: %d checks did not match the scheduled notes and envelopes\n", errors);
+        return 1;
+    }
+
+    return 0;
+}
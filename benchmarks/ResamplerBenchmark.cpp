@@ -0,0 +1,193 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Resampler cost and accuracy benchmark.
+  *
+  * Resamples a 400Hz sine wave between common rates at each quality setting, and reports the time taken per output sample
+  * and the signal to noise ratio of the output against the best fitting ideal sine wave. The source provides the same
+  * buffer each time, so its cost is negligible. Times depend on the host and compiler; the SNR figures do not.
+  *
+  * The same signal is also provided as unsigned 8 bit samples, to check that other encodings are converted on input, and as
+  * stereo samples, to check that they are refused. Finally the source's sample rate is changed after connection, to check
+  * that the resampler follows it.
+  *
+  * Usage: ResamplerBenchmark [input buffers per measurement]
+  *
+  * Exits with a failure if the output rate is wrong, or the SNR is below RESAMPLER_BENCHMARK_MINIMUM_SNR (or
+  * RESAMPLER_BENCHMARK_MINIMUM_SNR_8BIT for 8 bit input).
+  */
+
+#include "HostTarget.h"
+#include "HostSource.h"
+#include "Resampler.h"
+#include <math.h>
+
+using namespace codal;
+
+#define RESAMPLER_BENCHMARK_FREQUENCY           400     // Chosen so that a whole number of cycles fits in a 10ms buffer.
+#define RESAMPLER_BENCHMARK_AMPLITUDE           16000
+#define RESAMPLER_BENCHMARK_MINIMUM_SNR         40.0
+#define RESAMPLER_BENCHMARK_MINIMUM_SNR_8BIT    30.0
+
+/*
+ * Generates 10ms of the test sine wave at the given rate and sample encoding.
+ */
+static ManagedBuffer sine(int rate, DataStreamFormat format)
+{
+    int samples = rate / 100;
+    ManagedBuffer b(samples * format.sampleSize);
+
+    for (int i = 0; i < samples; i++)
+    {
+        double v = RESAMPLER_BENCHMARK_AMPLITUDE * sin(2 * M_PI * RESAMPLER_BENCHMARK_FREQUENCY * i / rate);
+
+        if (format.sampleSize == 1)
+            b[i] = (uint8_t)(128 + (int)lrint(v / 256));
+        else
+            ((int16_t *)b.getBytes())[i] = (int16_t)lrint(v);
+    }
+
+    return b;
+}
+
+/*
+ * Accumulates a least squares fit of the output to a sine wave of the test frequency, with unknown amplitude and phase.
+ */
+struct SineFit
+{
+    double ss, cc, sc, ys, yc, yy;
+    int count;
+
+    SineFit() : ss(0), cc(0), sc(0), ys(0), yc(0), yy(0), count(0) {}
+
+    void add(double y, double t)
+    {
+        double s = sin(2 * M_PI * RESAMPLER_BENCHMARK_FREQUENCY * t), c = cos(2 * M_PI * RESAMPLER_BENCHMARK_FREQUENCY * t);
+        ss += s * s; cc += c * c; sc += s * c; ys += y * s; yc += y * c; yy += y * y;
+        count++;
+    }
+
+    // The power of the fitted sine relative to the power of everything else, in dB.
+    double snr()
+    {
+        double d = ss * cc - sc * sc;
+        double a = (ys * cc - yc * sc) / d, b = (yc * ss - ys * sc) / d;
+        double signal = a * a * ss + 2 * a * b * sc + b * b * cc;
+        double noise = yy - signal;
+
+        return noise > 0 ? 10 * log10(signal / noise) : 200;
+    }
+};
+
+/*
+ * Resamples the test signal, and reports the cost per output sample and the SNR.
+ *
+ * @return true if the output is as expected.
+ */
+static bool run(int inputRate, int outputRate, int quality, DataStreamFormat encoding, int buffers)
+{
+    DataStreamFormat format(encoding.sampleSize, encoding.sampleBits, encoding.isSigned, 1, inputRate);
+    HostSource source(sine(inputRate, format), format);
+    Resampler resampler(source, outputRate, quality);
+    SineFit fit;
+    long timed = 0;
+
+    uint64_t start = host_time_ns();
+
+    for (int i = 0; i < buffers; i++)
+        timed += resampler.pull().length() / 2;
+
+    uint64_t elapsed = host_time_ns() - start;
+
+    // Measure the accuracy over a further second of output.
+    for (int i = 0; i < 100; i++)
+    {
+        ManagedBuffer out = resampler.pull();
+        int16_t *o = (int16_t *)out.getBytes();
+
+        for (int k = 0; k < out.length() / 2; k++)
+            fit.add(o[k], (double)fit.count / outputRate);
+    }
+
+    // Every input sample should give rise to outputRate / inputRate output samples, less those still held by the filter.
+    long expected = (long)(buffers + 100) * (inputRate / 100) * outputRate / inputRate;
+    long outputs = timed + fit.count;
+    double snr = fit.snr();
+    bool ok = labs(outputs - expected) <= (long)quality * outputRate / inputRate + 1;
+
+    ok &= snr >= (encoding.sampleSize == 1 ? RESAMPLER_BENCHMARK_MINIMUM_SNR_8BIT : RESAMPLER_BENCHMARK_MINIMUM_SNR);
+
+    printf("%6d -> %6d %6s %5d %10.1f %8.1f %s\n", inputRate, outputRate, encoding.sampleSize == 1 ? "u8" : "s16", quality,
+        (double)elapsed / max(timed, 1L), snr, ok ? "" : "FAIL");
+
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    int buffers = argc > 1 ? atoi(argv[1]) : 2000;
+    static const int rates[][2] = { { 44100, 16000 }, { 8000, 44100 }, { 16000, 48000 }, { 48000, 44100 } };
+    static const int qualities[] = { RESAMPLER_QUALITY_LOW, RESAMPLER_QUALITY_MEDIUM, RESAMPLER_QUALITY_HIGH };
+    bool ok = true;
+
+    printf("Resampler cost and accuracy, %d Hz sine wave\n\n", RESAMPLER_BENCHMARK_FREQUENCY);
+    printf("%16s %6s %5s %10s %8s\n", "rates", "input", "taps", "ns/sample", "SNR dB");
+
+    for (unsigned r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+        for (unsigned q = 0; q < sizeof(qualities) / sizeof(qualities[0]); q++)
+            ok &= run(rates[r][0], rates[r][1], qualities[q], DataStreamFormat(2, 16, true), buffers);
+
+    for (unsigned q = 0; q < sizeof(qualities) / sizeof(qualities[0]); q++)
+        ok &= run(44100, 16000, qualities[q], DataStreamFormat(1, 8, false), buffers);
+
+    // Interleaved stereo data cannot be resampled as a single channel, so must be refused.
+    DataStreamFormat stereo(2, 16, true, 2, 44100);
+    HostSource source(sine(88200, stereo), stereo);
+    Resampler resampler(source, 16000);
+
+    if (resampler.isSupported() || resampler.pull().length() != 0)
+    {
+        printf("\nFAIL: stereo input was accepted\n");
+        ok = false;
+    }
+
+    // A source reconfigured after connection must be followed, without a call to setInputRate().
+    DataStreamFormat mono(2, 16, true, 1, 44100);
+    HostSource changing(sine(44100, mono), mono);
+    Resampler follower(changing, 16000);
+
+    follower.pull();
+    mono.sampleRate = 22050;
+    changing.setFormat(mono);
+    follower.pull();
+
+    if (follower.getInputRate() != 22050)
+    {
+        printf("\nFAIL: input rate %d was not updated to 22050\n", follower.getInputRate());
+        ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
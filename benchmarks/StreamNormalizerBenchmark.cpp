@@ -0,0 +1,272 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * StreamNormalizer automatic gain control benchmark.
+  *
+  * Drives a StreamNormalizer with automatic gain control at 11kHz, with its default settings (target 16384, 16x maximum
+  * gain, 2ms attack, 500ms release and 4ms lookahead), and checks that:
+  *
+  *  - sine waves of very different amplitudes settle to output peaks close to the target, or to the input peak at the
+  *    maximum gain if that is lower.
+  *  - a sudden 30x rise in level clips the output without lookahead, but not with it.
+  *  - low level noise is faded out by the noise gate, rather than amplified as it is without the gate.
+  *
+  * Also reports the time taken per sample, which depends on the host and compiler.
+  *
+  * Usage: StreamNormalizerBenchmark [buffers per measurement]
+  *
+  * Exits with a failure if any of these checks fail.
+  */
+
+#include "HostTarget.h"
+#include "HostSource.h"
+#include "StreamNormalizer.h"
+#include <math.h>
+
+using namespace codal;
+
+#define AGC_BENCHMARK_RATE              11000
+#define AGC_BENCHMARK_FREQUENCY         500
+#define AGC_BENCHMARK_BUFFER            110         // 10ms.
+#define AGC_BENCHMARK_SETTLE_BUFFERS    300         // Six release time constants.
+#define AGC_BENCHMARK_TARGET_TOLERANCE  400
+#define AGC_BENCHMARK_NOISE             20
+#define AGC_BENCHMARK_GATE              100
+
+/*
+ * A source of a continuous sine wave, or of noise, whose amplitude can be changed as it runs.
+ */
+struct ToneSource : public DataSource
+{
+    int amplitude;
+    bool noise;
+    uint32_t position;
+    uint32_t seed;
+
+    ToneSource(int amplitude) : amplitude(amplitude), noise(false), position(0), seed(1) {}
+
+    virtual ManagedBuffer pull()
+    {
+        ManagedBuffer b(AGC_BENCHMARK_BUFFER * 2);
+        int16_t *data = (int16_t *)b.getBytes();
+
+        for (int i = 0; i < AGC_BENCHMARK_BUFFER; i++)
+        {
+            if (noise)
+            {
+                seed = seed * 1664525 + 1013904223;
+                data[i] = (int16_t)((int)((seed >> 8) % (2 * amplitude + 1)) - amplitude);
+            }
+            else
+            {
+                data[i] = (int16_t)lrint(amplitude * sin(2 * M_PI * AGC_BENCHMARK_FREQUENCY * position / AGC_BENCHMARK_RATE));
+            }
+
+            position++;
+        }
+
+        return b;
+    }
+
+    virtual DataStreamFormat getFormat()
+    {
+        return DataStreamFormat(2, 16, true, 1, AGC_BENCHMARK_RATE);
+    }
+};
+
+/*
+ * Records the peak and the number of clipped samples of the output since the last reset().
+ */
+struct PeakSink : public DataSink
+{
+    DataSource &upstream;
+    int peak;
+    int clipped;
+
+    PeakSink(DataSource &source) : upstream(source), peak(0), clipped(0)
+    {
+        source.connect(*this);
+    }
+
+    virtual int pullRequest()
+    {
+        ManagedBuffer b = upstream.pull();
+        int16_t *data = (int16_t *)b.getBytes();
+
+        for (int i = 0; i < b.length() / 2; i++)
+        {
+            int a = abs(data[i]);
+            peak = max(peak, a);
+
+            if (a >= 32767)
+                clipped++;
+        }
+
+        return DEVICE_OK;
+    }
+
+    void reset()
+    {
+        peak = 0;
+        clipped = 0;
+    }
+};
+
+/*
+ * Checks that a sine wave of the given amplitude settles to an output peak close to the target.
+ */
+static bool check_settling(int amplitude)
+{
+    ToneSource source(amplitude);
+    StreamNormalizer normalizer(source, 1024);
+    PeakSink sink(normalizer.output);
+
+    normalizer.enableAutomaticGain();
+
+    for (int i = 0; i < AGC_BENCHMARK_SETTLE_BUFFERS; i++)
+        normalizer.pullRequest();
+
+    sink.reset();
+
+    for (int i = 0; i < 50; i++)
+        normalizer.pullRequest();
+
+    // Quiet inputs are limited by the maximum gain, rather than reaching the target.
+    int expected = min(STREAM_NORMALIZER_AGC_DEFAULT_TARGET, amplitude * STREAM_NORMALIZER_AGC_DEFAULT_MAXIMUM_GAIN / 1024);
+    bool ok = abs(sink.peak - expected) <= AGC_BENCHMARK_TARGET_TOLERANCE;
+    printf("settling: input peak %5d, output peak %5d (expected %5d), gain %5d/1024 %s\n", amplitude, sink.peak, expected,
+        normalizer.getGain(), ok ? "" : "FAIL");
+
+    return ok;
+}
+
+/*
+ * Settles the gain on a quiet tone, then raises its level 30x.
+ *
+ * @return the number of output samples clipped after the step.
+ */
+static int step_clipping(int lookahead)
+{
+    ToneSource source(1000);
+    StreamNormalizer normalizer(source, 1024);
+    PeakSink sink(normalizer.output);
+
+    normalizer.setLookahead(lookahead);
+    normalizer.enableAutomaticGain();
+
+    for (int i = 0; i < AGC_BENCHMARK_SETTLE_BUFFERS; i++)
+        normalizer.pullRequest();
+
+    sink.reset();
+    source.amplitude = 30000;
+
+    for (int i = 0; i < 50; i++)
+        normalizer.pullRequest();
+
+    printf("step: 1000 to 30000 with %dms lookahead clipped %d samples\n", lookahead, sink.clipped);
+
+    return sink.clipped;
+}
+
+/*
+ * Feeds low level noise through the normalizer, with or without the noise gate.
+ *
+ * @return the output peak, once settled.
+ */
+static int noise_peak(int gate)
+{
+    ToneSource source(AGC_BENCHMARK_NOISE);
+    StreamNormalizer normalizer(source, 1024);
+    PeakSink sink(normalizer.output);
+
+    source.noise = true;
+    normalizer.setNoiseGate(gate);
+    normalizer.enableAutomaticGain();
+
+    for (int i = 0; i < AGC_BENCHMARK_SETTLE_BUFFERS; i++)
+        normalizer.pullRequest();
+
+    sink.reset();
+
+    for (int i = 0; i < 50; i++)
+        normalizer.pullRequest();
+
+    printf("noise: +/-%d with gate %3d gives +/-%d\n", AGC_BENCHMARK_NOISE, gate, sink.peak);
+
+    return sink.peak;
+}
+
+/*
+ * Measures the time taken per sample, with automatic gain control enabled. The tone is generated once, and copied by a
+ * HostSource on each pull, as generating it costs more than normalizing it.
+ */
+static double cost(int buffers)
+{
+    ToneSource tone(8000);
+    HostSource source(tone.pull(), tone.getFormat());
+    StreamNormalizer normalizer(source, 1024);
+    HostSink sink(normalizer.output);
+
+    normalizer.enableAutomaticGain();
+
+    uint64_t start = host_time_ns();
+
+    for (int i = 0; i < buffers; i++)
+        source.pullRequest();
+
+    return (double)(host_time_ns() - start) / ((double)buffers * AGC_BENCHMARK_BUFFER);
+}
+
+int main(int argc, char **argv)
+{
+    int buffers = argc > 1 ? atoi(argv[1]) : 20000;
+    bool ok = true;
+
+    HostEventBus bus;
+
+    printf("StreamNormalizer automatic gain control at %d Hz, target %d\n\n", AGC_BENCHMARK_RATE, STREAM_NORMALIZER_AGC_DEFAULT_TARGET);
+
+    ok &= check_settling(30000);
+    ok &= check_settling(8000);
+    ok &= check_settling(1000);
+
+    printf("\n");
+    ok &= step_clipping(0) > 0;
+    ok &= step_clipping(STREAM_NORMALIZER_AGC_DEFAULT_LOOKAHEAD) == 0;
+
+    printf("\n");
+    ok &= noise_peak(0) > 4 * AGC_BENCHMARK_NOISE;
+    ok &= noise_peak(AGC_BENCHMARK_GATE) < AGC_BENCHMARK_NOISE;
+
+    printf("\n%.2f ns/sample\n", cost(buffers));
+
+    if (!ok)
+    {
+        printf("\nFAIL\n");
+        return 1;
+    }
+
+    return 0;
+}
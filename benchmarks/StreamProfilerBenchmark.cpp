@@ -0,0 +1,162 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Stream pipeline profiling benchmark.
+  *
+  * Drives a synthetic 44.1kHz signed 16 bit source through a chain of stream components, with a StreamProfiler after the
+  * source and after each component, and reports what each profiler recorded. Times are measured with the host's clock, so
+  * depend on the host and compiler, and are rounded to whole microseconds by the system timer.
+  *
+  * The chain is given as a string of letters, one per component, in order from the source:
+  *   r  Resampler to 16kHz, at medium quality.
+  *   f  FilterChain with four biquad sections.
+  *   c  StreamConverter to unsigned 8 bit samples.
+  *
+  * After the timed run, the chain is also pulled a number of times without a pullRequest(), as a polling consumer would,
+  * to check that those pulls do not count towards latency.
+  *
+  * Usage: StreamProfilerBenchmark [chain] [samples per buffer] [buffers]
+  *
+  * Exits with a failure if the counts recorded by the profilers are inconsistent with the data that was delivered.
+  */
+
+#include "HostTarget.h"
+#include "HostSource.h"
+#include "StreamProfiler.h"
+#include "Resampler.h"
+#include "FilterChain.h"
+#include "StreamConverter.h"
+
+using namespace codal;
+
+#define STREAM_BENCHMARK_SAMPLE_RATE        44100
+#define STREAM_BENCHMARK_POLLS              100
+#define STREAM_BENCHMARK_MAXIMUM_STAGES     16
+
+/*
+ * Adds the component for the given letter after the given source.
+ *
+ * @return the new component, or NULL if the letter is not recognised.
+ */
+static DataSource *add_stage(char type, DataSource &source, const char **name)
+{
+    switch (type)
+    {
+        case 'r':
+            *name = "resampler";
+            return new Resampler(source, 16000, RESAMPLER_QUALITY_MEDIUM);
+
+        case 'f':
+        {
+            int rate = source.getFormat().sampleRate;
+            FilterChain *f = new FilterChain(source);
+
+            f->addStage(BiquadCoefficients::highPass(rate, 100));
+            f->addStage(BiquadCoefficients::lowPass(rate, 4000));
+            f->addStage(BiquadCoefficients::notch(rate, 1000));
+            f->addStage(BiquadCoefficients::bandPass(rate, 2000, 0.5f));
+
+            *name = "filter";
+            return f;
+        }
+
+        case 'c':
+            *name = "converter";
+            return new StreamConverter(source, DataStreamFormat(1, 8, false));
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    const char *chain = argc > 1 ? argv[1] : "rfc";
+    int samples = argc > 2 ? atoi(argv[2]) : 4410;
+    int buffers = argc > 3 ? atoi(argv[3]) : 2000;
+
+    StreamProfiler *profilers[STREAM_BENCHMARK_MAXIMUM_STAGES + 1];
+    int count = 0;
+    bool ok = true;
+
+    HostEventBus bus;
+    host_start_clock();
+
+    DataStreamFormat format(2, 16, true, 1, STREAM_BENCHMARK_SAMPLE_RATE);
+    HostSource source(host_generate_samples(samples, format), format);
+
+    profilers[count++] = new StreamProfiler(source, "source");
+
+    for (const char *c = chain; *c && count <= STREAM_BENCHMARK_MAXIMUM_STAGES; c++)
+    {
+        const char *name = NULL;
+        DataSource *stage = add_stage(*c, *profilers[count - 1], &name);
+
+        if (stage == NULL)
+        {
+            printf("unknown stage '%c'\n", *c);
+            return 1;
+        }
+
+        profilers[count++] = new StreamProfiler(*stage, name);
+    }
+
+    HostSink sink(*profilers[count - 1]);
+
+    for (int i = 0; i < buffers; i++)
+        source.pullRequest();
+
+    for (int i = 0; i < STREAM_BENCHMARK_POLLS; i++)
+        profilers[count - 1]->pull();
+
+    printf("Stream chain '%s', %d sample buffers at %d Hz\n\n", chain, samples, STREAM_BENCHMARK_SAMPLE_RATE);
+    printf("%-10s %8s %8s %8s %10s %10s %8s %11s %8s\n", "stage", "requests", "pulls", "serviced", "bytes", "us/pull", "max us", "latency us", "missed");
+
+    for (int i = 0; i < count; i++)
+    {
+        StreamProfile p;
+        profilers[i]->getProfile(&p);
+
+        printf("%-10s %8u %8u %8u %10u %10.2f %8u %11.2f %8u\n", profilers[i]->getName(), p.pullRequests, p.pulls, p.serviced, p.bytes,
+            p.pulls ? (double)p.totalTime / p.pulls : 0, p.maximumTime, p.serviced ? (double)p.totalLatency / p.serviced : 0, p.missed);
+
+        // Every request is serviced once. Polls pass through every profiler, but are not requests.
+        if (p.pullRequests != (uint32_t)buffers || p.serviced != (uint32_t)buffers || p.missed != 0 || p.pulls != (uint32_t)(buffers + STREAM_BENCHMARK_POLLS))
+            ok = false;
+    }
+
+    StreamProfile last;
+    profilers[count - 1]->getProfile(&last);
+
+    if (sink.getBufferCount() != (uint32_t)buffers || sink.getByteCount() > last.bytes)
+        ok = false;
+
+    if (!ok)
+    {
+        printf("\nFAIL: the profiles do not match the %d buffers delivered\n", buffers);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,264 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * StreamSplitter test.
+  *
+  * Checks two properties of a StreamSplitter that its users rely on:
+  *
+  *  - Backpressure: while a blocking channel has not pulled its last buffer, pullRequests from a queuing upstream component
+  *    are held back. Once the channel catches up, one buffer is delivered for every pullRequest held, so nothing is left
+  *    upstream and every channel sees every buffer, in order. A non-blocking channel that never pulls counts each buffer
+  *    it misses as dropped.
+  *
+  *  - Sharing: every channel is given the same buffer, so components that modify buffers in place (StreamNormalizer,
+  *    StreamConverter and FilterChain) must copy it, leaving the data seen by the other channels untouched. The last
+  *    channel to pull a buffer holds the only reference to it, so may modify it without a copy.
+  *
+  * Usage: StreamSplitterBenchmark
+  *
+  * Exits with a failure if either property does not hold.
+  */
+
+#include "HostTarget.h"
+#include "HostSource.h"
+#include "StreamSplitter.h"
+#include "StreamNormalizer.h"
+#include "StreamConverter.h"
+#include "FilterChain.h"
+#include <string.h>
+
+using namespace codal;
+
+#define SPLITTER_TEST_RATE          16000
+#define SPLITTER_TEST_SAMPLES       64
+#define SPLITTER_TEST_BUFFERS       10
+
+/*
+ * An upstream component that queues the buffers it produces until they are pulled, as a DataStream would.
+ * The first sample of each buffer is its sequence number.
+ */
+struct QueueSource : public DataSource
+{
+    DataSink *downStream;
+    int produced;
+    int consumed;
+
+    QueueSource() : downStream(NULL), produced(0), consumed(0) {}
+
+    virtual ManagedBuffer pull()
+    {
+        if (consumed == produced)
+            return ManagedBuffer();
+
+        ManagedBuffer b(SPLITTER_TEST_SAMPLES * 2);
+        ((int16_t *)b.getBytes())[0] = (int16_t)consumed++;
+
+        return b;
+    }
+
+    virtual void connect(DataSink &sink)
+    {
+        downStream = &sink;
+    }
+
+    virtual DataStreamFormat getFormat()
+    {
+        return DataStreamFormat(2, 16, true, 1, SPLITTER_TEST_RATE);
+    }
+
+    void produce()
+    {
+        produced++;
+        downStream->pullRequest();
+    }
+};
+
+/*
+ * A sink that checks the buffers it receives arrive in sequence. A deferred sink only pulls when take() is called,
+ * as a consumer running in another fiber would.
+ */
+struct SequenceSink : public DataSink
+{
+    DataSource &upstream;
+    bool deferred;
+    int requests;
+    int received;
+    bool inOrder;
+
+    SequenceSink(DataSource &source, bool deferred) : upstream(source), deferred(deferred), requests(0), received(0), inOrder(true)
+    {
+        source.connect(*this);
+    }
+
+    virtual int pullRequest()
+    {
+        requests++;
+
+        if (!deferred)
+            take();
+
+        return DEVICE_OK;
+    }
+
+    void take()
+    {
+        ManagedBuffer b = upstream.pull();
+
+        if (b.length() == 0)
+            return;
+
+        inOrder &= ((int16_t *)b.getBytes())[0] == received;
+        received++;
+    }
+
+    bool waiting()
+    {
+        return requests > received;
+    }
+};
+
+/*
+ * A sink that checks each buffer it receives against the data the source provided, and whether it was still shared.
+ */
+struct CompareSink : public DataSink
+{
+    DataSource &upstream;
+    ManagedBuffer expected;
+    int received;
+    int corrupted;
+    int shared;
+
+    CompareSink(DataSource &source, ManagedBuffer expected) : upstream(source), expected(expected), received(0), corrupted(0), shared(0)
+    {
+        source.connect(*this);
+    }
+
+    virtual int pullRequest()
+    {
+        ManagedBuffer b = upstream.pull();
+
+        received++;
+
+        if (b.length() != expected.length() || memcmp(b.getBytes(), expected.getBytes(), b.length()) != 0)
+            corrupted++;
+
+        if (b.isShared())
+            shared++;
+
+        return DEVICE_OK;
+    }
+};
+
+/*
+ * Stalls a blocking channel while a queuing source produces several buffers, then lets it catch up.
+ */
+static bool check_backpressure(HostEventBus &bus)
+{
+    QueueSource source;
+    StreamSplitter splitter(source);
+    SplitterChannel *fastChannel = splitter.createChannel(true);
+    SplitterChannel *slowChannel = splitter.createChannel(true);
+    SplitterChannel *lossyChannel = splitter.createChannel(false);
+    SequenceSink fast(*fastChannel, false);
+    SequenceSink slow(*slowChannel, true);
+    SequenceSink lossy(*lossyChannel, true);
+
+    for (int i = 0; i < SPLITTER_TEST_BUFFERS; i++)
+        source.produce();
+
+    int held = source.produced - source.consumed;
+
+    // Let the slow consumer catch up, one buffer at a time. Each pull lets the splitter deliver one held buffer.
+    while (slow.waiting())
+    {
+        slow.take();
+        bus.dispatch();
+    }
+
+    printf("backpressure: %d of %d buffers held, %d left upstream after catching up\n", held, SPLITTER_TEST_BUFFERS, source.produced - source.consumed);
+    printf("  fast channel received %d %s, slow channel %d %s, %u stalls\n", fast.received, fast.inOrder ? "in order" : "OUT OF ORDER",
+        slow.received, slow.inOrder ? "in order" : "OUT OF ORDER", slowChannel->getStallCount());
+    printf("  non-blocking channel dropped %u\n", lossyChannel->getDropCount());
+
+    bool ok = held == SPLITTER_TEST_BUFFERS - 1 && source.consumed == SPLITTER_TEST_BUFFERS;
+    ok &= fast.received == SPLITTER_TEST_BUFFERS && fast.inOrder && slow.received == SPLITTER_TEST_BUFFERS && slow.inOrder;
+    ok &= slowChannel->getStallCount() == SPLITTER_TEST_BUFFERS - 1 && fastChannel->getStallCount() == 0;
+    ok &= lossyChannel->getDropCount() == SPLITTER_TEST_BUFFERS - 1;
+
+    return ok;
+}
+
+/*
+ * Attaches each of the in place stages to its own channel, followed by a channel that checks its data is unmodified.
+ */
+static bool check_sharing()
+{
+    DataStreamFormat format(2, 16, true, 1, SPLITTER_TEST_RATE);
+    ManagedBuffer data = host_generate_samples(SPLITTER_TEST_SAMPLES, format);
+    HostSource source(data, format);
+    StreamSplitter splitter(source);
+
+    StreamNormalizer normalizer(*splitter.createChannel(), 2048);
+    HostSink normalized(normalizer.output);
+
+    StreamConverter converter(*splitter.createChannel(), DataStreamFormat(2, 12, true));
+    HostSink converted(converter);
+
+    FilterChain filter(*splitter.createChannel());
+    filter.addStage(BiquadCoefficients::highPass(SPLITTER_TEST_RATE, 1000));
+    HostSink filtered(filter);
+
+    CompareSink original(*splitter.createChannel(), data);
+
+    for (int i = 0; i < SPLITTER_TEST_BUFFERS; i++)
+        source.pullRequest();
+
+    printf("sharing: %d of %d buffers corrupted by in place stages, %d still shared when last pulled\n", original.corrupted, original.received,
+        original.shared);
+
+    bool ok = original.received == SPLITTER_TEST_BUFFERS && original.corrupted == 0 && original.shared == 0;
+    ok &= normalized.getBufferCount() == SPLITTER_TEST_BUFFERS && converted.getBufferCount() == SPLITTER_TEST_BUFFERS;
+    ok &= filtered.getBufferCount() == SPLITTER_TEST_BUFFERS;
+
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+
+    HostEventBus bus;
+
+    ok &= check_backpressure(bus);
+    ok &= check_sharing();
+
+    if (!ok)
+    {
+        printf("\nFAIL\n");
+        return 1;
+    }
+
+    return 0;
+}
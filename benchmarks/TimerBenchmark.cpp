@@ -0,0 +1,288 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Timer accuracy and jitter benchmark.
+  *
+  * Runs a Timer against a SimulatedLowLevelTimer, with a workload of 1 to 256 concurrent eventEveryUs or eventAfterUs
+  * timers with pseudo random periods, and reports the distribution of how late their events were dispatched. Time is
+  * simulated, so the results are deterministic, and depend only on the Timer implementation and the configured counter
+  * width and interrupt latency.
+  *
+  * A second set of workloads sweeps the slack given to 64 self rearming callbackAfterUs timers, either to all of them
+  * or to one in four, and reports how many interrupts were needed and the most any timer fired beyond its own slack.
+  *
+  * Usage: TimerBenchmark [interrupt latency in us] [counter width: 16, 24 or 32 bits]
+  *
+  * Exits with a failure if any event is dispatched later than the interrupt latency plus CODAL_TIMER_MINIMUM_PERIOD
+  * beyond its slack, which is the worst case, if any fires early, or if slack does not reduce the number of interrupts.
+  */
+
+#include "HostTarget.h"
+#include "Timer.h"
+#include "SimulatedLowLevelTimer.h"
+
+using namespace codal;
+
+#define WORKLOAD_ID                 4000
+#define WORKLOAD_DURATION           2000000     // Simulated time to run each workload for, in microseconds.
+#define WORKLOAD_MINIMUM_PERIOD     500
+#define WORKLOAD_MAXIMUM_PERIOD     50000
+#define WORKLOAD_MAXIMUM_STEP       1000        // Largest interval between simulated points at which time is read.
+#define WORKLOAD_SLACK_TIMERS       64
+
+/*
+ * A deterministic pseudo random number generator, so that every run generates the same workload.
+ */
+static uint32_t seed;
+
+static uint32_t workload_random(uint32_t range)
+{
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 8) % range;
+}
+
+static uint32_t workload_period()
+{
+    return WORKLOAD_MINIMUM_PERIOD + workload_random(WORKLOAD_MAXIMUM_PERIOD - WORKLOAD_MINIMUM_PERIOD);
+}
+
+/*
+ * One shot timers are set again as soon as they fire, to keep the number of concurrent timers constant.
+ */
+static void rearm_one_shot(Event evt, void *context)
+{
+    if (evt.source == WORKLOAD_ID)
+        ((Timer *)context)->eventAfterUs(workload_period(), WORKLOAD_ID, evt.value);
+}
+
+/*
+ * A callback timer with slack, that records how late it fires beyond that slack, then sets itself again.
+ */
+struct SlackTimer
+{
+    Timer *timer;
+    CODAL_TIMESTAMP slack;
+    CODAL_TIMESTAMP expected;
+};
+
+static uint32_t worstExcess;
+
+static void slack_callback(void *context)
+{
+    SlackTimer *t = (SlackTimer *)context;
+    CODAL_TIMESTAMP now = t->timer->getTimeUs();
+    uint32_t period = workload_period();
+
+    // Firing early wraps around to a very large excess.
+    uint32_t excess = now - t->expected - t->slack;
+    if (now - t->expected <= t->slack)
+        excess = 0;
+
+    worstExcess = max(worstExcess, excess);
+
+    t->expected = now + period;
+    t->timer->callbackAfterUs(period, slack_callback, t, t->slack);
+}
+
+/*
+ * Determines a lateness, in microseconds, that at least the given fraction of events did not exceed.
+ * This is the upper bound of the histogram bucket the fraction falls in.
+ */
+static uint32_t percentile(TimerStatistics &stats, uint32_t parts, uint32_t of)
+{
+    uint64_t target = ((uint64_t)stats.dispatched * parts + of - 1) / of;
+    uint64_t seen = 0;
+
+    for (int bucket = 0; bucket < CODAL_TIMER_LATENESS_BUCKETS; bucket++)
+    {
+        seen += stats.histogram[bucket];
+        if (seen >= target)
+            return bucket ? min((1UL << bucket) - 1, stats.maximumLateness) : 0;
+    }
+
+    return stats.maximumLateness;
+}
+
+/*
+ * Runs one workload, and reports the lateness of the events dispatched.
+ *
+ * @return the largest lateness of any event, in microseconds.
+ */
+static uint32_t run(HostEventBus &bus, TimerBitMode mode, uint32_t latency, int timers, bool repeating)
+{
+    SimulatedLowLevelTimer lowLevelTimer(mode, latency);
+    Timer *timer = new Timer(lowLevelTimer);
+    TimerStatistics stats;
+
+    seed = timers;
+    bus.setHandler(repeating ? NULL : rearm_one_shot, timer);
+
+    for (int i = 0; i < timers; i++)
+    {
+        int result = repeating ? timer->eventEveryUs(workload_period(), WORKLOAD_ID, i) : timer->eventAfterUs(workload_period(), WORKLOAD_ID, i);
+
+        if (result != DEVICE_OK)
+        {
+            printf("failed to set timer %d: %d\n", i, result);
+            exit(1);
+        }
+    }
+
+    timer->resetStatistics();
+
+    // Advance simulated time in irregular steps, reading the time at each step as application code would.
+    for (uint32_t elapsed = 0; elapsed < WORKLOAD_DURATION; )
+    {
+        uint32_t step = 1 + workload_random(WORKLOAD_MAXIMUM_STEP);
+
+        lowLevelTimer.advance(step);
+        timer->getTimeUs();
+        elapsed += step;
+    }
+
+    timer->getStatistics(&stats);
+    bus.setHandler(NULL);
+
+    printf("%-13s %4d %10u %10u %8u %6u %6u %6u\n", repeating ? "eventEveryUs" : "eventAfterUs", timers, stats.interrupts, stats.dispatched,
+        stats.dispatched ? stats.totalLateness / stats.dispatched : 0, percentile(stats, 1, 2), percentile(stats, 99, 100), stats.maximumLateness);
+
+    if (stats.dispatched == 0)
+    {
+        printf("no events were dispatched\n");
+        exit(1);
+    }
+
+    // The Timer does not free its event storage, so the instance is deliberately not deleted while its events are set.
+    return stats.maximumLateness;
+}
+
+/*
+ * Runs one slack workload, and reports the interrupts needed and the worst lateness beyond each timer's slack.
+ *
+ * @param every one in this many timers is given the slack, and the rest none.
+ *
+ * @return the number of interrupts.
+ */
+static uint32_t run_slack(TimerBitMode mode, uint32_t latency, uint32_t slack, int every)
+{
+    static SlackTimer timers[WORKLOAD_SLACK_TIMERS];
+    SimulatedLowLevelTimer lowLevelTimer(mode, latency);
+    Timer *timer = new Timer(lowLevelTimer);
+    TimerStatistics stats;
+
+    seed = WORKLOAD_SLACK_TIMERS;
+    worstExcess = 0;
+
+    for (int i = 0; i < WORKLOAD_SLACK_TIMERS; i++)
+    {
+        uint32_t period = workload_period();
+
+        timers[i].timer = timer;
+        timers[i].slack = i % every == 0 ? slack : 0;
+        timers[i].expected = timer->getTimeUs() + period;
+
+        if (timer->callbackAfterUs(period, slack_callback, &timers[i], timers[i].slack) != DEVICE_OK)
+        {
+            printf("failed to set callback timer %d\n", i);
+            exit(1);
+        }
+    }
+
+    timer->resetStatistics();
+
+    for (uint32_t elapsed = 0; elapsed < WORKLOAD_DURATION; )
+    {
+        uint32_t step = 1 + workload_random(WORKLOAD_MAXIMUM_STEP);
+
+        lowLevelTimer.advance(step);
+        timer->getTimeUs();
+        elapsed += step;
+    }
+
+    timer->getStatistics(&stats);
+
+    printf("%6u %6s %10u %10u %12u\n", slack, every == 1 ? "all" : "1 in 4", stats.interrupts, stats.dispatched, worstExcess);
+
+    return stats.interrupts;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t latency = argc > 1 ? atoi(argv[1]) : 5;
+    int width = argc > 2 ? atoi(argv[2]) : 32;
+    TimerBitMode mode = width == 16 ? BitMode16 : width == 24 ? BitMode24 : BitMode32;
+    uint32_t worst = 0;
+
+    HostEventBus bus;
+
+    printf("Timer lateness, %d bit counter, %u us interrupt latency, %u us simulated per workload\n\n", width, latency, WORKLOAD_DURATION);
+    printf("%-13s %4s %10s %10s %8s %6s %6s %6s\n", "workload", "n", "interrupts", "dispatched", "mean us", "p50", "p99", "max");
+
+    for (int repeating = 1; repeating >= 0; repeating--)
+        for (int timers = 1; timers <= 256; timers *= 2)
+            worst = max(worst, run(bus, mode, latency, timers, repeating));
+
+    printf("\nSlack sweep, %d callbackAfterUs timers\n\n", WORKLOAD_SLACK_TIMERS);
+    printf("%6s %6s %10s %10s %12s\n", "slack", "given", "interrupts", "dispatched", "max beyond");
+
+    static const uint32_t slacks[] = { 0, 100, 250, 500, 1000 };
+    uint32_t interrupts[sizeof(slacks) / sizeof(slacks[0])];
+    uint32_t worstBeyondSlack = 0;
+
+    for (int every = 1; every <= 4; every += 3)
+    {
+        for (unsigned i = 0; i < sizeof(slacks) / sizeof(slacks[0]); i++)
+        {
+            uint32_t n = run_slack(mode, latency, slacks[i], every);
+            worstBeyondSlack = max(worstBeyondSlack, worstExcess);
+
+            if (every == 1)
+                interrupts[i] = n;
+        }
+    }
+
+    if (worst > latency + CODAL_TIMER_MINIMUM_PERIOD)
+    {
+        printf("\nFAIL: an event was dispatched %u us late, more than %u us\n", worst, latency + CODAL_TIMER_MINIMUM_PERIOD);
+        return 1;
+    }
+
+    if (worstBeyondSlack > latency + CODAL_TIMER_MINIMUM_PERIOD)
+    {
+        printf("\nFAIL: a callback fired %u us beyond its slack, more than %u us (or early)\n", worstBeyondSlack, latency + CODAL_TIMER_MINIMUM_PERIOD);
+        return 1;
+    }
+
+    for (unsigned i = 1; i < sizeof(slacks) / sizeof(slacks[0]); i++)
+    {
+        if (interrupts[i] >= interrupts[0])
+        {
+            printf("\nFAIL: %u us of slack did not reduce the number of interrupts\n", slacks[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "HostSource.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+/**
+ * Constructor.
+ */
+HostSource::HostSource(ManagedBuffer buffer, DataStreamFormat format, int count)
+{
+    this->buffer = buffer;
+    this->format = format;
+    this->downStream = NULL;
+    this->remaining = count;
+    this->pulls = 0;
+}
+
+/**
+ * Provides a copy of the buffer, or an empty buffer once count buffers have been provided.
+ */
+ManagedBuffer HostSource::pull()
+{
+    pulls++;
+
+    if (remaining == 0)
+        return ManagedBuffer();
+
+    if (remaining > 0)
+        remaining--;
+
+    return ManagedBuffer(buffer.getBytes(), buffer.length());
+}
+
+/**
+ * Records the downstream component, so that it can be notified by pullRequest().
+ */
+void HostSource::connect(DataSink &sink)
+{
+    downStream = &sink;
+}
+
+/**
+ * Describes the data this source provides.
+ */
+DataStreamFormat HostSource::getFormat()
+{
+    return format;
+}
+
+/**
+  * Changes the format reported by getFormat(), as reconfiguring a real source would. The data provided is unchanged.
+  */
+void HostSource::setFormat(DataStreamFormat format)
+{
+    this->format = format;
+}
+
+/**
+ * Notifies the downstream component that a buffer is available.
+ */
+int HostSource::pullRequest()
+{
+    return downStream ? downStream->pullRequest() : DEVICE_INVALID_STATE;
+}
+
+/**
+ * Determines the number of times pull() has been called.
+ */
+uint32_t HostSource::getPullCount()
+{
+    return pulls;
+}
+
+/**
+ * Constructor.
+ */
+HostSink::HostSink(DataSource &source) : upstream(source)
+{
+    buffers = 0;
+    bytes = 0;
+
+    source.connect(*this);
+}
+
+/**
+ * Pulls and discards the next buffer from upstream.
+ */
+int HostSink::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+
+    if (b.length())
+    {
+        buffers++;
+        bytes += b.length();
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the number of non empty buffers received.
+ */
+uint32_t HostSink::getBufferCount()
+{
+    return buffers;
+}
+
+/**
+ * Determines the total size of the buffers received.
+ */
+uint32_t HostSink::getByteCount()
+{
+    return bytes;
+}
+
+/**
+ * Generates a buffer of deterministic pseudo random samples.
+ */
+ManagedBuffer codal::host_generate_samples(int samples, DataStreamFormat format, uint32_t seed)
+{
+    ManagedBuffer b(samples * format.sampleSize);
+    int64_t offset = format.isSigned ? 1LL << (format.sampleBits - 1) : 0;
+
+    for (int i = 0; i < samples; i++)
+    {
+        // Take the top bits of a linear congruential generator, which are the most random.
+        seed = seed * 1664525 + 1013904223;
+        int32_t v = (int32_t)((int64_t)(seed >> (32 - format.sampleBits)) - offset);
+
+        if (format.sampleSize == 1)
+            b[i] = (uint8_t)v;
+        else if (format.sampleSize == 2)
+            ((int16_t *)b.getBytes())[i] = (int16_t)v;
+        else
+            ((int32_t *)b.getBytes())[i] = v;
+    }
+
+    return b;
+}
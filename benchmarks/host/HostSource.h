@@ -0,0 +1,131 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_HOST_SOURCE_H
+#define CODAL_HOST_SOURCE_H
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+
+namespace codal
+{
+    /**
+      * A synthetic DataSource for host benchmarks and tests, that provides the same data on every pull().
+      * Each pull() returns a new copy, as stages downstream may modify their input in place.
+      */
+    class HostSource : public DataSource
+    {
+        ManagedBuffer buffer;
+        DataStreamFormat format;
+        DataSink *downStream;
+        int remaining;
+        uint32_t pulls;
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param buffer the data to provide on each pull().
+          * @param format the format of that data.
+          * @param count the number of buffers to provide before returning empty buffers, or -1 for no limit.
+          */
+        HostSource(ManagedBuffer buffer, DataStreamFormat format, int count = -1);
+
+        /**
+          * Provides a copy of the buffer, or an empty buffer once count buffers have been provided.
+          */
+        virtual ManagedBuffer pull();
+
+        /**
+          * Records the downstream component, so that it can be notified by pullRequest().
+          */
+        virtual void connect(DataSink &sink);
+
+        /**
+          * Describes the data this source provides.
+          */
+        virtual DataStreamFormat getFormat();
+
+        /**
+          * Changes the format reported by getFormat(), as reconfiguring a real source would. The data provided is unchanged.
+          */
+        void setFormat(DataStreamFormat format);
+
+        /**
+          * Notifies the downstream component that a buffer is available, as a microphone or other driver would.
+          */
+        int pullRequest();
+
+        /**
+          * Determines the number of times pull() has been called.
+          */
+        uint32_t getPullCount();
+    };
+
+    /**
+      * A DataSink for host benchmarks and tests, that pulls each buffer as soon as it is told one is available.
+      */
+    class HostSink : public DataSink
+    {
+        DataSource &upstream;
+        uint32_t buffers;
+        uint32_t bytes;
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param source the component to receive data from.
+          */
+        HostSink(DataSource &source);
+
+        /**
+          * Pulls and discards the next buffer from upstream.
+          */
+        virtual int pullRequest();
+
+        /**
+          * Determines the number of non empty buffers received.
+          */
+        uint32_t getBufferCount();
+
+        /**
+          * Determines the total size of the buffers received.
+          */
+        uint32_t getByteCount();
+    };
+
+    /**
+      * Generates a buffer of deterministic pseudo random samples.
+      *
+      * @param samples the number of samples.
+      * @param format the sample size, width and signedness to generate. Unsigned samples are centred on half their range.
+      * @param seed the seed for the sequence, so that different channels can be given different data.
+      */
+    ManagedBuffer host_generate_samples(int samples, DataStreamFormat format, uint32_t seed = 1);
+}
+
+#endif
@@ -0,0 +1,452 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "HostTarget.h"
+#include "CodalFiber.h"
+#include "MessageBus.h"
+#include "LowLevelTimer.h"
+#include "Timer.h"
+#include "ErrorNo.h"
+#include <time.h>
+
+using namespace codal;
+
+/*
+ * The host has no interrupts to disable.
+ */
+extern "C" void target_enable_irq()
+{
+}
+
+extern "C" void target_disable_irq()
+{
+}
+
+extern "C" void target_wait_for_event()
+{
+}
+
+extern "C" void target_panic(int statusCode)
+{
+    fprintf(stderr, "*** CODAL PANIC : [%d]\n", statusCode);
+    exit(1);
+}
+
+/**
+ * Constructor. The first HostEventBus created becomes the default EventModel.
+ */
+HostEventBus::HostEventBus()
+{
+    handler = NULL;
+    context = NULL;
+    count = 0;
+    listeners = NULL;
+    queueHead = 0;
+    queueLength = 0;
+    depth = 0;
+
+    if (EventModel::defaultEventBus == NULL)
+        EventModel::defaultEventBus = this;
+}
+
+/**
+ * Destructor. Frees every listener.
+ */
+HostEventBus::~HostEventBus()
+{
+    while (listeners)
+    {
+        Listener *l = listeners;
+        listeners = l->next;
+        delete l;
+    }
+
+    if (EventModel::defaultEventBus == this)
+        EventModel::defaultEventBus = NULL;
+}
+
+/*
+ * Determines if a listener should receive the given event.
+ */
+static bool host_listener_matches(Listener *l, Event evt)
+{
+    return !(l->flags & MESSAGE_BUS_LISTENER_DELETING) && (l->id == DEVICE_ID_ANY || l->id == evt.source) &&
+        (l->value == DEVICE_EVT_ANY || l->value == evt.value);
+}
+
+/*
+ * Determines if two listeners have the same callback.
+ */
+static bool host_listener_same_callback(Listener *a, Listener *b)
+{
+    if ((a->flags & MESSAGE_BUS_LISTENER_METHOD) != (b->flags & MESSAGE_BUS_LISTENER_METHOD))
+        return false;
+
+    return (a->flags & MESSAGE_BUS_LISTENER_METHOD) ? *a->cb_method == *b->cb_method : a->cb == b->cb;
+}
+
+/**
+ * Invokes every listener registered for the given event, of the given kind.
+ */
+void HostEventBus::deliver(Event evt, bool immediate)
+{
+    depth++;
+
+    for (Listener *l = listeners; l; l = l->next)
+    {
+        if (!host_listener_matches(l, evt) || ((l->flags & MESSAGE_BUS_LISTENER_IMMEDIATE) == MESSAGE_BUS_LISTENER_IMMEDIATE) != immediate)
+            continue;
+
+        if (l->flags & MESSAGE_BUS_LISTENER_METHOD)
+            l->cb_method->fire(evt);
+        else if (l->flags & MESSAGE_BUS_LISTENER_PARAMETERISED)
+            l->cb_param(evt, l->cb_arg);
+        else
+            l->cb(evt);
+    }
+
+    depth--;
+    reap();
+}
+
+/**
+ * Frees the listeners removed while they might have been running.
+ */
+void HostEventBus::reap()
+{
+    if (depth)
+        return;
+
+    Listener **p = &listeners;
+
+    while (*p)
+    {
+        Listener *l = *p;
+
+        if (l->flags & MESSAGE_BUS_LISTENER_DELETING)
+        {
+            *p = l->next;
+            delete l;
+        }
+        else
+        {
+            p = &l->next;
+        }
+    }
+}
+
+/**
+ * Defines the function invoked for each event raised.
+ */
+void HostEventBus::setHandler(HostEventHandler handler, void *context)
+{
+    this->handler = handler;
+    this->context = context;
+}
+
+/**
+ * Delivers the given event to the handler.
+ */
+int HostEventBus::send(Event evt)
+{
+    count++;
+
+    if (handler)
+        handler(evt, context);
+
+    deliver(evt, true);
+
+    for (Listener *l = listeners; l; l = l->next)
+    {
+        if (host_listener_matches(l, evt) && (l->flags & MESSAGE_BUS_LISTENER_IMMEDIATE) != MESSAGE_BUS_LISTENER_IMMEDIATE)
+        {
+            if (queueLength == HOST_EVENT_QUEUE_SIZE)
+                return DEVICE_NO_RESOURCES;
+
+            queue[(queueHead + queueLength++) % HOST_EVENT_QUEUE_SIZE] = evt;
+            break;
+        }
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Registers a listener. If one with the same event and callback is already registered, that one is left in place.
+ */
+int HostEventBus::add(Listener *listener)
+{
+    if (listener == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    for (Listener *l = listeners; l; l = l->next)
+    {
+        if (l->id == listener->id && l->value == listener->value && host_listener_same_callback(l, listener))
+        {
+            l->flags &= ~MESSAGE_BUS_LISTENER_DELETING;
+            return DEVICE_NOT_SUPPORTED;
+        }
+    }
+
+    // Append, so that listeners are invoked in the order they were registered.
+    Listener **p = &listeners;
+    while (*p)
+        p = &(*p)->next;
+
+    listener->next = NULL;
+    *p = listener;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Removes every listener with the same callback as the given one, for the same event.
+ */
+int HostEventBus::remove(Listener *listener)
+{
+    int removed = 0;
+
+    if (listener == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    for (Listener *l = listeners; l; l = l->next)
+    {
+        if ((listener->id == DEVICE_ID_ANY || listener->id == l->id) && (listener->value == DEVICE_EVT_ANY || listener->value == l->value) &&
+            host_listener_same_callback(l, listener))
+        {
+            l->flags |= MESSAGE_BUS_LISTENER_DELETING;
+            removed++;
+        }
+    }
+
+    reap();
+
+    return removed ? DEVICE_OK : DEVICE_INVALID_PARAMETER;
+}
+
+/**
+ * Invokes the listeners of each queued event in turn, until none remain. This includes any events sent by the
+ * listeners themselves.
+ */
+int HostEventBus::dispatch()
+{
+    int dispatched = 0;
+
+    while (queueLength)
+    {
+        Event evt = queue[queueHead];
+
+        queueHead = (queueHead + 1) % HOST_EVENT_QUEUE_SIZE;
+        queueLength--;
+
+        deliver(evt, false);
+        dispatched++;
+    }
+
+    return dispatched;
+}
+
+/**
+ * Determines the number of events raised since this bus was created.
+ */
+uint32_t HostEventBus::getEventCount()
+{
+    return count;
+}
+
+/**
+ * Determines the time elapsed on the host's monotonic clock, in nanoseconds.
+ */
+uint64_t codal::host_time_ns()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/*
+ * Default implementations of the optional LowLevelTimer operations, which are otherwise provided by the target.
+ */
+int LowLevelTimer::clearCompare(uint8_t)
+{
+    return DEVICE_NOT_SUPPORTED;
+}
+
+int LowLevelTimer::setClockSpeed(uint32_t)
+{
+    return DEVICE_NOT_SUPPORTED;
+}
+
+/*
+ * A free running 32 bit microsecond counter, read from the host's monotonic clock. It never raises interrupts, so a
+ * Timer using it keeps time correctly (time reads sync themselves), but never dispatches timer events.
+ */
+class HostLowLevelTimer : public LowLevelTimer
+{
+    public:
+
+    HostLowLevelTimer() : LowLevelTimer(2)
+    {
+        bitMode = BitMode32;
+        timer_pointer = NULL;
+    }
+
+    virtual int enable() { return DEVICE_OK; }
+    virtual int enableIRQ() { return DEVICE_OK; }
+    virtual int disable() { return DEVICE_OK; }
+    virtual int disableIRQ() { return DEVICE_OK; }
+    virtual int reset() { return DEVICE_OK; }
+    virtual int setMode(TimerMode t) { return t == TimerModeTimer ? DEVICE_OK : DEVICE_NOT_SUPPORTED; }
+    virtual int setCompare(uint8_t, uint32_t) { return DEVICE_OK; }
+    virtual int offsetCompare(uint8_t, uint32_t) { return DEVICE_OK; }
+    virtual int clearCompare(uint8_t) { return DEVICE_OK; }
+    virtual uint32_t captureCounter() { return (uint32_t)(host_time_ns() / 1000); }
+    virtual int setClockSpeed(uint32_t) { return DEVICE_OK; }
+    virtual int setBitMode(TimerBitMode t) { return t == BitMode32 ? DEVICE_OK : DEVICE_NOT_SUPPORTED; }
+};
+
+/**
+ * Creates a system Timer driven by the host's monotonic clock.
+ */
+void codal::host_start_clock()
+{
+    if (system_timer)
+        return;
+
+    static HostLowLevelTimer hostTimer;
+    static Timer timer(hostTimer);
+}
+
+/*
+ * Fibers. Each created fiber is recorded, and run to completion by host_run_fibers().
+ */
+struct HostFiber
+{
+    void (*entry)(void *);
+    void *param;
+    HostFiber *next;
+};
+
+static HostFiber *fibers = NULL;
+static void (*idleHook)(void *) = NULL;
+static void *idleContext = NULL;
+static uint16_t notifyEvent = 0;
+
+static void run_void_entry(void *entry)
+{
+    ((void (*)(void))entry)();
+}
+
+Fiber *codal::create_fiber(void (*entry_fn)(void *), void *param, void (*)(void *))
+{
+    HostFiber *f = new HostFiber;
+    HostFiber **tail = &fibers;
+
+    f->entry = entry_fn;
+    f->param = param;
+    f->next = NULL;
+
+    while (*tail)
+        tail = &(*tail)->next;
+
+    *tail = f;
+
+    // Fibers have no representation on the host.
+    return NULL;
+}
+
+Fiber *codal::create_fiber(void (*entry_fn)(void), void (*)(void))
+{
+    return create_fiber(run_void_entry, (void *)entry_fn, release_fiber);
+}
+
+/**
+ * Runs every fiber created with create_fiber() to completion, in the order they were created.
+ */
+int codal::host_run_fibers()
+{
+    int count = 0;
+
+    while (fibers)
+    {
+        HostFiber *f = fibers;
+        fibers = f->next;
+
+        f->entry(f->param);
+        delete f;
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * Defines a function invoked whenever a fiber calls schedule(), in place of running another fiber.
+ */
+void codal::host_set_idle_hook(void (*hook)(void *), void *context)
+{
+    idleHook = hook;
+    idleContext = context;
+}
+
+void codal::schedule()
+{
+    if (idleHook)
+        idleHook(idleContext);
+}
+
+void codal::release_fiber(void)
+{
+}
+
+void codal::release_fiber(void *)
+{
+}
+
+int codal::fiber_scheduler_running()
+{
+    return 0;
+}
+
+void codal::fiber_sleep(unsigned long)
+{
+    schedule();
+}
+
+int codal::fiber_wait_for_event(uint16_t, uint16_t)
+{
+    schedule();
+    return DEVICE_OK;
+}
+
+int codal::fiber_wake_on_event(uint16_t, uint16_t)
+{
+    return DEVICE_OK;
+}
+
+uint16_t codal::allocateNotifyEvent()
+{
+    return ++notifyEvent;
+}
@@ -0,0 +1,156 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Support for running codal-core components on the host, for benchmarking and testing.
+  *
+  * The host has no fiber scheduler and no interrupts. Interrupts are never disabled, fibers created with create_fiber()
+  * are not run until host_run_fibers() is called, and schedule() invokes an optional idle hook in place of switching to
+  * another fiber. This is enough to drive stream pipelines and timers deterministically from a single thread.
+  */
+
+#ifndef CODAL_HOST_TARGET_H
+#define CODAL_HOST_TARGET_H
+
+#include "CodalConfig.h"
+#include "EventModel.h"
+#include "CodalListener.h"
+
+#define HOST_EVENT_QUEUE_SIZE       64      // Events awaiting dispatch() to their listeners. Further events are dropped.
+
+namespace codal
+{
+    /**
+      * A function invoked for each event raised on the host.
+      */
+    typedef void (*HostEventHandler)(Event evt, void *context);
+
+    /**
+      * An EventModel that delivers each event synchronously to a single handler, in place of a MessageBus.
+      *
+      * Listeners registered with listen() are also supported. Those flagged MESSAGE_BUS_LISTENER_IMMEDIATE are invoked as
+      * each event is sent. Others are invoked by dispatch(), as a MessageBus would invoke them later from another fiber.
+      */
+    class HostEventBus : public EventModel
+    {
+        HostEventHandler    handler;
+        void                *context;
+        uint32_t            count;
+        Listener            *listeners;
+        Event               queue[HOST_EVENT_QUEUE_SIZE];
+        int                 queueHead;      // Index of the oldest queued event.
+        int                 queueLength;    // Number of queued events.
+        int                 depth;          // Number of listeners currently running, so that removed listeners are not yet freed.
+
+        /**
+          * Invokes every listener registered for the given event, of the given kind.
+          */
+        void deliver(Event evt, bool immediate);
+
+        /**
+          * Frees the listeners removed while they might have been running.
+          */
+        void reap();
+
+        public:
+
+        /**
+          * Constructor. The first HostEventBus created becomes the default EventModel.
+          */
+        HostEventBus();
+
+        /**
+          * Destructor. Frees every listener.
+          */
+        ~HostEventBus();
+
+        /**
+          * Defines the function invoked for each event raised.
+          *
+          * @param handler the function to invoke, or NULL to only count events.
+          * @param context an arbitrary pointer passed to the handler.
+          */
+        void setHandler(HostEventHandler handler, void *context = NULL);
+
+        /**
+          * Delivers the given event to the handler and any immediate listeners, and queues it for any other listeners.
+          */
+        virtual int send(Event evt);
+
+        /**
+          * Registers a listener. If one with the same event and callback is already registered, that one is left in place.
+          *
+          * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if the listener was a duplicate, and so not added.
+          */
+        virtual int add(Listener *listener);
+
+        /**
+          * Removes every listener with the same callback as the given one, for the same event.
+          *
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if no listener matched.
+          */
+        virtual int remove(Listener *listener);
+
+        /**
+          * Invokes the listeners of each queued event in turn, until none remain. This includes any events sent by the
+          * listeners themselves.
+          *
+          * @return the number of events dispatched.
+          */
+        int dispatch();
+
+        /**
+          * Determines the number of events raised since this bus was created.
+          */
+        uint32_t getEventCount();
+    };
+
+    /**
+      * Determines the time elapsed on the host's monotonic clock, in nanoseconds.
+      */
+    uint64_t host_time_ns();
+
+    /**
+      * Creates a system Timer driven by the host's monotonic clock, so that components that measure time (such as
+      * StreamProfiler) see real time. Does nothing if a system Timer already exists.
+      */
+    void host_start_clock();
+
+    /**
+      * Defines a function invoked whenever a fiber calls schedule(), in place of running another fiber.
+      *
+      * @param hook the function to invoke, or NULL.
+      * @param context an arbitrary pointer passed to the hook.
+      */
+    void host_set_idle_hook(void (*hook)(void *), void *context = NULL);
+
+    /**
+      * Runs every fiber created with create_fiber() to completion, in the order they were created.
+      *
+      * @return the number of fibers run.
+      */
+    int host_run_fibers();
+}
+
+#endif
@@ -0,0 +1,189 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * A simple scoped (bump) allocator for short lived temporaries.
+  *
+  * Event handlers and stream components frequently create temporary buffers that are discarded before
+  * the handler returns. Allocating these from the main heap costs a first fit search on every allocation
+  * and adds churn to the heap. An Arena instead hands out memory linearly from a single region, and
+  * releases everything allocated since a given mark in O(1).
+  *
+  * Memory allocated from an Arena must not outlive the scope that allocated it.
+  */
+
+#ifndef CODAL_ARENA_H
+#define CODAL_ARENA_H
+
+#include "CodalConfig.h"
+#include "ErrorNo.h"
+
+namespace codal
+{
+    class Arena
+    {
+        uint8_t     *start;             // Physical address of the start of this arena.
+        uint8_t     *end;               // Physical address of the end of this arena.
+        uint8_t     *top;               // The next free location in the arena.
+        uint8_t     *highWater;         // The highest value top has reached since creation.
+        bool        owned;              // true if the arena storage was allocated by (and is freed by) this instance.
+        Arena       *next;              // The next arena in the list of all live arenas.
+
+        static Arena *arenas;           // The list of all live arenas.
+
+        void init(void *memory, int size);
+
+        public:
+
+        /**
+          * Constructor.
+          * Creates an arena of the given size, using storage allocated from the heap.
+          *
+          * @param size The number of bytes of storage to make available.
+          */
+        Arena(int size);
+
+        /**
+          * Constructor.
+          * Creates an arena using the given region of memory (e.g. a static buffer).
+          *
+          * @param memory The start of the memory region to use.
+          * @param size The size of the memory region, in bytes.
+          */
+        Arena(void *memory, int size);
+
+        /**
+          * Destructor.
+          * Releases the storage held by this arena, if it was allocated from the heap.
+          */
+        ~Arena();
+
+        /**
+          * Allocate a block of memory from this arena. Blocks are word aligned.
+          *
+          * @param size The amount of memory, in bytes, to allocate.
+          *
+          * @return A pointer to the allocated memory, or NULL if insufficient space is available.
+          */
+        void *alloc(int size);
+
+        /**
+          * Determines the current allocation point of this arena, for later use with release().
+          *
+          * @return an opaque mark describing the current allocation point.
+          */
+        int mark()
+        {
+            return top - start;
+        }
+
+        /**
+          * Releases all memory allocated since the given mark was taken.
+          *
+          * @param mark A value previously returned by mark().
+          */
+        void release(int mark);
+
+        /**
+          * Releases all memory held in this arena.
+          */
+        void reset()
+        {
+            release(0);
+        }
+
+        /**
+          * Determines if the given pointer refers to memory inside this arena.
+          */
+        bool contains(const void *p) const
+        {
+            return (uint8_t *)p >= start && (uint8_t *)p < end;
+        }
+
+        /**
+          * Returns the total size of this arena in bytes.
+          */
+        int getSize() const
+        {
+            return end - start;
+        }
+
+        /**
+          * Returns the number of bytes currently allocated from this arena.
+          */
+        int getUsed() const
+        {
+            return top - start;
+        }
+
+        /**
+          * Returns the largest number of bytes that have been allocated from this arena at any one time.
+          */
+        int getHighWaterMark() const
+        {
+            return highWater - start;
+        }
+
+        /**
+          * Finds the live arena that holds the given pointer, if any.
+          *
+          * @param p The pointer to test.
+          *
+          * @return the Arena containing p, or NULL if p was not allocated from an arena.
+          */
+        static Arena *owner(const void *p);
+    };
+
+    /**
+      * Helper class that marks an arena on construction, and releases it back to that mark when destroyed.
+      *
+      * Example:
+      * @code
+      * void onData(Event)
+      * {
+      *     ArenaScope scope(scratch);
+      *     ManagedBuffer b(256, scratch);      // released when scope goes out of scope.
+      * }
+      * @endcode
+      */
+    class ArenaScope
+    {
+        Arena   &arena;
+        int     position;
+
+        public:
+
+        ArenaScope(Arena &a) : arena(a)
+        {
+            position = a.mark();
+        }
+
+        ~ArenaScope()
+        {
+            arena.release(position);
+        }
+    };
+}
+
+#endif
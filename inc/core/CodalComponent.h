@@ -65,6 +65,10 @@ DEALINGS IN THE SOFTWARE.
 #define DEVICE_ID_JACDAC_PHYS 31
 #define DEVICE_ID_JACDAC_CONTROL_SERVICE 32
 #define DEVICE_ID_JACDAC_CONFIGURATION_SERVICE 33
+#define DEVICE_ID_RING_BUFFER_STREAM 34
+#define DEVICE_ID_FFT_ANALYSER 35
+#define DEVICE_ID_FLASH_RECORDER 36
+#define DEVICE_ID_ACTIVITY_DETECTOR 37
 
 #define DEVICE_ID_IO_P0               100                       // IDs 100-227 are reserved for I/O Pin IDs.
 
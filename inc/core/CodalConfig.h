@@ -66,6 +66,24 @@ DEALINGS IN THE SOFTWARE.
 #define DEVICE_MAXIMUM_HEAPS                  1
 #endif
 
+//
+// The maximum number of heap blocks the allocator will examine with interrupts disabled, before briefly
+// re-enabling them to service any pending interrupts. This bounds the interrupt latency caused by heap allocation.
+// The longest section actually observed is recorded in the statistics of each heap.
+// Set to '0' to scan the heap in a single critical section.
+//
+#ifndef DEVICE_HEAP_CRITICAL_SECTION_BLOCKS
+#define DEVICE_HEAP_CRITICAL_SECTION_BLOCKS   0
+#endif
+
+//
+// Determines if the heap allocator provides malloc(), free(), realloc() and calloc() in place of the C library.
+// Set to '0' to use the allocator only through device_malloc() and device_free(), for example when testing it on a host.
+//
+#ifndef DEVICE_HEAP_REPLACE_LIBC
+#define DEVICE_HEAP_REPLACE_LIBC              1
+#endif
+
 // If enabled, RefCounted objects include a constant tag at the beginning.
 // Set '1' to enable.
 #ifndef DEVICE_TAG
@@ -53,13 +53,60 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalConfig.h"
 
 // Flag to indicate that a given block is FREE/USED (top bit of a CPU word)
-#define DEVICE_HEAP_BLOCK_FREE		(1 << (sizeof(PROCESSOR_WORD_TYPE) * 8 - 1))
+#define DEVICE_HEAP_BLOCK_FREE		((PROCESSOR_WORD_TYPE)1 << (sizeof(PROCESSOR_WORD_TYPE) * 8 - 1))
 #define DEVICE_HEAP_BLOCK_SIZE      (sizeof(PROCESSOR_WORD_TYPE))
 
+// Maximum number of times a bounded heap scan is restarted due to concurrent modification, before
+// the remainder of the scan is completed with interrupts disabled.
+#ifndef DEVICE_HEAP_MAXIMUM_RESTARTS
+#define DEVICE_HEAP_MAXIMUM_RESTARTS    2
+#endif
+
+// Placement hints. Each heap advertises the kinds of memory it provides, and allocations can request a kind of memory.
+#define DEVICE_HEAP_REGION_GENERAL      0x01    // General purpose memory.
+#define DEVICE_HEAP_REGION_FAST         0x02    // Fast (typically on-chip, zero wait state) memory, for hot data and fiber stacks.
+#define DEVICE_HEAP_REGION_DMA          0x04    // Memory reachable by the DMA controller(s).
+#define DEVICE_HEAP_REGION_BULK         0x08    // Large, potentially slower memory for bulk data such as images.
+#define DEVICE_HEAP_REGION_ANY          0x7F
+
+// If set in a placement hint, the allocation will fail rather than fall back to a heap of a different kind.
+#define DEVICE_HEAP_PLACEMENT_STRICT    0x80
+
+//
+// Placement hints used by the runtime for its own allocations.
+// These can be overridden in a target config.json to suit the memory map of a given device.
+//
+#ifndef DEVICE_HEAP_PLACEMENT_FIBER_STACK
+#define DEVICE_HEAP_PLACEMENT_FIBER_STACK   DEVICE_HEAP_REGION_FAST
+#endif
+
+#ifndef DEVICE_HEAP_PLACEMENT_DMA
+#define DEVICE_HEAP_PLACEMENT_DMA           DEVICE_HEAP_REGION_DMA
+#endif
+
+#ifndef DEVICE_HEAP_PLACEMENT_IMAGE
+#define DEVICE_HEAP_PLACEMENT_IMAGE         DEVICE_HEAP_REGION_BULK
+#endif
+
+struct HeapStatistics
+{
+    uint32_t allocations;                   // Number of successful allocations from this heap.
+    uint32_t frees;                         // Number of blocks released back to this heap.
+    uint32_t failures;                      // Number of allocation requests this heap could not satisfy.
+    uint32_t bytes_in_use;                  // Number of bytes currently allocated (including block headers).
+    uint32_t peak_bytes_in_use;             // Largest value bytes_in_use has reached.
+    uint32_t max_critical_blocks;           // Largest number of blocks examined in a single interrupts disabled section.
+    uint32_t restarts;                      // Number of scans restarted because the heap was modified by an interrupt.
+};
+
 struct HeapDefinition
 {
     PROCESSOR_WORD_TYPE *heap_start;		// Physical address of the start of this heap.
     PROCESSOR_WORD_TYPE *heap_end;		    // Physical address of the end of this heap.
+    const char *name;                       // Human readable name of this heap (may be NULL).
+    uint8_t regions;                        // The DEVICE_HEAP_REGION_* kinds of memory this heap provides.
+    uint32_t generation;                    // Incremented whenever the block structure of this heap changes.
+    HeapStatistics stats;                   // Usage statistics for this heap.
 };
 extern PROCESSOR_WORD_TYPE codal_heap_start;
 
@@ -73,13 +120,37 @@ extern PROCESSOR_WORD_TYPE codal_heap_start;
   *
   * @param end The end address of memory to use as a heap region.
   *
+  * @param regions The DEVICE_HEAP_REGION_* kinds of memory this heap provides. Defaults to all kinds.
+  *
+  * @param name An optional, human readable name for this heap.
+  *
   * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the heap could not be allocated.
   *
   * @note Only code that #includes DeviceHeapAllocator.h will use this heap. This includes all codal device runtime
   * code, and user code targetting the runtime. External code can choose to include this file, or
   * simply use the standard heap.
   */
-int device_create_heap(PROCESSOR_WORD_TYPE start, PROCESSOR_WORD_TYPE end);
+int device_create_heap(PROCESSOR_WORD_TYPE start, PROCESSOR_WORD_TYPE end, uint8_t regions = DEVICE_HEAP_REGION_ANY, const char *name = NULL);
+
+/**
+ * Determines the index of the heap with the given name.
+ *
+ * @param name the name given to the heap when it was created.
+ *
+ * @return the index of the heap, or DEVICE_INVALID_PARAMETER if no such heap exists.
+ */
+int device_heap_find(const char *name);
+
+/**
+ * Retrieves the usage statistics of a given heap.
+ *
+ * @param heap_index index between 0 and DEVICE_MAXIMUM_HEAPS-1
+ *
+ * @param stats the structure to populate.
+ *
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if no such heap exists.
+ */
+int device_heap_statistics(uint8_t heap_index, HeapStatistics *stats);
 
 /**
  * Returns the size of a given heap.
@@ -100,6 +171,26 @@ uint32_t device_heap_size(uint8_t heap_index);
   */
 extern "C" void* device_malloc(size_t size);
 
+/**
+  * Attempt to allocate a given amount of memory, preferring heaps that provide the given kind of memory.
+  * Heaps matching the placement hint are tried in creation order, followed by all other heaps
+  * unless DEVICE_HEAP_PLACEMENT_STRICT is set.
+  *
+  * @param size The amount of memory, in bytes, to allocate.
+  *
+  * @param placement A bitmask of DEVICE_HEAP_REGION_* values, optionally with DEVICE_HEAP_PLACEMENT_STRICT.
+  *
+  * @return A pointer to the allocated memory, or NULL if insufficient memory is available.
+  */
+#if CONFIG_ENABLED(DEVICE_HEAP_ALLOCATOR)
+void* device_malloc_region(size_t size, uint8_t placement);
+#else
+inline void* device_malloc_region(size_t size, uint8_t)
+{
+    return malloc(size);
+}
+#endif
+
 /**
   * Release a given area of memory from the heap.
   *
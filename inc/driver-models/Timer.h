@@ -33,28 +33,93 @@ DEALINGS IN THE SOFTWARE.
 #define CODAL_TIMER_DEFAULT_EVENT_LIST_SIZE     10
 #endif
 
+// The number of additional timer events allocated each time the event list becomes full.
+#ifndef CODAL_TIMER_EVENT_LIST_GROWTH
+#define CODAL_TIMER_EVENT_LIST_GROWTH           CODAL_TIMER_DEFAULT_EVENT_LIST_SIZE
+#endif
+
+// The maximum number of timer events that may be active at any one time.
+#ifndef CODAL_TIMER_MAXIMUM_EVENT_LIST_SIZE
+#define CODAL_TIMER_MAXIMUM_EVENT_LIST_SIZE     128
+#endif
+
+// The number of free timer events kept in reserve for use by timer callbacks. Callbacks run in interrupt context,
+// where the event list cannot be grown, so the list is grown early by other callers to leave this many free.
+#ifndef CODAL_TIMER_EVENT_LIST_RESERVE
+#define CODAL_TIMER_EVENT_LIST_RESERVE          2
+#endif
+
+// If enabled, the Timer records how late each event and callback is dispatched.
+// Set '1' to enable.
+#ifndef CODAL_TIMER_STATISTICS
+#define CODAL_TIMER_STATISTICS                  0
+#endif
+
+// The number of buckets in the lateness histogram. Bucket 0 counts events dispatched on time,
+// bucket n counts events between 2^(n-1) and 2^n - 1 microseconds late, and the last bucket counts everything later.
+#ifndef CODAL_TIMER_LATENESS_BUCKETS
+#define CODAL_TIMER_LATENESS_BUCKETS            16
+#endif
+
 namespace codal
 {
+    /**
+      * A function invoked directly from the timer interrupt when a callback timer expires.
+      *
+      * @param context the context pointer given when the callback timer was created.
+      */
+    typedef void (*TimerCallback)(void *context);
+
     struct TimerEvent
     {
         uint16_t id;
         uint16_t value;
         CODAL_TIMESTAMP period;
         CODAL_TIMESTAMP timestamp;
+        CODAL_TIMESTAMP slack;              // The event may fire at any time up to this many microseconds after timestamp.
+        CODAL_TIMESTAMP subtreeSlack;       // The largest slack of this event and those below it in the timer event queue.
+        TimerCallback callback;             // If set, invoked in place of raising an Event with the id and value above.
+        void *context;                      // Passed to callback.
 
-        void set(CODAL_TIMESTAMP timestamp, CODAL_TIMESTAMP period, uint16_t id, uint16_t value)
+        void set(CODAL_TIMESTAMP timestamp, CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack = 0)
         {
             this->timestamp = timestamp;
             this->period = period;
             this->id = id;
             this->value = value;
+            this->slack = slack;
+            this->subtreeSlack = slack;
+            this->callback = NULL;
+            this->context = NULL;
+        }
+
+        /**
+          * The latest time at which this event should fire.
+          */
+        CODAL_TIMESTAMP deadline()
+        {
+            return timestamp + slack;
         }
     };
 
+    struct TimerStatistics
+    {
+        uint32_t interrupts;                                // Number of times the timer has been serviced.
+        uint32_t dispatched;                                // Number of events and callbacks dispatched.
+        uint32_t callbacks;                                 // Number of those that were callbacks, and so raised no Event.
+        uint32_t eventDispatchTime;                         // Total time spent raising Events for the others, in microseconds.
+        uint32_t totalLateness;                             // Sum of the lateness of all dispatched events, in microseconds.
+        uint32_t maximumLateness;                           // Largest lateness of any dispatched event, in microseconds.
+        uint32_t histogram[CODAL_TIMER_LATENESS_BUCKETS];   // Number of events dispatched in each lateness range.
+    };
+
     class Timer
     {
-        uint16_t sigma;
-        uint16_t delta;
+        uint32_t sigma;                     // The low level timer counter value at the last sync().
+        uint32_t delta;                     // Microseconds accumulated since currentTime last advanced (always < 1000).
+        uint32_t counterMask;               // The range of the low level timer counter.
+        uint32_t fallbackPeriod;            // Interval of the fallback interrupt, at most a quarter of the counter range.
+        volatile uint32_t sequence;         // Incremented before and after each update of the time fields, so they can be read without locking.
         LowLevelTimer& timer;
 
         /**
@@ -62,6 +127,12 @@ namespace codal
           */
         void sync();
 
+        /**
+          * Determines the number of microseconds that have elapsed on the low level timer since the last sync().
+          * The caller must validate the result against the sequence counter.
+          */
+        uint32_t elapsedSinceSync();
+
         /**
          * request to the physical timer implementation code to provide a trigger callback at the given time.
          * @note it is perfectly legitimate for the implementation to trigger before this time if convenient.
@@ -74,6 +145,34 @@ namespace codal
          */
         void recomputeNextTimerEvent();
 
+        /**
+         * Restores the ordering of the timer event queue, moving the event at the given position towards the head.
+         *
+         * @return the position the event was moved to.
+         */
+        int siftUp(int position);
+
+        /**
+         * Restores the ordering of the timer event queue, moving the event at the given position towards the tail.
+         *
+         * @return the position the event was moved to.
+         */
+        int siftDown(int position);
+
+        /**
+         * Recomputes the subtreeSlack of the event at the given position in the queue, and of each event above it.
+         * Called after the events on that path have moved, or the subtrees below them have changed.
+         */
+        void updateSlack(int position);
+
+        /**
+         * Finds the earliest active event in the queue that is ready to fire. Subtrees of the queue whose slack
+         * windows have not yet opened are skipped, so this examines few events beyond those that are ready.
+         *
+         * @return the position of the event in the queue, or -1 if no event is ready.
+         */
+        int findDueTimerEvent();
+
     public:
 
         uint8_t ccPeriodChannel;
@@ -115,8 +214,11 @@ namespace codal
           * @param id the ID to be used in event generation.
           *
           * @param value the value to place into the Events' value field.
+          *
+          * @param slack the time, in milliseconds, by which the event may be delayed so that it can be
+          * combined with other events into a single interrupt. Defaults to zero (fire on time).
           */
-        int eventAfter(CODAL_TIMESTAMP period, uint16_t id, uint16_t value);
+        int eventAfter(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack = 0);
 
         /**
           * Configures this Timer instance to fire an event after period
@@ -127,8 +229,11 @@ namespace codal
           * @param id the ID to be used in event generation.
           *
           * @param value the value to place into the Events' value field.
+          *
+          * @param slack the time, in microseconds, by which the event may be delayed so that it can be
+          * combined with other events into a single interrupt. Defaults to zero (fire on time).
           */
-        int eventAfterUs(CODAL_TIMESTAMP period, uint16_t id, uint16_t value);
+        int eventAfterUs(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack = 0);
 
         /**
           * Configures this Timer instance to fire an event every period
@@ -139,8 +244,11 @@ namespace codal
           * @param id the ID to be used in event generation.
           *
           * @param value the value to place into the Events' value field.
+          *
+          * @param slack the time, in milliseconds, by which the event may be delayed so that it can be
+          * combined with other events into a single interrupt. Defaults to zero (fire on time).
           */
-        int eventEvery(CODAL_TIMESTAMP period, uint16_t id, uint16_t value);
+        int eventEvery(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack = 0);
 
         /**
           * Configures this Timer instance to fire an event every period
@@ -151,8 +259,54 @@ namespace codal
           * @param id the ID to be used in event generation.
           *
           * @param value the value to place into the Events' value field.
+          *
+          * @param slack the time, in microseconds, by which the event may be delayed so that it can be
+          * combined with other events into a single interrupt. Defaults to zero (fire on time).
           */
-        int eventEveryUs(CODAL_TIMESTAMP period, uint16_t id, uint16_t value);
+        int eventEveryUs(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack = 0);
+
+        /**
+          * Configures this Timer instance to invoke a function after period microseconds.
+          *
+          * Unlike eventAfterUs, no Event is raised: the callback is invoked directly from the timer interrupt,
+          * so it must be short and must not block. This avoids the cost of MessageBus queueing and listener
+          * matching for high rate work such as sensor sampling or display multiplexing.
+          *
+          * A callback may itself set timer events, but the event list is never grown from interrupt context,
+          * so only the CODAL_TIMER_EVENT_LIST_RESERVE free events kept in reserve are available to it.
+          *
+          * @param period the period to wait until the callback is invoked, in microseconds.
+          *
+          * @param callback the function to invoke.
+          *
+          * @param context an arbitrary pointer passed to the callback.
+          *
+          * @param slack the time, in microseconds, by which the callback may be delayed so that it can be
+          * combined with other events into a single interrupt. Defaults to zero (fire on time).
+          *
+          * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if callback is NULL,
+          * or DEVICE_NO_RESOURCES if no more timer events can be allocated.
+          */
+        int callbackAfterUs(CODAL_TIMESTAMP period, TimerCallback callback, void *context, CODAL_TIMESTAMP slack = 0);
+
+        /**
+          * Configures this Timer instance to invoke a function every period microseconds.
+          *
+          * The callback is invoked directly from the timer interrupt, so it must be short and must not block.
+          *
+          * @param period the interval between invocations of the callback, in microseconds.
+          *
+          * @param callback the function to invoke.
+          *
+          * @param context an arbitrary pointer passed to the callback.
+          *
+          * @param slack the time, in microseconds, by which the callback may be delayed so that it can be
+          * combined with other events into a single interrupt. Defaults to zero (fire on time).
+          *
+          * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if callback is NULL,
+          * or DEVICE_NO_RESOURCES if no more timer events can be allocated.
+          */
+        int callbackEveryUs(CODAL_TIMESTAMP period, TimerCallback callback, void *context, CODAL_TIMESTAMP slack = 0);
 
         /**
           * Cancels any events matching the given id and value.
@@ -163,6 +317,48 @@ namespace codal
           */
         int cancel(uint16_t id, uint16_t value);
 
+        /**
+          * Cancels a callback timer matching the given callback and context.
+          *
+          * @param callback the function that was given upon a previous call to callbackEveryUs / callbackAfterUs
+          *
+          * @param context the context that was given upon a previous call to callbackEveryUs / callbackAfterUs
+          *
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if no matching callback timer was found.
+          */
+        int cancelCallback(TimerCallback callback, void *context);
+
+        /**
+          * Determines the number of timer events that can currently be held without allocating more memory.
+          */
+        int getEventListSize();
+
+        /**
+          * Determines the largest number of timer events that have been active at any one time.
+          */
+        int getEventHighWaterMark();
+
+        /**
+          * Retrieves a snapshot of how late this Timer has been dispatching events.
+          * Lateness is measured from the time an event was scheduled for to the time it is dispatched,
+          * so it includes any slack requested for the event as well as interrupt latency.
+          *
+          * The time spent raising Events is also recorded. eventDispatchTime / (dispatched - callbacks) is the mean
+          * dispatch cost that each callback timer avoids.
+          *
+          * @param stats the structure to fill in.
+          *
+          * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if CODAL_TIMER_STATISTICS is not enabled.
+          */
+        int getStatistics(TimerStatistics *stats);
+
+        /**
+          * Clears the statistics returned by getStatistics.
+          *
+          * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if CODAL_TIMER_STATISTICS is not enabled.
+          */
+        int resetStatistics();
+
         /**
           * Destructor for this Timer instance
           */
@@ -188,13 +384,24 @@ namespace codal
         CODAL_TIMESTAMP currentTimeUs;
         uint32_t overflow;
 
-        TimerEvent *timerEventList;
+        TimerEvent *timerEventList;             // Storage for all timer events.
+        TimerEvent **timerEventQueue;           // Every entry of timerEventList. The first eventQueueLength entries are a binary min-heap
+                                                // of active events ordered by deadline. The remainder are free for use.
         TimerEvent *nextTimerEvent;
         int eventListSize;
+        int eventQueueLength;
+        int eventQueueHighWater;
+        volatile bool dispatching;              // true while trigger() is dispatching events, in interrupt context.
+
+#if CONFIG_ENABLED(CODAL_TIMER_STATISTICS)
+        TimerStatistics statistics;
+#endif
 
+        int growTimerEventList();
         TimerEvent *getTimerEvent();
-        void releaseTimerEvent(TimerEvent *event);
-        int setEvent(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, bool repeat);
+        void queueTimerEvent(TimerEvent *event);
+        void removeTimerEvent(int position);
+        int setEvent(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, bool repeat, CODAL_TIMESTAMP slack = 0, TimerCallback callback = NULL, void *context = NULL);
     };
 
     /*
@@ -224,9 +431,11 @@ namespace codal
      *
      * @param the value to fire against the current system_timer id.
      *
+     * @param slack the time, in microseconds, by which the event may be delayed to combine it with other events.
+     *
      * @return DEVICE_OK or DEVICE_NOT_SUPPORTED if no timer has been registered.
      */
-    int system_timer_event_every_us(CODAL_TIMESTAMP period, uint16_t id, uint16_t value);
+    int system_timer_event_every_us(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack = 0);
 
     /**
      * Configure an event to occur every given number of milliseconds.
@@ -235,9 +444,11 @@ namespace codal
      *
      * @param the value to fire against the current system_timer id.
      *
+     * @param slack the time, in milliseconds, by which the event may be delayed to combine it with other events.
+     *
      * @return DEVICE_OK or DEVICE_NOT_SUPPORTED if no timer has been registered.
      */
-    int system_timer_event_every(CODAL_TIMESTAMP period, uint16_t id, uint16_t value);
+    int system_timer_event_every(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack = 0);
 
     /**
      * Configure an event to occur after a given number of microseconds.
@@ -246,9 +457,11 @@ namespace codal
      *
      * @param the value to fire against the current system_timer id.
      *
+     * @param slack the time, in milliseconds, by which the event may be delayed to combine it with other events.
+     *
      * @return DEVICE_OK or DEVICE_NOT_SUPPORTED if no timer has been registered.
      */
-    int system_timer_event_after(CODAL_TIMESTAMP period, uint16_t id, uint16_t value);
+    int system_timer_event_after(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack = 0);
 
     /**
      * Configure an event to occur after a given number of milliseconds.
@@ -257,9 +470,11 @@ namespace codal
      *
      * @param the value to fire against the current system_timer id.
      *
+     * @param slack the time, in microseconds, by which the event may be delayed to combine it with other events.
+     *
      * @return DEVICE_OK or DEVICE_NOT_SUPPORTED if no timer has been registered.
      */
-    int system_timer_event_after_us(CODAL_TIMESTAMP period, uint16_t id, uint16_t value);
+    int system_timer_event_after_us(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack = 0);
 
     /**
       * Cancels any events matching the given id and value.
@@ -278,7 +493,7 @@ namespace codal
       *
       * If this method is not called, a less accurate timer implementation is used in system_timer_wait_us.
       *
-      * @return DEVICE_OK on success, and DEVICE_NOT_SUPPORTED if no system_timer yet exists.
+      * @return DEVICE_OK on success, and DEVICE_NOT_SUPPORTED if no system_timer yet exists, or it does not advance while spinning.
       */
     int system_timer_calibrate_cycles();
 
@@ -290,7 +505,11 @@ namespace codal
      *
      * @note the amount of cycles per iteration will vary between CPUs.
      */
+#if defined(__arm__) || defined(__thumb__)
     __attribute__((noinline, long_call, section(".data")))
+#else
+    __attribute__((noinline))
+#endif
     void system_timer_wait_cycles(uint32_t cycles);
 
     /**
@@ -0,0 +1,106 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_SIMULATED_LOW_LEVEL_TIMER_H
+#define CODAL_SIMULATED_LOW_LEVEL_TIMER_H
+
+#include "CodalConfig.h"
+#include "LowLevelTimer.h"
+
+// The maximum number of capture compare channels a SimulatedLowLevelTimer can provide.
+#ifndef SIMULATED_TIMER_MAXIMUM_CHANNELS
+#define SIMULATED_TIMER_MAXIMUM_CHANNELS        4
+#endif
+
+namespace codal
+{
+/**
+ * A LowLevelTimer implemented entirely in software, whose counter only moves when advance() is called.
+ *
+ * This allows the behaviour of a Timer (and code layered on it) to be measured deterministically,
+ * independently of any hardware: the counter width and the delay between a compare match and its
+ * interrupt being serviced are both configurable.
+ */
+class SimulatedLowLevelTimer : public LowLevelTimer
+{
+    uint32_t counter;                                           // The current counter value.
+    uint32_t mask;                                              // The range of the counter, derived from the bit mode.
+    uint32_t compare[SIMULATED_TIMER_MAXIMUM_CHANNELS];         // Capture compare values.
+    uint16_t enabledChannels;                                   // Bitmask of channels with an active compare.
+    uint16_t pendingChannels;                                   // Bitmask of channels that have matched, but not yet been serviced.
+    uint32_t pendingDelay;                                      // Ticks until pending channels are serviced.
+    uint32_t latency;                                           // Ticks between a compare match and its interrupt being serviced.
+    uint32_t interruptCount;                                    // Number of interrupts serviced.
+    bool running;
+    bool irqEnabled;
+
+    public:
+
+    /**
+     * Constructor.
+     *
+     * @param mode the width of the simulated counter.
+     *
+     * @param latency the number of ticks between a compare match and the interrupt handler being invoked.
+     *
+     * @param channels the number of capture compare channels to provide, up to SIMULATED_TIMER_MAXIMUM_CHANNELS.
+     */
+    SimulatedLowLevelTimer(TimerBitMode mode = BitMode32, uint32_t latency = 0, uint8_t channels = SIMULATED_TIMER_MAXIMUM_CHANNELS);
+
+    virtual int enable();
+    virtual int enableIRQ();
+    virtual int disable();
+    virtual int disableIRQ();
+    virtual int reset();
+    virtual int setMode(TimerMode t);
+    virtual int setCompare(uint8_t channel, uint32_t value);
+    virtual int offsetCompare(uint8_t channel, uint32_t value);
+    virtual int clearCompare(uint8_t channel);
+    virtual uint32_t captureCounter();
+    virtual int setClockSpeed(uint32_t speedKHz);
+    virtual int setBitMode(TimerBitMode t);
+
+    /**
+     * Sets the number of ticks between a compare match and its interrupt handler being invoked.
+     *
+     * @param ticks the simulated interrupt latency.
+     */
+    void setInterruptLatency(uint32_t ticks);
+
+    /**
+     * Moves the counter forward by the given number of ticks, invoking the interrupt handler
+     * for any compare matches along the way. Time does not advance while the handler runs.
+     *
+     * @param ticks the number of ticks to advance by.
+     */
+    void advance(uint32_t ticks);
+
+    /**
+     * Determines the number of times the interrupt handler has been invoked.
+     */
+    uint32_t getInterruptCount();
+};
+}
+
+#endif
@@ -0,0 +1,121 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_SIMULATED_SPIFLASH_H
+#define CODAL_SIMULATED_SPIFLASH_H
+
+#include "CodalConfig.h"
+#include "SPIFlash.h"
+
+namespace codal
+{
+/**
+ * An SPIFlash held entirely in RAM, that behaves as NOR flash does: erasing sets every byte of a row to 0xFF, and
+ * writing can only clear bits. Each operation is counted, along with any that a real part would reject or corrupt,
+ * so that code written against SPIFlash (such as FlashRecorder) can be tested deterministically without hardware.
+ *
+ * An operation can also be made to fail, to exercise error handling.
+ */
+class SimulatedSPIFlash : public SPIFlash
+{
+    uint8_t *memory;                // The contents of the flash.
+    int pages;                      // The size of the flash, in pages.
+    uint32_t reads;                 // Number of successful readBytes() calls.
+    uint32_t writes;                // Number of successful writeBytes() calls.
+    uint32_t smallRowErases;        // Number of successful eraseSmallRow() calls.
+    uint32_t bigRowErases;          // Number of successful eraseBigRow() calls.
+    uint32_t violations;            // Number of operations rejected, and bytes written without being erased first.
+    int failCountdown;              // Number of operations until one fails, or -1 if none will.
+
+    /**
+     * Counts down to a requested failure.
+     *
+     * @return true if this operation should fail.
+     */
+    bool fail();
+
+    public:
+
+    /**
+     * Constructor. The flash starts out erased.
+     *
+     * @param pages the size of the flash, in pages of SPIFLASH_PAGE_SIZE bytes. If the memory cannot be allocated,
+     * the flash has no pages.
+     */
+    SimulatedSPIFlash(int pages);
+
+    /**
+     * Destructor.
+     */
+    ~SimulatedSPIFlash();
+
+    virtual int numPages();
+    virtual int readBytes(uint32_t addr, void *buffer, uint32_t len);
+    virtual int writeBytes(uint32_t addr, const void *buffer, uint32_t len);
+    virtual int eraseSmallRow(uint32_t addr);
+    virtual int eraseBigRow(uint32_t addr);
+    virtual int eraseChip();
+
+    /**
+     * Makes a future operation fail with DEVICE_SPI_ERROR, as a bus error would.
+     *
+     * @param operations the number of operations to succeed before the failure, or -1 to cancel a pending failure.
+     */
+    void failAfter(int operations);
+
+    /**
+     * Provides direct access to the contents of the flash.
+     */
+    const uint8_t *getBytes();
+
+    /**
+     * Determines the number of successful readBytes() calls.
+     */
+    uint32_t getReadCount();
+
+    /**
+     * Determines the number of successful writeBytes() calls.
+     */
+    uint32_t getWriteCount();
+
+    /**
+     * Determines the number of successful eraseSmallRow() calls.
+     */
+    uint32_t getSmallRowEraseCount();
+
+    /**
+     * Determines the number of successful eraseBigRow() calls.
+     */
+    uint32_t getBigRowEraseCount();
+
+    /**
+     * Determines the number of operations rejected for invalid parameters, such as a write that crosses a page
+     * boundary, plus the number of bytes written to flash that had not been erased since it was last written.
+     * Correct use of the flash leaves this at zero.
+     */
+    uint32_t getViolationCount();
+};
+}
+
+#endif
@@ -0,0 +1,271 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_ACTIVITY_DETECTOR_H
+#define CODAL_ACTIVITY_DETECTOR_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+
+/**
+  * Events
+  */
+#define ACTIVITY_DETECTOR_EVT_START                 1       // Activity has been detected.
+#define ACTIVITY_DETECTOR_EVT_END                   2       // No activity has been detected for the hangover period.
+
+/**
+ * Number of octave bands used to estimate spectral flatness. Frame sizes must be a multiple of 2^ACTIVITY_DETECTOR_BANDS.
+ */
+#ifndef ACTIVITY_DETECTOR_BANDS
+#define ACTIVITY_DETECTOR_BANDS                     5
+#endif
+
+/**
+ * Default configuration values
+ */
+#define ACTIVITY_DETECTOR_DEFAULT_FRAME_SIZE        256
+#define ACTIVITY_DETECTOR_MAXIMUM_FRAME_SIZE        4096
+#define ACTIVITY_DETECTOR_DEFAULT_THRESHOLD         64      // Minimum RMS level of an active frame.
+#define ACTIVITY_DETECTOR_DEFAULT_NOISE_MARGIN      9       // dB above the noise floor of an active frame.
+#define ACTIVITY_DETECTOR_DEFAULT_ONSET             2       // Consecutive active frames needed to raise ACTIVITY_DETECTOR_EVT_START.
+#define ACTIVITY_DETECTOR_DEFAULT_HANGOVER          20      // Inactive frames needed to raise ACTIVITY_DETECTOR_EVT_END.
+
+/**
+ * Rate at which the noise floor rises through quiet frames, in 1/256ths of a bit (about 0.012 dB) per frame.
+ */
+#ifndef ACTIVITY_DETECTOR_FLOOR_RISE
+#define ACTIVITY_DETECTOR_FLOOR_RISE                4
+#endif
+
+/**
+ * Number of frames over which the DC offset estimate moves most of the way to a new offset. The mean of a single frame
+ * of a loud or low pitched sound can be far from zero, so tracking it any faster leaves a false offset behind each
+ * sound, which then reads as a loud tone.
+ */
+#ifndef ACTIVITY_DETECTOR_OFFSET_PERIOD
+#define ACTIVITY_DETECTOR_OFFSET_PERIOD             64
+#endif
+
+/**
+ * The value of a ratio of one, as returned by getZeroCrossingRate() and getFlatness().
+ */
+#define ACTIVITY_DETECTOR_UNITY                     1024
+
+namespace codal
+{
+    /**
+      * A DataSink that detects activity, such as speech or a running machine, in a stream of signed 16 bit mono samples.
+      *
+      * Samples are divided into frames, and three features are computed for each frame in integer arithmetic:
+      *
+      * - the short term energy (mean square) and RMS level, after removing any DC offset.
+      * - the zero crossing rate, the fraction of consecutive samples that differ in sign.
+      * - the spectral flatness, the ratio of the geometric to the arithmetic mean of the power spectrum. This is near
+      *   ACTIVITY_DETECTOR_UNITY for broadband noise, and near zero for tonal sounds such as voiced speech. The spectrum
+      *   is estimated with a Haar wavelet decomposition into ACTIVITY_DETECTOR_BANDS octave bands, as it is computed a
+      *   sample at a time using only adds, shifts and one multiply per band, and needs no frame buffer.
+      *
+      * A frame is active if its level is above a fixed threshold and, optionally, a margin above an adaptive noise floor,
+      * and its flatness and zero crossing rate are below their limits. ACTIVITY_DETECTOR_EVT_START is raised after a
+      * number of consecutive active frames, and ACTIVITY_DETECTOR_EVT_END once no frame has been active for the
+      * hangover period, so that brief pauses do not end the activity. These events can be used to connect expensive
+      * processing only while there is activity.
+      *
+      * The noise floor follows the level of quiet frames, falling immediately and rising slowly. It does not rise during
+      * activity, so sustained sound is not mistaken for background noise.
+      */
+    class ActivityDetector : public CodalComponent, public DataSink
+    {
+        DataSource      &upstream;
+        int             frameSize;          // Number of samples in each frame.
+        int             framePosition;      // Number of samples processed in the current frame.
+        int             sampleRate;         // Sample rate of the incoming data, in Hz.
+        uint32_t        upstreamRate;       // The sample rate last reported by our upstream component.
+        int             threshold;          // Minimum RMS level of an active frame.
+        int             noiseMargin;        // Margin above the noise floor of an active frame, in 1/256ths of a bit.
+        int             flatnessLimit;      // Maximum flatness of an active frame.
+        int             zeroCrossingLimit;  // Maximum zero crossing rate of an active frame.
+        int             onset;              // Consecutive active frames needed to start activity.
+        int             hangover;           // Inactive frames needed to end activity.
+        int             activeFrames;       // Number of consecutive active frames.
+        int             inactiveFrames;     // Number of consecutive inactive frames.
+        bool            active;             // true if activity is in progress.
+
+        int             offset;             // Estimated DC offset of the input, in 1/256ths of a sample.
+        int             offsetSum;          // Sum of the samples in the current frame.
+        int             previous;           // The last sample processed, less offset.
+        int             crossings;          // Number of zero crossings in the current frame.
+        uint64_t        energy;             // Sum of the squares of the samples in the current frame.
+        int             pending[ACTIVITY_DETECTOR_BANDS];           // The first of each pair of samples at each level of the decomposition.
+        uint64_t        bandEnergy[ACTIVITY_DETECTOR_BANDS + 1];    // Sum of the squares of the coefficients in each band.
+
+        uint32_t        frameEnergy;        // Mean square of the last complete frame.
+        int             frameLevel;         // RMS level of the last complete frame.
+        int             frameZeroCrossingRate;
+        int             frameFlatness;
+        int             noiseFloor;         // log2 of the noise floor energy, in 1/256ths, or -1 if not yet known.
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param source the component to receive data from.
+          * @param frameSize the number of samples in each frame. If this is not a valid frame size (see setFrameSize()),
+          * ACTIVITY_DETECTOR_DEFAULT_FRAME_SIZE is used instead.
+          * @param id The id to use for the message bus when transmitting events.
+          */
+        ActivityDetector(DataSource &source, int frameSize = ACTIVITY_DETECTOR_DEFAULT_FRAME_SIZE, uint16_t id = DEVICE_ID_ACTIVITY_DETECTOR);
+
+        /**
+          * Callback provided when data is ready.
+          */
+        virtual int pullRequest();
+
+        /**
+          * Changes the number of samples in each frame. Any partially processed frame is discarded.
+          *
+          * @param size the new frame size. Must be a multiple of 2^ACTIVITY_DETECTOR_BANDS, no larger than ACTIVITY_DETECTOR_MAXIMUM_FRAME_SIZE.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setFrameSize(int size);
+
+        int getFrameSize();
+
+        /**
+          * Defines the sample rate of the incoming data, used by getFrameDuration().
+          * By default, this is taken from the format of the upstream component. A rate set here holds until that format changes.
+          *
+          * @param rate the sample rate, in Hz.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setSampleRate(int rate);
+
+        /**
+          * Determines the duration of each frame, which is the unit of the onset and hangover periods.
+          *
+          * @return the duration in microseconds, or zero if the sample rate is not known.
+          */
+        int getFrameDuration();
+
+        /**
+          * Defines the minimum RMS level of an active frame.
+          *
+          * @param level the threshold, in sample units.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setThreshold(int level);
+
+        /**
+          * Defines how far above the noise floor the energy of an active frame must be.
+          *
+          * @param dB the margin, in decibels, or zero to use only the fixed threshold.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setNoiseMargin(int dB);
+
+        /**
+          * Defines the largest spectral flatness of an active frame. Lower values reject noise-like sounds, such as wind or hiss.
+          *
+          * @param flatness the limit, where ACTIVITY_DETECTOR_UNITY (the default) accepts any frame.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setFlatnessLimit(int flatness);
+
+        /**
+          * Defines the largest zero crossing rate of an active frame. Lower values reject high pitched sounds.
+          *
+          * @param rate the limit, where ACTIVITY_DETECTOR_UNITY (the default) accepts any frame.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setZeroCrossingLimit(int rate);
+
+        /**
+          * Defines the number of consecutive active frames needed to raise ACTIVITY_DETECTOR_EVT_START.
+          *
+          * @param frames the onset period, in frames.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setOnset(int frames);
+
+        /**
+          * Defines the number of consecutive inactive frames needed to raise ACTIVITY_DETECTOR_EVT_END.
+          *
+          * @param frames the hangover period, in frames.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setHangover(int frames);
+
+        /**
+          * Determines if activity is in progress.
+          */
+        bool isActive();
+
+        /**
+          * Determines the energy (mean square) of the last complete frame.
+          */
+        uint32_t getEnergy();
+
+        /**
+          * Determines the RMS level of the last complete frame.
+          */
+        int getLevel();
+
+        /**
+          * Determines the zero crossing rate of the last complete frame.
+          *
+          * @return the fraction of consecutive samples that differ in sign, where ACTIVITY_DETECTOR_UNITY is every sample.
+          */
+        int getZeroCrossingRate();
+
+        /**
+          * Determines the spectral flatness of the last complete frame.
+          *
+          * @return the flatness, from zero for a pure tone to around ACTIVITY_DETECTOR_UNITY for white noise.
+          */
+        int getFlatness();
+
+        /**
+          * Determines the RMS level of the noise floor.
+          *
+          * @return the level, or zero if no frame has been processed.
+          */
+        int getNoiseFloor();
+
+        private:
+
+        /**
+          * Computes the features of the current frame, and updates the activity state.
+          */
+        void processFrame();
+
+        /**
+          * Clears the accumulated features of the current frame.
+          */
+        void resetFrame();
+    };
+}
+
+#endif
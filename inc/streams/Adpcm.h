@@ -0,0 +1,175 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_ADPCM_H
+#define CODAL_ADPCM_H
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+
+/**
+ * The default size of an ADPCM block, in bytes. Each block holds (size - 4) * 2 + 1 samples.
+ */
+#ifndef ADPCM_BLOCK_SIZE
+#define ADPCM_BLOCK_SIZE                        256
+#endif
+
+#define ADPCM_BLOCK_HEADER_SIZE                 4
+#define ADPCM_SAMPLES_PER_BLOCK(size)           (((size) - ADPCM_BLOCK_HEADER_SIZE) * 2 + 1)
+
+namespace codal
+{
+    /**
+      * A stream component that compresses signed 16 bit mono samples to 4 bit IMA (DVI) ADPCM, reducing their size by a
+      * factor of four.
+      *
+      * Data is produced as a sequence of blocks in the layout used by IMA ADPCM WAV files. Each block starts with a four
+      * byte header (the first sample as a little endian int16_t, the step index, and a zero byte), followed by two
+      * samples per byte, low nibble first. Every block can be decoded on its own, so a lost buffer does not corrupt the
+      * ones that follow it.
+      *
+      * Each buffer provided holds a whole number of blocks, the last of which may be shorter than the block size. The
+      * buffers can therefore be stored or transmitted as they are, and given to an AdpcmDecoder in the same sizes.
+      * Use a StreamConverter upstream if the source does not provide signed 16 bit samples.
+      */
+    class AdpcmEncoder : public DataSource, public DataSink
+    {
+        DataSource      &upstream;
+        DataSink        *downStream;
+        int             blockSize;          // The size of a full block, in bytes.
+        int             index;              // Step index carried from one block to the next.
+        int16_t         carry;              // A sample held over to the next buffer, so that every block ends on a whole byte.
+        bool            hasCarry;
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param source the component to receive signed 16 bit samples from.
+          * @param blockSize the size of each block, in bytes.
+          */
+        AdpcmEncoder(DataSource &source, int blockSize = ADPCM_BLOCK_SIZE);
+
+        /**
+          * Provide the next available ManagedBuffer to our downstream caller, if available.
+          */
+        virtual ManagedBuffer pull();
+
+        /**
+          * Callback provided when data is ready.
+          */
+        virtual int pullRequest();
+
+        /**
+          * Define a downstream component for data stream.
+          *
+          * @sink The component that data will be delivered to, when it is availiable
+          */
+        virtual void connect(DataSink &sink);
+
+        /**
+          * Describes the data this component provides. ADPCM is not a PCM encoding, so the sample size is reported as
+          * unknown, with 4 significant bits per sample at the upstream sample rate. Stages that adapt to their input,
+          * such as StreamConverter, check isKnown() and so pass ADPCM data through untouched.
+          */
+        virtual DataStreamFormat getFormat();
+
+        /**
+          * Encodes one ADPCM block.
+          *
+          * @param first the first sample of the block, which is stored exactly in the header.
+          * @param samples the remaining samples of the block.
+          * @param count the number of remaining samples, which must be even.
+          * @param out the memory to write the block to, ADPCM_BLOCK_HEADER_SIZE + count / 2 bytes in length.
+          * @param index the step index to start from, updated to the one to start the next block with.
+          * @return the number of bytes written.
+          */
+        static int encodeBlock(int16_t first, const int16_t *samples, int count, uint8_t *out, int &index);
+    };
+
+    /**
+      * A stream component that decompresses IMA (DVI) ADPCM blocks, as produced by AdpcmEncoder, to signed 16 bit mono samples.
+      *
+      * Each buffer received must hold a whole number of blocks of the given block size, the last of which may be shorter.
+      */
+    class AdpcmDecoder : public DataSource, public DataSink
+    {
+        DataSource      &upstream;
+        DataSink        *downStream;
+        int             blockSize;          // The size of a full block, in bytes.
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param source the component to receive ADPCM blocks from.
+          * @param blockSize the size of each block, in bytes. This must match the block size used to encode the data.
+          */
+        AdpcmDecoder(DataSource &source, int blockSize = ADPCM_BLOCK_SIZE);
+
+        /**
+          * Provide the next available ManagedBuffer to our downstream caller, if available.
+          */
+        virtual ManagedBuffer pull();
+
+        /**
+          * Callback provided when data is ready.
+          */
+        virtual int pullRequest();
+
+        /**
+          * Define a downstream component for data stream.
+          *
+          * @sink The component that data will be delivered to, when it is availiable
+          */
+        virtual void connect(DataSink &sink);
+
+        /**
+          * Describes the data this component provides: signed 16 bit mono samples at the upstream sample rate.
+          */
+        virtual DataStreamFormat getFormat();
+
+        /**
+          * Determines the number of samples held in a run of ADPCM data.
+          *
+          * @param length the length of the data, in bytes.
+          * @param blockSize the size of each block, in bytes.
+          */
+        static int sampleCount(int length, int blockSize = ADPCM_BLOCK_SIZE);
+
+        /**
+          * Decodes one ADPCM block.
+          *
+          * @param in the block to decode.
+          * @param length the length of the block, in bytes. Blocks shorter than ADPCM_BLOCK_HEADER_SIZE hold no samples.
+          * @param out the memory to write samples to, which must have space for ADPCM_SAMPLES_PER_BLOCK(length) samples.
+          * @return the number of samples written.
+          */
+        static int decodeBlock(const uint8_t *in, int length, int16_t *out);
+    };
+}
+
+#endif
@@ -32,6 +32,55 @@ DEALINGS IN THE SOFTWARE.
 
 namespace codal
 {
+    /**
+     * Describes the content of the buffers flowing through a stream.
+     * Samples are held little endian in containers of sampleSize bytes, of which the low sampleBits bits are significant.
+     * Unsigned samples are centred on 2^(sampleBits-1). Multi channel data is interleaved.
+     * A sampleSize, channels or sampleRate of zero indicates that property is unknown.
+     */
+    struct DataStreamFormat
+    {
+        uint8_t     sampleSize;         // Number of bytes used to hold each sample (1, 2 or 4).
+        uint8_t     sampleBits;         // Number of significant bits in each sample.
+        bool        isSigned;           // true if samples are two's complement, false if they are offset binary.
+        uint8_t     channels;           // Number of interleaved channels.
+        uint32_t    sampleRate;         // Samples per second, per channel.
+
+        DataStreamFormat(uint8_t sampleSize = 0, uint8_t sampleBits = 0, bool isSigned = true, uint8_t channels = 1, uint32_t sampleRate = 0)
+        {
+            this->sampleSize = sampleSize;
+            this->sampleBits = sampleBits ? sampleBits : sampleSize * 8;
+            this->isSigned = isSigned;
+            this->channels = channels;
+            this->sampleRate = sampleRate;
+        }
+
+        /**
+         * Determines if the sample encoding of this format is known.
+         */
+        bool isKnown() const
+        {
+            return sampleSize != 0;
+        }
+
+        /**
+         * Determines if samples in this format can be used as samples in the given format without conversion.
+         */
+        bool sameEncoding(const DataStreamFormat &other) const
+        {
+            return sampleSize == other.sampleSize && sampleBits == other.sampleBits && isSigned == other.isSigned;
+        }
+
+        /**
+         * Determines if samples in this format can be read directly as int16_t values.
+         * An unknown format is assumed to be, as that is what sources that do not describe themselves have always provided.
+         */
+        bool isInt16() const
+        {
+            return !isKnown() || (sampleSize == 2 && isSigned);
+        }
+    };
+
     /**
      * Interface definition for a DataSource.
      */
@@ -51,6 +100,14 @@ namespace codal
 
     	virtual ManagedBuffer pull();
     	virtual void connect(DataSink &sink);
+
+        /**
+         * Describes the data this source provides. Sinks should call this when they connect, and
+         * adapt to (or insert a StreamConverter for) the format given, rather than assuming one.
+         *
+         * @return the format of the buffers returned by pull(). The default implementation returns an unknown format.
+         */
+        virtual DataStreamFormat getFormat();
     };
 
     /**
@@ -177,6 +234,11 @@ namespace codal
     	 */
     	virtual int pullRequest();
 
+        /**
+         * Describes the data this stream provides, which is the data provided by its upstream component.
+         */
+        virtual DataStreamFormat getFormat();
+
         private:
         /**
          * Issue a deferred pull request to our downstream component, if one has been registered.
@@ -0,0 +1,163 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_FFT_ANALYSER_H
+#define CODAL_FFT_ANALYSER_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+
+/**
+  * Events
+  */
+#define FFT_ANALYSER_EVT_PEAK                       1       // The dominant frequency has changed, and is above the peak threshold.
+
+/**
+ * Default configuration values
+ */
+#define FFT_ANALYSER_DEFAULT_FRAME_SIZE             256
+#define FFT_ANALYSER_MINIMUM_FRAME_SIZE             16
+#define FFT_ANALYSER_MAXIMUM_FRAME_SIZE             2048
+#define FFT_ANALYSER_DEFAULT_PEAK_THRESHOLD         64
+
+namespace codal
+{
+    /**
+      * A DataSink that computes the frequency spectrum of a stream of signed 16 bit mono samples.
+      *
+      * Samples are gathered into frames of a configurable, power of two size. Each frame has a Hann window applied and is
+      * transformed with a fixed point (Q15) radix-2 real FFT, yielding frameSize / 2 magnitude bins. An FFT_ANALYSER_EVT_PEAK
+      * event is raised whenever the strongest bin changes while above a threshold.
+      *
+      * All storage is allocated when the frame size is set, so no memory is allocated as frames are processed.
+      */
+    class FFTAnalyser : public CodalComponent, public DataSink
+    {
+        DataSource      &upstream;
+        int             frameSize;          // Number of samples in each frame (a power of two).
+        int             framePosition;      // Number of samples gathered into the current frame.
+        int             sampleRate;         // Sample rate of the incoming data, in Hz.
+        uint32_t        upstreamRate;       // The sample rate last reported by our upstream component.
+        int             peakThreshold;      // Minimum magnitude of a peak that raises an event.
+        int             peakBin;            // Index of the strongest bin in the last frame.
+        int             lastPeakBin;        // The peak bin last reported by an event.
+        int16_t         *frame;             // Samples gathered for the current frame.
+        int16_t         *window;            // Q15 window coefficients.
+        uint32_t        *work;              // The frame as packed complex Q15 values (real in the low halfword).
+        uint32_t        *twiddles;          // frameSize / 2 packed complex Q15 twiddle factors.
+        uint16_t        *magnitudes;        // Magnitude of each frequency bin in the last frame.
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param source the component to receive data from.
+          * @param frameSize the number of samples to analyse at a time. Must be a power of two.
+          * @param id The id to use for the message bus when transmitting events.
+          */
+        FFTAnalyser(DataSource &source, int frameSize = FFT_ANALYSER_DEFAULT_FRAME_SIZE, uint16_t id = DEVICE_ID_FFT_ANALYSER);
+
+        /**
+          * Destructor.
+          */
+        ~FFTAnalyser();
+
+        /**
+          * Callback provided when data is ready.
+          */
+        virtual int pullRequest();
+
+        /**
+          * Changes the number of samples analysed at a time. Any partially gathered frame is discarded.
+          *
+          * @param size the new frame size. Must be a power of two between FFT_ANALYSER_MINIMUM_FRAME_SIZE and FFT_ANALYSER_MAXIMUM_FRAME_SIZE.
+          * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the size is not supported, or DEVICE_NO_RESOURCES.
+          */
+        int setFrameSize(int size);
+
+        int getFrameSize();
+
+        /**
+          * Defines the sample rate of the incoming data, used to convert bins to frequencies.
+          * By default, this is taken from the format of the upstream component. A rate set here holds until that format changes.
+          *
+          * @param rate the sample rate, in Hz.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setSampleRate(int rate);
+
+        /**
+          * Defines the smallest peak magnitude that will raise an FFT_ANALYSER_EVT_PEAK event.
+          *
+          * @param threshold the minimum magnitude.
+          * @return DEVICE_OK.
+          */
+        int setPeakThreshold(int threshold);
+
+        /**
+          * Determines the number of frequency bins produced for each frame (half the frame size).
+          */
+        int getBinCount();
+
+        /**
+          * Provides the magnitudes computed for the last complete frame. Bin n covers frequencies around n * sampleRate / frameSize.
+          * The data is overwritten as each new frame completes. A sine wave centred on a bin gives that bin a magnitude of
+          * half the wave's amplitude.
+          *
+          * @return a pointer to getBinCount() magnitudes.
+          */
+        const uint16_t *getMagnitudes();
+
+        /**
+          * Determines the magnitude of a single bin in the last complete frame.
+          *
+          * @param bin the index of the bin.
+          * @return the magnitude, or DEVICE_INVALID_PARAMETER.
+          */
+        int getMagnitude(int bin);
+
+        /**
+          * Determines the centre frequency of the strongest bin (ignoring DC) in the last complete frame.
+          *
+          * @return the frequency, in Hz, or zero if the sample rate is not known.
+          */
+        int getPeakFrequency();
+
+        /**
+          * Determines the magnitude of the strongest bin (ignoring DC) in the last complete frame.
+          */
+        int getPeakMagnitude();
+
+        private:
+
+        /**
+          * Transforms the current frame, and updates the magnitudes and peak.
+          */
+        void processFrame();
+    };
+}
+
+#endif
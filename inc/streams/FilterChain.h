@@ -0,0 +1,253 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_FILTER_CHAIN_H
+#define CODAL_FILTER_CHAIN_H
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+
+/**
+ * The largest number of biquad stages a FilterChain can hold.
+ */
+#ifndef FILTER_CHAIN_MAXIMUM_STAGES
+#define FILTER_CHAIN_MAXIMUM_STAGES             4
+#endif
+
+#define FILTER_CHAIN_DEFAULT_Q                  0.7071f     // Butterworth response.
+
+#define BIQUAD_A_WEIGHTING_SECTIONS             3
+#define BIQUAD_C_WEIGHTING_SECTIONS             2
+
+namespace codal
+{
+    /**
+      * The arithmetic used to compute a biquad stage.
+      */
+    enum BiquadPrecision
+    {
+        BiquadQ15 = 0,          // 16 bit coefficients and state. Fastest, but too coarse for cutoffs far below the sample rate.
+        BiquadQ31               // 32 bit coefficients and state, with a 64 bit accumulator.
+    };
+
+    /**
+      * The coefficients of a biquad filter section, normalised so that a0 is one:
+      *
+      * y[n] = b0 * x[n] + b1 * x[n-1] + b2 * x[n-2] - a1 * y[n-1] - a2 * y[n-2]
+      *
+      * Each coefficient must lie in the range (-2, 2). The static design methods follow the widely used "Audio EQ Cookbook"
+      * formulae, and are intended to be called when a filter is configured rather than per sample.
+      */
+    struct BiquadCoefficients
+    {
+        float b0, b1, b2, a1, a2;
+
+        /**
+          * Constructor. Creates a filter that passes its input unchanged.
+          */
+        BiquadCoefficients(float b0 = 1.0f, float b1 = 0.0f, float b2 = 0.0f, float a1 = 0.0f, float a2 = 0.0f);
+
+        /**
+          * Designs a second order low pass filter.
+          *
+          * @param sampleRate the sample rate of the data to be filtered, in Hz.
+          * @param cutoff the frequency at which the response falls away, in Hz.
+          * @param q the quality factor of the filter.
+          */
+        static BiquadCoefficients lowPass(int sampleRate, float cutoff, float q = FILTER_CHAIN_DEFAULT_Q);
+
+        /**
+          * Designs a second order high pass filter.
+          *
+          * @param sampleRate the sample rate of the data to be filtered, in Hz.
+          * @param cutoff the frequency at which the response falls away, in Hz.
+          * @param q the quality factor of the filter.
+          */
+        static BiquadCoefficients highPass(int sampleRate, float cutoff, float q = FILTER_CHAIN_DEFAULT_Q);
+
+        /**
+          * Designs a band pass filter, with unity gain at its centre frequency.
+          *
+          * @param sampleRate the sample rate of the data to be filtered, in Hz.
+          * @param centre the frequency to pass, in Hz.
+          * @param q the quality factor of the filter. Higher values give a narrower band.
+          */
+        static BiquadCoefficients bandPass(int sampleRate, float centre, float q = FILTER_CHAIN_DEFAULT_Q);
+
+        /**
+          * Designs a notch filter, which removes a narrow band of frequencies.
+          *
+          * @param sampleRate the sample rate of the data to be filtered, in Hz.
+          * @param centre the frequency to remove, in Hz.
+          * @param q the quality factor of the filter. Higher values give a narrower notch.
+          */
+        static BiquadCoefficients notch(int sampleRate, float centre, float q = FILTER_CHAIN_DEFAULT_Q);
+
+        /**
+          * Designs a first order filter that removes any DC offset.
+          *
+          * @param sampleRate the sample rate of the data to be filtered, in Hz.
+          * @param cutoff the frequency below which the signal is attenuated, in Hz.
+          */
+        static BiquadCoefficients dcBlock(int sampleRate, float cutoff);
+
+        /**
+          * Designs the IEC 61672 A frequency weighting used for sound level measurement, normalised to unity gain at 1kHz.
+          *
+          * @param sampleRate the sample rate of the data to be filtered, in Hz.
+          * @param sections storage for the BIQUAD_A_WEIGHTING_SECTIONS sections of the filter, to be applied in order.
+          * @return the number of sections written.
+          */
+        static int aWeighting(int sampleRate, BiquadCoefficients *sections);
+
+        /**
+          * Designs the IEC 61672 C frequency weighting used for sound level measurement, normalised to unity gain at 1kHz.
+          *
+          * @param sampleRate the sample rate of the data to be filtered, in Hz.
+          * @param sections storage for the BIQUAD_C_WEIGHTING_SECTIONS sections of the filter, to be applied in order.
+          * @return the number of sections written.
+          */
+        static int cWeighting(int sampleRate, BiquadCoefficients *sections);
+    };
+
+    /**
+      * A single biquad section in fixed point form, holding its coefficients and history.
+      */
+    struct BiquadStage
+    {
+        BiquadPrecision precision;
+        int32_t         coefficients[5];    // b0, b1, b2, -a1, -a2. Q14 for Q15 stages, Q30 for Q31 stages.
+        int32_t         state[4];           // x[n-1], x[n-2], y[n-1], y[n-2].
+
+        /**
+          * Converts a set of coefficients into the fixed point form used by this stage. The history is left unchanged.
+          *
+          * @param coefficients the filter to apply.
+          * @param precision the arithmetic to use.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if any coefficient is out of range.
+          */
+        int configure(const BiquadCoefficients &coefficients, BiquadPrecision precision);
+
+        /**
+          * Filters a block of samples in place.
+          *
+          * @param data the samples to filter.
+          * @param samples the number of samples.
+          */
+        void process(int16_t *data, int samples);
+
+        /**
+          * Clears the history of the stage, as if it had only ever seen silence.
+          */
+        void reset();
+    };
+
+    /**
+      * A stream component that filters signed 16 bit samples through a cascade of biquad (second order IIR) sections.
+      *
+      * Buffers are filtered in place as they are pulled, and no memory is allocated once the chain is configured. Stages may
+      * be added or their coefficients changed at any time, including while data is flowing.
+      */
+    class FilterChain : public DataSource, public DataSink
+    {
+        DataSource          &upstream;
+        DataSink            *downStream;
+        BiquadStage         stages[FILTER_CHAIN_MAXIMUM_STAGES];
+        int                 stageCount;
+
+        public:
+
+        /**
+          * Constructor. Creates a chain with no stages, which passes its input unchanged.
+          *
+          * @param source the component to receive data from.
+          */
+        FilterChain(DataSource &source);
+
+        /**
+          * Destructor.
+          */
+        ~FilterChain();
+
+        /**
+          * Appends a stage to the end of the chain.
+          *
+          * @param coefficients the filter to apply.
+          * @param precision the arithmetic to use for this stage.
+          * @return the index of the new stage on success, DEVICE_INVALID_PARAMETER if the coefficients are out of range,
+          * or DEVICE_NO_RESOURCES if the chain already has FILTER_CHAIN_MAXIMUM_STAGES stages.
+          */
+        int addStage(const BiquadCoefficients &coefficients, BiquadPrecision precision = BiquadQ31);
+
+        /**
+          * Replaces the coefficients of an existing stage. The history of the stage is kept if its precision is unchanged,
+          * so that filters can be retuned while running without a discontinuity.
+          *
+          * @param stage the index of the stage to update.
+          * @param coefficients the filter to apply.
+          * @param precision the arithmetic to use for this stage.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the stage does not exist or the coefficients are out of range.
+          */
+        int setStage(int stage, const BiquadCoefficients &coefficients, BiquadPrecision precision = BiquadQ31);
+
+        /**
+          * Removes all stages from the chain.
+          */
+        void clear();
+
+        /**
+          * Clears the history of every stage, as if the chain had only ever seen silence.
+          */
+        void reset();
+
+        /**
+          * Determines the number of stages in the chain.
+          */
+        int getStageCount();
+
+        /**
+          * Provide the next available ManagedBuffer to our downstream caller, filtered by each stage in turn.
+          */
+        virtual ManagedBuffer pull();
+
+        /**
+          * Callback provided when data is ready.
+          */
+        virtual int pullRequest();
+
+        /**
+          * Define a downstream component for data stream.
+          *
+          * @sink The component that data will be delivered to, when it is availiable
+          */
+        virtual void connect(DataSink &sink);
+
+        /**
+          * Describes the data this component provides.
+          */
+        virtual DataStreamFormat getFormat();
+    };
+}
+
+#endif
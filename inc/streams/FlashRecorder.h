@@ -0,0 +1,191 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_FLASH_RECORDER_H
+#define CODAL_FLASH_RECORDER_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+#include "SPIFlash.h"
+
+/**
+  * Events
+  */
+#define FLASH_RECORDER_EVT_FULL                     1       // Recording stopped because the flash region is full.
+#define FLASH_RECORDER_EVT_ERROR                    2       // Recording stopped because the flash reported an error.
+
+/**
+ * The default size of each of the two buffers data is gathered into before it is written. Must be a multiple of SPIFLASH_PAGE_SIZE.
+ */
+#ifndef FLASH_RECORDER_CHUNK_SIZE
+#define FLASH_RECORDER_CHUNK_SIZE                   1024
+#endif
+
+/**
+ * The default distance, in bytes, that the recorder erases ahead of the data it has written.
+ */
+#ifndef FLASH_RECORDER_ERASE_AHEAD
+#define FLASH_RECORDER_ERASE_AHEAD                  (2 * SPIFLASH_SMALL_ROW_SIZE)
+#endif
+
+namespace codal
+{
+    /**
+      * A DataSink that records a stream to a region of SPI flash, such as a StandardSPIFlash.
+      *
+      * Incoming buffers are copied into one of two page aligned chunks. When a chunk is full, a writer fiber programs it
+      * into flash a page at a time while the other chunk fills. Whenever the writer has nothing to write, it erases the
+      * rows ahead of the data, so that erasing rarely delays a write. If both chunks are full when a buffer arrives,
+      * that buffer is dropped and counted, rather than blocking the upstream component.
+      *
+      * Rows are erased with eraseSmallRow(), unless the erase ahead distance is at least SPIFLASH_BIG_ROW_SIZE, in which
+      * case aligned 64k rows are erased with eraseBigRow(). Big rows take fewer commands per byte, but each erase takes
+      * longer, so the chunks must be large enough to absorb the delay.
+      */
+    class FlashRecorder : public CodalComponent, public DataSink
+    {
+        DataSource      &upstream;
+        SPIFlash        &flash;
+        uint32_t        start;              // Flash address of the start of the region.
+        uint32_t        end;                // Flash address of the end of the region.
+        uint32_t        writeAddress;       // Flash address the next chunk will be written to.
+        uint32_t        erased;             // Flash address up to which the region has been erased.
+        uint32_t        accepted;           // Number of bytes accepted from upstream.
+        uint32_t        written;            // Number of bytes written to flash.
+        uint32_t        dropped;            // Number of buffers dropped because both chunks were full.
+        uint32_t        eraseAhead;         // Distance to erase ahead of writeAddress, in bytes.
+        CODAL_TIMESTAMP startTime;          // Time at which recording started, in ms.
+        CODAL_TIMESTAMP stopTime;           // Time at which the writer finished, in ms.
+        uint8_t         *chunks;            // Two chunks of chunkSize bytes.
+        int             chunkSize;
+        int             filling;            // Index of the chunk being filled.
+        int             fillLength;         // Number of bytes in the chunk being filled.
+        volatile int    ready;              // Index of the chunk waiting to be written, or -1.
+        uint16_t        eventCode;          // Notify event used to wake the writer.
+        volatile bool   recording;          // true if incoming data is being recorded.
+        bool            active;             // true if the writer fiber is running.
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param source the component to receive data from.
+          * @param flash the flash memory to record to.
+          * @param start the flash address of the region to record into. Must be a multiple of SPIFLASH_SMALL_ROW_SIZE.
+          * @param length the length of the region, in bytes. Must be a multiple of SPIFLASH_SMALL_ROW_SIZE.
+          * @param chunkSize the size of each of the two buffers that data is gathered into. Must be a multiple of SPIFLASH_PAGE_SIZE,
+          * and should be larger than the buffers provided by the source.
+          * @param id The id to use for the message bus when transmitting events.
+          */
+        FlashRecorder(DataSource &source, SPIFlash &flash, uint32_t start, uint32_t length, int chunkSize = FLASH_RECORDER_CHUNK_SIZE, uint16_t id = DEVICE_ID_FLASH_RECORDER);
+
+        /**
+          * Destructor. If a recording is still being written, recording stops and the destructor blocks until the data
+          * already received has been written to flash, as the writer fiber uses this object until then.
+          */
+        ~FlashRecorder();
+
+        /**
+          * Starts recording at the start of the region, overwriting anything already recorded.
+          *
+          * @return DEVICE_OK on success, DEVICE_BUSY if a recording is still being written, DEVICE_INVALID_PARAMETER if the region
+          * or chunk size is not correctly aligned or does not lie within the flash, or DEVICE_NO_RESOURCES if there is insufficient memory.
+          */
+        int record();
+
+        /**
+          * Stops recording. Data already received is still written to flash, which completes in the background.
+          */
+        void stop();
+
+        /**
+          * Determines if incoming data is being recorded.
+          */
+        bool isRecording();
+
+        /**
+          * Determines if data is still being written to flash. Once this returns false, getLength() bytes have been written.
+          */
+        bool isWriting();
+
+        /**
+          * Defines how far ahead of the recorded data the region is erased.
+          *
+          * @param bytes the distance, in bytes. Values of SPIFLASH_BIG_ROW_SIZE or more allow 64k rows to be erased at a time.
+          */
+        void setEraseAhead(uint32_t bytes);
+
+        /**
+          * Determines the number of bytes recorded.
+          */
+        uint32_t getLength();
+
+        /**
+          * Determines the number of bytes written to flash so far.
+          */
+        uint32_t getBytesWritten();
+
+        /**
+          * Determines the number of buffers dropped because the flash could not keep up.
+          */
+        uint32_t getDropCount();
+
+        /**
+          * Determines the rate at which data has been written to flash since recording started, in bytes per second.
+          */
+        uint32_t getThroughput();
+
+        /**
+          * Callback provided when data is ready.
+          */
+        virtual int pullRequest();
+
+        /**
+          * Writes chunks to flash and erases ahead until recording stops and every chunk has been written.
+          * This is run in its own fiber, started by record().
+          */
+        void writer();
+
+        private:
+
+        /**
+          * Erases the next row of the region.
+          */
+        int eraseRow();
+
+        /**
+          * Writes data to flash at writeAddress a page at a time, erasing first if necessary.
+          */
+        int write(const uint8_t *data, int length);
+
+        /**
+          * Ends recording, raising the given event.
+          */
+        void abort(int event);
+    };
+}
+
+#endif
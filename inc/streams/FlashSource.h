@@ -0,0 +1,123 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_FLASH_SOURCE_H
+#define CODAL_FLASH_SOURCE_H
+
+#include "CodalConfig.h"
+#include "MemorySource.h"
+#include "SPIFlash.h"
+
+/**
+ * The number of bytes of 8 or 16 bit sample data read from flash at a time.
+ */
+#ifndef FLASH_SOURCE_CHUNK_SIZE
+#define FLASH_SOURCE_CHUNK_SIZE                 MEMORY_SOURCE_MAX_BUFFER
+#endif
+
+namespace codal
+{
+    /**
+      * A MemorySource that plays samples held in external SPI flash, such as a StandardSPIFlash, rather than in
+      * addressable memory.
+      *
+      * Samples are read a chunk at a time, only as the output stream has room for them. While one chunk is played
+      * downstream and the next waits in the output stream, the playing fiber reads the one after, so clips of any
+      * length play with a small, fixed amount of RAM. Samples are converted in exactly the same way as MemorySource.
+      */
+    class FlashSource : public MemorySource
+    {
+        SPIFlash        &flash;
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param flash the flash memory to read samples from.
+          * @param maximumValue the upper bound for samples in the 16 bit output stream.
+          */
+        FlashSource(SPIFlash &flash, int maximumValue = 256);
+
+        /**
+          * Samples held in memory can still be played with the play() methods of MemorySource.
+          */
+        using MemorySource::play;
+
+        /**
+          * Perform a blocking playout of 8 bit samples held in flash. Samples are upscaled to 16 bit.
+          * Returns when all the data has been queued, or when stop() is called.
+          *
+          * A literal address of zero must be given as 0u, as 0 could also be a null pointer to samples in memory.
+          *
+          * @param address the flash address of the first sample.
+          * @param length number of bytes to stream.
+          * @param loop repeat playback of the samples when completed the given number of times. Set to zero to repeat forever.
+          * @param expand repeat each input sample the given number of times in the output stream.
+          * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if there are no samples or they do not lie within the flash, or the error reported by the flash.
+          */
+        int play(uint32_t address, int length, int loop = 1, int expand = 1);
+
+        /**
+          * Perform a blocking playout of little endian 16 bit samples held in flash.
+          * Returns when all the data has been queued, or when stop() is called.
+          *
+          * @param address the flash address of the first sample.
+          * @param length number of 16 bit words to stream.
+          * @param loop repeat playback of the samples when completed the given number of times. Set to zero to repeat forever.
+          * @param expand repeat each input sample the given number of times in the output stream.
+          * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if there are no samples or they do not lie within the flash, or the error reported by the flash.
+          */
+        int play16(uint32_t address, int length, int loop = 1, int expand = 1);
+
+        /**
+          * Perform a blocking playout of IMA ADPCM data held in flash, as produced by AdpcmEncoder, reading and decoding
+          * one block at a time. Returns when all the data has been queued, or when stop() is called.
+          *
+          * @param address the flash address of the first block.
+          * @param length number of bytes to stream.
+          * @param loop repeat playback of the data when completed the given number of times. Set to zero to repeat forever.
+          * @param expand repeat each input sample the given number of times in the output stream.
+          * @param blockSize the size of each ADPCM block in the data, in bytes.
+          * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if there is not a whole block header or the data does not lie within the flash, or the error reported by the flash.
+          */
+        int playAdpcm(uint32_t address, int length, int loop = 1, int expand = 1, int blockSize = ADPCM_BLOCK_SIZE);
+
+        private:
+
+        /**
+          * Reads samples from flash a chunk at a time and queues them, until all the data has been queued or stop() is called.
+          *
+          * @param address the flash address of the data.
+          * @param length the length of the data, in bytes.
+          * @param chunkSize the number of bytes to read at a time.
+          * @param loop repeat playback of the data when completed the given number of times. Set to zero to repeat forever.
+          * @param expand repeat each input sample the given number of times in the output stream.
+          * @param sampleSize 1 or 2 for 8 or 16 bit samples, or 0 for ADPCM blocks.
+          */
+        int stream(uint32_t address, int length, int chunkSize, int loop, int expand, int sampleSize);
+    };
+}
+
+#endif
@@ -24,6 +24,7 @@ DEALINGS IN THE SOFTWARE.
 
 #include "CodalConfig.h"
 #include "DataStream.h"
+#include "FilterChain.h"
 
 #ifndef LEVEL_DETECTOR_SPL_H
 #define LEVEL_DETECTOR_SPL_H
@@ -39,6 +40,23 @@ DEALINGS IN THE SOFTWARE.
  * Default configuration values
  */
 #define LEVEL_DETECTOR_SPL_DEFAULT_WINDOW_SIZE              128
+#define LEVEL_DETECTOR_SPL_DEFAULT_SAMPLE_RATE              11000
+#define LEVEL_DETECTOR_SPL_MAXIMUM_WINDOW_SIZE              32768   // Keeps the window's 64 bit sums from overflowing.
+
+/**
+ * Frequency weightings
+ */
+#define LEVEL_DETECTOR_SPL_WEIGHTING_Z                      0       // No weighting.
+#define LEVEL_DETECTOR_SPL_WEIGHTING_A                      1
+#define LEVEL_DETECTOR_SPL_WEIGHTING_C                      2
+
+/**
+ * Time weightings, in milliseconds
+ */
+#define LEVEL_DETECTOR_SPL_TIME_WINDOW                      0       // Each window is measured independently.
+#define LEVEL_DETECTOR_SPL_TIME_FAST                        125
+#define LEVEL_DETECTOR_SPL_TIME_SLOW                        1000
+#define LEVEL_DETECTOR_SPL_TIME_LEQ                         -1      // The equivalent continuous level since the time weighting was set.
 
 namespace codal{
     class LevelDetectorSPL : public CodalComponent, public DataSink
@@ -51,10 +69,26 @@ namespace codal{
         float           lowThreshold;       // threshold at which a LOW event is generated
         int             windowSize;         // The number of samples the make up a level detection window.
         float           level;              // The current, instantaneous level.
-        int             sigma;              // Running total of the samples in the current window.
+        int64_t         sigma;              // Running total of the samples in the current window.
+        uint64_t        sigmaSquared;       // Running total of the squares of the samples in the current window.
+        int             windowPosition;     // Number of samples gathered into the current window.
         float           gain;
         float           minValue;
 
+        int             sampleRate;         // Sample rate of the incoming data, in Hz.
+        uint32_t        upstreamRate;       // The sample rate last reported by our upstream component.
+        int             weighting;          // The frequency weighting in use. One of the LEVEL_DETECTOR_SPL_WEIGHTING_ values.
+        int             weightingStages;    // The number of filter stages used by the frequency weighting.
+        BiquadStage     weightingFilter[BIQUAD_A_WEIGHTING_SECTIONS];
+        int             timeConstant;       // The time weighting in use, in milliseconds, or LEVEL_DETECTOR_SPL_TIME_LEQ.
+        uint32_t        smoothing;          // Q16 proportion of each new window blended into the time weighted energy.
+        uint64_t        energy;             // Time weighted mean square of the samples, in Q16.
+        uint32_t        windows;            // The number of windows that contributed to energy, when computing Leq.
+        int32_t         levelQ8;            // The current level, in 1/256 dB.
+        int32_t         offsetQ8;           // The level of a full scale signal, in 1/256 dB.
+        int32_t         highThresholdQ8;
+        int32_t         lowThresholdQ8;
+
 
         /**
           * Creates a component capable of measuring and thresholding stream data
@@ -125,11 +159,53 @@ namespace codal{
 
         int setGain(float gain);
 
+        /**
+         * Defines the sample rate of the incoming data, used to design the weighting filters and time constants.
+         * By default, this is taken from the format of the upstream component. A rate set here holds until that format changes.
+         *
+         * @param rate the sample rate, in Hz.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the request fails.
+         */
+        int setSampleRate(int rate);
+
+        /**
+         * Selects the frequency weighting applied before the level is measured.
+         *
+         * @param weighting One of LEVEL_DETECTOR_SPL_WEIGHTING_Z (none), LEVEL_DETECTOR_SPL_WEIGHTING_A or LEVEL_DETECTOR_SPL_WEIGHTING_C.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the request fails.
+         */
+        int setWeighting(int weighting);
+
+        /**
+         * Selects how the level is averaged over time.
+         *
+         * @param ms The time constant of an exponential average, in milliseconds (such as LEVEL_DETECTOR_SPL_TIME_FAST or
+         * LEVEL_DETECTOR_SPL_TIME_SLOW), LEVEL_DETECTOR_SPL_TIME_WINDOW to measure each window independently, or
+         * LEVEL_DETECTOR_SPL_TIME_LEQ to average all windows equally from now on.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the request fails.
+         */
+        int setTimeConstant(int ms);
+
         /**
          * Destructor.
          */
         ~LevelDetectorSPL();
 
+    private:
+
+        /**
+         * Recomputes the filters and constants that depend on the sample rate, window size and weightings.
+         */
+        void configure();
+
+        /**
+         * Completes a window, updating the level and raising any threshold events.
+         */
+        void processWindow();
+
     };
 }
 
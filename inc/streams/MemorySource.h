@@ -1,5 +1,6 @@
 #include "CodalConfig.h"
 #include "DataStream.h"
+#include "Adpcm.h"
 
 #ifndef MEMORY_SOURCE_H
 #define MEMORY_SOURCE_H
@@ -13,13 +14,14 @@ namespace codal
 {
     class MemorySource : public DataSource
     {
-        private:
+        protected:
         int bytesSent;
         ManagedBuffer buffer;
         bool loop;
 
         int maximumValue;
         int scalar;
+        bool stopping;          // true if the current playout has been asked to stop.
 
         public:
         DataStream output;
@@ -35,30 +37,80 @@ namespace codal
         virtual ManagedBuffer pull();
 
         /**
-         * Perform a blocking playout of the data buffer. Returns when all the data has been queued.
-         * (or never if loop is set).
+         * Describes the data this source provides: unsigned samples in 16 bit words, no greater than the maximum sample value.
+         */
+        virtual DataStreamFormat getFormat();
+
+        /**
+         * Perform a blocking playout of the data buffer. Returns when all the data has been queued, or when stop() is called.
+         * Returns immediately if there are no samples to play.
          * @param data pointer to memory location to playout
          * @param length number of bytes to stream
-         * @param loop if repeat playback of buffer when completed the given number of times
+         * @param loop if repeat playback of buffer when completed the given number of times. Set to zero to repeat until stop() is called.
          * @param expand repeat each input sample the given number of times in the output stream.
          */
         void play(const uint8_t *data, int length, int loop = 1, int expand = 1);
 
         /**
          * Perform a 16 bit blocking playout of a 16 bit data buffer. 
-         * Returns when all the data has been queued.
+         * Returns when all the data has been queued, or when stop() is called, or immediately if there are no samples to play.
          * @param data pointer to memory location to playout.
          * @param length number of 16 bit words to stream.
-         * @param loop  repeat playback of buffer when completed the given number of times. Set to zero to repeat forever.
+         * @param loop  repeat playback of buffer when completed the given number of times. Set to zero to repeat until stop() is called.
          * @param expand repeat each input sample the given number of times in the output stream.
          */
         void play(const uint16_t *data, int length, int loop = 1, int expand = 1);
 
+        /**
+         * Perform a blocking playout of IMA ADPCM data, as produced by AdpcmEncoder, decoding one block per buffer.
+         * Samples are scaled from signed 16 bit to the range 0..maximum sample value.
+         * Returns when all the data has been queued, or when stop() is called, or immediately if there is not a whole block header to play.
+         * @param data pointer to memory location to playout.
+         * @param length number of bytes to stream.
+         * @param loop  repeat playback of buffer when completed the given number of times. Set to zero to repeat until stop() is called.
+         * @param expand repeat each input sample the given number of times in the output stream.
+         * @param blockSize the size of each ADPCM block in the data, in bytes.
+         */
+        void playAdpcm(const uint8_t *data, int length, int loop = 1, int expand = 1, int blockSize = ADPCM_BLOCK_SIZE);
+
+        /**
+         * Ends the current playout once the buffer being queued has been queued. Buffers already queued still play.
+         * This is the only way to end a playout that repeats forever, so call it from another fiber or an event handler.
+         */
+        void stop();
+
         /**
          * Define the upper bound for samples in the 16 bit stream
          */
         void setMaximumSampleValue(int maximum);
 
+        protected:
+
+        /**
+         * Converts a run of 8 bit samples, scaled to the maximum sample value, into a new buffer and queues it on the output stream.
+         * @param data pointer to the samples.
+         * @param size number of samples.
+         * @param expand repeat each input sample the given number of times in the output stream.
+         */
+        void queue(const uint8_t *data, int size, int expand);
+
+        /**
+         * Converts a run of 16 bit samples, limited to the maximum sample value, into a new buffer and queues it on the output stream.
+         * @param data pointer to the samples.
+         * @param size number of samples.
+         * @param expand repeat each input sample the given number of times in the output stream.
+         */
+        void queue(const uint16_t *data, int size, int expand);
+
+        /**
+         * Decodes an IMA ADPCM block, scaled from signed 16 bit to the range 0..maximum sample value, into a new buffer
+         * and queues it on the output stream.
+         * @param data pointer to the block.
+         * @param size length of the block, in bytes.
+         * @param expand repeat each input sample the given number of times in the output stream.
+         */
+        void queueAdpcm(const uint8_t *data, int size, int expand);
+
     };
 }
 #endif
\ No newline at end of file
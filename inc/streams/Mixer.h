@@ -46,6 +46,9 @@ class Mixer : public DataSource, public DataSink
 {
     MixerChannel *channels;
     DataSink *downStream;
+    int32_t *accumulator;           // Per sample running totals used while mixing, reused between calls to pull().
+    int accumulatorLength;          // The number of samples accumulator can hold.
+    ManagedBuffer output;           // The last buffer returned by pull(), reused once downstream has released it.
 
 public:
     /**
@@ -60,6 +63,13 @@ public:
      */
     ~Mixer();
 
+    /**
+     * Adds a new input to this mixer. Samples are expected to be 10 bit values in 16 bit words.
+     * Whether they are signed or centred on 512 is taken from the format reported by the stream, where it is known.
+     *
+     * @param stream the stream to mix.
+     * @return the new channel, whose volume and isSigned fields may be adjusted.
+     */
     MixerChannel *addChannel(DataStream &stream);
 
     /**
@@ -78,6 +88,11 @@ public:
      * @sink The component that data will be delivered to, when it is availiable
      */
     virtual void connect(DataSink &sink);
+
+    /**
+     * Describes the data this mixer provides: unsigned 10 bit samples in 16 bit words, at the rate of the most recently added channel.
+     */
+    virtual DataStreamFormat getFormat();
 };
 
 } // namespace codal
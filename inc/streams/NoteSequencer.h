@@ -0,0 +1,138 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_NOTE_SEQUENCER_H
+#define CODAL_NOTE_SEQUENCER_H
+
+#include "CodalConfig.h"
+#include "PolySynthesizer.h"
+
+/**
+ * The number of instruments a NoteSequencer can hold.
+ */
+#ifndef NOTE_SEQUENCER_INSTRUMENTS
+#define NOTE_SEQUENCER_INSTRUMENTS              4
+#endif
+
+namespace codal
+{
+    /**
+      * One entry in a note list. Note lists are typically held in flash as const arrays.
+      */
+    struct SequencerNote
+    {
+        uint16_t            frequency;      // The frequency to play, in Hz, or zero for a rest.
+        uint16_t            duration;       // The time, in ms, from the start of this note to the start of the next.
+        uint8_t             volume;         // The peak level of the note, in the range 0..255.
+        uint8_t             instrument;     // The index of the instrument to play the note with.
+    };
+
+    /**
+      * Plays a list of notes on a PolySynthesizer.
+      *
+      * Rather than a fiber sleeping between notes, the sequencer is called by the synthesizer's rendering fiber once
+      * per buffer, and schedules every note that starts within that buffer against the synthesizer's sample clock.
+      * Each note therefore starts on its exact sample however busy the system is, and a melody costs one callback
+      * per buffer regardless of how many notes it contains.
+      *
+      * Note start times are calculated from the total elapsed time of the list, so rounding to whole samples
+      * never accumulates into drift.
+      */
+    class NoteSequencer
+    {
+        PolySynthesizer         &synth;
+        SynthesizerInstrument   instruments[NOTE_SEQUENCER_INSTRUMENTS];
+        const SequencerNote     *notes;         // The list being played, or NULL.
+        int                     length;         // The number of notes in the list.
+        int                     position;       // The index of the next note to schedule.
+        uint32_t                startTime;      // The sample time at which the current pass through the list started.
+        uint32_t                elapsed;        // Time, in ms, from startTime to the start of the next note.
+        bool                    loop;
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param synth The synthesizer to play notes on. Only one sequencer may use a synthesizer at a time.
+          */
+        NoteSequencer(PolySynthesizer &synth);
+
+        /**
+          * Destructor.
+          * Stops playback.
+          */
+        ~NoteSequencer();
+
+        /**
+          * Defines an instrument that notes may be played with. Every instrument is initially a sine wave with
+          * a short attack and release.
+          *
+          * @param index The instrument to define, in the range 0..NOTE_SEQUENCER_INSTRUMENTS-1.
+          * @param wavetable TONE_WIDTH unsigned 10 bit samples describing one period of the waveform, or NULL for a sine wave.
+          * @param attack The time, in ms, to rise from silence to the note's volume.
+          * @param decay The time, in ms, to fall from the note's volume to the sustain level.
+          * @param sustain The level held until the note ends, as a proportion of the note's volume in the range 0..1024.
+          * @param release The time, in ms, to fall to silence once the note ends.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setInstrument(int index, const uint16_t *wavetable, int attack, int decay, int sustain, int release);
+
+        /**
+          * Starts playing a list of notes, replacing any list already playing. Returns immediately.
+          *
+          * @param notes The notes to play, which must remain valid until playback ends.
+          * @param length The number of notes in the list.
+          * @param loop true to repeat the list until stop() is called.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int play(const SequencerNote *notes, int length, bool loop = false);
+
+        /**
+          * Stops playback. Notes that have already been scheduled on the synthesizer still play.
+          */
+        void stop();
+
+        /**
+          * Determines if a note list is being played.
+          */
+        bool isPlaying();
+
+        private:
+
+        /**
+          * Schedules every note that starts before the end of the given buffer.
+          *
+          * @return true if there are more notes to schedule.
+          */
+        bool schedule(uint32_t time, int samples);
+
+        /**
+          * PolySynthesizerCallback that forwards to schedule().
+          */
+        static bool onRender(void *arg, uint32_t time, int samples);
+    };
+}
+
+#endif
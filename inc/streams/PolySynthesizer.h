@@ -0,0 +1,365 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_POLY_SYNTHESIZER_H
+#define CODAL_POLY_SYNTHESIZER_H
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+#include "Synthesizer.h"
+
+/**
+ * The number of voices a PolySynthesizer renders.
+ */
+#ifndef POLY_SYNTHESIZER_VOICES
+#define POLY_SYNTHESIZER_VOICES                 8
+#endif
+
+/**
+ * The number of note events that may be scheduled ahead of the sample clock at any one time.
+ */
+#ifndef POLY_SYNTHESIZER_MAXIMUM_EVENTS
+#define POLY_SYNTHESIZER_MAXIMUM_EVENTS         32
+#endif
+
+#define POLY_SYNTHESIZER_ALL_VOICES             -1
+
+namespace codal
+{
+    /**
+      * The envelope stages of a synthesizer voice.
+      */
+    enum SynthesizerVoiceStage
+    {
+        VoiceIdle = 0,
+        VoiceAttack,
+        VoiceDecay,
+        VoiceSustain,
+        VoiceRelease
+    };
+
+    /**
+      * The sound of a note: the waveform it plays and the envelope that shapes its volume.
+      */
+    struct SynthesizerInstrument
+    {
+        const uint16_t      *wavetable;     // TONE_WIDTH unsigned 10 bit samples describing one period of the waveform.
+        uint16_t            attack;         // Attack time, in ms.
+        uint16_t            decay;          // Decay time, in ms.
+        uint16_t            sustain;        // Sustain level, as a proportion of the peak level in the range 0..1024.
+        uint16_t            release;        // Release time, in ms.
+    };
+
+    /**
+      * The state of a single PolySynthesizer voice.
+      *
+      * Envelope levels are held as Q20 fixed point values in the range 0..1024, and each stage is a linear ramp that
+      * lasts a whole number of samples, so a voice only changes stage on a sample boundary.
+      */
+    struct SynthesizerVoice
+    {
+        SynthesizerInstrument instrument;   // The waveform and envelope of the current note.
+        uint32_t            phase;          // Position within the wavetable, as a fraction of a period.
+        uint32_t            phaseDelta;     // Phase increment per sample.
+        int32_t             level;          // Current envelope level.
+        int32_t             delta;          // Envelope level increment per sample.
+        int32_t             target;         // Envelope level at the end of the current stage.
+        int32_t             peak;           // Envelope level at the end of the attack stage.
+        uint32_t            remaining;      // Samples left in the current stage.
+        uint32_t            busyUntil;      // Sample time at which the last scheduled note on this voice will have finished.
+        uint8_t             stage;          // The current SynthesizerVoiceStage.
+        bool                held;           // true if a note has been started on this voice with no matching noteOff.
+    };
+
+    /**
+      * A note on or note off, to be applied to a voice at a given sample time.
+      */
+    struct SynthesizerEvent
+    {
+        uint32_t            time;
+        uint32_t            phaseDelta;
+        const SynthesizerInstrument *instrument;    // The sound to give the voice at note on, or NULL to keep its own.
+        uint16_t            volume;
+        uint8_t             voice;
+        uint8_t             noteOn;
+    };
+
+    /**
+      * A function called at the start of every buffer a PolySynthesizer renders, before any of it is rendered.
+      * Notes scheduled from here for sample times within the buffer still start on their exact sample.
+      *
+      * @param arg The argument given when the callback was registered.
+      * @param time The sample time of the first sample in the buffer.
+      * @param samples The number of samples in the buffer.
+      * @return true if the callback expects to schedule more notes in later buffers, which keeps the synthesizer running.
+      */
+    typedef bool (*PolySynthesizerCallback)(void *arg, uint32_t time, int samples);
+
+    /**
+      * A multi-voice synthesizer.
+      *
+      * Every voice is rendered into a single shared buffer in one pass, so playing chords does not require one
+      * Synthesizer and one buffer chain per note, mixed by a Mixer. Each voice has its own wavetable and ADSR envelope.
+      *
+      * Notes are scheduled against a sample clock, which counts the samples this synthesizer has rendered. An event
+      * scheduled for a given sample time takes effect on exactly that sample, regardless of how buffers are sized or
+      * when the rendering fiber happens to run. The clock only advances while the synthesizer is producing audio.
+      *
+      * Output is 10 bit samples in 16 bit words, in the same format as Synthesizer.
+      */
+    class PolySynthesizer : public DataSource
+    {
+        SynthesizerVoice    voices[POLY_SYNTHESIZER_VOICES];
+        SynthesizerEvent    events[POLY_SYNTHESIZER_MAXIMUM_EVENTS];   // Pending events, ordered by time.
+        int                 eventCount;
+        uint32_t            clock;          // Sample time of the next sample to be rendered.
+        int                 sampleRate;
+        int                 bufferSize;     // The size of each output buffer, in bytes.
+        int                 amplitude;      // The volume of the output, in the range 0..1024.
+        int32_t             *accumulator;   // Per sample running totals used while rendering.
+        int                 accumulatorLength;
+        PolySynthesizerCallback callback;   // Called at the start of every buffer, if defined.
+        void                *callbackArg;
+        bool                callbackPending; // true if the callback has more notes to schedule.
+        bool                active;         // true if the rendering fiber is running.
+        bool                isSigned;
+        ManagedBuffer       buffer;         // Playout buffer.
+
+        public:
+
+        DataStream output;
+
+        /**
+          * Constructor.
+          *
+          * @param sampleRate The sample rate at which this synthesizer will produce data.
+          * @param isSigned If true, samples use int16_t otherwise uint16_t centred on 512.
+          */
+        PolySynthesizer(int sampleRate = SYNTHESIZER_SAMPLE_RATE, bool isSigned = false);
+
+        /**
+          * Destructor.
+          * Removes all resources held by the instance.
+          */
+        ~PolySynthesizer();
+
+        /**
+          * Determines the sample time of the next sample to be rendered. Note events are scheduled relative to this clock.
+          */
+        uint32_t getTime();
+
+        /**
+          * Converts a period in milliseconds into a number of samples at the current sample rate.
+          */
+        uint32_t samplesFromMs(int ms);
+
+        /**
+          * Starts a note on the given voice. The note sounds until a matching noteOff().
+          * Starting a note on a voice that is already sounding restarts its envelope from the current level.
+          *
+          * @param voice The voice to use, in the range 0..POLY_SYNTHESIZER_VOICES-1.
+          * @param frequency The frequency, in Hz, to generate. This must be below half the sample rate. Zero releases the voice instead.
+          * @param volume The peak level of the note, in the range 0..1024.
+          * @param when The sample time at which the note starts. Times that have already passed start the note on the next sample rendered.
+          * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER, or DEVICE_NO_RESOURCES if too many events are already scheduled.
+          */
+        int noteOn(int voice, float frequency, int volume = 1024, uint32_t when = 0);
+
+        /**
+          * Releases the note on the given voice, which then fades out over the voice's release time.
+          *
+          * @param voice The voice to release, in the range 0..POLY_SYNTHESIZER_VOICES-1.
+          * @param when The sample time at which the note is released.
+          * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER, or DEVICE_NO_RESOURCES if too many events are already scheduled.
+          */
+        int noteOff(int voice, uint32_t when = 0);
+
+        /**
+          * Schedules a note of a fixed length on a free voice. If every voice is busy at the given time,
+          * the voice that becomes free soonest is reused. Voices held by noteOn() are never reused.
+          *
+          * @param frequency The frequency, in Hz, to generate.
+          * @param duration The time, in ms, between the start of the note and its release.
+          * @param volume The peak level of the note, in the range 0..1024.
+          * @param when The sample time at which the note starts.
+          * @param instrument The waveform and envelope of the note, which must remain valid until the note has started,
+          * or NULL to use those already defined for the chosen voice.
+          * @return The voice used on success, DEVICE_INVALID_PARAMETER, or DEVICE_NO_RESOURCES if no voice or event is available.
+          */
+        int playNote(float frequency, int duration, int volume = 1024, uint32_t when = 0, const SynthesizerInstrument *instrument = NULL);
+
+        /**
+          * Schedules a note between two sample times on a free voice, in the same way as playNote().
+          *
+          * @param frequency The frequency, in Hz, to generate.
+          * @param start The sample time at which the note starts.
+          * @param end The sample time at which the note is released.
+          * @param volume The peak level of the note, in the range 0..1024.
+          * @param instrument The waveform and envelope of the note, or NULL to use those already defined for the chosen voice.
+          * @return The voice used on success, DEVICE_INVALID_PARAMETER, or DEVICE_NO_RESOURCES if no voice or event is available.
+          */
+        int scheduleNote(float frequency, uint32_t start, uint32_t end, int volume = 1024, const SynthesizerInstrument *instrument = NULL);
+
+        /**
+          * Registers a function to be called at the start of every buffer rendered, so that notes can be scheduled
+          * one buffer at a time from the rendering fiber. Registering a callback starts the synthesizer.
+          *
+          * @param callback The function to call, or NULL to remove the current callback.
+          * @param arg An argument to pass to the function.
+          */
+        void setCallback(PolySynthesizerCallback callback, void *arg = NULL);
+
+        /**
+          * Silences every voice immediately and discards any scheduled events.
+          */
+        void stop();
+
+        /**
+          * Defines the waveform of a voice.
+          *
+          * @param voice The voice to change, or POLY_SYNTHESIZER_ALL_VOICES.
+          * @param wavetable TONE_WIDTH unsigned 10 bit samples describing one period of the waveform, which must remain valid
+          * while the voice is in use. NULL selects a sine wave.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setWavetable(int voice, const uint16_t *wavetable);
+
+        /**
+          * Defines the envelope of a voice. The new envelope applies from the next note started on the voice.
+          *
+          * @param voice The voice to change, or POLY_SYNTHESIZER_ALL_VOICES.
+          * @param attack The time, in ms, to rise from silence to the note's volume.
+          * @param decay The time, in ms, to fall from the note's volume to the sustain level.
+          * @param sustain The level held until the note is released, as a proportion of the note's volume in the range 0..1024.
+          * @param release The time, in ms, to fall to silence once the note is released.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setEnvelope(int voice, int attack, int decay, int sustain, int release);
+
+        /**
+          * Determines the number of voices currently producing sound.
+          */
+        int getActiveVoiceCount();
+
+        /**
+          * Define the volume of the output.
+          * @param volume The new output volume, in the range 0..1024
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER
+          */
+        int setVolume(int volume);
+
+        /**
+          * Define the size of the audio buffers to generate. The larger the buffer, the lower the CPU overhead, but the longer the delay.
+          * @param size The new buffer size to use, in bytes.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER
+          */
+        int setBufferSize(int size);
+
+        /**
+          * Determine the sample rate currently in use by this synthesizer.
+          * @return the current sample rate, in Hz.
+          */
+        int getSampleRate();
+
+        /**
+          * Change the sample rate used by this synthesizer. This applies to notes scheduled after the change.
+          * @param sampleRate The new sample rate, in Hz.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER
+          */
+        int setSampleRate(int sampleRate);
+
+        /**
+          * Renders the given number of samples, advancing the sample clock and applying any events that fall due.
+          *
+          * @param out The buffer to fill with 10 bit samples.
+          * @param samples The number of samples to render.
+          * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if there is insufficient memory.
+          */
+        int render(uint16_t *out, int samples);
+
+        /**
+          * Renders buffers and queues them on the output stream until every voice is silent and no events are pending.
+          * This is normally run in its own fiber, started when the first note is scheduled.
+          */
+        void generate();
+
+        /**
+          * Provide the next available ManagedBuffer to our downstream caller, if available.
+          */
+        virtual ManagedBuffer pull();
+
+        /**
+          * Describes the data this synthesizer provides: 10 bit samples in 16 bit words, at the current sample rate.
+          */
+        virtual DataStreamFormat getFormat();
+
+        /**
+          * Creates a wavetable from one of the Synthesizer tone functions, such as Synthesizer::SquareWaveTone.
+          *
+          * @param tonePrint The function to sample.
+          * @param arg The argument to pass to the tone function.
+          * @return A TONE_WIDTH entry wavetable, which the caller should free(), or NULL if there is insufficient memory.
+          */
+        static uint16_t *createWavetable(SynthesizerGetSample tonePrint, void *arg = NULL);
+
+        private:
+
+        /**
+          * Adds an event to the queue, in time order.
+          */
+        int schedule(uint32_t time, int voice, bool noteOn, uint32_t phaseDelta, int volume, const SynthesizerInstrument *instrument);
+
+        /**
+          * Removes the events queued for a voice at or after the given time.
+          */
+        void unschedule(int voice, uint32_t time);
+
+        /**
+          * Adds a note on event, with its instrument, to the queue.
+          */
+        int queueNote(int voice, float frequency, int volume, uint32_t when, const SynthesizerInstrument *instrument);
+
+        /**
+          * Applies a note on or note off to its voice.
+          */
+        void apply(SynthesizerEvent &e);
+
+        /**
+          * Moves a voice on to its next envelope stage once the current one has run its course.
+          */
+        void advance(SynthesizerVoice &v);
+
+        /**
+          * Adds a run of samples from a voice into the accumulator.
+          */
+        void renderVoice(SynthesizerVoice &v, int32_t *acc, int samples);
+
+        /**
+          * Starts the rendering fiber, if it is not already running.
+          */
+        void start();
+    };
+}
+
+#endif
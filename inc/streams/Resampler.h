@@ -0,0 +1,161 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_RESAMPLER_H
+#define CODAL_RESAMPLER_H
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+#include "StreamConverter.h"
+
+/**
+ * Quality settings, giving the number of filter taps used to compute each output sample.
+ * Higher quality gives better rejection of aliasing and imaging, at a proportionally higher CPU cost.
+ */
+#define RESAMPLER_QUALITY_LOW                   2           // Linear interpolation.
+#define RESAMPLER_QUALITY_MEDIUM                8
+#define RESAMPLER_QUALITY_HIGH                  16
+
+/**
+ * The number of filter phases, i.e. the resolution with which output samples are positioned between input samples. Must be a power of two.
+ */
+#ifndef RESAMPLER_PHASES_BITS
+#define RESAMPLER_PHASES_BITS                   5
+#endif
+
+#define RESAMPLER_PHASES                        (1 << RESAMPLER_PHASES_BITS)
+
+namespace codal
+{
+    /**
+      * A stream component that converts a stream of signed 16 bit mono samples from one sample rate to another.
+      * Mono data in other sample encodings is converted to signed 16 bit as it arrives. Data with more than one channel is not supported.
+      *
+      * Conversion uses a polyphase windowed sinc filter in Q15 fixed point, with the filter length selected by the quality setting.
+      * The filter coefficients are computed when the rates or quality change, so no floating point is used as data flows.
+      */
+    class Resampler : public DataSource, public DataSink
+    {
+        StreamConverter input;              // Our upstream component, converted to signed 16 bit samples.
+        DataSink        *downStream;
+        int             inputRate;          // Sample rate of the upstream component, in Hz.
+        uint32_t        upstreamRate;       // The sample rate last reported by the upstream component, or zero if unknown.
+        int             outputRate;         // Sample rate we provide, in Hz.
+        int             taps;               // Number of filter taps per output sample.
+        int16_t         *coefficients;      // RESAMPLER_PHASES sets of taps Q15 coefficients.
+        int16_t         *work;              // Input samples carried over from the previous buffer, followed by the current buffer.
+        int             workLength;         // Number of samples work can hold.
+        int             historyLength;      // Number of samples carried over from the previous buffer.
+        uint32_t        step;               // Distance between output samples, in input samples (16.16 fixed point, rounded down).
+        uint32_t        stepRemainder;      // The part of the step lost to rounding, in units of 1/outputRate of the 16.16 fraction.
+        uint32_t        position;           // Position of the next output sample in work (16.16 fixed point).
+        uint32_t        positionRemainder;  // Accumulated stepRemainder, always less than outputRate.
+        bool            supported;          // false if the upstream component provides more than one channel.
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param source the component to receive data from. If its format does not give its sample rate, use setInputRate().
+          * If it provides more than one channel, the Resampler provides only empty buffers: see isSupported().
+          * @param outputRate the sample rate to convert to, in Hz.
+          * @param quality the number of filter taps to use. One of the RESAMPLER_QUALITY_ values.
+          */
+        Resampler(DataSource &source, int outputRate, int quality = RESAMPLER_QUALITY_MEDIUM);
+
+        /**
+          * Destructor.
+          */
+        ~Resampler();
+
+        /**
+          * Defines the sample rate of the incoming data. This holds until the sample rate reported by the upstream component changes.
+          *
+          * @param rate The sample rate, in Hz.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setInputRate(int rate);
+
+        /**
+          * Defines the sample rate to convert to.
+          *
+          * @param rate The sample rate, in Hz.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setOutputRate(int rate);
+
+        /**
+          * Selects the trade off between conversion quality and CPU cost.
+          *
+          * @param quality the number of filter taps to use per output sample. One of the RESAMPLER_QUALITY_ values, or any even number from 2 to 64.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setQuality(int quality);
+
+        int getInputRate();
+
+        int getOutputRate();
+
+        int getQuality();
+
+        /**
+          * Determines if the format of the upstream component can be resampled.
+          *
+          * @return true if the upstream component provides mono data, or does not describe its format. false otherwise.
+          */
+        bool isSupported();
+
+        /**
+          * Provide the next available ManagedBuffer to our downstream caller, at our output sample rate.
+          */
+        virtual ManagedBuffer pull();
+
+        /**
+          * Callback provided when data is ready.
+          */
+        virtual int pullRequest();
+
+        /**
+          * Define a downstream component for data stream.
+          *
+          * @sink The component that data will be delivered to, when it is availiable
+          */
+        virtual void connect(DataSink &sink);
+
+        /**
+          * Describes the data this component provides: signed 16 bit mono samples at the output rate.
+          */
+        virtual DataStreamFormat getFormat();
+
+        private:
+
+        /**
+          * Recomputes the filter and step for the current rates and quality.
+          */
+        int configure();
+    };
+}
+
+#endif
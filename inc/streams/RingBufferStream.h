@@ -0,0 +1,276 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_RING_BUFFER_STREAM_H
+#define CODAL_RING_BUFFER_STREAM_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+
+/**
+  * Events
+  */
+#define RING_BUFFER_STREAM_EVT_HIGH_WATERMARK           1
+#define RING_BUFFER_STREAM_EVT_LOW_WATERMARK            2
+#define RING_BUFFER_STREAM_EVT_OVERRUN                  3
+
+/**
+ * Status values
+ */
+#define RING_BUFFER_STREAM_HIGH_WATERMARK_PASSED        0x02
+#define RING_BUFFER_STREAM_LOW_WATERMARK_PASSED         0x04
+
+namespace codal
+{
+    /**
+      * Class definition for RingBufferStream.
+      *
+      * A RingBufferStream is a DataStream alternative that holds its data as bytes in a single circular buffer of fixed capacity,
+      * rather than as a list of ManagedBuffer references. This provides constant time access to any byte in the stream, and allows
+      * producers and consumers to read and write directly into the buffer through contiguous windows, without intermediate copies.
+      *
+      * Optional low and high watermarks raise events as the amount of buffered data crosses them.
+      */
+    class RingBufferStream : public CodalComponent, public DataSource, public DataSink
+    {
+        uint8_t *buffer;                // Storage for the stream.
+        int capacity;                   // Size of buffer, in bytes.
+        int readPosition;               // Offset of the oldest byte in the stream, in the range 0..2*capacity-1.
+        int writePosition;              // Offset one beyond the newest byte in the stream, in the range 0..2*capacity-1.
+        int lowWatermark;               // Level at or below which a LOW_WATERMARK event is raised.
+        int highWatermark;              // Level at or above which a HIGH_WATERMARK event is raised.
+        int preferredBufferSize;
+        int writers;
+        uint32_t overruns;
+        uint16_t spaceAvailableEventCode;
+        uint16_t pullRequestEventCode;
+        bool isBlocking;
+
+        DataSink *downStream;
+        DataSource *upStream;
+
+        public:
+
+        /**
+          * Constructor.
+          * Creates an empty RingBufferStream.
+          *
+          * @param upstream the component that will normally feed this stream with data.
+          * @param capacity the maximum number of bytes the stream can hold.
+          * @param id The id to use for the message bus when transmitting events.
+          *
+          * @note If there is insufficient memory for the buffer, the stream is created with zero capacity and all data written to it
+          * is dropped. Use getCapacity() to check.
+          */
+        RingBufferStream(DataSource &upstream, int capacity, uint16_t id = DEVICE_ID_RING_BUFFER_STREAM);
+
+        /**
+          * Destructor.
+          * Removes all resources held by the instance.
+          */
+        ~RingBufferStream();
+
+        /**
+          * Determines the value of the given byte in the stream.
+          *
+          * @param position The index of the byte to read, relative to the oldest byte in the stream.
+          * @return The value of the byte at the given position, or DEVICE_INVALID_PARAMETER.
+          */
+        int get(int position);
+
+        /**
+          * Sets the byte at the given index to value provided.
+          *
+          * @param position The index of the byte to change, relative to the oldest byte in the stream.
+          * @param value The new value of the byte (0-255).
+          * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER.
+          */
+        int set(int position, uint8_t value);
+
+        /**
+          * Gets number of bytes that are ready to be consumed in this stream.
+          * @return The size in bytes.
+          */
+        int length();
+
+        /**
+          * Gets number of bytes that can be added to this stream before it is full.
+          * @return The size in bytes.
+          */
+        int space();
+
+        /**
+          * Gets the maximum number of bytes this stream can hold.
+          * @return The size in bytes, or zero if the buffer could not be allocated.
+          */
+        int getCapacity();
+
+        /**
+          * Determines if the stream can accept any more data.
+          *
+          * @return true if the stream is full, false otherwise.
+          */
+        bool full();
+
+        /**
+          * Provides direct access to the oldest data in the stream.
+          * Because the stream wraps around, this may be less than length() bytes. Once the data has been used,
+          * call consume() to release it, and call getReadWindow() again to access any remaining data.
+          *
+          * @param size Set to the number of contiguous bytes available at the returned address.
+          * @return A pointer to the oldest byte in the stream.
+          */
+        uint8_t *getReadWindow(int &size);
+
+        /**
+          * Removes the given number of bytes from the start of the stream.
+          *
+          * @param size The number of bytes to remove.
+          * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if fewer than size bytes are held.
+          */
+        int consume(int size);
+
+        /**
+          * Provides direct access to the free space at the end of the stream.
+          * Because the stream wraps around, this may be less than space() bytes. Once data has been written,
+          * call commit() to add it to the stream.
+          *
+          * @param size Set to the number of contiguous bytes available at the returned address.
+          * @return A pointer to the first free byte in the stream.
+          */
+        uint8_t *getWriteWindow(int &size);
+
+        /**
+          * Adds the given number of bytes, previously written via getWriteWindow(), to the end of the stream.
+          * Any downstream component is notified that data is available.
+          *
+          * @param size The number of bytes to add.
+          * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if there is not space for size bytes.
+          */
+        int commit(int size);
+
+        /**
+          * Copies data onto the end of the stream.
+          * Any downstream component is notified that data is available.
+          *
+          * @param data The data to add.
+          * @param size The number of bytes to add.
+          * @return The number of bytes added, which may be less than size if the stream is full.
+          */
+        int write(const uint8_t *data, int size);
+
+        /**
+          * Copies data from the start of the stream, removing it from the stream.
+          *
+          * @param data The location to copy the data to.
+          * @param size The maximum number of bytes to copy.
+          * @return The number of bytes copied.
+          */
+        int read(uint8_t *data, int size);
+
+        /**
+          * Defines the levels at which RING_BUFFER_STREAM_EVT_LOW_WATERMARK and RING_BUFFER_STREAM_EVT_HIGH_WATERMARK events are raised.
+          * A HIGH_WATERMARK event is raised when the stream fills to at least the high watermark. A LOW_WATERMARK event is then raised when
+          * it drains to the low watermark or below, and so on.
+          * Events are always in this order: after the watermarks are set, the first event is HIGH_WATERMARK, even if the stream
+          * already holds no more than the low watermark.
+          *
+          * @param low The low watermark, in bytes.
+          * @param high The high watermark, in bytes.
+          * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the watermarks are out of range.
+          */
+        int setWatermarks(int low, int high);
+
+        /**
+          * Determines the number of bytes that have been dropped because the stream was full.
+          */
+        uint32_t getOverruns();
+
+        /**
+          * Define a downstream component for data stream.
+          *
+          * @sink The component that data will be delivered to, when it is availiable
+          */
+        virtual void connect(DataSink &sink);
+
+        /**
+          * Removes the downstream component of this stream.
+          */
+        void disconnect();
+
+        /**
+          * Determine the maximum number of bytes delivered in each buffer by pull().
+          * @return the current preferred buffer size for this stream. Zero means all available data.
+          */
+        int getPreferredBufferSize();
+
+        /**
+          * Define the maximum number of bytes delivered in each buffer by pull().
+          * @param size The number of bytes, or zero to deliver all available data.
+          */
+        void setPreferredBufferSize(int size);
+
+        /**
+          * Determines if this stream acts in a synchronous, blocking mode or asynchronous mode. In blocking mode, data that does not fit
+          * will result in the calling fiber being blocked until space is available, and downstream DataSinks are notified immediately.
+          * In non-blocking asynchronous mode, data that does not fit is dropped and downstream DataSinks are notified in a new fiber.
+          */
+        void setBlocking(bool isBlocking);
+
+        /**
+          * Provide the next available data to our downstream caller, as a ManagedBuffer of up to getPreferredBufferSize() bytes.
+          */
+        virtual ManagedBuffer pull();
+
+        /**
+          * Copy the next buffer from our upstream component into the stream.
+          */
+        virtual int pullRequest();
+
+        /**
+          * Describes the data this stream provides, which is the data provided by its upstream component.
+          */
+        virtual DataStreamFormat getFormat();
+
+        private:
+
+        /**
+          * Raise any watermark events due, and tell our downstream component that data is available.
+          */
+        void dataAvailable();
+
+        /**
+          * Raise any watermark events due, and wake any writers waiting for space.
+          */
+        void spaceAvailable();
+
+        /**
+          * Issue a deferred pull request to our downstream component, if one has been registered.
+          */
+        void onDeferredPullRequest(Event);
+    };
+}
+
+#endif
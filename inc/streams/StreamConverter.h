@@ -0,0 +1,94 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_STREAM_CONVERTER_H
+#define CODAL_STREAM_CONVERTER_H
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+
+namespace codal
+{
+    /**
+      * A stream component that converts samples from the format provided by its upstream component into a given format.
+      *
+      * The input format is read from the upstream component as each buffer is pulled. If the sample encodings
+      * already match, buffers are passed through untouched. Otherwise each sample is converted exactly once, as it is pulled.
+      * Only the sample encoding (size, significant bits and signedness) is converted: the channel count and sample rate are
+      * passed through unchanged.
+      */
+    class StreamConverter : public DataSource, public DataSink
+    {
+        DataSource          &upstream;
+        DataSink            *downStream;
+        DataStreamFormat    inputFormat;
+        DataStreamFormat    outputFormat;
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param source the component to receive data from.
+          * @param format the sample encoding to convert the data into.
+          */
+        StreamConverter(DataSource &source, DataStreamFormat format);
+
+        /**
+          * Destructor.
+          */
+        ~StreamConverter();
+
+        /**
+          * Determines if this converter is currently modifying the data passing through it.
+          *
+          * @return true if the input and output sample encodings differ, false if buffers are passed straight through.
+          */
+        bool isConverting();
+
+        /**
+          * Provide the next available ManagedBuffer to our downstream caller, converted to our output format.
+          */
+        virtual ManagedBuffer pull();
+
+        /**
+          * Callback provided when data is ready.
+          */
+        virtual int pullRequest();
+
+        /**
+          * Define a downstream component for data stream.
+          *
+          * @sink The component that data will be delivered to, when it is availiable
+          */
+        virtual void connect(DataSink &sink);
+
+        /**
+          * Describes the data this converter provides.
+          */
+        virtual DataStreamFormat getFormat();
+    };
+}
+
+#endif
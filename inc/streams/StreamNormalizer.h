@@ -31,6 +31,19 @@ DEALINGS IN THE SOFTWARE.
 /**
  * Default configuration values
  */
+#define STREAM_NORMALIZER_DEFAULT_SAMPLE_RATE           11000
+#define STREAM_NORMALIZER_AGC_DEFAULT_TARGET            16384   // Peak amplitude the AGC aims for (-6dBFS).
+#define STREAM_NORMALIZER_AGC_DEFAULT_MAXIMUM_GAIN      16384   // 16x, in 1024ths.
+#define STREAM_NORMALIZER_AGC_DEFAULT_ATTACK            2       // ms
+#define STREAM_NORMALIZER_AGC_DEFAULT_RELEASE           500     // ms
+#define STREAM_NORMALIZER_AGC_DEFAULT_LOOKAHEAD         4       // ms
+#define STREAM_NORMALIZER_AGC_MAXIMUM_GAIN              32768   // 32x, in 1024ths. Keeps the gain within the range of a 32x16 bit multiply.
+
+/**
+ * Status values
+ */
+#define STREAM_NORMALIZER_AGC_ENABLED                   0x01
+#define STREAM_NORMALIZER_LOOKAHEAD_CONFIGURED          0x02
 
 namespace codal{
 
@@ -43,6 +56,23 @@ namespace codal{
         DataStream      output;
         ManagedBuffer   buffer;
 
+        uint8_t         status;                 // STREAM_NORMALIZER_AGC_ENABLED if the gain is adapted automatically, and
+                                                // STREAM_NORMALIZER_LOOKAHEAD_CONFIGURED once setLookahead() has been called.
+        int             sampleRate;             // Sample rate of the incoming data, in Hz, used to convert times into samples.
+        int             target;                 // Peak amplitude the automatic gain control aims for.
+        int             maximumGain;            // Largest gain the automatic gain control will apply, in 1024ths.
+        int             gateThreshold;          // Input envelope below which the noise gate closes, or zero if disabled.
+        int             attackTime;             // The attack time constant, in milliseconds.
+        int             releaseTime;            // The release time constant, in milliseconds.
+        int             attackShift;            // log2 of the attack time constant, in samples.
+        int             releaseShift;           // log2 of the release time constant, in samples.
+        int32_t         agcGain;                // The current automatic gain, in Q16.
+        int32_t         envelope;               // Peak envelope of the input signal.
+        int32_t         gateGain;               // The current noise gate gain, in Q15.
+        int16_t         *lookahead;             // Delay line, allowing gain reductions to take effect before the peak that caused them.
+        int             lookaheadLength;        // Number of samples in the delay line.
+        int             lookaheadPosition;      // Index of the oldest sample in the delay line.
+
         /**
           * Creates a component capable of translating one data representation format into another
           *
@@ -62,15 +92,106 @@ namespace codal{
          */
         virtual ManagedBuffer pull();
 
+        /**
+         * Describes the data this component provides: signed 16 bit samples, at the rate and channel count of its upstream component.
+         * Buffers in any other encoding cannot be normalized, and are passed on unchanged in their original format.
+         */
+        virtual DataStreamFormat getFormat();
+
+        /**
+         * Applies a fixed gain, disabling automatic gain control.
+         *
+         * @param gain the gain to apply, in 1024ths of a unit.
+         *
+         * @return DEVICE_OK.
+         */
         int setGain(int gain);
 
+        /**
+         * Determines the gain being applied, in 1024ths of a unit. When automatic gain control is enabled,
+         * this is the gain at the end of the last buffer processed.
+         */
         int getGain();
 
+        /**
+         * Enables automatic gain control. The gain is continually adapted so that the peak level of the output approaches the
+         * given target, falling quickly (the attack) when the signal grows and rising slowly (the release) when it fades.
+         * The output is delayed by a short lookahead, so that the gain falls before a sudden peak is output rather than after.
+         * This is STREAM_NORMALIZER_AGC_DEFAULT_LOOKAHEAD, unless setLookahead() has already been called.
+         *
+         * @param target the peak amplitude to aim for.
+         * @param maximumGain the largest gain to apply, in 1024ths of a unit. At most STREAM_NORMALIZER_AGC_MAXIMUM_GAIN.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES if the request fails.
+         */
+        int enableAutomaticGain(int target = STREAM_NORMALIZER_AGC_DEFAULT_TARGET, int maximumGain = STREAM_NORMALIZER_AGC_DEFAULT_MAXIMUM_GAIN);
+
+        /**
+         * Disables automatic gain control, leaving the current gain in place as a fixed gain.
+         *
+         * @return DEVICE_OK.
+         */
+        int disableAutomaticGain();
+
+        /**
+         * Defines how quickly the automatic gain falls when the signal exceeds the target.
+         * Times are rounded to a power of two number of samples.
+         *
+         * @param ms the time taken for the gain to fall by a factor of e, in milliseconds.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the request fails.
+         */
+        int setAttack(int ms);
+
+        /**
+         * Defines how quickly the automatic gain rises, and the envelope decays, as the signal fades.
+         * Times are rounded to a power of two number of samples.
+         *
+         * @param ms the time taken for the gain to rise by a factor of e, in milliseconds.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the request fails.
+         */
+        int setRelease(int ms);
+
+        /**
+         * Defines how far ahead the automatic gain control looks for peaks. The output is delayed by this amount.
+         * The delay is held as a number of samples, so it is not resized if the sample rate later changes.
+         *
+         * @param ms the lookahead time, in milliseconds, or zero to disable lookahead.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES if the request fails.
+         */
+        int setLookahead(int ms);
+
+        /**
+         * Defines the level below which the signal is treated as noise. While the input is below this level the automatic
+         * gain is held, and the output is faded out. The gate fades back in at the attack rate when the signal returns.
+         *
+         * @param threshold the input peak amplitude below which the gate closes, or zero to disable the gate.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the request fails.
+         */
+        int setNoiseGate(int threshold);
+
         /**
          * Destructor.
          */
         ~StreamNormalizer();
 
+    private:
+
+        /**
+         * Converts a time into the log2 of a number of samples, for use as a time constant.
+         */
+        int timeToShift(int ms);
+
+        /**
+         * Applies automatic gain control to a block of samples, in place.
+         *
+         * @return the sum of the unprocessed samples.
+         */
+        int processAutomaticGain(int16_t *data, int samples);
+
     };
 }
 
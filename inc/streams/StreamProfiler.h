@@ -0,0 +1,152 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_STREAM_PROFILER_H
+#define CODAL_STREAM_PROFILER_H
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+
+/**
+ * Set to 1 to record statistics in StreamProfiler stages. When disabled, StreamProfiler stages pass data straight through.
+ */
+#ifndef CODAL_STREAM_PROFILING
+#define CODAL_STREAM_PROFILING                  0
+#endif
+
+namespace codal
+{
+    /**
+      * A snapshot of the activity seen by a StreamProfiler. Times are in microseconds.
+      */
+    struct StreamProfile
+    {
+        uint32_t pullRequests;          // Number of times upstream signalled that data was ready.
+        uint32_t pulls;                 // Number of buffers pulled through the profiler.
+        uint32_t serviced;              // Number of pullRequest() calls followed by a pull(), over which latency is averaged.
+        uint32_t bytes;                 // Total size of the buffers pulled.
+        uint32_t totalTime;             // Time spent in upstream pull() calls, excluding time recorded by nested profilers.
+        uint32_t maximumTime;           // Longest single upstream pull(), excluding time recorded by nested profilers.
+        uint32_t totalLatency;          // Sum of the delays between a pullRequest() and the pull() that serviced it.
+        uint32_t maximumLatency;        // Longest delay between a pullRequest() and the pull() that serviced it.
+        uint32_t missed;                // Number of pullRequest() calls that arrived before the previous one was serviced.
+    };
+
+    /**
+      * A pass-through stream stage that measures the stage (or chain of stages) upstream of it.
+      *
+      * Insert a profiler after each stage of interest. Where one profiler's upstream pull() passes through another, the
+      * time recorded by the inner profiler is excluded from the outer, so each profiler reports the cost of only the stages
+      * between it and the next profiler upstream. All profilers can be listed together with StreamProfiler::dump().
+      *
+      * Statistics are only recorded when CODAL_STREAM_PROFILING is enabled.
+      */
+    class StreamProfiler : public DataSource, public DataSink
+    {
+        DataSource          &upstream;
+        DataSink            *downStream;
+        const char          *name;
+        StreamProfiler      *next;
+
+#if CONFIG_ENABLED(CODAL_STREAM_PROFILING)
+        StreamProfile       profile;
+        CODAL_TIMESTAMP     requestTime;    // Time of the last pullRequest() not yet serviced by a pull().
+        bool                requested;
+        uint32_t            nested;         // Time recorded by profilers nested within the current pull().
+#endif
+
+        static StreamProfiler *profilers;   // All profilers, for dump().
+        static StreamProfiler *active;      // The profiler whose pull() is currently running, if any.
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param source the component to receive data from.
+          * @param name a name for this point in the pipeline, used by dump(). The string is not copied.
+          */
+        StreamProfiler(DataSource &source, const char *name);
+
+        /**
+          * Destructor.
+          */
+        ~StreamProfiler();
+
+        /**
+          * Provide the next available ManagedBuffer to our downstream caller, measuring the time taken to produce it.
+          */
+        virtual ManagedBuffer pull();
+
+        /**
+          * Callback provided when data is ready.
+          */
+        virtual int pullRequest();
+
+        /**
+          * Define a downstream component for data stream.
+          *
+          * @sink The component that data will be delivered to, when it is availiable
+          */
+        virtual void connect(DataSink &sink);
+
+        /**
+          * Describes the data this component provides, which is the data provided by its upstream component.
+          */
+        virtual DataStreamFormat getFormat();
+
+        /**
+          * Determines the name given to this profiler.
+          */
+        const char *getName();
+
+        /**
+          * Retrieves a snapshot of the activity recorded by this profiler.
+          *
+          * @param profile the structure to fill in.
+          *
+          * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if CODAL_STREAM_PROFILING is not enabled.
+          */
+        int getProfile(StreamProfile *profile);
+
+        /**
+          * Clears the activity recorded by this profiler.
+          *
+          * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if CODAL_STREAM_PROFILING is not enabled.
+          */
+        int resetProfile();
+
+        /**
+          * Writes the activity recorded by every profiler to DMESG, one line per profiler.
+          */
+        static void dump();
+
+        /**
+          * Clears the activity recorded by every profiler.
+          */
+        static void resetAll();
+    };
+}
+
+#endif
@@ -0,0 +1,178 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_STREAM_SPLITTER_H
+#define CODAL_STREAM_SPLITTER_H
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+
+namespace codal
+{
+    class StreamSplitter;
+
+    /**
+      * One output of a StreamSplitter. Connect a downstream component to a channel as if it were any other DataSource.
+      * Channels are only created and deleted by their StreamSplitter.
+      */
+    class SplitterChannel final : public DataSource
+    {
+        private:
+        SplitterChannel     *next;
+        StreamSplitter      *parent;
+        DataSink            *output;
+        ManagedBuffer       buffer;         // The buffer waiting to be pulled by this channel.
+        bool                pending;        // true if buffer has not yet been pulled.
+        bool                blocking;       // true if this channel holds back data until it has consumed the last buffer.
+        uint32_t            dropped;        // Number of buffers replaced before this channel pulled them.
+        uint32_t            stalls;         // Number of times this channel held back data from upstream.
+        friend class StreamSplitter;
+
+        SplitterChannel(StreamSplitter &parent, bool blocking);
+
+        public:
+
+        /**
+          * Provide the next available ManagedBuffer to our downstream caller. This is the buffer shared by every channel,
+          * so ManagedBuffer::isShared() is true until the last channel has pulled it, and it must not be modified until then.
+          */
+        virtual ManagedBuffer pull();
+
+        /**
+          * Define a downstream component for data stream.
+          *
+          * @sink The component that data will be delivered to, when it is availiable
+          */
+        virtual void connect(DataSink &sink);
+
+        /**
+          * Removes the downstream component of this channel. It is no longer offered data, and the channel may then be destroyed.
+          */
+        void disconnect();
+
+        /**
+          * Describes the data this channel provides, which is the data provided by the splitter's upstream component.
+          */
+        virtual DataStreamFormat getFormat();
+
+        /**
+          * Determines if this channel holds back data from upstream until it has consumed the last buffer.
+          */
+        bool isBlocking();
+
+        /**
+          * Determines the number of buffers this channel missed because it had not pulled the previous buffer in time.
+          * Only non-blocking channels drop buffers.
+          */
+        uint32_t getDropCount();
+
+        /**
+          * Determines the number of times this channel held back data from upstream because it had not pulled the previous
+          * buffer. This identifies the slowest consumer on a splitter. Only blocking channels stall.
+          */
+        uint32_t getStallCount();
+
+        /**
+          * Resets the drop and stall counts to zero.
+          */
+        void resetCounters();
+    };
+
+    /**
+      * A stream component that delivers the data from one upstream component to any number of downstream components.
+      *
+      * Every channel is given a reference to the same ManagedBuffer, so no data is copied. Components that modify buffers in
+      * place (such as StreamNormalizer, FilterChain or StreamConverter) copy any buffer that ManagedBuffer::isShared()
+      * reports is still referenced elsewhere, so they work after a splitter. They avoid that copy if placed before it.
+      *
+      * Blocking channels apply backpressure: a new buffer is only pulled from upstream once every blocking channel has pulled
+      * the last one, so the slowest blocking consumer sets the pace. Non-blocking channels never hold back the others;
+      * if they fall behind, their unconsumed buffer is replaced and counted as dropped.
+      */
+    class StreamSplitter : public DataSink
+    {
+        DataSource          &upstream;
+        SplitterChannel     *channels;
+        uint16_t            pullRequestEventCode;
+        uint16_t            requestsPending;    // Number of pullRequests from upstream held back by a blocking channel.
+        friend class SplitterChannel;
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param source the component to receive data from.
+          */
+        StreamSplitter(DataSource &source);
+
+        /**
+          * Destructor. Deletes every channel, so any components connected to them must already have been destroyed.
+          */
+        ~StreamSplitter();
+
+        /**
+          * Adds an output to this splitter.
+          *
+          * @param blocking true if the pace of the splitter should be limited by this channel, or false if it may drop buffers instead.
+          * @return the new channel, or NULL if there is insufficient memory.
+          */
+        SplitterChannel *createChannel(bool blocking = true);
+
+        /**
+          * Removes and deletes an output of this splitter.
+          * The channel must first be disconnected, as its downstream component would otherwise be left holding a reference to it.
+          *
+          * @param channel the channel to remove.
+          * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the channel does not belong to this splitter,
+          * or DEVICE_BUSY if it is still connected to a downstream component.
+          */
+        int destroyChannel(SplitterChannel *channel);
+
+        /**
+          * Callback provided when data is ready.
+          */
+        virtual int pullRequest();
+
+        private:
+
+        /**
+          * Determines if every blocking channel has pulled its last buffer.
+          */
+        bool ready();
+
+        /**
+          * Pulls a buffer from upstream, and offers it to every connected channel.
+          */
+        int deliver();
+
+        /**
+          * Delivers the data that was held back by a blocking channel, one buffer per held pullRequest, once that channel
+          * has caught up.
+          */
+        void onDeferredPullRequest(Event);
+    };
+}
+
+#endif
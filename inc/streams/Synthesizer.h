@@ -129,6 +129,11 @@ namespace codal
          */
         virtual ManagedBuffer pull();
 
+        /**
+         * Describes the data this synthesizer provides: 10 bit samples in 16 bit words, at the current sample rate.
+         */
+        virtual DataStreamFormat getFormat();
+
         /**
          * Implement this function to receive a callback when the device is idling.
          */
@@ -26,6 +26,7 @@ DEALINGS IN THE SOFTWARE.
 #define DEVICE_MANAGED_BUFFER_H
 
 #include "CodalCompat.h"
+#include "CodalArena.h"
 #include "RefCounted.h"
 
 namespace codal
@@ -87,6 +88,24 @@ namespace codal
           */
         ManagedBuffer(uint8_t *data, int length);
 
+        /**
+          * Constructor.
+          * Creates a new ManagedBuffer of the given size, using storage from the given Arena rather than the heap.
+          * If the arena has insufficient space, the buffer is allocated from the heap as normal.
+          *
+          * @param length The length of the buffer to create.
+          * @param arena The Arena to allocate storage from.
+          *
+          * @note The buffer (and any copies of it) must not be used after the arena is released past this allocation.
+          *
+          * Example:
+          * @code
+          * ArenaScope scope(scratch);
+          * ManagedBuffer p(16, scratch);   // Creates a ManagedBuffer 16 bytes long in the scratch arena.
+          * @endcode
+          */
+        ManagedBuffer(int length, Arena &arena);
+
         /**
           * Copy Constructor.
           * Add ourselves as a reference to an existing ManagedBuffer.
@@ -278,6 +297,14 @@ namespace codal
 
         bool isReadOnly() const { return ptr->isReadOnly(); }
 
+        /**
+          * Determines if this buffer's data may be seen through another ManagedBuffer, so must not be modified in place.
+          * This is the case if any other ManagedBuffer refers to the same data, or if the data is read only.
+          *
+          * @return true if the data is shared or read only, false if this is the only reference to it.
+          */
+        bool isShared() const { return ptr->isReadOnly() || ptr->refCount > 3; }
+
         int truncate(int length);
     };
 }
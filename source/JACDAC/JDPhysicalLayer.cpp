@@ -3,6 +3,7 @@
 #include "EventModel.h"
 #include "codal_target_hal.h"
 #include "CodalDmesg.h"
+#include "CodalHeapAllocator.h"
 #include "CodalFiber.h"
 #include "SingleWireSerial.h"
 #include "Timer.h"
@@ -394,7 +395,7 @@ void JDPhysicalLayer::_dmaCallback(uint16_t errCode)
             if (ret == DEVICE_OK)
             {
                 JD_DMESG("RXD[%d,%d]",this->rxHead, this->rxTail);
-                rxBuf = (JDPacket*)malloc(sizeof(JDPacket));
+                rxBuf = (JDPacket*)device_malloc_region(sizeof(JDPacket), DEVICE_HEAP_PLACEMENT_DMA);
                 diagnostics.packets_received++;
             }
             else
@@ -575,7 +576,7 @@ void JDPhysicalLayer::start()
         return;
 
     if (rxBuf == NULL)
-        rxBuf = (JDPacket*)malloc(sizeof(JDPacket));
+        rxBuf = (JDPacket*)device_malloc_region(sizeof(JDPacket), DEVICE_HEAP_PLACEMENT_DMA);
 
     JD_SET_FLAGS(DEVICE_COMPONENT_RUNNING);
 
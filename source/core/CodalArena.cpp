@@ -0,0 +1,165 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CodalConfig.h"
+#include "CodalArena.h"
+#include "CodalCompat.h"
+#include "codal_target_hal.h"
+
+using namespace codal;
+
+Arena *Arena::arenas = NULL;
+
+/**
+  * Internal constructor helper.
+  * Records the dimensions of the arena and registers it in the list of live arenas.
+  */
+void Arena::init(void *memory, int size)
+{
+    PROCESSOR_WORD_TYPE base = ((PROCESSOR_WORD_TYPE)memory + sizeof(PROCESSOR_WORD_TYPE) - 1) & ~(sizeof(PROCESSOR_WORD_TYPE) - 1);
+
+    if (memory == NULL || size < 0)
+        size = 0;
+
+    start = (uint8_t *)base;
+    end = (uint8_t *)memory + size;
+
+    if (end < start)
+        end = start;
+
+    top = start;
+    highWater = start;
+
+    target_disable_irq();
+    next = arenas;
+    arenas = this;
+    target_enable_irq();
+}
+
+/**
+  * Constructor.
+  * Creates an arena of the given size, using storage allocated from the heap.
+  *
+  * @param size The number of bytes of storage to make available.
+  */
+Arena::Arena(int size)
+{
+    owned = true;
+    init(malloc(size), size);
+}
+
+/**
+  * Constructor.
+  * Creates an arena using the given region of memory (e.g. a static buffer).
+  *
+  * @param memory The start of the memory region to use.
+  * @param size The size of the memory region, in bytes.
+  */
+Arena::Arena(void *memory, int size)
+{
+    owned = false;
+    init(memory, size);
+}
+
+/**
+  * Destructor.
+  * Releases the storage held by this arena, if it was allocated from the heap.
+  */
+Arena::~Arena()
+{
+    target_disable_irq();
+    for (Arena **a = &arenas; *a; a = &(*a)->next)
+    {
+        if (*a == this)
+        {
+            *a = next;
+            break;
+        }
+    }
+    target_enable_irq();
+
+    if (owned && start != end)
+        free(start);
+}
+
+/**
+  * Allocate a block of memory from this arena. Blocks are word aligned.
+  *
+  * @param size The amount of memory, in bytes, to allocate.
+  *
+  * @return A pointer to the allocated memory, or NULL if insufficient space is available.
+  */
+void *Arena::alloc(int size)
+{
+    void *p = NULL;
+
+    if (size <= 0)
+        return NULL;
+
+    size = (size + sizeof(PROCESSOR_WORD_TYPE) - 1) & ~(sizeof(PROCESSOR_WORD_TYPE) - 1);
+
+    target_disable_irq();
+
+    if (end - top >= size)
+    {
+        p = top;
+        top += size;
+
+        if (top > highWater)
+            highWater = top;
+    }
+
+    target_enable_irq();
+
+    return p;
+}
+
+/**
+  * Releases all memory allocated since the given mark was taken.
+  *
+  * @param mark A value previously returned by mark().
+  */
+void Arena::release(int mark)
+{
+    if (mark < 0 || mark > top - start)
+        return;
+
+    top = start + mark;
+}
+
+/**
+  * Finds the live arena that holds the given pointer, if any.
+  *
+  * @param p The pointer to test.
+  *
+  * @return the Arena containing p, or NULL if p was not allocated from an arena.
+  */
+Arena *Arena::owner(const void *p)
+{
+    for (Arena *a = arenas; a; a = a->next)
+        if (a->contains(p))
+            return a;
+
+    return NULL;
+}
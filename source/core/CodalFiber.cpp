@@ -33,6 +33,7 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalConfig.h"
 #include "CodalFiber.h"
 #include "Timer.h"
+#include "CodalHeapAllocator.h"
 #include "codal_target_hal.h"
 
 #define INITIAL_STACK_DEPTH (fiber_initial_stack_base() - 0x04)
@@ -826,7 +827,7 @@ void codal::verify_stack_size(Fiber *f)
             free((void *)f->stack_bottom);
 
         // Allocate a new one of the appropriate size.
-        f->stack_bottom = (PROCESSOR_WORD_TYPE)malloc(bufferSize);
+        f->stack_bottom = (PROCESSOR_WORD_TYPE)device_malloc_region(bufferSize, DEVICE_HEAP_PLACEMENT_FIBER_STACK);
 
         // Recalculate where the top of the stack is and we're done.
         f->stack_top = f->stack_bottom + bufferSize;
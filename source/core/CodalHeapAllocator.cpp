@@ -78,6 +78,9 @@ void device_heap_print(HeapDefinition &heap)
         return;
     }
 
+    if (heap.name)
+        DMESG("heap_name  : %s\n", heap.name);
+
     DMESG("heap_start : %d\n", heap.heap_start);
     DMESG("heap_end   : %d\n", heap.heap_end);
     DMESG("heap_size  : %d\n", (int)heap.heap_end - (int)heap.heap_start);
@@ -108,6 +111,8 @@ void device_heap_print(HeapDefinition &heap)
     DMESG("\n");
     DMESG("mb_total_free : %d\n", totalFreeBlock*DEVICE_HEAP_BLOCK_SIZE);
     DMESG("mb_total_used : %d\n", totalUsedBlock*DEVICE_HEAP_BLOCK_SIZE);
+    DMESG("mb_peak_used  : %d\n", heap.stats.peak_bytes_in_use);
+    DMESG("mb_failures   : %d\n", heap.stats.failures);
 }
 
 
@@ -132,6 +137,10 @@ void device_heap_print()
   *
   * @param end The end address of memory to use as a heap region.
   *
+  * @param regions The DEVICE_HEAP_REGION_* kinds of memory this heap provides. Defaults to all kinds.
+  *
+  * @param name An optional, human readable name for this heap.
+  *
   * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the heap could not be allocated.
   *
   * @note Only code that #includes DeviceHeapAllocator.h will use this heap. This includes all codal device runtime
@@ -139,7 +148,7 @@ void device_heap_print()
   * simply use the standard heap.
   */
 
-int device_create_heap(PROCESSOR_WORD_TYPE start, PROCESSOR_WORD_TYPE end)
+int device_create_heap(PROCESSOR_WORD_TYPE start, PROCESSOR_WORD_TYPE end, uint8_t regions, const char *name)
 {
     HeapDefinition *h = &heap[heap_count];
 
@@ -159,6 +168,10 @@ int device_create_heap(PROCESSOR_WORD_TYPE start, PROCESSOR_WORD_TYPE end)
     // Record the dimensions of this new heap
     h->heap_start = (PROCESSOR_WORD_TYPE *)start;
     h->heap_end = (PROCESSOR_WORD_TYPE *)end;
+    h->name = name;
+    h->regions = regions & DEVICE_HEAP_REGION_ANY;
+    h->generation = 0;
+    memset(&h->stats, 0, sizeof(HeapStatistics));
 
     // Initialise the heap as being completely empty and available for use.
     *h->heap_start = DEVICE_HEAP_BLOCK_FREE | (((PROCESSOR_WORD_TYPE) h->heap_end - (PROCESSOR_WORD_TYPE) h->heap_start) / DEVICE_HEAP_BLOCK_SIZE);
@@ -183,6 +196,84 @@ uint32_t device_heap_size(uint8_t heap_index)
     return (uint8_t*)h->heap_end - (uint8_t*)h->heap_start;
 }
 
+/**
+ * Determines the index of the heap with the given name.
+ *
+ * @param name the name given to the heap when it was created.
+ *
+ * @return the index of the heap, or DEVICE_INVALID_PARAMETER if no such heap exists.
+ */
+int device_heap_find(const char *name)
+{
+    if (name == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    for (int i=0; i < heap_count; i++)
+        if (heap[i].name && strcmp(heap[i].name, name) == 0)
+            return i;
+
+    return DEVICE_INVALID_PARAMETER;
+}
+
+/**
+ * Retrieves the usage statistics of a given heap.
+ *
+ * @param heap_index index between 0 and DEVICE_MAXIMUM_HEAPS-1
+ *
+ * @param stats the structure to populate.
+ *
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if no such heap exists.
+ */
+int device_heap_statistics(uint8_t heap_index, HeapStatistics *stats)
+{
+    if (heap_index >= heap_count || stats == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    target_disable_irq();
+    *stats = heap[heap_index].stats;
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+  * Bounds the time spent with interrupts disabled during a heap scan, by briefly enabling them
+  * once DEVICE_HEAP_CRITICAL_SECTION_BLOCKS blocks have been examined.
+  *
+  * If an interrupt handler restructured the heap meanwhile, the scan position may no longer be a valid
+  * block header, so the scan must start again. After a few attempts, the scan completes without yielding.
+  *
+  * @return true if the scan must be restarted, false otherwise.
+  */
+static inline bool device_heap_yield(HeapDefinition &heap, uint32_t &scanned, uint32_t generation, int &restarts)
+{
+#if (DEVICE_HEAP_CRITICAL_SECTION_BLOCKS > 0)
+    if (scanned >= DEVICE_HEAP_CRITICAL_SECTION_BLOCKS && restarts < DEVICE_HEAP_MAXIMUM_RESTARTS)
+    {
+        if (scanned > heap.stats.max_critical_blocks)
+            heap.stats.max_critical_blocks = scanned;
+        scanned = 0;
+
+        target_enable_irq();
+        target_disable_irq();
+
+        if (heap.generation != generation)
+        {
+            restarts++;
+            heap.stats.restarts++;
+            scanned = 0;
+            return true;
+        }
+    }
+#else
+    (void)heap;
+    (void)scanned;
+    (void)generation;
+    (void)restarts;
+#endif
+    return false;
+}
+
 /**
   * Attempt to allocate a given amount of memory from a given heap area.
   *
@@ -197,6 +288,9 @@ void *device_malloc_in(size_t size, HeapDefinition &heap)
     PROCESSOR_WORD_TYPE	blocksNeeded = size % DEVICE_HEAP_BLOCK_SIZE == 0 ? size / DEVICE_HEAP_BLOCK_SIZE : size / DEVICE_HEAP_BLOCK_SIZE + 1;
     PROCESSOR_WORD_TYPE	*block;
     PROCESSOR_WORD_TYPE	*next;
+    uint32_t scanned = 0;
+    uint32_t generation;
+    int restarts = 0;
 
     if (size <= 0)
         return NULL;
@@ -207,11 +301,19 @@ void *device_malloc_in(size_t size, HeapDefinition &heap)
     // Disable IRQ temporarily to ensure no race conditions!
     target_disable_irq();
 
+restart:
+    generation = heap.generation;
+
     // We implement a first fit algorithm with cache to handle rapid churn...
     // We also defragment free blocks as we search, to optimise this and future searches.
     block = heap.heap_start;
     while (block < heap.heap_end)
     {
+        if (device_heap_yield(heap, scanned, generation, restarts))
+            goto restart;
+
+        scanned++;
+
         // If the block is used, then keep looking.
         if(!(*block & DEVICE_HEAP_BLOCK_FREE))
         {
@@ -233,7 +335,15 @@ void *device_malloc_in(size_t size, HeapDefinition &heap)
             blockSize += (*next & ~DEVICE_HEAP_BLOCK_FREE);
             *block = blockSize | DEVICE_HEAP_BLOCK_FREE;
 
+            // Merging moves block boundaries, so let any interrupted allocations know, even if this one fails.
+            // Interrupts have been disabled since the last yield, so no other change can be hidden by this.
+            generation = ++heap.generation;
+
             next = block + blockSize;
+            scanned++;
+
+            if (device_heap_yield(heap, scanned, generation, restarts))
+                goto restart;
         }
 
         // We have a free block. Let's see if it's big enough.
@@ -245,9 +355,13 @@ void *device_malloc_in(size_t size, HeapDefinition &heap)
         block += blockSize;
     }
 
+    if (scanned > heap.stats.max_critical_blocks)
+        heap.stats.max_critical_blocks = scanned;
+
     // We're full!
     if (block >= heap.heap_end)
     {
+        heap.stats.failures++;
         target_enable_irq();
         return NULL;
     }
@@ -268,6 +382,14 @@ void *device_malloc_in(size_t size, HeapDefinition &heap)
         *block = blocksNeeded;
     }
 
+    // Let any interrupted allocations know that the heap has been restructured.
+    heap.generation++;
+
+    heap.stats.allocations++;
+    heap.stats.bytes_in_use += *block * DEVICE_HEAP_BLOCK_SIZE;
+    if (heap.stats.bytes_in_use > heap.stats.peak_bytes_in_use)
+        heap.stats.peak_bytes_in_use = heap.stats.bytes_in_use;
+
     // Enable Interrupts
     target_enable_irq();
 
@@ -275,16 +397,20 @@ void *device_malloc_in(size_t size, HeapDefinition &heap)
 }
 
 /**
-  * Attempt to allocate a given amount of memory from any of our configured heap areas.
+  * Attempt to allocate a given amount of memory, preferring heaps that provide the given kind of memory.
+  * Heaps matching the placement hint are tried in creation order, followed by all other heaps
+  * unless DEVICE_HEAP_PLACEMENT_STRICT is set.
   *
   * @param size The amount of memory, in bytes, to allocate.
   *
+  * @param placement A bitmask of DEVICE_HEAP_REGION_* values, optionally with DEVICE_HEAP_PLACEMENT_STRICT.
+  *
   * @return A pointer to the allocated memory, or NULL if insufficient memory is available.
   */
-void* device_malloc (size_t size)
+void* device_malloc_region(size_t size, uint8_t placement)
 {
     static uint8_t initialised = 0;
-    void *p;
+    void *p = NULL;
 
     if (size <= 0)
         return NULL;
@@ -303,15 +429,20 @@ void* device_malloc (size_t size)
     }
 
 #if (DEVICE_MAXIMUM_HEAPS == 1)
-    p = device_malloc_in(size, heap[0]);
+    // There is nothing to fall back to, but a strict request must still be refused by a heap of the wrong kind.
+    if ((heap[0].regions & placement) || !(placement & DEVICE_HEAP_PLACEMENT_STRICT))
+        p = device_malloc_in(size, heap[0]);
 #else
-    // Assign the memory from the first heap created that has space.
-    for (int i=0; i < heap_count; i++)
-    {
-        p = device_malloc_in(size, heap[i]);
-        if (p != NULL)
-            break;
-    }
+    // Assign the memory from the first heap created that has space and provides the requested kind of memory.
+    for (int i=0; i < heap_count && p == NULL; i++)
+        if (heap[i].regions & placement)
+            p = device_malloc_in(size, heap[i]);
+
+    // Otherwise, fall back to the first of the remaining heaps that has space.
+    if (!(placement & DEVICE_HEAP_PLACEMENT_STRICT))
+        for (int i=0; i < heap_count && p == NULL; i++)
+            if (!(heap[i].regions & placement))
+                p = device_malloc_in(size, heap[i]);
 #endif
 
     if (p != NULL)
@@ -335,6 +466,18 @@ void* device_malloc (size_t size)
     return NULL;
 }
 
+/**
+  * Attempt to allocate a given amount of memory from any of our configured heap areas.
+  *
+  * @param size The amount of memory, in bytes, to allocate.
+  *
+  * @return A pointer to the allocated memory, or NULL if insufficient memory is available.
+  */
+void* device_malloc (size_t size)
+{
+    return device_malloc_region(size, DEVICE_HEAP_REGION_GENERAL);
+}
+
 /**
   * Release a given area of memory from the heap.
   *
@@ -366,7 +509,14 @@ void device_free (void *mem)
             // flag that this memory area is now free, and we're done.
             if (*cb == 0 || *cb & DEVICE_HEAP_BLOCK_FREE)
                 target_panic(DEVICE_HEAP_ERROR);
+
+            target_disable_irq();
+            heap[i].stats.frees++;
+            heap[i].stats.bytes_in_use -= *cb * DEVICE_HEAP_BLOCK_SIZE;
+
+            // Freeing does not move any block boundaries, so interrupted scans remain valid and the generation is unchanged.
             *cb |= DEVICE_HEAP_BLOCK_FREE;
+            target_enable_irq();
             return;
         }
     }
@@ -375,6 +525,7 @@ void device_free (void *mem)
     target_panic(DEVICE_HEAP_ERROR);
 }
 
+#if CONFIG_ENABLED(DEVICE_HEAP_REPLACE_LIBC)
 void* calloc (size_t num, size_t size)
 {
     void *mem = malloc(num*size);
@@ -388,10 +539,11 @@ void* calloc (size_t num, size_t size)
 
     return mem;
 }
+#endif
 
 extern "C" void* device_realloc (void* ptr, size_t size)
 {
-    void *mem = malloc(size);
+    void *mem = device_malloc(size);
 
     // handle the simplest case - no previous memory allocted.
     if (ptr != NULL && mem != NULL)
@@ -402,12 +554,13 @@ extern "C" void* device_realloc (void* ptr, size_t size)
         PROCESSOR_WORD_TYPE blockSize = *cb & ~DEVICE_HEAP_BLOCK_FREE;
 
         memcpy(mem, ptr, min(blockSize * sizeof(PROCESSOR_WORD_TYPE), size));
-        free(ptr);
+        device_free(ptr);
     }
 
     return mem;
 }
 
+#if CONFIG_ENABLED(DEVICE_HEAP_REPLACE_LIBC)
 void *malloc(size_t sz) __attribute__ ((weak, alias ("device_malloc")));
 void free(void *mem) __attribute__ ((weak, alias ("device_free")));
 void* realloc (void* ptr, size_t size) __attribute__ ((weak, alias ("device_realloc")));
@@ -423,5 +576,6 @@ void _free_r(struct _reent *, void *addr)
 {
     free(addr);
 }
+#endif
 
 #endif
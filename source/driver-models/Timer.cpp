@@ -43,6 +43,12 @@ DEALINGS IN THE SOFTWARE.
 
 using namespace codal;
 
+//
+// Prevents the compiler from moving memory accesses across this point, so that the time fields
+// are read between the two reads of the sequence counter.
+//
+#define TIMER_COMPILER_BARRIER()    __asm__ __volatile__ ("" ::: "memory")
+
 //
 // Default system wide timer, if created.
 //
@@ -69,24 +75,244 @@ void Timer::triggerIn(CODAL_TIMESTAMP t)
     target_enable_irq();
 }
 
+/**
+ * Retrieves an unused TimerEvent. The event does not become active until it is passed to queueTimerEvent().
+ *
+ * @return a free TimerEvent, or NULL if none are available.
+ */
 TimerEvent *Timer::getTimerEvent()
 {
-    // Find the first unused slot, and assign it.
-    for (int i=0; i < eventListSize; i++)
+    // Free events are always held immediately after the active events in the queue.
+    if (eventQueueLength < eventListSize)
+        return timerEventQueue[eventQueueLength];
+
+    return NULL;
+}
+
+/**
+ * Adds a further CODAL_TIMER_EVENT_LIST_GROWTH free events to the event list, up to CODAL_TIMER_MAXIMUM_EVENT_LIST_SIZE.
+ * Existing events are never moved, so this is safe to call while events are active.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the list could not be extended.
+ */
+int Timer::growTimerEventList()
+{
+    int currentSize = eventListSize;
+    int growth = min(CODAL_TIMER_EVENT_LIST_GROWTH, CODAL_TIMER_MAXIMUM_EVENT_LIST_SIZE - currentSize);
+
+    if (growth <= 0)
+        return DEVICE_NO_RESOURCES;
+
+    // Perform the allocations outside of the critical section.
+    TimerEvent *chunk = (TimerEvent *) malloc(sizeof(TimerEvent) * growth);
+    TimerEvent **queue = (TimerEvent **) malloc(sizeof(TimerEvent *) * (currentSize + growth));
+
+    if (chunk == NULL || queue == NULL)
     {
-        if (timerEventList[i].id == 0)
-            return &timerEventList[i];
+        free(chunk);
+        free(queue);
+        return DEVICE_NO_RESOURCES;
     }
 
-    // TODO: should try to realloc the list here.
-    return NULL;
+    memclr(chunk, sizeof(TimerEvent) * growth);
+
+    target_disable_irq();
+
+    // Another context may have extended the list while we were allocating.
+    if (eventListSize != currentSize)
+    {
+        target_enable_irq();
+        free(chunk);
+        free(queue);
+        return DEVICE_OK;
+    }
+
+    memcpy(queue, timerEventQueue, sizeof(TimerEvent *) * currentSize);
+    for (int i = 0; i < growth; i++)
+        queue[currentSize + i] = &chunk[i];
+
+    TimerEvent **oldQueue = timerEventQueue;
+    timerEventQueue = queue;
+    eventListSize = currentSize + growth;
+
+    target_enable_irq();
+
+    free(oldQueue);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Adds a TimerEvent previously returned by getTimerEvent() to the queue of active events.
+ * Must be called with interrupts disabled.
+ */
+void Timer::queueTimerEvent(TimerEvent *event)
+{
+    // Move the event to the head of the free area of the queue, if it isn't already there.
+    for (int i = eventQueueLength; i < eventListSize; i++)
+    {
+        if (timerEventQueue[i] == event)
+        {
+            timerEventQueue[i] = timerEventQueue[eventQueueLength];
+            timerEventQueue[eventQueueLength] = event;
+            break;
+        }
+    }
+
+    eventQueueLength++;
+    siftUp(eventQueueLength - 1);
+    updateSlack(eventQueueLength - 1);
+
+    if (eventQueueLength > eventQueueHighWater)
+        eventQueueHighWater = eventQueueLength;
+
+    nextTimerEvent = timerEventQueue[0];
 }
 
-void Timer::releaseTimerEvent(TimerEvent *event)
+/**
+ * Removes the active event at the given position in the queue, and returns it to the free area.
+ * Must be called with interrupts disabled.
+ */
+void Timer::removeTimerEvent(int position)
 {
+    TimerEvent *event = timerEventQueue[position];
+
     event->id = 0;
-    if (nextTimerEvent == event)
-        nextTimerEvent = NULL;
+    eventQueueLength--;
+
+    // Fill the hole with the last active event, and park the released event at the head of the free area.
+    timerEventQueue[position] = timerEventQueue[eventQueueLength];
+    timerEventQueue[eventQueueLength] = event;
+
+    // The parent of the vacated slot lost an event from its subtree.
+    if (eventQueueLength)
+        updateSlack((eventQueueLength - 1) >> 1);
+
+    if (position < eventQueueLength)
+    {
+        // At most one of these moves the event. Either way, every position changed lies on the path from where
+        // siftDown() leaves it to the head of the queue.
+        int last = siftDown(position);
+        siftUp(position);
+        updateSlack(last);
+    }
+
+    nextTimerEvent = eventQueueLength ? timerEventQueue[0] : NULL;
+}
+
+int Timer::siftUp(int position)
+{
+    TimerEvent *e = timerEventQueue[position];
+
+    while (position > 0)
+    {
+        int parent = (position - 1) >> 1;
+
+        if (!(e->deadline() < timerEventQueue[parent]->deadline()))
+            break;
+
+        timerEventQueue[position] = timerEventQueue[parent];
+        position = parent;
+    }
+
+    timerEventQueue[position] = e;
+
+    return position;
+}
+
+int Timer::siftDown(int position)
+{
+    TimerEvent *e = timerEventQueue[position];
+
+    while (true)
+    {
+        int child = 2 * position + 1;
+
+        if (child >= eventQueueLength)
+            break;
+
+        if (child + 1 < eventQueueLength && timerEventQueue[child + 1]->deadline() < timerEventQueue[child]->deadline())
+            child++;
+
+        if (!(timerEventQueue[child]->deadline() < e->deadline()))
+            break;
+
+        timerEventQueue[position] = timerEventQueue[child];
+        position = child;
+    }
+
+    timerEventQueue[position] = e;
+
+    return position;
+}
+
+void Timer::updateSlack(int position)
+{
+    while (true)
+    {
+        TimerEvent *e = timerEventQueue[position];
+        CODAL_TIMESTAMP slack = e->slack;
+        int child = 2 * position + 1;
+
+        if (child < eventQueueLength && timerEventQueue[child]->subtreeSlack > slack)
+            slack = timerEventQueue[child]->subtreeSlack;
+
+        if (child + 1 < eventQueueLength && timerEventQueue[child + 1]->subtreeSlack > slack)
+            slack = timerEventQueue[child + 1]->subtreeSlack;
+
+        e->subtreeSlack = slack;
+
+        if (position == 0)
+            break;
+
+        position = (position - 1) >> 1;
+    }
+}
+
+int Timer::findDueTimerEvent()
+{
+    int best = -1;
+    int position = 0;
+
+    // Visit the queue in pre-order, without recursion or a stack, as this runs in interrupt context.
+    while (true)
+    {
+        if (position < eventQueueLength)
+        {
+            TimerEvent *e = timerEventQueue[position];
+
+            // The queue is ordered by deadline, and no event in this subtree starts more than its subtreeSlack before
+            // its deadline. So unless that window has opened, nothing in this subtree is ready, and it can be skipped.
+            if (e->deadline() <= currentTimeUs + e->subtreeSlack)
+            {
+                if (currentTimeUs >= e->timestamp && (best < 0 || e->timestamp < timerEventQueue[best]->timestamp))
+                    best = position;
+
+                position = 2 * position + 1;
+                continue;
+            }
+        }
+
+        // Move on to the next subtree: climb out of right children (even positions), then step across to the sibling.
+        while (position > 0 && !(position & 1))
+            position = (position - 1) >> 1;
+
+        if (position == 0)
+            break;
+
+        position++;
+    }
+
+    return best;
+}
+
+/**
+ * Divides the given value by 1000, using a fixed point reciprocal rather than a (slow, or on many
+ * Cortex-M parts, software) division. The result is exact for all 32 bit values.
+ */
+static inline uint32_t udiv1000(uint32_t value)
+{
+    return (uint32_t)(((uint64_t)value * 0x10624DD3ULL) >> 38);
 }
 
 /**
@@ -106,16 +332,54 @@ Timer::Timer(LowLevelTimer& t, uint8_t ccPeriodChannel, uint8_t ccEventChannel)
     memclr(timerEventList, sizeof(TimerEvent) * CODAL_TIMER_DEFAULT_EVENT_LIST_SIZE);
     nextTimerEvent = NULL;
 
+    // All events start out free.
+    timerEventQueue = (TimerEvent **) malloc(sizeof(TimerEvent *) * CODAL_TIMER_DEFAULT_EVENT_LIST_SIZE);
+    for (int i = 0; i < CODAL_TIMER_DEFAULT_EVENT_LIST_SIZE; i++)
+        timerEventQueue[i] = &timerEventList[i];
+    eventQueueLength = 0;
+    eventQueueHighWater = 0;
+    dispatching = false;
+
+#if CONFIG_ENABLED(CODAL_TIMER_STATISTICS)
+    memclr(&statistics, sizeof(TimerStatistics));
+#endif
+
     // Reset clock
     currentTime = 0;
     currentTimeUs = 0;
 
+    // Determine the range of the hardware counter, so that we can correctly measure time across overflows.
+    switch (timer.getBitMode())
+    {
+        case BitMode8:
+            counterMask = 0xFF;
+            break;
+
+        case BitMode24:
+            counterMask = 0xFFFFFF;
+            break;
+
+        case BitMode32:
+            counterMask = 0xFFFFFFFF;
+            break;
+
+        default:
+            counterMask = 0xFFFF;
+            break;
+    }
+
+    // The fallback interrupt syncs at least every 10 seconds, and at least every quarter of the counter range.
+    // So unless the timer interrupt is held off for a further quarter of the range, no more than half the range
+    // elapses between syncs, and no counter overflow can be missed.
+    fallbackPeriod = min(10000000, (counterMask >> 2) + 1);
+
     timer.setIRQ(timer_callback);
-    timer.setCompare(ccPeriodChannel, 10000000);
+    timer.setCompare(ccPeriodChannel, fallbackPeriod);
     timer.enable();
 
+    sequence = 0;
     delta = 0;
-    sigma = timer.captureCounter();
+    sigma = timer.captureCounter() & counterMask;
 
     system_timer_calibrate_cycles();
 }
@@ -128,8 +392,22 @@ Timer::Timer(LowLevelTimer& t, uint8_t ccPeriodChannel, uint8_t ccEventChannel)
  */
 CODAL_TIMESTAMP Timer::getTime()
 {
-    sync();
-    return currentTime;
+    uint32_t seq;
+    uint32_t elapsed;
+    CODAL_TIMESTAMP t;
+    uint32_t d;
+
+    do
+    {
+        seq = sequence;
+        TIMER_COMPILER_BARRIER();
+        t = currentTime;
+        d = delta;
+        elapsed = elapsedSinceSync();
+        TIMER_COMPILER_BARRIER();
+    } while (seq != sequence);
+
+    return t + udiv1000(d + elapsed);
 }
 
 /**
@@ -140,8 +418,20 @@ CODAL_TIMESTAMP Timer::getTime()
  */
 CODAL_TIMESTAMP Timer::getTimeUs()
 {
-    sync();
-    return currentTimeUs;
+    uint32_t seq;
+    uint32_t elapsed;
+    CODAL_TIMESTAMP t;
+
+    do
+    {
+        seq = sequence;
+        TIMER_COMPILER_BARRIER();
+        t = currentTimeUs;
+        elapsed = elapsedSinceSync();
+        TIMER_COMPILER_BARRIER();
+    } while (seq != sequence);
+
+    return t + elapsed;
 }
 
 int Timer::disableInterrupts()
@@ -156,22 +446,31 @@ int Timer::enableInterrupts()
     return DEVICE_OK;
 }
 
-int Timer::setEvent(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, bool repeat)
+int Timer::setEvent(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, bool repeat, CODAL_TIMESTAMP slack, TimerCallback callback, void *context)
 {
-    TimerEvent *evt = getTimerEvent();
-    if (evt == NULL)
-        return DEVICE_NO_RESOURCES;
-
-    evt->set(getTimeUs() + period, repeat ? period: 0, id, value);
+    // Make sure there is space for this event before entering the critical section, keeping some in reserve for
+    // timer callbacks. Memory is never allocated when called from a callback, as that runs in interrupt context.
+    if (!dispatching && eventListSize - eventQueueLength <= CODAL_TIMER_EVENT_LIST_RESERVE)
+        growTimerEventList();
 
     target_disable_irq();
 
-    if (nextTimerEvent == NULL || evt->timestamp < nextTimerEvent->timestamp)
+    TimerEvent *evt = getTimerEvent();
+    if (evt == NULL)
     {
-        nextTimerEvent = evt;
-        triggerIn(period);
+        target_enable_irq();
+        return DEVICE_NO_RESOURCES;
     }
 
+    evt->set(getTimeUs() + period, repeat ? period: 0, id, value, slack);
+    evt->callback = callback;
+    evt->context = context;
+    queueTimerEvent(evt);
+
+    // If this now has the earliest deadline, reschedule the hardware timer.
+    if (nextTimerEvent == evt)
+        triggerIn(period + slack);
+
     target_enable_irq();
 
     return DEVICE_OK;
@@ -190,27 +489,119 @@ int Timer::cancel(uint16_t id, uint16_t value)
     int res = DEVICE_INVALID_PARAMETER;
 
     target_disable_irq();
-    if (nextTimerEvent && nextTimerEvent->id == id && nextTimerEvent->value == value)
+
+    for (int i = 0; i < eventQueueLength; i++)
     {
-        nextTimerEvent->id = 0;
-        recomputeNextTimerEvent();
-        res = DEVICE_OK;
+        if (timerEventQueue[i]->callback == NULL && timerEventQueue[i]->id == id && timerEventQueue[i]->value == value)
+        {
+            removeTimerEvent(i);
+
+            // If we removed the earliest event, reschedule the hardware timer.
+            if (i == 0)
+                recomputeNextTimerEvent();
+
+            res = DEVICE_OK;
+            break;
+        }
     }
-    else
-        for (int i=0; i<eventListSize; i++)
+
+    target_enable_irq();
+
+    return res;
+}
+
+/**
+ * Cancels a callback timer matching the given callback and context.
+ *
+ * @param callback the function that was given upon a previous call to callbackEveryUs / callbackAfterUs
+ *
+ * @param context the context that was given upon a previous call to callbackEveryUs / callbackAfterUs
+ *
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if no matching callback timer was found.
+ */
+int Timer::cancelCallback(TimerCallback callback, void *context)
+{
+    int res = DEVICE_INVALID_PARAMETER;
+
+    target_disable_irq();
+
+    for (int i = 0; i < eventQueueLength; i++)
+    {
+        if (timerEventQueue[i]->callback == callback && timerEventQueue[i]->context == context)
         {
-            if (timerEventList[i].id == id && timerEventList[i].value == value)
-            {
-                timerEventList[i].id = 0;
-                res = DEVICE_OK;
-                break;
-            }
+            removeTimerEvent(i);
+
+            if (i == 0)
+                recomputeNextTimerEvent();
+
+            res = DEVICE_OK;
+            break;
         }
+    }
+
     target_enable_irq();
 
     return res;
 }
 
+/**
+ * Determines the number of timer events that can currently be held without allocating more memory.
+ */
+int Timer::getEventListSize()
+{
+    return eventListSize;
+}
+
+/**
+ * Retrieves a snapshot of how late this Timer has been dispatching events.
+ *
+ * @param stats the structure to fill in.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if CODAL_TIMER_STATISTICS is not enabled.
+ */
+int Timer::getStatistics(TimerStatistics *stats)
+{
+#if CONFIG_ENABLED(CODAL_TIMER_STATISTICS)
+    if (stats == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    target_disable_irq();
+    memcpy(stats, &statistics, sizeof(TimerStatistics));
+    target_enable_irq();
+
+    return DEVICE_OK;
+#else
+    (void)stats;
+    return DEVICE_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * Clears the statistics returned by getStatistics.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if CODAL_TIMER_STATISTICS is not enabled.
+ */
+int Timer::resetStatistics()
+{
+#if CONFIG_ENABLED(CODAL_TIMER_STATISTICS)
+    target_disable_irq();
+    memclr(&statistics, sizeof(TimerStatistics));
+    target_enable_irq();
+
+    return DEVICE_OK;
+#else
+    return DEVICE_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * Determines the largest number of timer events that have been active at any one time.
+ */
+int Timer::getEventHighWaterMark()
+{
+    return eventQueueHighWater;
+}
+
 /**
  * Configures this Timer instance to fire an event after period
  * milliseconds.
@@ -220,10 +611,12 @@ int Timer::cancel(uint16_t id, uint16_t value)
  * @param id the ID to be used in event generation.
  *
  * @param value the value to place into the Events' value field.
+ *
+ * @param slack the time by which the event may be delayed so that it can be combined with other events.
  */
-int Timer::eventAfter(CODAL_TIMESTAMP period, uint16_t id, uint16_t value)
+int Timer::eventAfter(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack)
 {
-    return eventAfterUs(period*1000, id, value);
+    return eventAfterUs(period*1000, id, value, slack*1000);
 }
 
 /**
@@ -235,10 +628,12 @@ int Timer::eventAfter(CODAL_TIMESTAMP period, uint16_t id, uint16_t value)
  * @param id the ID to be used in event generation.
  *
  * @param value the value to place into the Events' value field.
+ *
+ * @param slack the time by which the event may be delayed so that it can be combined with other events.
  */
-int Timer::eventAfterUs(CODAL_TIMESTAMP period, uint16_t id, uint16_t value)
+int Timer::eventAfterUs(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack)
 {
-    return setEvent(period, id, value, false);
+    return setEvent(period, id, value, false, slack);
 }
 
 /**
@@ -250,10 +645,12 @@ int Timer::eventAfterUs(CODAL_TIMESTAMP period, uint16_t id, uint16_t value)
  * @param id the ID to be used in event generation.
  *
  * @param value the value to place into the Events' value field.
+ *
+ * @param slack the time by which the event may be delayed so that it can be combined with other events.
  */
-int Timer::eventEvery(CODAL_TIMESTAMP period, uint16_t id, uint16_t value)
+int Timer::eventEvery(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack)
 {
-    return eventEveryUs(period*1000, id, value);
+    return eventEveryUs(period*1000, id, value, slack*1000);
 }
 
 /**
@@ -265,10 +662,52 @@ int Timer::eventEvery(CODAL_TIMESTAMP period, uint16_t id, uint16_t value)
  * @param id the ID to be used in event generation.
  *
  * @param value the value to place into the Events' value field.
+ *
+ * @param slack the time by which the event may be delayed so that it can be combined with other events.
+ */
+int Timer::eventEveryUs(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack)
+{
+    return setEvent(period, id, value, true, slack);
+}
+
+/**
+ * Configures this Timer instance to invoke a function after period microseconds.
+ * The callback is invoked directly from the timer interrupt, so it must be short and must not block.
+ *
+ * @param period the period to wait until the callback is invoked, in microseconds.
+ *
+ * @param callback the function to invoke.
+ *
+ * @param context an arbitrary pointer passed to the callback.
+ *
+ * @param slack the time by which the callback may be delayed so that it can be combined with other events.
+ */
+int Timer::callbackAfterUs(CODAL_TIMESTAMP period, TimerCallback callback, void *context, CODAL_TIMESTAMP slack)
+{
+    if (callback == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    return setEvent(period, 0, 0, false, slack, callback, context);
+}
+
+/**
+ * Configures this Timer instance to invoke a function every period microseconds.
+ * The callback is invoked directly from the timer interrupt, so it must be short and must not block.
+ *
+ * @param period the interval between invocations of the callback, in microseconds.
+ *
+ * @param callback the function to invoke.
+ *
+ * @param context an arbitrary pointer passed to the callback.
+ *
+ * @param slack the time by which the callback may be delayed so that it can be combined with other events.
  */
-int Timer::eventEveryUs(CODAL_TIMESTAMP period, uint16_t id, uint16_t value)
+int Timer::callbackEveryUs(CODAL_TIMESTAMP period, TimerCallback callback, void *context, CODAL_TIMESTAMP slack)
 {
-    return setEvent(period, id, value, true);
+    if (callback == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    return setEvent(period, 0, 0, true, slack, callback, context);
 }
 
 /**
@@ -281,48 +720,68 @@ void Timer::sync()
     // sync(), it might call into getTimeUs(), which would call sync()
     target_disable_irq();
 
-    uint32_t val = timer.captureCounter();
-    uint32_t elapsed = 0;
+    uint32_t val = timer.captureCounter() & counterMask;
+
+    // note that this also works when the timer overflows
+    uint32_t elapsed = (val - sigma) & counterMask;
+
+    // Readers retry if the sequence changes (or is odd) while they are reading.
+    sequence++;
+    TIMER_COMPILER_BARRIER();
 
-    // assume at least 16 bit counter; note that this also works when the timer overflows
-    elapsed = (uint16_t)(val - sigma);
     sigma = val;
 
     // advance main timer
     currentTimeUs += elapsed;
 
-    // the 64 bit division is ~150 cycles
-    // this is called at least every few ms, and quite possibly much more often
+    // carry whole milliseconds across, using a multiply rather than a division
     delta += elapsed;
-    while (delta >= 1000) {
-        currentTime++;
-        delta -= 1000;
+    if (delta >= 1000)
+    {
+        uint32_t ms = udiv1000(delta);
+        currentTime += ms;
+        delta -= ms * 1000;
     }
 
+    TIMER_COMPILER_BARRIER();
+    sequence++;
+
     target_enable_irq();
 }
 
-void Timer::recomputeNextTimerEvent()
+/**
+ * Determines the number of microseconds that have elapsed on the low level timer since the last sync().
+ * The caller must validate the result against the sequence counter.
+ */
+uint32_t Timer::elapsedSinceSync()
 {
-    nextTimerEvent = NULL;
-
-    TimerEvent *e = timerEventList;
+    uint32_t elapsed = (timer.captureCounter() - sigma) & counterMask;
 
-    // Find the next most recent and schedule it.
-    for (int i = 0; i < eventListSize; i++)
+    // The fallback interrupt keeps this below half the counter range. If it is larger, the timer interrupt has been
+    // held off for a long time (for example, a spin wait with interrupts disabled), and we may be close to losing a
+    // counter overflow. Bring our time up to date before that happens. If interrupts are disabled and time is not
+    // read at all for a whole counter range (65ms for a 16 bit microsecond counter), that time is lost.
+    if (elapsed > (counterMask >> 1))
     {
-        if (e->id != 0 && (nextTimerEvent == NULL || (e->timestamp < nextTimerEvent->timestamp)))
-            nextTimerEvent = e;
-        e++;
+        sync();
+        elapsed = 0;
     }
 
+    return elapsed;
+}
+
+void Timer::recomputeNextTimerEvent()
+{
+    // The earliest event is always at the head of the queue.
+    nextTimerEvent = eventQueueLength ? timerEventQueue[0] : NULL;
+
     if (nextTimerEvent) {
         // this may possibly happen if a new timer event was added to the queue while
         // we were running - it might be already in the past
-        if (nextTimerEvent->timestamp < currentTimeUs + CODAL_TIMER_MINIMUM_PERIOD)
+        if (nextTimerEvent->deadline() < currentTimeUs + CODAL_TIMER_MINIMUM_PERIOD)
             triggerIn(CODAL_TIMER_MINIMUM_PERIOD);
         else
-            triggerIn(nextTimerEvent->timestamp - currentTimeUs);
+            triggerIn(nextTimerEvent->deadline() - currentTimeUs);
     }
 }
 
@@ -332,47 +791,96 @@ void Timer::recomputeNextTimerEvent()
 void Timer::trigger(bool isFallback)
 {
     if (isFallback)
-        timer.setCompare(ccPeriodChannel, timer.captureCounter() + 10000000);
-
-    int eventsFired;
+        timer.setCompare(ccPeriodChannel, (timer.captureCounter() + fallbackPeriod) & counterMask);
 
     sync();
 
-    // Now, walk the list and trigger any events that are pending.
-    do
+#if CONFIG_ENABLED(CODAL_TIMER_STATISTICS)
+    statistics.interrupts++;
+#endif
+
+    // Now, trigger any events that are pending, earliest first.
+    // This includes any events whose slack window has opened, so that they are serviced by this interrupt.
+    dispatching = true;
+
+    while (true)
     {
-        eventsFired = 0;
-        TimerEvent *e = timerEventList;
+        target_disable_irq();
 
-        for (int i = 0; i<eventListSize; i++)
+        int position = findDueTimerEvent();
+
+        if (position < 0)
         {
-            if (e->id != 0 && currentTimeUs >= e->timestamp)
-            {
-                uint16_t id = e->id;
-                uint16_t value = e->value;
-
-                // Release before triggering event. Otherwise, an immediate event handler
-                // can cancel this event, another event might be put in its place
-                // and we end up releasing (or repeating) a completely different event.
-                if (e->period == 0)
-                    releaseTimerEvent(e);
-                else
-                    e->timestamp += e->period;
-
-                // We need to trigger this event.
+            target_enable_irq();
+            break;
+        }
+
+        TimerEvent *e = timerEventQueue[position];
+        uint16_t id = e->id;
+        uint16_t value = e->value;
+        TimerCallback callback = e->callback;
+        void *context = e->context;
+
+#if CONFIG_ENABLED(CODAL_TIMER_STATISTICS)
+        uint32_t lateness = currentTimeUs - e->timestamp;
+        int bucket = 0;
+
+        while (lateness >> bucket && bucket < CODAL_TIMER_LATENESS_BUCKETS - 1)
+            bucket++;
+
+        statistics.dispatched++;
+        statistics.totalLateness += lateness;
+        statistics.histogram[bucket]++;
+        if (lateness > statistics.maximumLateness)
+            statistics.maximumLateness = lateness;
+#endif
+
+        // Release before triggering event. Otherwise, an immediate event handler
+        // can cancel this event, another event might be put in its place
+        // and we end up releasing (or repeating) a completely different event.
+        if (e->period == 0)
+        {
+            removeTimerEvent(position);
+        }
+        else
+        {
+            e->timestamp += e->period;
+            updateSlack(siftDown(position));
+            nextTimerEvent = timerEventQueue[0];
+        }
+
+        target_enable_irq();
+
+        // Callback timers are serviced here and now, without involving the MessageBus.
+        if (callback)
+        {
+#if CONFIG_ENABLED(CODAL_TIMER_STATISTICS)
+            statistics.callbacks++;
+#endif
+            callback(context);
+            continue;
+        }
+
+#if CONFIG_ENABLED(CODAL_TIMER_STATISTICS)
+        // Measure the cost of raising the Event, which is what a callback timer saves.
+        CODAL_TIMESTAMP raised = getTimeUs();
+#endif
+
+        // We need to trigger this event.
 #if CONFIG_ENABLED(LIGHTWEIGHT_EVENTS)
-                Event evt(id, value, currentTime);
+        Event evt(id, value, currentTime);
 #else
-                Event evt(id, value, currentTimeUs);
+        Event evt(id, value, currentTimeUs);
 #endif
 
-                // TODO: Handle rollover case above...
-                eventsFired++;
-            }
-            e++;
-        }
+#if CONFIG_ENABLED(CODAL_TIMER_STATISTICS)
+        statistics.eventDispatchTime += getTimeUs() - raised;
+#endif
+
+        // TODO: Handle rollover case above...
+    }
 
-    } while (eventsFired);
+    dispatching = false;
 
     // always recompute nextTimerEvent - event firing could have added new timer events
     recomputeNextTimerEvent();
@@ -425,14 +933,16 @@ CODAL_TIMESTAMP codal::system_timer_current_time_us()
   *
   * @param the value to fire against the current system_timer id.
   *
+  * @param slack the time by which the event may be delayed to combine it with other events.
+  *
   * @return DEVICE_OK or DEVICE_NOT_SUPPORTED if no timer has been registered.
   */
-int codal::system_timer_event_every_us(CODAL_TIMESTAMP period, uint16_t id, uint16_t value)
+int codal::system_timer_event_every_us(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack)
 {
     if(system_timer == NULL)
         return DEVICE_NOT_SUPPORTED;
 
-    return system_timer->eventEveryUs(period, id, value);
+    return system_timer->eventEveryUs(period, id, value, slack);
 }
 
 /**
@@ -442,14 +952,16 @@ int codal::system_timer_event_every_us(CODAL_TIMESTAMP period, uint16_t id, uint
   *
   * @param the value to fire against the current system_timer id.
   *
+  * @param slack the time by which the event may be delayed to combine it with other events.
+  *
   * @return DEVICE_OK or DEVICE_NOT_SUPPORTED if no timer has been registered.
   */
-int codal::system_timer_event_after_us(CODAL_TIMESTAMP period, uint16_t id, uint16_t value)
+int codal::system_timer_event_after_us(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack)
 {
     if(system_timer == NULL)
         return DEVICE_NOT_SUPPORTED;
 
-    return system_timer->eventAfterUs(period, id, value);
+    return system_timer->eventAfterUs(period, id, value, slack);
 }
 
 /**
@@ -459,14 +971,16 @@ int codal::system_timer_event_after_us(CODAL_TIMESTAMP period, uint16_t id, uint
   *
   * @param the value to fire against the current system_timer id.
   *
+  * @param slack the time by which the event may be delayed to combine it with other events.
+  *
   * @return DEVICE_OK or DEVICE_NOT_SUPPORTED if no timer has been registered.
   */
-int codal::system_timer_event_every(CODAL_TIMESTAMP period, uint16_t id, uint16_t value)
+int codal::system_timer_event_every(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack)
 {
     if(system_timer == NULL)
         return DEVICE_NOT_SUPPORTED;
 
-    return system_timer->eventEvery(period, id, value);
+    return system_timer->eventEvery(period, id, value, slack);
 }
 
 /**
@@ -476,14 +990,16 @@ int codal::system_timer_event_every(CODAL_TIMESTAMP period, uint16_t id, uint16_
   *
   * @param the value to fire against the current system_timer id.
   *
+  * @param slack the time by which the event may be delayed to combine it with other events.
+  *
   * @return DEVICE_OK or DEVICE_NOT_SUPPORTED if no timer has been registered.
   */
-int codal::system_timer_event_after(CODAL_TIMESTAMP period, uint16_t id, uint16_t value)
+int codal::system_timer_event_after(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, CODAL_TIMESTAMP slack)
 {
     if(system_timer == NULL)
         return DEVICE_NOT_SUPPORTED;
 
-    return system_timer->eventAfter(period, id, value);
+    return system_timer->eventAfter(period, id, value, slack);
 }
 
 /**
@@ -509,7 +1025,7 @@ int codal::system_timer_cancel_event(uint16_t id, uint16_t value)
  *
  * If this method is not called, a less accurate timer implementation is used in system_timer_wait_us.
  *
- * @return DEVICE_OK on success, and DEVICE_NOT_SUPPORTED if no system_timer yet exists.
+ * @return DEVICE_OK on success, and DEVICE_NOT_SUPPORTED if no system_timer yet exists, or it does not advance while spinning.
  */
 int codal::system_timer_calibrate_cycles()
 {
@@ -519,6 +1035,12 @@ int codal::system_timer_calibrate_cycles()
     uint32_t start = system_timer->getTimeUs();
     system_timer_wait_cycles(10000);
     uint32_t end = system_timer->getTimeUs();
+
+    // A timer that does not advance measurably while we spin (such as a SimulatedLowLevelTimer) cannot calibrate
+    // the wait loop, so timer based waits are used instead.
+    if (end - start <= 5)
+        return DEVICE_NOT_SUPPORTED;
+
     cycleScale = (10000) / (end - start - 5);
 
     return DEVICE_OK;
@@ -532,6 +1054,7 @@ int codal::system_timer_calibrate_cycles()
  */
 void codal::system_timer_wait_cycles(uint32_t cycles)
 {
+#if defined(__arm__) || defined(__thumb__)
     __asm__ __volatile__(
         ".syntax unified\n"
         "1:              \n"
@@ -541,6 +1064,12 @@ void codal::system_timer_wait_cycles(uint32_t cycles)
         :                    // no input
         :                    // no clobber
     );
+#else
+    // Any other architecture (such as a host build for benchmarking). Not cycle accurate, but calibrated as above.
+    volatile uint32_t n = cycles;
+    while (n)
+        n--;
+#endif
 }
 
 /**
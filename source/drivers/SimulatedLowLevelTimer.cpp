@@ -0,0 +1,222 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SimulatedLowLevelTimer.h"
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+SimulatedLowLevelTimer::SimulatedLowLevelTimer(TimerBitMode mode, uint32_t latency, uint8_t channels)
+    : LowLevelTimer(min(channels, SIMULATED_TIMER_MAXIMUM_CHANNELS))
+{
+    this->latency = latency;
+    this->interruptCount = 0;
+    this->running = false;
+    this->irqEnabled = false;
+    this->timer_pointer = NULL;
+
+    setBitMode(mode);
+    reset();
+
+    enabledChannels = 0;
+    pendingChannels = 0;
+    pendingDelay = 0;
+
+    for (int i = 0; i < SIMULATED_TIMER_MAXIMUM_CHANNELS; i++)
+        compare[i] = 0;
+}
+
+int SimulatedLowLevelTimer::enable()
+{
+    running = true;
+    irqEnabled = true;
+    return DEVICE_OK;
+}
+
+int SimulatedLowLevelTimer::enableIRQ()
+{
+    irqEnabled = true;
+    return DEVICE_OK;
+}
+
+int SimulatedLowLevelTimer::disable()
+{
+    running = false;
+    irqEnabled = false;
+    return DEVICE_OK;
+}
+
+int SimulatedLowLevelTimer::disableIRQ()
+{
+    irqEnabled = false;
+    return DEVICE_OK;
+}
+
+int SimulatedLowLevelTimer::reset()
+{
+    counter = 0;
+    return DEVICE_OK;
+}
+
+int SimulatedLowLevelTimer::setMode(TimerMode t)
+{
+    return t == TimerModeTimer ? DEVICE_OK : DEVICE_NOT_SUPPORTED;
+}
+
+int SimulatedLowLevelTimer::setCompare(uint8_t channel, uint32_t value)
+{
+    if (channel >= channel_count)
+        return DEVICE_INVALID_PARAMETER;
+
+    compare[channel] = value & mask;
+    enabledChannels |= 1 << channel;
+
+    return DEVICE_OK;
+}
+
+int SimulatedLowLevelTimer::offsetCompare(uint8_t channel, uint32_t value)
+{
+    if (channel >= channel_count)
+        return DEVICE_INVALID_PARAMETER;
+
+    compare[channel] = (compare[channel] + value) & mask;
+
+    return DEVICE_OK;
+}
+
+int SimulatedLowLevelTimer::clearCompare(uint8_t channel)
+{
+    if (channel >= channel_count)
+        return DEVICE_INVALID_PARAMETER;
+
+    compare[channel] = 0;
+    enabledChannels &= ~(1 << channel);
+    pendingChannels &= ~(1 << channel);
+
+    return DEVICE_OK;
+}
+
+uint32_t SimulatedLowLevelTimer::captureCounter()
+{
+    return counter;
+}
+
+int SimulatedLowLevelTimer::setClockSpeed(uint32_t)
+{
+    // The simulated counter advances one tick per call to advance(), whatever its nominal speed.
+    return DEVICE_OK;
+}
+
+int SimulatedLowLevelTimer::setBitMode(TimerBitMode t)
+{
+    switch (t)
+    {
+        case BitMode8:
+            mask = 0xFF;
+            break;
+
+        case BitMode16:
+            mask = 0xFFFF;
+            break;
+
+        case BitMode24:
+            mask = 0xFFFFFF;
+            break;
+
+        default:
+            mask = 0xFFFFFFFF;
+            break;
+    }
+
+    bitMode = t;
+    counter &= mask;
+
+    return DEVICE_OK;
+}
+
+void SimulatedLowLevelTimer::setInterruptLatency(uint32_t ticks)
+{
+    latency = ticks;
+}
+
+void SimulatedLowLevelTimer::advance(uint32_t ticks)
+{
+    while (true)
+    {
+        // Service any interrupt that is now due. The handler may set new compare values.
+        if (pendingChannels && pendingDelay == 0 && irqEnabled)
+        {
+            uint16_t channels = pendingChannels;
+            pendingChannels = 0;
+            interruptCount++;
+
+            if (timer_pointer)
+                timer_pointer(channels);
+
+            continue;
+        }
+
+        if (ticks == 0 || !running)
+            break;
+
+        // Move directly to the next point of interest: a compare match, or a pending interrupt becoming due.
+        uint32_t step = ticks;
+
+        for (int i = 0; i < channel_count; i++)
+        {
+            if (enabledChannels & (1 << i))
+            {
+                uint32_t gap = (compare[i] - counter - 1) & mask;
+                if (gap < step - 1)
+                    step = gap + 1;
+            }
+        }
+
+        if (pendingChannels && irqEnabled && pendingDelay < step)
+            step = pendingDelay;
+
+        counter = (counter + step) & mask;
+        ticks -= step;
+
+        if (pendingChannels)
+            pendingDelay = pendingDelay > step ? pendingDelay - step : 0;
+
+        for (int i = 0; i < channel_count; i++)
+        {
+            if ((enabledChannels & (1 << i)) && compare[i] == counter)
+            {
+                if (pendingChannels == 0)
+                    pendingDelay = latency;
+
+                pendingChannels |= 1 << i;
+            }
+        }
+    }
+}
+
+uint32_t SimulatedLowLevelTimer::getInterruptCount()
+{
+    return interruptCount;
+}
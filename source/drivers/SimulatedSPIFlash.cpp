@@ -0,0 +1,186 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SimulatedSPIFlash.h"
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+SimulatedSPIFlash::SimulatedSPIFlash(int pages)
+{
+    this->memory = (uint8_t *)malloc(pages * SPIFLASH_PAGE_SIZE);
+    this->pages = memory ? pages : 0;
+    this->reads = 0;
+    this->writes = 0;
+    this->smallRowErases = 0;
+    this->bigRowErases = 0;
+    this->violations = 0;
+    this->failCountdown = -1;
+
+    if (memory)
+        memset(memory, 0xFF, pages * SPIFLASH_PAGE_SIZE);
+}
+
+SimulatedSPIFlash::~SimulatedSPIFlash()
+{
+    free(memory);
+}
+
+bool SimulatedSPIFlash::fail()
+{
+    if (failCountdown < 0)
+        return false;
+
+    return failCountdown-- == 0;
+}
+
+int SimulatedSPIFlash::numPages()
+{
+    return pages;
+}
+
+int SimulatedSPIFlash::readBytes(uint32_t addr, void *buffer, uint32_t len)
+{
+    if (addr > (uint32_t)pages * SPIFLASH_PAGE_SIZE || len > (uint32_t)pages * SPIFLASH_PAGE_SIZE - addr)
+    {
+        violations++;
+        return DEVICE_INVALID_PARAMETER;
+    }
+
+    if (fail())
+        return DEVICE_SPI_ERROR;
+
+    memcpy(buffer, &memory[addr], len);
+    reads++;
+
+    return DEVICE_OK;
+}
+
+int SimulatedSPIFlash::writeBytes(uint32_t addr, const void *buffer, uint32_t len)
+{
+    // A write may not cross a page boundary: a real part wraps around to the start of the page instead.
+    if (len == 0 || len > SPIFLASH_PAGE_SIZE || addr / SPIFLASH_PAGE_SIZE != (addr + len - 1) / SPIFLASH_PAGE_SIZE || addr / SPIFLASH_PAGE_SIZE >= (uint32_t)pages)
+    {
+        violations++;
+        return DEVICE_INVALID_PARAMETER;
+    }
+
+    if (fail())
+        return DEVICE_SPI_ERROR;
+
+    const uint8_t *data = (const uint8_t *)buffer;
+
+    // Programming can only clear bits, so writing over data that has not been erased corrupts it.
+    for (uint32_t i = 0; i < len; i++)
+    {
+        if (memory[addr + i] != 0xFF)
+            violations++;
+
+        memory[addr + i] &= data[i];
+    }
+
+    writes++;
+
+    return DEVICE_OK;
+}
+
+int SimulatedSPIFlash::eraseSmallRow(uint32_t addr)
+{
+    if (addr % SPIFLASH_SMALL_ROW_SIZE || addr / SPIFLASH_PAGE_SIZE >= (uint32_t)pages)
+    {
+        violations++;
+        return DEVICE_INVALID_PARAMETER;
+    }
+
+    if (fail())
+        return DEVICE_SPI_ERROR;
+
+    memset(&memory[addr], 0xFF, min(SPIFLASH_SMALL_ROW_SIZE, pages * SPIFLASH_PAGE_SIZE - (int)addr));
+    smallRowErases++;
+
+    return DEVICE_OK;
+}
+
+int SimulatedSPIFlash::eraseBigRow(uint32_t addr)
+{
+    if (addr % SPIFLASH_BIG_ROW_SIZE || addr / SPIFLASH_PAGE_SIZE >= (uint32_t)pages)
+    {
+        violations++;
+        return DEVICE_INVALID_PARAMETER;
+    }
+
+    if (fail())
+        return DEVICE_SPI_ERROR;
+
+    memset(&memory[addr], 0xFF, min(SPIFLASH_BIG_ROW_SIZE, pages * SPIFLASH_PAGE_SIZE - (int)addr));
+    bigRowErases++;
+
+    return DEVICE_OK;
+}
+
+int SimulatedSPIFlash::eraseChip()
+{
+    if (fail())
+        return DEVICE_SPI_ERROR;
+
+    memset(memory, 0xFF, pages * SPIFLASH_PAGE_SIZE);
+
+    return DEVICE_OK;
+}
+
+void SimulatedSPIFlash::failAfter(int operations)
+{
+    failCountdown = operations;
+}
+
+const uint8_t *SimulatedSPIFlash::getBytes()
+{
+    return memory;
+}
+
+uint32_t SimulatedSPIFlash::getReadCount()
+{
+    return reads;
+}
+
+uint32_t SimulatedSPIFlash::getWriteCount()
+{
+    return writes;
+}
+
+uint32_t SimulatedSPIFlash::getSmallRowEraseCount()
+{
+    return smallRowErases;
+}
+
+uint32_t SimulatedSPIFlash::getBigRowEraseCount()
+{
+    return bigRowErases;
+}
+
+uint32_t SimulatedSPIFlash::getViolationCount()
+{
+    return violations;
+}
@@ -0,0 +1,475 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ActivityDetector.h"
+#include "Event.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+/*
+ * Determines log2 of the given value, in 1/256ths. The fractional part is interpolated linearly, so is accurate to
+ * within about 0.09. Zero is treated as one.
+ */
+static int activity_log2(uint64_t value)
+{
+    if (value <= 1)
+        return 0;
+
+    int bits = 63 - __builtin_clzll(value);
+    uint32_t fraction = bits >= 8 ? (uint32_t)(value >> (bits - 8)) : (uint32_t)(value << (8 - bits));
+
+    return (bits << 8) + (fraction & 0xff);
+}
+
+/*
+ * The inverse of activity_log2(), for values of log2 between zero and 32.
+ */
+static uint32_t activity_exp2(int log)
+{
+    if (log < 0)
+        return 0;
+
+    if (log >= 32 << 8)
+        return 0xffffffff;
+
+    int bits = log >> 8;
+    uint32_t mantissa = 256 + (log & 0xff);
+
+    return bits >= 8 ? mantissa << (bits - 8) : mantissa >> (8 - bits);
+}
+
+/*
+ * Determines the integer square root of the given value.
+ */
+static int activity_sqrt(uint32_t value)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > value)
+        bit >>= 2;
+
+    while (bit)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+
+        bit >>= 2;
+    }
+
+    return (int)root;
+}
+
+/**
+ * Constructor.
+ *
+ * @param source the component to receive data from.
+ * @param frameSize the number of samples in each frame. If this is not a valid frame size (see setFrameSize()),
+ * ACTIVITY_DETECTOR_DEFAULT_FRAME_SIZE is used instead.
+ * @param id The id to use for the message bus when transmitting events.
+ */
+ActivityDetector::ActivityDetector(DataSource &source, int frameSize, uint16_t id) : upstream(source)
+{
+    this->id = id;
+    this->frameSize = ACTIVITY_DETECTOR_DEFAULT_FRAME_SIZE;
+    this->threshold = ACTIVITY_DETECTOR_DEFAULT_THRESHOLD;
+    this->flatnessLimit = ACTIVITY_DETECTOR_UNITY;
+    this->zeroCrossingLimit = ACTIVITY_DETECTOR_UNITY;
+    this->onset = ACTIVITY_DETECTOR_DEFAULT_ONSET;
+    this->hangover = ACTIVITY_DETECTOR_DEFAULT_HANGOVER;
+    this->activeFrames = 0;
+    this->inactiveFrames = 0;
+    this->active = false;
+    this->offset = 0;
+    this->previous = 0;
+    this->frameEnergy = 0;
+    this->frameLevel = 0;
+    this->frameZeroCrossingRate = 0;
+    this->frameFlatness = 0;
+    this->noiseFloor = -1;
+
+    setNoiseMargin(ACTIVITY_DETECTOR_DEFAULT_NOISE_MARGIN);
+
+    // Start from an empty frame of the default size, which setFrameSize() leaves in place if frameSize is invalid.
+    resetFrame();
+    setFrameSize(frameSize);
+
+    // Adopt the sample rate of our upstream component. It is checked again as each buffer arrives, in case it changes.
+    this->upstreamRate = source.getFormat().sampleRate;
+    this->sampleRate = upstreamRate;
+
+    source.connect(*this);
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int ActivityDetector::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+    DataStreamFormat format = upstream.getFormat();
+
+    if (format.sampleRate && format.sampleRate != upstreamRate)
+    {
+        upstreamRate = format.sampleRate;
+        sampleRate = upstreamRate;
+    }
+
+    // The frame statistics are computed over int16_t samples, so other encodings are ignored.
+    if (!format.isInt16())
+        return DEVICE_NOT_SUPPORTED;
+
+    int16_t *data = (int16_t *) &b[0];
+
+    int samples = b.length() / 2;
+    int dc = offset >> 8;
+
+    for (int i = 0; i < samples; i++)
+    {
+        int sample = *data++;
+        int x = sample - dc;
+
+        offsetSum += sample;
+
+        // Squares are below 2^32, as |x| < 2^16.
+        energy += (uint32_t)x * (uint32_t)x;
+
+        if ((x ^ previous) < 0)
+            crossings++;
+
+        previous = x;
+
+        // Feed the sample through the Haar decomposition. Level k completes a pair (and passes half their sum on to
+        // level k + 1) every 2^(k+1) samples, so on average each sample costs less than two butterflies.
+        int level = 0;
+        while (level < ACTIVITY_DETECTOR_BANDS)
+        {
+            if (!(framePosition & (1 << level)))
+            {
+                pending[level] = x;
+                break;
+            }
+
+            int d = (pending[level] - x) >> 1;
+            x = (pending[level] + x) >> 1;
+            bandEnergy[level] += (uint32_t)d * (uint32_t)d;
+            level++;
+        }
+
+        if (level == ACTIVITY_DETECTOR_BANDS)
+            bandEnergy[ACTIVITY_DETECTOR_BANDS] += (uint32_t)x * (uint32_t)x;
+
+        if (++framePosition == frameSize)
+            processFrame();
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Computes the features of the current frame, and updates the activity state.
+ */
+void ActivityDetector::processFrame()
+{
+    frameEnergy = (uint32_t)(energy / frameSize);
+    frameLevel = activity_sqrt(frameEnergy);
+    frameZeroCrossingRate = crossings * ACTIVITY_DETECTOR_UNITY / frameSize;
+
+    // Each Haar level halves its input, so the coefficients of detail band k (covering 2^-(k+1) of the spectrum) have
+    // 2^-k of the power density of the input. Take the log2 of each band's density, relative to that of the whole frame,
+    // and weight them by bandwidth (scaled by 2^ACTIVITY_DETECTOR_BANDS) to find the log of the geometric mean. The
+    // arithmetic mean is computed with the same weights, so the two can be compared directly.
+    int geometric = activity_log2(bandEnergy[ACTIVITY_DETECTOR_BANDS]) + (2 * ACTIVITY_DETECTOR_BANDS << 8);
+    uint64_t arithmetic = bandEnergy[ACTIVITY_DETECTOR_BANDS];
+
+    for (int k = 0; k < ACTIVITY_DETECTOR_BANDS; k++)
+    {
+        geometric += (activity_log2(bandEnergy[k]) + ((2 * k + 1) << 8)) << (ACTIVITY_DETECTOR_BANDS - k - 1);
+        arithmetic += bandEnergy[k] << k;
+    }
+
+    geometric >>= ACTIVITY_DETECTOR_BANDS;
+
+    int flatness = geometric - activity_log2(arithmetic);
+    frameFlatness = min((int)activity_exp2(flatness + (10 << 8)), ACTIVITY_DETECTOR_UNITY);
+
+    // Classify the frame, then update the noise floor.
+    int log = activity_log2(frameEnergy);
+    bool loud = frameLevel >= threshold && (noiseMargin == 0 || (noiseFloor >= 0 && log >= noiseFloor + noiseMargin));
+
+    if (noiseFloor < 0 || log < noiseFloor)
+        noiseFloor = log;
+    else if (!loud && !active)
+        noiseFloor += ACTIVITY_DETECTOR_FLOOR_RISE;
+
+    if (loud && frameFlatness <= flatnessLimit && frameZeroCrossingRate <= zeroCrossingLimit)
+    {
+        inactiveFrames = 0;
+
+        if (!active && ++activeFrames >= onset)
+        {
+            active = true;
+            Event(id, ACTIVITY_DETECTOR_EVT_START);
+        }
+    }
+    else
+    {
+        activeFrames = 0;
+
+        if (active && ++inactiveFrames >= hangover)
+        {
+            active = false;
+            inactiveFrames = 0;
+            Event(id, ACTIVITY_DETECTOR_EVT_END);
+        }
+    }
+
+    // Track any DC offset slowly, so that it does not follow low frequency signals, or the mean of short loud sounds.
+    // The offset is held in 1/256ths, so that it still converges to within one sample of the true offset.
+    int mean = (int)(((int64_t)offsetSum << 8) / frameSize);
+    offset += (mean - offset) / ACTIVITY_DETECTOR_OFFSET_PERIOD;
+
+    resetFrame();
+}
+
+/**
+ * Clears the accumulated features of the current frame.
+ */
+void ActivityDetector::resetFrame()
+{
+    framePosition = 0;
+    offsetSum = 0;
+    crossings = 0;
+    energy = 0;
+
+    for (int k = 0; k <= ACTIVITY_DETECTOR_BANDS; k++)
+        bandEnergy[k] = 0;
+}
+
+/**
+ * Changes the number of samples in each frame. Any partially processed frame is discarded.
+ *
+ * @param size the new frame size. Must be a multiple of 2^ACTIVITY_DETECTOR_BANDS, no larger than ACTIVITY_DETECTOR_MAXIMUM_FRAME_SIZE.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int ActivityDetector::setFrameSize(int size)
+{
+    if (size <= 0 || size > ACTIVITY_DETECTOR_MAXIMUM_FRAME_SIZE || size % (1 << ACTIVITY_DETECTOR_BANDS))
+        return DEVICE_INVALID_PARAMETER;
+
+    frameSize = size;
+    resetFrame();
+
+    return DEVICE_OK;
+}
+
+int ActivityDetector::getFrameSize()
+{
+    return frameSize;
+}
+
+/**
+ * Defines the sample rate of the incoming data, used by getFrameDuration().
+ * By default, this is taken from the format of the upstream component. A rate set here holds until that format changes.
+ *
+ * @param rate the sample rate, in Hz.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int ActivityDetector::setSampleRate(int rate)
+{
+    if (rate <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    sampleRate = rate;
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the duration of each frame, which is the unit of the onset and hangover periods.
+ *
+ * @return the duration in microseconds, or zero if the sample rate is not known.
+ */
+int ActivityDetector::getFrameDuration()
+{
+    if (sampleRate <= 0)
+        return 0;
+
+    return (int)((int64_t)frameSize * 1000000 / sampleRate);
+}
+
+/**
+ * Defines the minimum RMS level of an active frame.
+ *
+ * @param level the threshold, in sample units.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int ActivityDetector::setThreshold(int level)
+{
+    if (level < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    threshold = level;
+    return DEVICE_OK;
+}
+
+/**
+ * Defines how far above the noise floor the energy of an active frame must be.
+ *
+ * @param dB the margin, in decibels, or zero to use only the fixed threshold.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int ActivityDetector::setNoiseMargin(int dB)
+{
+    if (dB < 0 || dB > 60)
+        return DEVICE_INVALID_PARAMETER;
+
+    // One decibel is log2(10) / 10 of a bit, or 85 / 256.
+    noiseMargin = dB * 85;
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the largest spectral flatness of an active frame. Lower values reject noise-like sounds, such as wind or hiss.
+ *
+ * @param flatness the limit, where ACTIVITY_DETECTOR_UNITY (the default) accepts any frame.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int ActivityDetector::setFlatnessLimit(int flatness)
+{
+    if (flatness < 0 || flatness > ACTIVITY_DETECTOR_UNITY)
+        return DEVICE_INVALID_PARAMETER;
+
+    flatnessLimit = flatness;
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the largest zero crossing rate of an active frame. Lower values reject high pitched sounds.
+ *
+ * @param rate the limit, where ACTIVITY_DETECTOR_UNITY (the default) accepts any frame.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int ActivityDetector::setZeroCrossingLimit(int rate)
+{
+    if (rate < 0 || rate > ACTIVITY_DETECTOR_UNITY)
+        return DEVICE_INVALID_PARAMETER;
+
+    zeroCrossingLimit = rate;
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the number of consecutive active frames needed to raise ACTIVITY_DETECTOR_EVT_START.
+ *
+ * @param frames the onset period, in frames.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int ActivityDetector::setOnset(int frames)
+{
+    if (frames < 1)
+        return DEVICE_INVALID_PARAMETER;
+
+    onset = frames;
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the number of consecutive inactive frames needed to raise ACTIVITY_DETECTOR_EVT_END.
+ *
+ * @param frames the hangover period, in frames.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int ActivityDetector::setHangover(int frames)
+{
+    if (frames < 1)
+        return DEVICE_INVALID_PARAMETER;
+
+    hangover = frames;
+    return DEVICE_OK;
+}
+
+/**
+ * Determines if activity is in progress.
+ */
+bool ActivityDetector::isActive()
+{
+    return active;
+}
+
+/**
+ * Determines the energy (mean square) of the last complete frame.
+ */
+uint32_t ActivityDetector::getEnergy()
+{
+    return frameEnergy;
+}
+
+/**
+ * Determines the RMS level of the last complete frame.
+ */
+int ActivityDetector::getLevel()
+{
+    return frameLevel;
+}
+
+/**
+ * Determines the zero crossing rate of the last complete frame.
+ *
+ * @return the fraction of consecutive samples that differ in sign, where ACTIVITY_DETECTOR_UNITY is every sample.
+ */
+int ActivityDetector::getZeroCrossingRate()
+{
+    return frameZeroCrossingRate;
+}
+
+/**
+ * Determines the spectral flatness of the last complete frame.
+ *
+ * @return the flatness, from zero for a pure tone to around ACTIVITY_DETECTOR_UNITY for white noise.
+ */
+int ActivityDetector::getFlatness()
+{
+    return frameFlatness;
+}
+
+/**
+ * Determines the RMS level of the noise floor.
+ *
+ * @return the level, or zero if no frame has been processed.
+ */
+int ActivityDetector::getNoiseFloor()
+{
+    if (noiseFloor < 0)
+        return 0;
+
+    return activity_sqrt(activity_exp2(noiseFloor));
+}
@@ -0,0 +1,362 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Adpcm.h"
+#include "ErrorNo.h"
+
+#if defined(__ARM_FEATURE_SAT)
+#include <arm_acle.h>
+#endif
+
+using namespace codal;
+
+static const int16_t adpcm_step[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060,
+    1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484,
+    7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t adpcm_index[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+/**
+ * Clamps a predicted value to the range of a 16 bit sample.
+ */
+static inline int adpcm_clamp(int v)
+{
+#if defined(__ARM_FEATURE_SAT)
+    return __ssat(v, 16);
+#else
+    if (v < -32768) v = -32768;
+    if (v > 32767) v = 32767;
+    return v;
+#endif
+}
+
+/**
+ * Encodes one sample against the current predictor and step index, updating both to match what a decoder will compute.
+ */
+static inline int adpcm_encode_sample(int sample, int &predictor, int &index)
+{
+    int step = adpcm_step[index];
+    int diff = sample - predictor;
+    int nibble = 0;
+
+    if (diff < 0)
+    {
+        nibble = 8;
+        diff = -diff;
+    }
+
+    // Successive approximation of diff / step, accumulating the same delta the decoder will reconstruct.
+    int delta = step >> 3;
+
+    if (diff >= step)
+    {
+        nibble |= 4;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+
+    if (diff >= step)
+    {
+        nibble |= 2;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+
+    if (diff >= step)
+    {
+        nibble |= 1;
+        delta += step;
+    }
+
+    predictor = adpcm_clamp(nibble & 8 ? predictor - delta : predictor + delta);
+
+    index += adpcm_index[nibble];
+    if (index < 0) index = 0;
+    if (index > 88) index = 88;
+
+    return nibble;
+}
+
+/**
+ * Decodes one sample, updating the predictor and step index.
+ */
+static inline int adpcm_decode_sample(int nibble, int &predictor, int &index)
+{
+    int step = adpcm_step[index];
+    int delta = step >> 3;
+
+    if (nibble & 4) delta += step;
+    if (nibble & 2) delta += step >> 1;
+    if (nibble & 1) delta += step >> 2;
+
+    predictor = adpcm_clamp(nibble & 8 ? predictor - delta : predictor + delta);
+
+    index += adpcm_index[nibble];
+    if (index < 0) index = 0;
+    if (index > 88) index = 88;
+
+    return predictor;
+}
+
+/**
+ * Constructor.
+ *
+ * @param source the component to receive signed 16 bit samples from.
+ * @param blockSize the size of each block, in bytes.
+ */
+AdpcmEncoder::AdpcmEncoder(DataSource &source, int blockSize) : upstream(source)
+{
+    this->downStream = NULL;
+    this->blockSize = blockSize > ADPCM_BLOCK_HEADER_SIZE ? blockSize : ADPCM_BLOCK_SIZE;
+    this->index = 0;
+    this->carry = 0;
+    this->hasCarry = false;
+
+    source.connect(*this);
+}
+
+/**
+ * Encodes one ADPCM block.
+ */
+int AdpcmEncoder::encodeBlock(int16_t first, const int16_t *samples, int count, uint8_t *out, int &index)
+{
+    int predictor = first;
+
+    out[0] = first & 0xff;
+    out[1] = (first >> 8) & 0xff;
+    out[2] = index;
+    out[3] = 0;
+    out += ADPCM_BLOCK_HEADER_SIZE;
+
+    for (int i = count >> 1; i > 0; i--)
+    {
+        int lo = adpcm_encode_sample(*samples++, predictor, index);
+        int hi = adpcm_encode_sample(*samples++, predictor, index);
+        *out++ = lo | (hi << 4);
+    }
+
+    return ADPCM_BLOCK_HEADER_SIZE + (count >> 1);
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, if available.
+ */
+ManagedBuffer AdpcmEncoder::pull()
+{
+    ManagedBuffer in = upstream.pull();
+
+    const int16_t *src = (const int16_t *)in.getBytes();
+    int samplesPerBlock = ADPCM_SAMPLES_PER_BLOCK(blockSize);
+    int available = in.length() / 2 + (hasCarry ? 1 : 0);
+    int blocks = available / samplesPerBlock;
+    int tail = available % samplesPerBlock;
+
+    // A block always holds an odd number of samples, so that it ends on a whole byte. If the last block would
+    // hold an even number, its final sample is held over and starts the next buffer instead.
+    if (tail && (tail & 1) == 0)
+        tail--;
+
+    if (tail)
+        blocks++;
+
+    int length = (blocks - (tail ? 1 : 0)) * blockSize + (tail ? ADPCM_BLOCK_HEADER_SIZE + (tail - 1) / 2 : 0);
+    int consumed = 0;
+
+    ManagedBuffer out(length);
+    uint8_t *dst = out.getBytes();
+
+    for (int b = 0; b < blocks; b++)
+    {
+        int count = (tail && b == blocks - 1 ? tail : samplesPerBlock) - 1;
+        int16_t first;
+
+        if (hasCarry)
+        {
+            first = carry;
+            hasCarry = false;
+        }
+        else
+        {
+            first = *src++;
+        }
+
+        dst += encodeBlock(first, src, count, dst, index);
+        src += count;
+        consumed += count + 1;
+    }
+
+    if (consumed < available)
+    {
+        carry = *src;
+        hasCarry = true;
+    }
+
+    return out;
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int AdpcmEncoder::pullRequest()
+{
+    if (downStream)
+        return downStream->pullRequest();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void AdpcmEncoder::connect(DataSink &sink)
+{
+    this->downStream = &sink;
+}
+
+/**
+ * Describes the data this component provides. ADPCM is not a PCM encoding, so the sample size is reported as zero.
+ * This makes the format unknown to isKnown(), so stages that adapt to their input, such as StreamConverter, pass
+ * ADPCM data through untouched rather than treating it as samples.
+ */
+DataStreamFormat AdpcmEncoder::getFormat()
+{
+    DataStreamFormat format = upstream.getFormat();
+    return DataStreamFormat(0, 4, true, 1, format.sampleRate);
+}
+
+/**
+ * Constructor.
+ *
+ * @param source the component to receive ADPCM blocks from.
+ * @param blockSize the size of each block, in bytes.
+ */
+AdpcmDecoder::AdpcmDecoder(DataSource &source, int blockSize) : upstream(source)
+{
+    this->downStream = NULL;
+    this->blockSize = blockSize > ADPCM_BLOCK_HEADER_SIZE ? blockSize : ADPCM_BLOCK_SIZE;
+
+    source.connect(*this);
+}
+
+/**
+ * Determines the number of samples held in a run of ADPCM data.
+ */
+int AdpcmDecoder::sampleCount(int length, int blockSize)
+{
+    int tail = length % blockSize;
+    int samples = (length / blockSize) * ADPCM_SAMPLES_PER_BLOCK(blockSize);
+
+    if (tail >= ADPCM_BLOCK_HEADER_SIZE)
+        samples += ADPCM_SAMPLES_PER_BLOCK(tail);
+
+    return samples;
+}
+
+/**
+ * Decodes one ADPCM block.
+ */
+int AdpcmDecoder::decodeBlock(const uint8_t *in, int length, int16_t *out)
+{
+    if (length < ADPCM_BLOCK_HEADER_SIZE)
+        return 0;
+
+    int predictor = (int16_t)(in[0] | (in[1] << 8));
+    int index = in[2] > 88 ? 88 : in[2];
+    int bytes = length - ADPCM_BLOCK_HEADER_SIZE;
+
+    in += ADPCM_BLOCK_HEADER_SIZE;
+    *out++ = predictor;
+
+    while (bytes--)
+    {
+        int b = *in++;
+        *out++ = adpcm_decode_sample(b & 0x0f, predictor, index);
+        *out++ = adpcm_decode_sample(b >> 4, predictor, index);
+    }
+
+    return ADPCM_SAMPLES_PER_BLOCK(length);
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, if available.
+ */
+ManagedBuffer AdpcmDecoder::pull()
+{
+    ManagedBuffer in = upstream.pull();
+
+    const uint8_t *src = in.getBytes();
+    int length = in.length();
+
+    ManagedBuffer out(sampleCount(length, blockSize) * 2);
+    int16_t *dst = (int16_t *)out.getBytes();
+
+    while (length > 0)
+    {
+        int size = min(length, blockSize);
+        dst += decodeBlock(src, size, dst);
+        src += size;
+        length -= size;
+    }
+
+    return out;
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int AdpcmDecoder::pullRequest()
+{
+    if (downStream)
+        return downStream->pullRequest();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void AdpcmDecoder::connect(DataSink &sink)
+{
+    this->downStream = &sink;
+}
+
+/**
+ * Describes the data this component provides: signed 16 bit mono samples at the upstream sample rate.
+ */
+DataStreamFormat AdpcmDecoder::getFormat()
+{
+    DataStreamFormat format = upstream.getFormat();
+    return DataStreamFormat(2, 16, true, 1, format.sampleRate);
+}
@@ -41,6 +41,11 @@ void DataSource::connect(DataSink& )
 {
 }
 
+DataStreamFormat DataSource::getFormat()
+{
+    return DataStreamFormat();
+}
+
 int DataSink::pullRequest()
 {
 	return DEVICE_NOT_SUPPORTED;
@@ -225,6 +230,14 @@ ManagedBuffer DataStream::pull()
 	return out;
 }
 
+/**
+ * Describes the data this stream provides, which is the data provided by its upstream component.
+ */
+DataStreamFormat DataStream::getFormat()
+{
+    return upStream->getFormat();
+}
+
 /**
  * Issue a pull request to our downstream component, if one has been registered.
  */
@@ -0,0 +1,409 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "FFTAnalyser.h"
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+#include "Event.h"
+#include <math.h>
+
+#if defined(__ARM_FEATURE_DSP)
+#include <arm_acle.h>
+#endif
+
+using namespace codal;
+
+/*
+ * Complex values are held as a packed pair of Q15 halfwords (real in the low half, imaginary in the high half),
+ * which lets targets with the DSP extension perform a complex multiply or butterfly in one or two instructions.
+ */
+static inline int16_t fft_re(uint32_t x)
+{
+    return (int16_t)(x & 0xFFFF);
+}
+
+static inline int16_t fft_im(uint32_t x)
+{
+    return (int16_t)(x >> 16);
+}
+
+static inline uint32_t fft_pack(int32_t re, int32_t im)
+{
+    return (uint16_t)re | ((uint32_t)(uint16_t)im << 16);
+}
+
+/**
+ * Computes re(a * w) and im(a * w), scaled by 2^15, for a complex Q15 value a and twiddle factor w.
+ */
+static inline void fft_multiply(uint32_t a, uint32_t w, int32_t &re, int32_t &im)
+{
+#if defined(__ARM_FEATURE_DSP)
+    re = __smusd((int32_t)a, (int32_t)w);
+    im = __smuadx((int32_t)a, (int32_t)w);
+#else
+    re = fft_re(a) * fft_re(w) - fft_im(a) * fft_im(w);
+    im = fft_re(a) * fft_im(w) + fft_im(a) * fft_re(w);
+#endif
+}
+
+/**
+ * In place radix-2 decimation in time FFT of n complex values, halving the data at each stage so that it cannot overflow.
+ * The result is therefore the transform scaled by 1/n.
+ *
+ * @param data the packed complex values to transform.
+ * @param n the number of values. Must be a power of two.
+ * @param twiddles packed Q15 values of exp(-2*pi*i*k/(2n)), for 0 <= k < n.
+ */
+static void fft_complex(uint32_t *data, int n, const uint32_t *twiddles)
+{
+    // Reorder the input into bit reversed index order.
+    for (int i = 1, j = 0; i < n; i++)
+    {
+        int bit = n >> 1;
+
+        while (j & bit)
+        {
+            j ^= bit;
+            bit >>= 1;
+        }
+        j |= bit;
+
+        if (i < j)
+        {
+            uint32_t t = data[i];
+            data[i] = data[j];
+            data[j] = t;
+        }
+    }
+
+    for (int length = 2; length <= n; length <<= 1)
+    {
+        int half = length >> 1;
+        int stride = (2 * n) / length;
+
+        for (int start = 0; start < n; start += length)
+        {
+            uint32_t *a = &data[start];
+            uint32_t *b = &data[start + half];
+            const uint32_t *w = twiddles;
+
+            for (int k = 0; k < half; k++)
+            {
+                int32_t re, im;
+
+                fft_multiply(b[k], *w, re, im);
+                w += stride;
+
+                uint32_t t = fft_pack(re >> 15, im >> 15);
+
+#if defined(__ARM_FEATURE_DSP)
+                // Halving adds perform both halves of the butterfly, with scaling, in one instruction each.
+                b[k] = __shsub16(a[k], t);
+                a[k] = __shadd16(a[k], t);
+#else
+                uint32_t x = a[k];
+                a[k] = fft_pack((fft_re(x) + fft_re(t)) >> 1, (fft_im(x) + fft_im(t)) >> 1);
+                b[k] = fft_pack((fft_re(x) - fft_re(t)) >> 1, (fft_im(x) - fft_im(t)) >> 1);
+#endif
+            }
+        }
+    }
+}
+
+/**
+ * Constructor.
+ *
+ * @param source the component to receive data from.
+ * @param frameSize the number of samples to analyse at a time. Must be a power of two.
+ * @param id The id to use for the message bus when transmitting events.
+ */
+FFTAnalyser::FFTAnalyser(DataSource &source, int frameSize, uint16_t id) : upstream(source)
+{
+    this->id = id;
+    this->frameSize = 0;
+    this->framePosition = 0;
+    this->peakThreshold = FFT_ANALYSER_DEFAULT_PEAK_THRESHOLD;
+    this->peakBin = 0;
+    this->lastPeakBin = 0;
+    this->frame = NULL;
+    this->window = NULL;
+    this->work = NULL;
+    this->twiddles = NULL;
+    this->magnitudes = NULL;
+
+    // Take our sample rate from the format of our upstream component. pullRequest() follows any later change to it.
+    this->upstreamRate = source.getFormat().sampleRate;
+    this->sampleRate = upstreamRate;
+
+    setFrameSize(frameSize);
+    source.connect(*this);
+}
+
+/**
+ * Destructor.
+ */
+FFTAnalyser::~FFTAnalyser()
+{
+    // All buffers share a single allocation, which begins with the work buffer.
+    free(work);
+}
+
+/**
+ * Changes the number of samples analysed at a time. Any partially gathered frame is discarded.
+ *
+ * @param size the new frame size. Must be a power of two between FFT_ANALYSER_MINIMUM_FRAME_SIZE and FFT_ANALYSER_MAXIMUM_FRAME_SIZE.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the size is not supported, or DEVICE_NO_RESOURCES.
+ */
+int FFTAnalyser::setFrameSize(int size)
+{
+    if (size < FFT_ANALYSER_MINIMUM_FRAME_SIZE || size > FFT_ANALYSER_MAXIMUM_FRAME_SIZE || (size & (size - 1)))
+        return DEVICE_INVALID_PARAMETER;
+
+    int bins = size / 2;
+
+    // Place the word aligned buffers first, so that every buffer is naturally aligned.
+    uint8_t *block = (uint8_t *) malloc(2 * bins * sizeof(uint32_t) + 2 * size * sizeof(int16_t) + bins * sizeof(uint16_t));
+
+    if (block == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    free(work);
+
+    work = (uint32_t *) block;
+    twiddles = work + bins;
+    frame = (int16_t *) (twiddles + bins);
+    window = frame + size;
+    magnitudes = (uint16_t *) (window + size);
+
+    frameSize = size;
+    framePosition = 0;
+    peakBin = 0;
+    lastPeakBin = 0;
+
+    for (int k = 0; k < bins; k++)
+    {
+        float a = 2 * PI * k / size;
+        twiddles[k] = fft_pack((int32_t)floorf(32767.0f * cosf(a) + 0.5f), (int32_t)floorf(-32767.0f * sinf(a) + 0.5f));
+    }
+
+    // A Hann window, to limit leakage between bins.
+    for (int n = 0; n < size; n++)
+        window[n] = (int16_t)floorf(16383.5f * (1.0f - cosf(2 * PI * n / size)) + 0.5f);
+
+    memset(magnitudes, 0, bins * sizeof(uint16_t));
+
+    return DEVICE_OK;
+}
+
+int FFTAnalyser::getFrameSize()
+{
+    return frameSize;
+}
+
+/**
+ * Defines the sample rate of the incoming data, used to convert bins to frequencies.
+ * By default, this is taken from the format of the upstream component. A rate set here holds until that format changes.
+ *
+ * @param rate the sample rate, in Hz.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int FFTAnalyser::setSampleRate(int rate)
+{
+    if (rate <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    sampleRate = rate;
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the smallest peak magnitude that will raise an FFT_ANALYSER_EVT_PEAK event.
+ *
+ * @param threshold the minimum magnitude.
+ * @return DEVICE_OK.
+ */
+int FFTAnalyser::setPeakThreshold(int threshold)
+{
+    peakThreshold = threshold;
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the number of frequency bins produced for each frame (half the frame size).
+ */
+int FFTAnalyser::getBinCount()
+{
+    return frameSize / 2;
+}
+
+/**
+ * Provides the magnitudes computed for the last complete frame. Bin n covers frequencies around n * sampleRate / frameSize.
+ * The data is overwritten as each new frame completes. A sine wave centred on a bin gives that bin a magnitude of
+ * half the wave's amplitude.
+ *
+ * @return a pointer to getBinCount() magnitudes.
+ */
+const uint16_t *FFTAnalyser::getMagnitudes()
+{
+    return magnitudes;
+}
+
+/**
+ * Determines the magnitude of a single bin in the last complete frame.
+ *
+ * @param bin the index of the bin.
+ * @return the magnitude, or DEVICE_INVALID_PARAMETER.
+ */
+int FFTAnalyser::getMagnitude(int bin)
+{
+    if (bin < 0 || bin >= frameSize / 2)
+        return DEVICE_INVALID_PARAMETER;
+
+    return magnitudes[bin];
+}
+
+/**
+ * Determines the centre frequency of the strongest bin (ignoring DC) in the last complete frame.
+ *
+ * @return the frequency, in Hz, or zero if the sample rate is not known.
+ */
+int FFTAnalyser::getPeakFrequency()
+{
+    if (frameSize == 0 || sampleRate <= 0)
+        return 0;
+
+    return (int)(((int64_t)peakBin * sampleRate + frameSize / 2) / frameSize);
+}
+
+/**
+ * Determines the magnitude of the strongest bin (ignoring DC) in the last complete frame.
+ */
+int FFTAnalyser::getPeakMagnitude()
+{
+    return frameSize ? magnitudes[peakBin] : 0;
+}
+
+/**
+ * Transforms the current frame, and updates the magnitudes and peak.
+ */
+void FFTAnalyser::processFrame()
+{
+    int bins = frameSize / 2;
+
+    // Treat the even and odd samples of the windowed frame as the real and imaginary parts of a complex sequence of half the length.
+    for (int k = 0; k < bins; k++)
+    {
+        int32_t re = (frame[2 * k] * window[2 * k]) >> 15;
+        int32_t im = (frame[2 * k + 1] * window[2 * k + 1]) >> 15;
+        work[k] = fft_pack(re, im);
+    }
+
+    fft_complex(work, bins, twiddles);
+
+    // Separate the spectrum of the real frame from that of the packed sequence, X[k] = E[k] - i * W^k * O[k], where
+    // E and O are the transforms of the even and odd samples recovered from Z[k] and conj(Z[bins - k]).
+    int best = 1;
+
+    for (int k = 0; k < bins; k++)
+    {
+        uint32_t z = work[k];
+        uint32_t c = work[(bins - k) & (bins - 1)];
+
+        int32_t eRe = (fft_re(z) + fft_re(c)) >> 1;
+        int32_t eIm = (fft_im(z) - fft_im(c)) >> 1;
+        int32_t oRe = (fft_re(z) - fft_re(c)) >> 1;
+        int32_t oIm = (fft_im(z) + fft_im(c)) >> 1;
+
+        int32_t re, im;
+        fft_multiply(fft_pack(oRe, oIm), twiddles[k], re, im);
+
+        int32_t xRe = abs(eRe + (im >> 15));
+        int32_t xIm = abs(eIm - (re >> 15));
+
+        // Approximate the magnitude as max + 3/8 min, which is within 7% of the true value without needing a square root.
+        int32_t m = max(xRe, xIm) + ((3 * min(xRe, xIm)) >> 3);
+        magnitudes[k] = (uint16_t) min(m, 65535);
+
+        if (k > 1 && magnitudes[k] > magnitudes[best])
+            best = k;
+    }
+
+    peakBin = best;
+
+    if (magnitudes[peakBin] >= peakThreshold)
+    {
+        if (peakBin != lastPeakBin)
+        {
+            lastPeakBin = peakBin;
+            Event(id, FFT_ANALYSER_EVT_PEAK);
+        }
+    }
+    else
+    {
+        lastPeakBin = 0;
+    }
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int FFTAnalyser::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+    DataStreamFormat format = upstream.getFormat();
+
+    if (format.sampleRate && format.sampleRate != upstreamRate)
+    {
+        upstreamRate = format.sampleRate;
+        sampleRate = upstreamRate;
+    }
+
+    // Frames are gathered as int16_t. Other encodings need a StreamConverter in front of this component.
+    if (!format.isInt16())
+        return DEVICE_NOT_SUPPORTED;
+
+    if (frameSize == 0)
+        return DEVICE_OK;
+
+    int16_t *data = (int16_t *) b.getBytes();
+    int samples = b.length() / 2;
+
+    while (samples > 0)
+    {
+        int n = min(samples, frameSize - framePosition);
+
+        memcpy(&frame[framePosition], data, n * sizeof(int16_t));
+        framePosition += n;
+        data += n;
+        samples -= n;
+
+        if (framePosition == frameSize)
+        {
+            processFrame();
+            framePosition = 0;
+        }
+    }
+
+    return DEVICE_OK;
+}
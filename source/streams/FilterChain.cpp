@@ -0,0 +1,549 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "FilterChain.h"
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+#include <math.h>
+
+#if defined(__ARM_FEATURE_DSP) || defined(__ARM_FEATURE_SAT)
+#include <arm_acle.h>
+#endif
+
+using namespace codal;
+
+static inline int32_t saturate16(int32_t v)
+{
+#if defined(__ARM_FEATURE_SAT)
+    return __ssat(v, 16);
+#else
+    return v > 32767 ? 32767 : v < -32768 ? -32768 : v;
+#endif
+}
+
+/**
+ * Filters samples through a stage using 16 bit arithmetic. Coefficients are Q14, so that they can represent values up to 2.
+ */
+static void biquad_q15(BiquadStage &stage, int16_t *data, int samples)
+{
+    const int32_t *c = stage.coefficients;
+    int32_t x1 = stage.state[0];
+    int32_t x2 = stage.state[1];
+    int32_t y1 = stage.state[2];
+    int32_t y2 = stage.state[3];
+
+#if defined(__ARM_FEATURE_DSP)
+    // Pair the coefficients, so that four of the five products are formed by two dual multiply-accumulates.
+    int32_t c01 = (int32_t)(((uint32_t)c[0] & 0xFFFF) | ((uint32_t)c[1] << 16));
+    int32_t c23 = (int32_t)(((uint32_t)c[2] & 0xFFFF) | ((uint32_t)c[3] << 16));
+#endif
+
+    for (int i = 0; i < samples; i++)
+    {
+        int32_t x0 = data[i];
+
+#if defined(__ARM_FEATURE_DSP)
+        int32_t acc = __smlad(c01, (int32_t)(((uint32_t)x0 & 0xFFFF) | ((uint32_t)x1 << 16)), 1 << 13);
+        acc = __smlad(c23, (int32_t)(((uint32_t)x2 & 0xFFFF) | ((uint32_t)y1 << 16)), acc);
+        acc = __smlabb(c[4], y2, acc);
+#else
+        int32_t acc = (1 << 13) + c[0] * x0 + c[1] * x1 + c[2] * x2 + c[3] * y1 + c[4] * y2;
+#endif
+
+        int32_t y0 = saturate16(acc >> 14);
+
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
+
+        data[i] = (int16_t)y0;
+    }
+
+    stage.state[0] = x1;
+    stage.state[1] = x2;
+    stage.state[2] = y1;
+    stage.state[3] = y2;
+}
+
+/**
+ * Filters samples through a stage using 32 bit arithmetic. Coefficients are Q30, and the history is held as samples
+ * scaled by 2^15, so that the feedback path keeps enough precision for low cutoff frequencies.
+ */
+static void biquad_q31(BiquadStage &stage, int16_t *data, int samples)
+{
+    const int32_t *c = stage.coefficients;
+    int32_t x1 = stage.state[0];
+    int32_t x2 = stage.state[1];
+    int32_t y1 = stage.state[2];
+    int32_t y2 = stage.state[3];
+
+    for (int i = 0; i < samples; i++)
+    {
+        int32_t x0 = (int32_t)data[i] * 32768;
+
+        int64_t acc = (int64_t)1 << 29;
+        acc += (int64_t)c[0] * x0;
+        acc += (int64_t)c[1] * x1;
+        acc += (int64_t)c[2] * x2;
+        acc += (int64_t)c[3] * y1;
+        acc += (int64_t)c[4] * y2;
+
+        acc >>= 30;
+
+        int32_t y0 = acc > INT32_MAX ? INT32_MAX : acc < INT32_MIN ? INT32_MIN : (int32_t)acc;
+
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
+
+        // Round to the nearest sample. Written this way so that it cannot overflow.
+        data[i] = (int16_t)saturate16((y0 >> 15) + ((y0 >> 14) & 1));
+    }
+
+    stage.state[0] = x1;
+    stage.state[1] = x2;
+    stage.state[2] = y1;
+    stage.state[3] = y2;
+}
+
+/**
+ * Converts a coefficient to fixed point, with the given number of fractional bits.
+ *
+ * @return true on success, or false if the value cannot be represented in a value of the given number of bits.
+ */
+static bool biquad_fixed(float value, int fractionalBits, int bits, int32_t &result)
+{
+    double v = floor((double)value * (double)(1LL << fractionalBits) + 0.5);
+    double limit = (double)(1LL << (bits - 1));
+
+    if (v < -limit || v >= limit)
+        return false;
+
+    result = (int32_t)v;
+    return true;
+}
+
+/**
+ * Constructor. Creates a filter that passes its input unchanged.
+ */
+BiquadCoefficients::BiquadCoefficients(float b0, float b1, float b2, float a1, float a2)
+{
+    this->b0 = b0;
+    this->b1 = b1;
+    this->b2 = b2;
+    this->a1 = a1;
+    this->a2 = a2;
+}
+
+/**
+ * Designs a second order low pass filter.
+ *
+ * @param sampleRate the sample rate of the data to be filtered, in Hz.
+ * @param cutoff the frequency at which the response falls away, in Hz.
+ * @param q the quality factor of the filter.
+ */
+BiquadCoefficients BiquadCoefficients::lowPass(int sampleRate, float cutoff, float q)
+{
+    float w = 2 * PI * cutoff / sampleRate;
+    float cw = cosf(w);
+    float a0 = 1.0f + sinf(w) / (2 * q);
+
+    return BiquadCoefficients((1.0f - cw) / (2 * a0), (1.0f - cw) / a0, (1.0f - cw) / (2 * a0), -2 * cw / a0, (2.0f - a0) / a0);
+}
+
+/**
+ * Designs a second order high pass filter.
+ *
+ * @param sampleRate the sample rate of the data to be filtered, in Hz.
+ * @param cutoff the frequency at which the response falls away, in Hz.
+ * @param q the quality factor of the filter.
+ */
+BiquadCoefficients BiquadCoefficients::highPass(int sampleRate, float cutoff, float q)
+{
+    float w = 2 * PI * cutoff / sampleRate;
+    float cw = cosf(w);
+    float a0 = 1.0f + sinf(w) / (2 * q);
+
+    return BiquadCoefficients((1.0f + cw) / (2 * a0), -(1.0f + cw) / a0, (1.0f + cw) / (2 * a0), -2 * cw / a0, (2.0f - a0) / a0);
+}
+
+/**
+ * Designs a band pass filter, with unity gain at its centre frequency.
+ *
+ * @param sampleRate the sample rate of the data to be filtered, in Hz.
+ * @param centre the frequency to pass, in Hz.
+ * @param q the quality factor of the filter. Higher values give a narrower band.
+ */
+BiquadCoefficients BiquadCoefficients::bandPass(int sampleRate, float centre, float q)
+{
+    float w = 2 * PI * centre / sampleRate;
+    float alpha = sinf(w) / (2 * q);
+    float a0 = 1.0f + alpha;
+
+    return BiquadCoefficients(alpha / a0, 0.0f, -alpha / a0, -2 * cosf(w) / a0, (1.0f - alpha) / a0);
+}
+
+/**
+ * Designs a notch filter, which removes a narrow band of frequencies.
+ *
+ * @param sampleRate the sample rate of the data to be filtered, in Hz.
+ * @param centre the frequency to remove, in Hz.
+ * @param q the quality factor of the filter. Higher values give a narrower notch.
+ */
+BiquadCoefficients BiquadCoefficients::notch(int sampleRate, float centre, float q)
+{
+    float w = 2 * PI * centre / sampleRate;
+    float cw = cosf(w);
+    float alpha = sinf(w) / (2 * q);
+    float a0 = 1.0f + alpha;
+
+    return BiquadCoefficients(1.0f / a0, -2 * cw / a0, 1.0f / a0, -2 * cw / a0, (1.0f - alpha) / a0);
+}
+
+/**
+ * Designs a first order filter that removes any DC offset.
+ *
+ * @param sampleRate the sample rate of the data to be filtered, in Hz.
+ * @param cutoff the frequency below which the signal is attenuated, in Hz.
+ */
+BiquadCoefficients BiquadCoefficients::dcBlock(int sampleRate, float cutoff)
+{
+    float r = expf(-2 * PI * cutoff / sampleRate);
+
+    // Scale the zero so that the gain is unity at high frequencies.
+    float g = (1.0f + r) / 2;
+
+    return BiquadCoefficients(g, -g, 0.0f, -r, 0.0f);
+}
+
+/**
+ * Designs a digital biquad section from an analog section with two real poles, s^zeros / ((s + p) * (s + q)), using the
+ * bilinear transform.
+ *
+ * @param k twice the sample rate.
+ * @param zeros the number of zeros at DC, from zero to two.
+ * @param p the angular frequency of the first pole.
+ * @param q the angular frequency of the second pole.
+ */
+static BiquadCoefficients biquad_bilinear(float k, int zeros, float p, float q)
+{
+    // Each analog factor (c1 * s + c0) maps to ((c0 + c1 * k) + (c0 - c1 * k) / z) / (1 + 1 / z). The section has two
+    // factors above and below, so the (1 + 1 / z) terms cancel, leaving products of first order polynomials in 1 / z.
+    float n0[2], n1[2];
+
+    for (int i = 0; i < 2; i++)
+    {
+        n0[i] = i < zeros ? k : 1.0f;
+        n1[i] = i < zeros ? -k : 1.0f;
+    }
+
+    float a0 = (k + p) * (k + q);
+
+    return BiquadCoefficients(n0[0] * n0[1] / a0, (n0[0] * n1[1] + n1[0] * n0[1]) / a0, n1[0] * n1[1] / a0,
+                              ((k + p) * (q - k) + (p - k) * (k + q)) / a0, (p - k) * (q - k) / a0);
+}
+
+/**
+ * Determines the gain of a biquad section at the given angular frequency, in radians per sample.
+ */
+static float biquad_gain(const BiquadCoefficients &c, float w)
+{
+    float c1 = cosf(w), s1 = sinf(w), c2 = cosf(2 * w), s2 = sinf(2 * w);
+
+    float bRe = c.b0 + c.b1 * c1 + c.b2 * c2;
+    float bIm = c.b1 * s1 + c.b2 * s2;
+    float aRe = 1.0f + c.a1 * c1 + c.a2 * c2;
+    float aIm = c.a1 * s1 + c.a2 * s2;
+
+    return sqrtf((bRe * bRe + bIm * bIm) / (aRe * aRe + aIm * aIm));
+}
+
+/**
+ * Scales a cascade of sections to unity gain at 1kHz, the reference frequency of the sound level weightings.
+ */
+static void biquad_normalise(int sampleRate, BiquadCoefficients *sections, int count)
+{
+    float w = 2 * PI * 1000.0f / sampleRate;
+    float gain = 1.0f;
+
+    for (int i = 0; i < count; i++)
+        gain *= biquad_gain(sections[i], w);
+
+    BiquadCoefficients &last = sections[count - 1];
+    last.b0 /= gain;
+    last.b1 /= gain;
+    last.b2 /= gain;
+}
+
+// Pole frequencies of the IEC 61672 weighting curves, in Hz.
+#define WEIGHTING_POLE_1        20.598997f
+#define WEIGHTING_POLE_2        107.65265f
+#define WEIGHTING_POLE_3        737.86223f
+#define WEIGHTING_POLE_4        12194.217f
+
+/**
+ * Designs the IEC 61672 A frequency weighting used for sound level measurement, normalised to unity gain at 1kHz.
+ *
+ * @param sampleRate the sample rate of the data to be filtered, in Hz.
+ * @param sections storage for the BIQUAD_A_WEIGHTING_SECTIONS sections of the filter, to be applied in order.
+ * @return the number of sections written.
+ */
+int BiquadCoefficients::aWeighting(int sampleRate, BiquadCoefficients *sections)
+{
+    float k = 2.0f * sampleRate;
+
+    sections[0] = biquad_bilinear(k, 2, 2 * PI * WEIGHTING_POLE_1, 2 * PI * WEIGHTING_POLE_1);
+    sections[1] = biquad_bilinear(k, 2, 2 * PI * WEIGHTING_POLE_2, 2 * PI * WEIGHTING_POLE_3);
+    sections[2] = biquad_bilinear(k, 0, 2 * PI * WEIGHTING_POLE_4, 2 * PI * WEIGHTING_POLE_4);
+
+    biquad_normalise(sampleRate, sections, BIQUAD_A_WEIGHTING_SECTIONS);
+    return BIQUAD_A_WEIGHTING_SECTIONS;
+}
+
+/**
+ * Designs the IEC 61672 C frequency weighting used for sound level measurement, normalised to unity gain at 1kHz.
+ *
+ * @param sampleRate the sample rate of the data to be filtered, in Hz.
+ * @param sections storage for the BIQUAD_C_WEIGHTING_SECTIONS sections of the filter, to be applied in order.
+ * @return the number of sections written.
+ */
+int BiquadCoefficients::cWeighting(int sampleRate, BiquadCoefficients *sections)
+{
+    float k = 2.0f * sampleRate;
+
+    sections[0] = biquad_bilinear(k, 2, 2 * PI * WEIGHTING_POLE_1, 2 * PI * WEIGHTING_POLE_1);
+    sections[1] = biquad_bilinear(k, 0, 2 * PI * WEIGHTING_POLE_4, 2 * PI * WEIGHTING_POLE_4);
+
+    biquad_normalise(sampleRate, sections, BIQUAD_C_WEIGHTING_SECTIONS);
+    return BIQUAD_C_WEIGHTING_SECTIONS;
+}
+
+/**
+ * Converts a set of coefficients into the fixed point form used by this stage. The history is left unchanged.
+ *
+ * @param coefficients the filter to apply.
+ * @param precision the arithmetic to use.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if any coefficient is out of range.
+ */
+int BiquadStage::configure(const BiquadCoefficients &c, BiquadPrecision precision)
+{
+    int fractionalBits = precision == BiquadQ15 ? 14 : 30;
+    int bits = precision == BiquadQ15 ? 16 : 32;
+
+    // The feedback coefficients are stored negated, so that every term of the filter is accumulated.
+    float values[5] = { c.b0, c.b1, c.b2, -c.a1, -c.a2 };
+    int32_t fixed[5];
+
+    for (int i = 0; i < 5; i++)
+        if (!biquad_fixed(values[i], fractionalBits, bits, fixed[i]))
+            return DEVICE_INVALID_PARAMETER;
+
+    memcpy(coefficients, fixed, sizeof(coefficients));
+    this->precision = precision;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Filters a block of samples in place.
+ *
+ * @param data the samples to filter.
+ * @param samples the number of samples.
+ */
+void BiquadStage::process(int16_t *data, int samples)
+{
+    if (precision == BiquadQ15)
+        biquad_q15(*this, data, samples);
+    else
+        biquad_q31(*this, data, samples);
+}
+
+/**
+ * Clears the history of the stage, as if it had only ever seen silence.
+ */
+void BiquadStage::reset()
+{
+    memset(state, 0, sizeof(state));
+}
+
+/**
+ * Constructor. Creates a chain with no stages, which passes its input unchanged.
+ *
+ * @param source the component to receive data from.
+ */
+FilterChain::FilterChain(DataSource &source) : upstream(source)
+{
+    this->downStream = NULL;
+    this->stageCount = 0;
+
+    source.connect(*this);
+}
+
+/**
+ * Destructor.
+ */
+FilterChain::~FilterChain()
+{
+}
+
+/**
+ * Appends a stage to the end of the chain.
+ *
+ * @param coefficients the filter to apply.
+ * @param precision the arithmetic to use for this stage.
+ * @return the index of the new stage on success, DEVICE_INVALID_PARAMETER if the coefficients are out of range,
+ * or DEVICE_NO_RESOURCES if the chain already has FILTER_CHAIN_MAXIMUM_STAGES stages.
+ */
+int FilterChain::addStage(const BiquadCoefficients &coefficients, BiquadPrecision precision)
+{
+    if (stageCount >= FILTER_CHAIN_MAXIMUM_STAGES)
+        return DEVICE_NO_RESOURCES;
+
+    BiquadStage &stage = stages[stageCount];
+
+    if (stage.configure(coefficients, precision) != DEVICE_OK)
+        return DEVICE_INVALID_PARAMETER;
+
+    stage.reset();
+
+    // Only bring the stage into use once it is fully configured.
+    return stageCount++;
+}
+
+/**
+ * Replaces the coefficients of an existing stage. The history of the stage is kept if its precision is unchanged,
+ * so that filters can be retuned while running without a discontinuity.
+ *
+ * @param stage the index of the stage to update.
+ * @param coefficients the filter to apply.
+ * @param precision the arithmetic to use for this stage.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the stage does not exist or the coefficients are out of range.
+ */
+int FilterChain::setStage(int stage, const BiquadCoefficients &coefficients, BiquadPrecision precision)
+{
+    if (stage < 0 || stage >= stageCount)
+        return DEVICE_INVALID_PARAMETER;
+
+    BiquadStage s = stages[stage];
+
+    if (s.configure(coefficients, precision) != DEVICE_OK)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Swap in the new coefficients atomically, so that the stage is never seen half updated.
+    target_disable_irq();
+    memcpy(stages[stage].coefficients, s.coefficients, sizeof(s.coefficients));
+
+    // The history is held at a different scale by each precision, so cannot be carried over.
+    if (precision != stages[stage].precision)
+    {
+        stages[stage].reset();
+        stages[stage].precision = precision;
+    }
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Removes all stages from the chain.
+ */
+void FilterChain::clear()
+{
+    stageCount = 0;
+}
+
+/**
+ * Clears the history of every stage, as if the chain had only ever seen silence.
+ */
+void FilterChain::reset()
+{
+    target_disable_irq();
+    for (int i = 0; i < stageCount; i++)
+        stages[i].reset();
+    target_enable_irq();
+}
+
+/**
+ * Determines the number of stages in the chain.
+ */
+int FilterChain::getStageCount()
+{
+    return stageCount;
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, filtered by each stage in turn.
+ */
+ManagedBuffer FilterChain::pull()
+{
+    ManagedBuffer b = upstream.pull();
+
+    if (stageCount == 0)
+        return b;
+
+    // Filter in place where possible. Buffers that are read only (such as those in flash), or that are also seen by
+    // another component (such as the other outputs of a StreamSplitter), must be copied first.
+    if (b.isShared())
+        b = ManagedBuffer(b.getBytes(), b.length());
+
+    int16_t *data = (int16_t *) b.getBytes();
+    int samples = b.length() / 2;
+
+    // Run each stage across the whole buffer in turn, so that its coefficients and history stay in registers.
+    for (int i = 0; i < stageCount; i++)
+        stages[i].process(data, samples);
+
+    return b;
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int FilterChain::pullRequest()
+{
+    if (downStream)
+        return downStream->pullRequest();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void FilterChain::connect(DataSink &sink)
+{
+    downStream = &sink;
+}
+
+/**
+ * Describes the data this component provides.
+ */
+DataStreamFormat FilterChain::getFormat()
+{
+    return upstream.getFormat();
+}
@@ -0,0 +1,371 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "FlashRecorder.h"
+#include "CodalFiber.h"
+#include "Timer.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+/*
+ * Simple internal helper funtion that runs the writer of the given FlashRecorder in its own fiber
+ */
+static void begin_writer(void *data)
+{
+    ((FlashRecorder *)data)->writer();
+}
+
+/**
+ * Constructor.
+ *
+ * @param source the component to receive data from.
+ * @param flash the flash memory to record to.
+ * @param start the flash address of the region to record into.
+ * @param length the length of the region, in bytes.
+ * @param chunkSize the size of each of the two buffers that data is gathered into.
+ * @param id The id to use for the message bus when transmitting events.
+ */
+FlashRecorder::FlashRecorder(DataSource &source, SPIFlash &flash, uint32_t start, uint32_t length, int chunkSize, uint16_t id) : upstream(source), flash(flash)
+{
+    this->id = id;
+    this->start = start;
+    this->end = start + length;
+    this->writeAddress = start;
+    this->erased = start;
+    this->accepted = 0;
+    this->written = 0;
+    this->dropped = 0;
+    this->eraseAhead = FLASH_RECORDER_ERASE_AHEAD;
+    this->startTime = 0;
+    this->stopTime = 0;
+    this->chunks = NULL;
+    this->chunkSize = chunkSize;
+    this->filling = 0;
+    this->fillLength = 0;
+    this->ready = -1;
+    this->eventCode = allocateNotifyEvent();
+    this->recording = false;
+    this->active = false;
+
+    source.connect(*this);
+}
+
+/**
+ * Destructor. If a recording is still being written, stops it and waits for the writer to finish with the chunks.
+ */
+FlashRecorder::~FlashRecorder()
+{
+    stop();
+
+    while (active)
+        fiber_sleep(1);
+
+    free(chunks);
+}
+
+/**
+ * Starts recording at the start of the region, overwriting anything already recorded.
+ */
+int FlashRecorder::record()
+{
+    if (active)
+        return DEVICE_BUSY;
+
+    if (start % SPIFLASH_SMALL_ROW_SIZE || end % SPIFLASH_SMALL_ROW_SIZE || end <= start || end > (uint32_t)flash.numPages() * SPIFLASH_PAGE_SIZE)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (chunkSize <= 0 || chunkSize % SPIFLASH_PAGE_SIZE)
+        return DEVICE_INVALID_PARAMETER;
+
+    chunks = (uint8_t *)malloc(2 * chunkSize);
+    if (chunks == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    writeAddress = start;
+    erased = start;
+    accepted = 0;
+    written = 0;
+    dropped = 0;
+    filling = 0;
+    fillLength = 0;
+    ready = -1;
+    startTime = system_timer_current_time();
+    stopTime = 0;
+    recording = true;
+    active = true;
+
+    create_fiber(begin_writer, this);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Stops recording. Data already received is still written to flash, which completes in the background.
+ */
+void FlashRecorder::stop()
+{
+    if (!recording)
+        return;
+
+    recording = false;
+    Event(DEVICE_ID_NOTIFY, eventCode);
+}
+
+/**
+ * Ends recording, raising the given event.
+ */
+void FlashRecorder::abort(int event)
+{
+    recording = false;
+    Event(id, event);
+    Event(DEVICE_ID_NOTIFY, eventCode);
+}
+
+/**
+ * Determines if incoming data is being recorded.
+ */
+bool FlashRecorder::isRecording()
+{
+    return recording;
+}
+
+/**
+ * Determines if data is still being written to flash.
+ */
+bool FlashRecorder::isWriting()
+{
+    return active;
+}
+
+/**
+ * Defines how far ahead of the recorded data the region is erased.
+ */
+void FlashRecorder::setEraseAhead(uint32_t bytes)
+{
+    eraseAhead = bytes;
+}
+
+/**
+ * Determines the number of bytes recorded.
+ */
+uint32_t FlashRecorder::getLength()
+{
+    return accepted;
+}
+
+/**
+ * Determines the number of bytes written to flash so far.
+ */
+uint32_t FlashRecorder::getBytesWritten()
+{
+    return written;
+}
+
+/**
+ * Determines the number of buffers dropped because the flash could not keep up.
+ */
+uint32_t FlashRecorder::getDropCount()
+{
+    return dropped;
+}
+
+/**
+ * Determines the rate at which data has been written to flash since recording started, in bytes per second.
+ */
+uint32_t FlashRecorder::getThroughput()
+{
+    CODAL_TIMESTAMP elapsed = (active ? system_timer_current_time() : stopTime) - startTime;
+
+    if (elapsed == 0)
+        return 0;
+
+    return (uint32_t)(((uint64_t)written * 1000) / elapsed);
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int FlashRecorder::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+
+    if (!recording)
+        return DEVICE_OK;
+
+    const uint8_t *data = b.getBytes();
+    int length = b.length();
+
+    if (accepted + length > end - start)
+    {
+        abort(FLASH_RECORDER_EVT_FULL);
+        return DEVICE_OK;
+    }
+
+    // The buffer must fit in the rest of the chunk being filled, plus the other chunk if the writer has finished with it.
+    int space = (ready < 0 ? 2 * chunkSize : chunkSize) - fillLength;
+    if (length > space)
+    {
+        dropped++;
+        return DEVICE_OK;
+    }
+
+    int n = min(length, chunkSize - fillLength);
+    memcpy(&chunks[filling * chunkSize + fillLength], data, n);
+    fillLength += n;
+
+    // If the writer is still busy with the other chunk, it hands this one over itself once it has finished.
+    if (fillLength == chunkSize && ready < 0)
+    {
+        ready = filling;
+        filling ^= 1;
+        fillLength = length - n;
+        memcpy(&chunks[filling * chunkSize], data + n, fillLength);
+
+        Event(DEVICE_ID_NOTIFY, eventCode);
+    }
+
+    accepted += length;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Erases the next row of the region.
+ */
+int FlashRecorder::eraseRow()
+{
+    int result;
+
+    if (erased % SPIFLASH_BIG_ROW_SIZE == 0 && erased + SPIFLASH_BIG_ROW_SIZE <= end && eraseAhead >= SPIFLASH_BIG_ROW_SIZE)
+    {
+        result = flash.eraseBigRow(erased);
+        if (result == DEVICE_OK)
+            erased += SPIFLASH_BIG_ROW_SIZE;
+    }
+    else
+    {
+        result = flash.eraseSmallRow(erased);
+        if (result == DEVICE_OK)
+            erased += SPIFLASH_SMALL_ROW_SIZE;
+    }
+
+    return result;
+}
+
+/**
+ * Writes data to flash at writeAddress a page at a time, erasing first if necessary.
+ */
+int FlashRecorder::write(const uint8_t *data, int length)
+{
+    while (erased < writeAddress + length)
+    {
+        int result = eraseRow();
+        if (result != DEVICE_OK)
+            return result;
+    }
+
+    while (length > 0)
+    {
+        int size = min(length, SPIFLASH_PAGE_SIZE - (writeAddress % SPIFLASH_PAGE_SIZE));
+        int result = flash.writeBytes(writeAddress, data, size);
+        if (result != DEVICE_OK)
+            return result;
+
+        data += size;
+        length -= size;
+        writeAddress += size;
+        written += size;
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Writes chunks to flash and erases ahead until recording stops and every chunk has been written.
+ */
+void FlashRecorder::writer()
+{
+    while (true)
+    {
+        if (ready >= 0)
+        {
+            if (write(&chunks[ready * chunkSize], chunkSize) != DEVICE_OK)
+            {
+                abort(FLASH_RECORDER_EVT_ERROR);
+                break;
+            }
+
+            // Hand over the chunk being filled if it filled up while the last one was being written.
+            target_disable_irq();
+            ready = -1;
+            if (fillLength == chunkSize)
+            {
+                ready = filling;
+                filling ^= 1;
+                fillLength = 0;
+            }
+            target_enable_irq();
+
+            continue;
+        }
+
+        if (!recording)
+        {
+            // Write whatever is left in the chunk that was being filled.
+            if (fillLength && write(&chunks[filling * chunkSize], fillLength) != DEVICE_OK)
+                Event(id, FLASH_RECORDER_EVT_ERROR);
+
+            break;
+        }
+
+        if (erased < end && erased < writeAddress + eraseAhead)
+        {
+            if (eraseRow() != DEVICE_OK)
+            {
+                abort(FLASH_RECORDER_EVT_ERROR);
+                break;
+            }
+
+            continue;
+        }
+
+        // Nothing to do until a chunk fills or recording stops. Check again with interrupts disabled,
+        // so that a wake up raised by pullRequest() cannot be missed.
+        target_disable_irq();
+        bool idle = ready < 0 && recording;
+        if (idle)
+            fiber_wake_on_event(DEVICE_ID_NOTIFY, eventCode);
+        target_enable_irq();
+
+        if (idle)
+            schedule();
+    }
+
+    stopTime = system_timer_current_time();
+
+    free(chunks);
+    chunks = NULL;
+    active = false;
+}
@@ -0,0 +1,119 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "FlashSource.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+/**
+ * Constructor.
+ *
+ * @param flash the flash memory to read samples from.
+ * @param maximumValue the upper bound for samples in the 16 bit output stream.
+ */
+FlashSource::FlashSource(SPIFlash &flash, int maximumValue) : MemorySource(maximumValue), flash(flash)
+{
+}
+
+/**
+ * Perform a blocking playout of 8 bit samples held in flash.
+ */
+int FlashSource::play(uint32_t address, int length, int loop, int expand)
+{
+    return stream(address, length, FLASH_SOURCE_CHUNK_SIZE, loop, expand, 1);
+}
+
+/**
+ * Perform a blocking playout of little endian 16 bit samples held in flash.
+ */
+int FlashSource::play16(uint32_t address, int length, int loop, int expand)
+{
+    return stream(address, length * 2, FLASH_SOURCE_CHUNK_SIZE, loop, expand, 2);
+}
+
+/**
+ * Perform a blocking playout of IMA ADPCM data held in flash.
+ */
+int FlashSource::playAdpcm(uint32_t address, int length, int loop, int expand, int blockSize)
+{
+    if (blockSize <= ADPCM_BLOCK_HEADER_SIZE)
+        return DEVICE_INVALID_PARAMETER;
+
+    return stream(address, length, blockSize, loop, expand, 0);
+}
+
+/**
+ * Reads samples from flash a chunk at a time and queues them, until all the data has been queued or stop() is called.
+ */
+int FlashSource::stream(uint32_t address, int length, int chunkSize, int loop, int expand, int sampleSize)
+{
+    if (length < 0 || expand < 1 || address + length > (uint32_t)flash.numPages() * SPIFLASH_PAGE_SIZE)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Data shorter than one sample, or one ADPCM block header, queues nothing, so a playout repeating forever would
+    // spin without ever yielding.
+    if (length < (sampleSize ? sampleSize : ADPCM_BLOCK_HEADER_SIZE))
+        return DEVICE_INVALID_PARAMETER;
+
+    // A single chunk of RAM holds the raw data. Each chunk is converted into a buffer of its own, which is queued on
+    // the output stream, so the next read happens while earlier chunks are still being played.
+    ManagedBuffer chunk(chunkSize);
+
+    stopping = false;
+
+    do
+    {
+        int offset = 0;
+
+        while (offset < length && !stopping)
+        {
+            int size = min(length - offset, chunkSize);
+
+            // Discard any partial sample or ADPCM header at the end of the data.
+            if (sampleSize == 2)
+                size &= ~1;
+            if (sampleSize == 0 && size < ADPCM_BLOCK_HEADER_SIZE)
+                size = 0;
+            if (size == 0)
+                break;
+
+            int result = flash.readBytes(address + offset, chunk.getBytes(), size);
+            if (result != DEVICE_OK)
+                return result;
+
+            if (sampleSize == 1)
+                queue(chunk.getBytes(), size, expand);
+            else if (sampleSize == 2)
+                queue((const uint16_t *)chunk.getBytes(), size / 2, expand);
+            else
+                queueAdpcm(chunk.getBytes(), size, expand);
+
+            offset += size;
+        }
+
+    } while (!stopping && (loop == 0 || --loop > 0));
+
+    return DEVICE_OK;
+}
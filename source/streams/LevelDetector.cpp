@@ -52,6 +52,11 @@ LevelDetector::LevelDetector(DataSource &source, int highThreshold, int lowThres
 int LevelDetector::pullRequest()
 {
     ManagedBuffer b = upstream.pull();
+
+    // Thresholds are expressed in int16_t sample values, so other encodings are ignored.
+    if (!upstream.getFormat().isInt16())
+        return DEVICE_NOT_SUPPORTED;
+
     int16_t *data = (int16_t *) &b[0];
 
     int samples = b.length() / 2;
@@ -29,93 +29,257 @@ DEALINGS IN THE SOFTWARE.
 #include "LevelDetector.h"
 #include "LevelDetectorSPL.h"
 #include "ErrorNo.h"
+#include <math.h>
+
+#if defined(__ARM_FEATURE_DSP)
+#include <arm_acle.h>
+#endif
+
+// The number of samples passed through the weighting filters at a time, using a buffer on the stack.
+#define LEVEL_DETECTOR_SPL_BLOCK_SIZE       32
+
+// The reference sound pressure, in pascals.
+#define LEVEL_DETECTOR_SPL_REFERENCE        0.00002f
+
+// 10 * log10(2), in Q16.
+#define LEVEL_DETECTOR_SPL_DB_PER_OCTAVE    197283
 
 using namespace codal;
 
+// log2(1 + i / 16) for 0 <= i <= 16, in Q16.
+static const uint32_t log2_table[17] = {
+    0, 5732, 11136, 16248, 21098, 25711, 30109, 34312, 38336, 42196, 45904, 49472, 52911, 56229, 59434, 62534, 65536
+};
+
+// log2_q16() only handles values below 2^63. The energy it is given is the Q16 mean square of 16 bit samples, so is at most
+// 2^46, but computing it needs (n * 2^30) << 16 to fit in 64 bits for a window of n samples. This is what limits the window size.
+#if LEVEL_DETECTOR_SPL_MAXIMUM_WINDOW_SIZE > 32768
+#error "LEVEL_DETECTOR_SPL_MAXIMUM_WINDOW_SIZE must not exceed 32768"
+#endif
+
+/**
+ * Computes the base 2 logarithm of a non zero value below 2^63, in Q16, by interpolating a table. Accurate to about 0.001.
+ */
+static int32_t log2_q16(uint64_t x)
+{
+    int32_t result = 0;
+
+    // Normalise x so that its most significant bit is bit 62. A value with bit 63 set would not be shifted, and give a wrong result.
+    for (int shift = 32; shift > 0; shift >>= 1)
+    {
+        if ((x >> (63 - shift)) == 0)
+        {
+            x <<= shift;
+            result -= shift << 16;
+        }
+    }
+
+    result += 62 << 16;
+
+    // The next 4 bits select a table entry, and the 16 below them interpolate between it and the next.
+    uint32_t index = (uint32_t)(x >> 58) & 0x0F;
+    uint32_t fraction = (uint32_t)(x >> 42) & 0xFFFF;
+
+    return result + log2_table[index] + (((log2_table[index + 1] - log2_table[index]) * fraction) >> 16);
+}
+
 LevelDetectorSPL::LevelDetectorSPL(DataSource &source, float highThreshold, float lowThreshold, float gain, float minValue, uint16_t id) : upstream(source)
 {
     this->id = id;
-    this->level = 0;
+    this->level = minValue;
+    this->levelQ8 = (int32_t)(minValue * 256);
     this->windowSize = LEVEL_DETECTOR_SPL_DEFAULT_WINDOW_SIZE;
+    this->windowPosition = 0;
+    this->sigma = 0;
+    this->sigmaSquared = 0;
+    this->minValue = minValue;
     this->lowThreshold = lowThreshold;
     this->highThreshold = highThreshold;
-    this->gain = gain;
+    this->lowThresholdQ8 = (int32_t)(lowThreshold * 256);
+    this->highThresholdQ8 = (int32_t)(highThreshold * 256);
+    this->weighting = LEVEL_DETECTOR_SPL_WEIGHTING_Z;
+    this->weightingStages = 0;
+    this->timeConstant = LEVEL_DETECTOR_SPL_TIME_WINDOW;
     this->status |= LEVEL_DETECTOR_SPL_INITIALISED;
 
+    // Design for the rate our upstream component reports, if it knows it. pullRequest() redesigns if that rate changes.
+    this->upstreamRate = source.getFormat().sampleRate;
+    this->sampleRate = upstreamRate ? upstreamRate : LEVEL_DETECTOR_SPL_DEFAULT_SAMPLE_RATE;
+
+    setGain(gain);
+    configure();
+
     // Register with our upstream component
     source.connect(*this);
 }
 
+/**
+ * Recomputes the filters and constants that depend on the sample rate, window size and weightings.
+ */
+void LevelDetectorSPL::configure()
+{
+    BiquadCoefficients sections[BIQUAD_A_WEIGHTING_SECTIONS];
+    int count = 0;
+
+    if (weighting == LEVEL_DETECTOR_SPL_WEIGHTING_A)
+        count = BiquadCoefficients::aWeighting(sampleRate, sections);
+
+    if (weighting == LEVEL_DETECTOR_SPL_WEIGHTING_C)
+        count = BiquadCoefficients::cWeighting(sampleRate, sections);
+
+    // The weightings reach down to 20Hz, so need the precision of 32 bit stages.
+    weightingStages = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (weightingFilter[i].configure(sections[i], BiquadQ31) != DEVICE_OK)
+            break;
+
+        weightingFilter[i].reset();
+        weightingStages++;
+    }
+
+    if (weightingStages != count)
+        weightingStages = 0;
+
+    // Exponential averaging blends in a fixed proportion of each window, determined by its duration.
+    if (timeConstant > 0)
+    {
+        float windowMs = windowSize * 1000.0f / sampleRate;
+        smoothing = max(1, (int)(65536.0f * (1.0f - expf(-windowMs / timeConstant))));
+    }
+    else
+    {
+        smoothing = 65536;
+    }
+
+    energy = 0;
+    windows = 0;
+}
+
+/**
+ * Completes a window, updating the level and raising any threshold events.
+ */
+void LevelDetectorSPL::processWindow()
+{
+    // The variance of the window is its mean square with any DC offset removed: (n * sum(x^2) - sum(x)^2) / n^2.
+    // This is exact, where subtracting the square of a rounded mean would swamp quiet signals with a large offset.
+    // With |x| <= 2^15 and n <= 2^15, d / n is at most 2^45, so shifting it by 16 cannot overflow, and e is at most 2^46.
+    uint64_t n = windowSize;
+    uint64_t d = sigmaSquared * n - (uint64_t)(sigma * sigma);
+    uint64_t e = ((d / n) << 16) / n;
+
+    sigma = 0;
+    sigmaSquared = 0;
+    windowPosition = 0;
+
+    if (timeConstant == LEVEL_DETECTOR_SPL_TIME_LEQ)
+    {
+        // A running mean, weighting every window equally.
+        windows++;
+        energy = (uint64_t)((int64_t)energy + ((int64_t)(e - energy)) / (int64_t)windows);
+    }
+    else
+    {
+        energy = (uint64_t)((int64_t)energy + (((int64_t)(e - energy) * smoothing) >> 16));
+    }
+
+    // Convert to decibels. energy is Q16, so remove 16 octaves from its logarithm.
+    if (energy == 0)
+        levelQ8 = (int32_t)(minValue * 256);
+    else
+        levelQ8 = (int32_t)(((int64_t)(log2_q16(energy) - (16 << 16)) * LEVEL_DETECTOR_SPL_DB_PER_OCTAVE) >> 24) + offsetQ8;
+
+    level = levelQ8 / 256.0f;
+
+    if ((!(status & LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED)) && levelQ8 > highThresholdQ8)
+    {
+        Event(id, LEVEL_THRESHOLD_HIGH);
+        status |=  LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED;
+        status &= ~LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED;
+    }
+
+    if ((!(status & LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED)) && levelQ8 < lowThresholdQ8)
+    {
+        Event(id, LEVEL_THRESHOLD_LOW);
+        status |=  LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED;
+        status &= ~LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED;
+    }
+}
+
 /**
  * Callback provided when data is ready.
  */
 int LevelDetectorSPL::pullRequest()
 {
     ManagedBuffer b = upstream.pull();
-    int16_t *data = (int16_t *) &b[0];
-
-    int samples = b.length() / 2;
+    DataStreamFormat format = upstream.getFormat();
 
-    while(samples){
+    if (format.sampleRate && format.sampleRate != upstreamRate)
+    {
+        upstreamRate = format.sampleRate;
+        setSampleRate(upstreamRate);
+    }
 
-        //ensure we use at least windowSize number of samples
-        int16_t *end, *ptr;
-        if(samples < windowSize)
-        break;
+    // Levels are measured relative to int16_t full scale, so other encodings cannot be measured.
+    if (!format.isInt16())
+        return DEVICE_NOT_SUPPORTED;
 
-        end = data + windowSize;
+    int16_t *data = (int16_t *) &b[0];
+    int16_t block[LEVEL_DETECTOR_SPL_BLOCK_SIZE];
 
-        float pref = 0.00002;
+    int samples = b.length() / 2;
 
-        /*******************************
-        *   REMOVE DC OFFSET
-        ******************************/
-        int32_t avg = 0;
-        ptr = data;
-        while(ptr < end) avg += *ptr++;
-        avg = avg/windowSize;
+    // Accumulate the sum and sum of squares of each window in a single pass. Windows may span several buffers.
+    while (samples > 0)
+    {
+        int n = min(samples, windowSize - windowPosition);
+        int16_t *ptr = data;
 
-        ptr = data;
-        while(ptr < end) *ptr++ -= avg;
+        if (weightingStages)
+        {
+            // Filter a copy, leaving the buffer untouched for any other consumers.
+            n = min(n, LEVEL_DETECTOR_SPL_BLOCK_SIZE);
+            memcpy(block, data, n * sizeof(int16_t));
 
-        /*******************************
-        *   GET MAX VALUE
-        ******************************/
+            for (int i = 0; i < weightingStages; i++)
+                weightingFilter[i].process(block, n);
 
-        int16_t maxVal = 0;
-        ptr = data;
-        while(ptr < end){
-         int32_t v = abs(*ptr++);
-         if(v > maxVal) maxVal = v;
+            ptr = block;
         }
 
-        float conv = ((float)maxVal)/((1 << 15)-1) * gain;
-
-        /*******************************
-        *   CALCULATE SPL
-        ******************************/
-        conv = 20 * log10(conv/pref);
-
-        if(isfinite(conv)) level = conv;
-        else level = minValue;
+        int16_t *end = ptr + n;
+        int32_t sum = 0;
+        int64_t squares = 0;
 
-        samples -= windowSize;
-        if ((!(status & LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED)) && level > highThreshold)
+#if defined(__ARM_FEATURE_DSP)
+        // Two samples per instruction for both the sum and the sum of squares.
+        while (ptr + 2 <= end)
         {
-            Event(id, LEVEL_THRESHOLD_HIGH);
-            status |=  LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED;
-            status &= ~LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED;
+            int32_t pair;
+            memcpy(&pair, ptr, 4);
+            sum = __smlad(pair, 0x00010001, sum);
+            squares = __smlald(pair, pair, squares);
+            ptr += 2;
         }
-
-        if ((!(status & LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED)) && level < lowThreshold)
+#endif
+        while (ptr < end)
         {
-            Event(id, LEVEL_THRESHOLD_LOW);
-            status |=  LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED;
-            status &= ~LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED;
+            int32_t v = *ptr++;
+            sum += v;
+            squares += v * v;
         }
-   }
 
-   return DEVICE_OK;
+        sigma += sum;
+        sigmaSquared += (uint64_t)squares;
+        windowPosition += n;
+        data += n;
+        samples -= n;
+
+        if (windowPosition >= windowSize)
+            processWindow();
+    }
+
+    return DEVICE_OK;
 }
 
 /*
@@ -144,6 +308,7 @@ int LevelDetectorSPL::setLowThreshold(float value)
 
     // We need to update our threshold
     lowThreshold = value;
+    lowThresholdQ8 = (int32_t)(value * 256);
 
     // Reset any exisiting threshold state, and enable threshold detection.
     status &= ~LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED;
@@ -170,6 +335,7 @@ int LevelDetectorSPL::setHighThreshold(float value)
 
     // We need to update our threshold
     highThreshold = value;
+    highThresholdQ8 = (int32_t)(value * 256);
 
     // Reset any exisiting threshold state, and enable threshold detection.
     status &= ~LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED;
@@ -212,16 +378,81 @@ float LevelDetectorSPL::getHighThreshold()
  */
 int LevelDetectorSPL::setWindowSize(int size)
 {
-    if (size <= 0)
+    if (size <= 0 || size > LEVEL_DETECTOR_SPL_MAXIMUM_WINDOW_SIZE)
         return DEVICE_INVALID_PARAMETER;
 
     this->windowSize = size;
+    this->windowPosition = 0;
+    this->sigma = 0;
+    this->sigmaSquared = 0;
+
+    configure();
     return DEVICE_OK;
 }
 
 int LevelDetectorSPL::setGain(float gain)
 {
     this->gain = gain;
+
+    // Fold the level of a full scale signal into a constant, so that no floating point is needed per window.
+    this->offsetQ8 = (int32_t)(256 * 20 * log10f(gain / (32767 * LEVEL_DETECTOR_SPL_REFERENCE)));
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the sample rate of the incoming data, used to design the weighting filters and time constants.
+ * By default, this is taken from the format of the upstream component. A rate set here holds until that format changes.
+ *
+ * @param rate the sample rate, in Hz.
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the request fails.
+ */
+int LevelDetectorSPL::setSampleRate(int rate)
+{
+    if (rate <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->sampleRate = rate;
+
+    configure();
+    return DEVICE_OK;
+}
+
+/**
+ * Selects the frequency weighting applied before the level is measured.
+ *
+ * @param weighting One of LEVEL_DETECTOR_SPL_WEIGHTING_Z (none), LEVEL_DETECTOR_SPL_WEIGHTING_A or LEVEL_DETECTOR_SPL_WEIGHTING_C.
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the request fails.
+ */
+int LevelDetectorSPL::setWeighting(int weighting)
+{
+    if (weighting != LEVEL_DETECTOR_SPL_WEIGHTING_Z && weighting != LEVEL_DETECTOR_SPL_WEIGHTING_A && weighting != LEVEL_DETECTOR_SPL_WEIGHTING_C)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->weighting = weighting;
+
+    configure();
+    return DEVICE_OK;
+}
+
+/**
+ * Selects how the level is averaged over time.
+ *
+ * @param ms The time constant of an exponential average, in milliseconds (such as LEVEL_DETECTOR_SPL_TIME_FAST or
+ * LEVEL_DETECTOR_SPL_TIME_SLOW), LEVEL_DETECTOR_SPL_TIME_WINDOW to measure each window independently, or
+ * LEVEL_DETECTOR_SPL_TIME_LEQ to average all windows equally from now on.
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the request fails.
+ */
+int LevelDetectorSPL::setTimeConstant(int ms)
+{
+    if (ms < 0 && ms != LEVEL_DETECTOR_SPL_TIME_LEQ)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->timeConstant = ms;
+
+    configure();
     return DEVICE_OK;
 }
 
@@ -12,8 +12,8 @@ using namespace codal;
 MemorySource::MemorySource(int maximumValue) : output(*this)
 {
     this->bytesSent = 0;
-    this->maximumValue = maximumValue;
-    this->scalar = 1;
+    this->stopping = false;
+    this->setMaximumSampleValue(maximumValue);
 } 
 
 /**
@@ -25,6 +25,14 @@ void MemorySource::setMaximumSampleValue(int maximum)
     scalar = (maximumValue << 8) / 256;
 }
 
+/**
+ * Ends the current playout once the buffer being queued has been queued. Buffers already queued still play.
+ */
+void MemorySource::stop()
+{
+    stopping = true;
+}
+
 /**
  * Provide the next available ManagedBuffer to our downstream caller, if available.
  */
@@ -33,98 +41,199 @@ ManagedBuffer MemorySource::pull()
     return buffer;
 } 
 
+/**
+ * Describes the data this source provides: unsigned samples in 16 bit words, no greater than the maximum sample value.
+ */
+DataStreamFormat MemorySource::getFormat()
+{
+    int bits = 1;
+
+    while (bits < 16 && (1 << bits) <= maximumValue)
+        bits++;
+
+    return DataStreamFormat(2, bits, false);
+}
+
+/**
+ * Converts a run of 8 bit samples, scaled to the maximum sample value, into a new buffer and queues it on the output stream.
+ * @param data pointer to the samples.
+ * @param size number of samples.
+ * @param expand repeat each input sample the given number of times in the output stream.
+ */
+void MemorySource::queue(const uint8_t *data, int size, int expand)
+{
+    int sample;
+    uint16_t *out;
+
+    buffer = ManagedBuffer(size*expand*2);
+    out = (uint16_t *) &buffer[0];
+
+    for (int i=0; i<size; i++)
+    {
+        sample = data[i];
+
+        if (sample == 255)
+            sample = maximumValue;
+        else
+            sample = (sample * scalar) >> 8;
+
+        for (int s=0; s < expand; s++)
+        {
+            *out = sample;
+            out++;
+        }
+    }
+
+    output.pullRequest();
+}
+
+/**
+ * Converts a run of 16 bit samples, limited to the maximum sample value, into a new buffer and queues it on the output stream.
+ * @param data pointer to the samples.
+ * @param size number of samples.
+ * @param expand repeat each input sample the given number of times in the output stream.
+ */
+void MemorySource::queue(const uint16_t *data, int size, int expand)
+{
+    int sample;
+    uint16_t *out;
+
+    buffer = ManagedBuffer(size*expand*2);
+    out = (uint16_t *) &buffer[0];
+
+    for (int i=0; i<size; i++)
+    {
+        sample = min(data[i], maximumValue);
+
+        for (int s=0; s < expand; s++)
+        {
+            *out = sample;
+            out++;
+        }
+    }
+
+    output.pullRequest();
+}
+
+/**
+ * Decodes an IMA ADPCM block, scaled from signed 16 bit to the range 0..maximum sample value, into a new buffer
+ * and queues it on the output stream.
+ * @param data pointer to the block.
+ * @param size length of the block, in bytes.
+ * @param expand repeat each input sample the given number of times in the output stream.
+ */
+void MemorySource::queueAdpcm(const uint8_t *data, int size, int expand)
+{
+    int samples = ADPCM_SAMPLES_PER_BLOCK(size);
+
+    buffer = ManagedBuffer(samples*expand*2);
+
+    // Decode into the start of the buffer, then scale and expand in place, working backwards so that
+    // no decoded sample is overwritten before it has been read.
+    int16_t *pcm = (int16_t *) &buffer[0];
+    uint16_t *out = (uint16_t *) &buffer[0];
+
+    AdpcmDecoder::decodeBlock(data, size, pcm);
+
+    for (int i = samples - 1; i >= 0; i--)
+    {
+        uint16_t sample = ((uint32_t)(pcm[i] + 32768) * maximumValue) >> 16;
+
+        for (int s = expand - 1; s >= 0; s--)
+            out[i * expand + s] = sample;
+    }
+
+    output.pullRequest();
+}
+
 /**
  * Perform a 16 bit blocking playout of the 8 bit data buffer. 
- * Samples are upscaled to 16 bit. Returns when all the data has been queued.
+ * Samples are upscaled to 16 bit. Returns when all the data has been queued, or when stop() is called.
+ * Returns immediately if there are no samples to play.
  * @param data pointer to memory location to playout.
  * @param length number of bytes to stream.
- * @param loop  repeat playback of buffer when completed the given number of times. Set to zero to repeat forever.
+ * @param loop  repeat playback of buffer when completed the given number of times. Set to zero to repeat until stop() is called.
  * @param expand repeat each input sample the given number of times in the output stream.
  */
 void MemorySource::play(const uint8_t *data, int length, int loop, int expand)
 {
-    int sample;
-    uint16_t *out;
+    // With nothing to queue, a playout repeating forever would spin without ever yielding.
+    if (data == NULL || length <= 0 || expand < 1)
+        return;
+
+    stopping = false;
 
     do
     {
-        while (bytesSent < length)
+        while (bytesSent < length && !stopping)
         {
             int size = min(length - bytesSent, MEMORY_SOURCE_MAX_BUFFER);
-            buffer = ManagedBuffer(size*expand*2);
-            out = (uint16_t *) &buffer[0];
-
-            for (int i=0; i<size; i++)
-            {
-                sample = data[bytesSent];
-                bytesSent++;
-
-                if (sample == 255)
-                    sample = maximumValue;
-                else
-                    sample = (sample * scalar) >> 8;
-
-                for (int s=0; s < expand; s++)
-                {
-                    *out = sample; 
-                    out++;
-                }
-            }
-
-            output.pullRequest();
+            queue(&data[bytesSent], size, expand);
+            bytesSent += size;
         }
 
         bytesSent = 0;
-        if (loop > 0)
-            loop--;
-
-    } while (loop);
+    } while (!stopping && (loop == 0 || --loop > 0));
 
 } 
 
 /**
  * Perform a 16 bit blocking playout of a 16 bit data buffer. 
- * Returns when all the data has been queued.
+ * Returns when all the data has been queued, or when stop() is called, or immediately if there are no samples to play.
  * @param data pointer to memory location to playout.
  * @param length number of 16 bit words to stream.
- * @param loop  repeat playback of buffer when completed the given number of times. Set to zero to repeat forever.
+ * @param loop  repeat playback of buffer when completed the given number of times. Set to zero to repeat until stop() is called.
  * @param expand repeat each input sample the given number of times in the output stream.
  */
 void MemorySource::play(const uint16_t *data, int length, int loop, int expand)
 {
-    int sample;
-    uint16_t *out;
+    // With nothing to queue, a playout repeating forever would spin without ever yielding.
+    if (data == NULL || length <= 0 || expand < 1)
+        return;
+
+    stopping = false;
 
     do
     {
-        while (bytesSent < length)
+        while (bytesSent < length && !stopping)
         {
             int size = min(length - bytesSent, MEMORY_SOURCE_MAX_BUFFER);
+            queue(&data[bytesSent], size, expand);
+            bytesSent += size;
+        }
+        
+        bytesSent = 0;
+    } while (!stopping && (loop == 0 || --loop > 0));
 
-            buffer = ManagedBuffer(size*expand*2);
-            out = (uint16_t *) &buffer[0];
-
-            for (int i=0; i<size; i++)
-            {
-                sample = data[bytesSent];
-                bytesSent++;
+} 
 
-                sample = min(sample, maximumValue);
+/**
+ * Perform a blocking playout of IMA ADPCM data, decoding one block per buffer.
+ * Samples are scaled from signed 16 bit to the range 0..maximum sample value.
+ * Returns when all the data has been queued, or when stop() is called, or immediately if there is not a whole block header to play.
+ * @param data pointer to memory location to playout.
+ * @param length number of bytes to stream.
+ * @param loop  repeat playback of buffer when completed the given number of times. Set to zero to repeat until stop() is called.
+ * @param expand repeat each input sample the given number of times in the output stream.
+ * @param blockSize the size of each ADPCM block in the data, in bytes.
+ */
+void MemorySource::playAdpcm(const uint8_t *data, int length, int loop, int expand, int blockSize)
+{
+    // Data too short to hold a single block header queues nothing, so a playout repeating forever would spin without ever yielding.
+    if (data == NULL || length < ADPCM_BLOCK_HEADER_SIZE || expand < 1 || blockSize <= ADPCM_BLOCK_HEADER_SIZE)
+        return;
 
-                for (int s=0; s < expand; s++)
-                {
-                    *out = sample; 
-                    out++;
-                }
-            }
+    stopping = false;
 
-            output.pullRequest();
+    do
+    {
+        while (bytesSent + ADPCM_BLOCK_HEADER_SIZE <= length && !stopping)
+        {
+            int size = min(length - bytesSent, blockSize);
+            queueAdpcm(&data[bytesSent], size, expand);
+            bytesSent += size;
         }
-        
-        bytesSent = 0;
-        if (loop > 0)
-            loop--;
-
-    } while (loop);
 
-} 
+        bytesSent = 0;
+    } while (!stopping && (loop == 0 || --loop > 0));
+}
@@ -26,12 +26,68 @@ DEALINGS IN THE SOFTWARE.
 #include "ErrorNo.h"
 #include "CodalDmesg.h"
 
+#if defined(__ARM_FEATURE_DSP) || defined(__ARM_FEATURE_SAT)
+#include <arm_acle.h>
+#endif
+
 using namespace codal;
 
+/**
+ * Adds a channel's samples, scaled by its volume, into a set of 32 bit running totals.
+ * Unsigned samples are centred on 512.
+ */
+static void mixer_accumulate(int32_t *acc, const int16_t *data, int samples, int volume, bool isSigned)
+{
+    int32_t bias = isSigned ? 0 : 512 * volume;
+
+#if defined(__ARM_FEATURE_DSP)
+    // Take two samples per load where the data is word aligned, and use the DSP multiply-accumulate
+    // instructions on the bottom and top halfwords.
+    if (((uint32_t)data & 3) == 0)
+    {
+        const int32_t *words = (const int32_t *)data;
+
+        for (int i = samples >> 1; i > 0; i--)
+        {
+            int32_t w = *words++;
+            acc[0] = __smlabb(w, volume, acc[0]) - bias;
+            acc[1] = __smlatb(w, volume, acc[1]) - bias;
+            acc += 2;
+        }
+
+        data = (const int16_t *)words;
+        samples &= 1;
+    }
+#endif
+
+    while (samples--)
+        *acc++ += *data++ * volume - bias;
+}
+
+/**
+ * Scales a set of running totals back to 10 bit samples, saturating once, and centres them on 512.
+ */
+static void mixer_output(int16_t *out, const int32_t *acc, int samples)
+{
+    while (samples--)
+    {
+        int32_t v = *acc++ >> 10;
+#if defined(__ARM_FEATURE_SAT)
+        v = __ssat(v, 10);
+#else
+        if (v < -512) v = -512;
+        if (v > 511) v = 511;
+#endif
+        *out++ = v + 512;
+    }
+}
+
 Mixer::Mixer()
 {
     channels = NULL;
     downStream = NULL;
+    accumulator = NULL;
+    accumulatorLength = 0;
 }
 
 Mixer::~Mixer()
@@ -43,6 +99,8 @@ Mixer::~Mixer()
         n->stream->disconnect();
         delete n;
     }
+
+    free(accumulator);
 }
 
 MixerChannel *Mixer::addChannel(DataStream &stream)
@@ -54,6 +112,11 @@ MixerChannel *Mixer::addChannel(DataStream &stream)
     c->isSigned = true;
     channels = c;
     stream.connect(*this);
+
+    DataStreamFormat format = stream.getFormat();
+    if (format.isKnown())
+        c->isSigned = format.isSigned;
+
     return c;
 }
 
@@ -61,39 +124,46 @@ ManagedBuffer Mixer::pull() {
     if (!channels)
         return ManagedBuffer(512);
 
-    ManagedBuffer sum;
     MixerChannel *next;
+    int length = 0;
 
     for (auto ch = channels; ch; ch = next) {
         next = ch->next; // save next in case the current channel gets deleted
         bool isSigned = ch->isSigned;
         int vol = ch->volume;
         ManagedBuffer data = ch->stream->pull();
-        if (sum.length() < data.length()) {
-            ManagedBuffer newsum(data.length());
-            newsum.writeBuffer(0, sum);
-            sum = newsum;
+        int samples = data.length() >> 1;
+
+        // Grow our accumulator if this is the longest buffer seen so far. This is rare after the first few calls.
+        if (samples > accumulatorLength) {
+            int32_t *newAccumulator = (int32_t *)malloc(samples * sizeof(int32_t));
+            if (newAccumulator == NULL)
+                continue;
+
+            if (length)
+                memcpy(newAccumulator, accumulator, length * sizeof(int32_t));
+
+            free(accumulator);
+            accumulator = newAccumulator;
+            accumulatorLength = samples;
         }
-        auto d = (int16_t*)&data[0];
-        auto s = (int16_t*)&sum[0];
-        auto len = data.length() >> 1;
-        while (len--) {
-            int v = isSigned ? *d : *(uint16_t*)d - 512;
-            v = ((v * vol) + (*s << 10)) >> 10;
-            if (v < -512) v = -512;
-            if (v > 511) v = 511;
-            *s = v;
-            d++;
-            s++;
+
+        // Clear the part of the accumulator this channel extends into.
+        if (samples > length) {
+            memset(&accumulator[length], 0, (samples - length) * sizeof(int32_t));
+            length = samples;
         }
+
+        mixer_accumulate(accumulator, (int16_t *)data.getBytes(), samples, vol, isSigned);
     }
 
-    auto s = (int16_t*)&sum[0];
-    auto len = sum.length() >> 1;
-    while (len--)
-        *s++ += 512;
-        
-    return sum;
+    // Every sample of the output is written, so the last buffer can be reused as is if nothing else still refers to it.
+    if (output.length() != length * 2 || output.isShared())
+        output = ManagedBuffer(length * 2);
+
+    mixer_output((int16_t *)output.getBytes(), accumulator, length);
+
+    return output;
 }
 
 int Mixer::pullRequest()
@@ -110,3 +180,8 @@ void Mixer::connect(DataSink &sink)
 {
     this->downStream = &sink;
 }
+
+DataStreamFormat Mixer::getFormat()
+{
+    return DataStreamFormat(2, 10, false, 1, channels ? channels->stream->getFormat().sampleRate : 0);
+}
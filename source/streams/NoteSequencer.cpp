@@ -0,0 +1,185 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "NoteSequencer.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+/**
+ * Constructor.
+ *
+ * @param synth The synthesizer to play notes on.
+ */
+NoteSequencer::NoteSequencer(PolySynthesizer &synth) : synth(synth)
+{
+    this->notes = NULL;
+    this->length = 0;
+    this->position = 0;
+    this->startTime = 0;
+    this->elapsed = 0;
+    this->loop = false;
+
+    for (int i = 0; i < NOTE_SEQUENCER_INSTRUMENTS; i++)
+        setInstrument(i, NULL, 5, 0, 1024, 20);
+}
+
+/**
+ * Destructor.
+ * Stops playback.
+ */
+NoteSequencer::~NoteSequencer()
+{
+    stop();
+}
+
+/**
+ * Defines an instrument that notes may be played with.
+ */
+int NoteSequencer::setInstrument(int index, const uint16_t *wavetable, int attack, int decay, int sustain, int release)
+{
+    if (index < 0 || index >= NOTE_SEQUENCER_INSTRUMENTS)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (attack < 0 || attack > 0xFFFF || decay < 0 || decay > 0xFFFF || release < 0 || release > 0xFFFF || sustain < 0 || sustain > 1024)
+        return DEVICE_INVALID_PARAMETER;
+
+    instruments[index].wavetable = wavetable;
+    instruments[index].attack = attack;
+    instruments[index].decay = decay;
+    instruments[index].sustain = sustain;
+    instruments[index].release = release;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Starts playing a list of notes, replacing any list already playing.
+ */
+int NoteSequencer::play(const SequencerNote *notes, int length, bool loop)
+{
+    if (notes == NULL || length <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    // A looping list must take some time to play, or scheduling it would never finish.
+    if (loop)
+    {
+        uint32_t total = 0;
+        for (int i = 0; i < length; i++)
+            total += notes[i].duration;
+
+        if (total == 0)
+            return DEVICE_INVALID_PARAMETER;
+    }
+
+    this->notes = notes;
+    this->length = length;
+    this->loop = loop;
+    this->position = 0;
+    this->elapsed = 0;
+    this->startTime = synth.getTime();
+
+    synth.setCallback(onRender, this);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Stops playback.
+ */
+void NoteSequencer::stop()
+{
+    if (notes)
+        synth.setCallback(NULL);
+
+    notes = NULL;
+}
+
+/**
+ * Determines if a note list is being played.
+ */
+bool NoteSequencer::isPlaying()
+{
+    return notes != NULL;
+}
+
+/**
+ * Schedules every note that starts before the end of the given buffer.
+ */
+bool NoteSequencer::schedule(uint32_t time, int samples)
+{
+    while (notes)
+    {
+        const SequencerNote &n = notes[position];
+        uint32_t when = startTime + synth.samplesFromMs(elapsed);
+
+        if ((int32_t)(when - time) >= samples)
+            return true;
+
+        if (n.frequency)
+        {
+            // The note sounds until the next one starts, and its envelope's release then overlaps the next note.
+            uint32_t end = startTime + synth.samplesFromMs(elapsed + n.duration);
+            int result = synth.scheduleNote(n.frequency, when, end, (n.volume << 2) + (n.volume >> 6),
+                                            &instruments[n.instrument < NOTE_SEQUENCER_INSTRUMENTS ? n.instrument : 0]);
+
+            // If the synthesizer has no free event or voice, try again in the next buffer.
+            if (result == DEVICE_NO_RESOURCES)
+                return true;
+        }
+
+        elapsed += n.duration;
+        position++;
+
+        // Move whole seconds from elapsed into startTime, so that elapsed never grows without bound. Whole seconds
+        // are a whole number of samples, so this introduces no rounding.
+        if (elapsed >= 1000)
+        {
+            startTime += synth.getSampleRate() * (elapsed / 1000);
+            elapsed %= 1000;
+        }
+
+        if (position >= length)
+        {
+            if (!loop)
+            {
+                notes = NULL;
+                synth.setCallback(NULL);
+                return false;
+            }
+
+            position = 0;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * PolySynthesizerCallback that forwards to schedule().
+ */
+bool NoteSequencer::onRender(void *arg, uint32_t time, int samples)
+{
+    return ((NoteSequencer *)arg)->schedule(time, samples);
+}
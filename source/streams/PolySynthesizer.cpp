@@ -0,0 +1,654 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "PolySynthesizer.h"
+#include "CodalFiber.h"
+#include "ErrorNo.h"
+
+#if defined(__ARM_FEATURE_SAT)
+#include <arm_acle.h>
+#endif
+
+// Wavetables hold TONE_WIDTH (2^10) entries, indexed by the top bits of a 32 bit phase accumulator.
+#define POLY_SYNTHESIZER_PHASE_SHIFT    22
+
+using namespace codal;
+
+static uint16_t *sineWavetable = NULL;
+
+/**
+ * Provides the wavetable used by voices that have not been given one, creating it on first use.
+ */
+static const uint16_t *default_wavetable()
+{
+    if (sineWavetable == NULL)
+        sineWavetable = PolySynthesizer::createWavetable(Synthesizer::SineTone);
+
+    return sineWavetable;
+}
+
+/**
+ * Determines if sample time a falls before sample time b, allowing for the clock wrapping around.
+ */
+static inline bool before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+/*
+ * Simple internal helper funtion that creates a fiber within the given PolySynthesizer to handle playback
+ */
+static void begin_playback(void *data)
+{
+    ((PolySynthesizer*)data)->generate();
+}
+
+/**
+ * Constructor.
+ *
+ * @param sampleRate The sample rate at which this synthesizer will produce data.
+ * @param isSigned If true, samples use int16_t otherwise uint16_t centred on 512.
+ */
+PolySynthesizer::PolySynthesizer(int sampleRate, bool isSigned) : output(*this)
+{
+    this->sampleRate = sampleRate;
+    this->isSigned = isSigned;
+    this->bufferSize = 512;
+    this->amplitude = 1024;
+    this->eventCount = 0;
+    this->clock = 0;
+    this->accumulator = NULL;
+    this->accumulatorLength = 0;
+    this->callback = NULL;
+    this->callbackArg = NULL;
+    this->callbackPending = false;
+    this->active = false;
+
+    memset(voices, 0, sizeof(voices));
+    setEnvelope(POLY_SYNTHESIZER_ALL_VOICES, 5, 0, 1024, 20);
+}
+
+/**
+ * Destructor.
+ * Removes all resources held by the instance.
+ */
+PolySynthesizer::~PolySynthesizer()
+{
+    free(accumulator);
+}
+
+/**
+ * Creates a wavetable from one of the Synthesizer tone functions, such as Synthesizer::SquareWaveTone.
+ */
+uint16_t *PolySynthesizer::createWavetable(SynthesizerGetSample tonePrint, void *arg)
+{
+    uint16_t *table = (uint16_t *)malloc(TONE_WIDTH * sizeof(uint16_t));
+
+    if (table)
+        for (int i = 0; i < TONE_WIDTH; i++)
+            table[i] = tonePrint(arg, i);
+
+    return table;
+}
+
+/**
+ * Determines the sample time of the next sample to be rendered.
+ */
+uint32_t PolySynthesizer::getTime()
+{
+    return clock;
+}
+
+/**
+ * Converts a period in milliseconds into a number of samples at the current sample rate.
+ */
+uint32_t PolySynthesizer::samplesFromMs(int ms)
+{
+    return (uint32_t)(((uint64_t)ms * sampleRate) / 1000);
+}
+
+/**
+ * Adds an event to the queue, in time order. Events scheduled for the same time are applied in the order they were scheduled.
+ */
+int PolySynthesizer::schedule(uint32_t time, int voice, bool noteOn, uint32_t phaseDelta, int volume, const SynthesizerInstrument *instrument)
+{
+    if (eventCount >= POLY_SYNTHESIZER_MAXIMUM_EVENTS)
+        return DEVICE_NO_RESOURCES;
+
+    if (before(time, clock))
+        time = clock;
+
+    int i = eventCount;
+    while (i > 0 && before(time, events[i-1].time))
+    {
+        events[i] = events[i-1];
+        i--;
+    }
+
+    events[i].time = time;
+    events[i].voice = voice;
+    events[i].noteOn = noteOn;
+    events[i].phaseDelta = phaseDelta;
+    events[i].volume = volume;
+    events[i].instrument = instrument;
+    eventCount++;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Removes the events queued for a voice at or after the given time.
+ */
+void PolySynthesizer::unschedule(int voice, uint32_t time)
+{
+    int kept = 0;
+
+    for (int i = 0; i < eventCount; i++)
+        if (events[i].voice != voice || before(events[i].time, time))
+            events[kept++] = events[i];
+
+    eventCount = kept;
+}
+
+/**
+ * Adds a note on event, with its instrument, to the queue.
+ */
+int PolySynthesizer::queueNote(int voice, float frequency, int volume, uint32_t when, const SynthesizerInstrument *instrument)
+{
+    int result = schedule(when, voice, true, (uint32_t)(frequency * (4294967296.0f / sampleRate)), volume, instrument);
+
+    if (result == DEVICE_OK)
+    {
+        voices[voice].held = true;
+        start();
+    }
+
+    return result;
+}
+
+/**
+ * Starts a note on the given voice. The note sounds until a matching noteOff().
+ */
+int PolySynthesizer::noteOn(int voice, float frequency, int volume, uint32_t when)
+{
+    if (voice < 0 || voice >= POLY_SYNTHESIZER_VOICES || frequency < 0 || frequency * 2 >= sampleRate || volume < 0 || volume > 1024)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (frequency == 0)
+        return noteOff(voice, when);
+
+    return queueNote(voice, frequency, volume, when, NULL);
+}
+
+/**
+ * Releases the note on the given voice, which then fades out over the voice's release time.
+ */
+int PolySynthesizer::noteOff(int voice, uint32_t when)
+{
+    if (voice < 0 || voice >= POLY_SYNTHESIZER_VOICES)
+        return DEVICE_INVALID_PARAMETER;
+
+    int result = schedule(when, voice, false, 0, 0, NULL);
+
+    if (result == DEVICE_OK)
+    {
+        voices[voice].held = false;
+        voices[voice].busyUntil = (before(when, clock) ? clock : when) + samplesFromMs(voices[voice].instrument.release);
+    }
+
+    return result;
+}
+
+/**
+ * Schedules a note of a fixed length on a free voice.
+ */
+int PolySynthesizer::playNote(float frequency, int duration, int volume, uint32_t when, const SynthesizerInstrument *instrument)
+{
+    if (duration < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (before(when, clock))
+        when = clock;
+
+    return scheduleNote(frequency, when, when + samplesFromMs(duration), volume, instrument);
+}
+
+/**
+ * Schedules a note between two sample times on a free voice.
+ */
+int PolySynthesizer::scheduleNote(float frequency, uint32_t start, uint32_t end, int volume, const SynthesizerInstrument *instrument)
+{
+    if (frequency < 0 || frequency * 2 >= sampleRate || volume < 0 || volume > 1024)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (eventCount + 2 > POLY_SYNTHESIZER_MAXIMUM_EVENTS)
+        return DEVICE_NO_RESOURCES;
+
+    if (before(start, clock))
+        start = clock;
+
+    if (before(end, start))
+        end = start;
+
+    // Prefer a voice that will be silent by the time the note starts, otherwise steal the one that finishes soonest.
+    int voice = -1;
+    for (int i = 0; i < POLY_SYNTHESIZER_VOICES; i++)
+    {
+        if (voices[i].held)
+            continue;
+
+        if (!before(start, voices[i].busyUntil))
+        {
+            voice = i;
+            break;
+        }
+
+        if (voice < 0 || before(voices[i].busyUntil, voices[voice].busyUntil))
+            voice = i;
+    }
+
+    if (voice < 0)
+        return DEVICE_NO_RESOURCES;
+
+    // When stealing a voice, the rest of its current note must not carry on into the new one. In particular, its
+    // noteOff would otherwise release the new note early.
+    unschedule(voice, start);
+
+    queueNote(voice, frequency, volume, start, instrument);
+    noteOff(voice, end);
+
+    // The release time of the note comes from its own instrument, which the voice only takes on when the note starts.
+    if (instrument)
+        voices[voice].busyUntil = end + samplesFromMs(instrument->release);
+
+    return voice;
+}
+
+/**
+ * Registers a function to be called at the start of every buffer rendered.
+ */
+void PolySynthesizer::setCallback(PolySynthesizerCallback callback, void *arg)
+{
+    this->callback = callback;
+    this->callbackArg = arg;
+    this->callbackPending = callback != NULL;
+
+    if (callback)
+        start();
+}
+
+/**
+ * Silences every voice immediately and discards any scheduled events.
+ */
+void PolySynthesizer::stop()
+{
+    eventCount = 0;
+
+    for (int i = 0; i < POLY_SYNTHESIZER_VOICES; i++)
+    {
+        voices[i].stage = VoiceIdle;
+        voices[i].level = 0;
+        voices[i].delta = 0;
+        voices[i].held = false;
+        voices[i].busyUntil = clock;
+    }
+}
+
+/**
+ * Defines the waveform of a voice.
+ */
+int PolySynthesizer::setWavetable(int voice, const uint16_t *wavetable)
+{
+    if (voice < POLY_SYNTHESIZER_ALL_VOICES || voice >= POLY_SYNTHESIZER_VOICES)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (wavetable == NULL)
+        wavetable = default_wavetable();
+
+    if (wavetable == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    for (int i = 0; i < POLY_SYNTHESIZER_VOICES; i++)
+        if (voice == POLY_SYNTHESIZER_ALL_VOICES || voice == i)
+            voices[i].instrument.wavetable = wavetable;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the envelope of a voice.
+ */
+int PolySynthesizer::setEnvelope(int voice, int attack, int decay, int sustain, int release)
+{
+    if (voice < POLY_SYNTHESIZER_ALL_VOICES || voice >= POLY_SYNTHESIZER_VOICES)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (attack < 0 || attack > 0xFFFF || decay < 0 || decay > 0xFFFF || release < 0 || release > 0xFFFF || sustain < 0 || sustain > 1024)
+        return DEVICE_INVALID_PARAMETER;
+
+    for (int i = 0; i < POLY_SYNTHESIZER_VOICES; i++)
+    {
+        if (voice == POLY_SYNTHESIZER_ALL_VOICES || voice == i)
+        {
+            voices[i].instrument.attack = attack;
+            voices[i].instrument.decay = decay;
+            voices[i].instrument.sustain = sustain;
+            voices[i].instrument.release = release;
+        }
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the number of voices currently producing sound.
+ */
+int PolySynthesizer::getActiveVoiceCount()
+{
+    int count = 0;
+
+    for (int i = 0; i < POLY_SYNTHESIZER_VOICES; i++)
+        if (voices[i].stage != VoiceIdle)
+            count++;
+
+    return count;
+}
+
+/**
+ * Applies a note on or note off to its voice.
+ */
+void PolySynthesizer::apply(SynthesizerEvent &e)
+{
+    SynthesizerVoice &v = voices[e.voice];
+
+    if (e.noteOn)
+    {
+        if (e.instrument)
+            v.instrument = *e.instrument;
+
+        if (v.instrument.wavetable == NULL)
+            v.instrument.wavetable = default_wavetable();
+
+        if (v.instrument.wavetable == NULL)
+            return;
+
+        // Restart the waveform from the beginning of a period, unless the voice is still sounding, in which case
+        // its phase and level carry on so the new note does not click.
+        if (v.stage == VoiceIdle)
+            v.phase = 0;
+
+        v.phaseDelta = e.phaseDelta;
+        v.peak = e.volume << 20;
+        v.target = v.peak;
+        v.stage = VoiceAttack;
+        v.remaining = samplesFromMs(v.instrument.attack);
+    }
+    else
+    {
+        if (v.stage == VoiceIdle)
+            return;
+
+        v.target = 0;
+        v.stage = VoiceRelease;
+        v.remaining = samplesFromMs(v.instrument.release);
+    }
+
+    if (v.remaining)
+        v.delta = (v.target - v.level) / (int32_t)v.remaining;
+    else
+        advance(v);
+}
+
+/**
+ * Moves a voice on to its next envelope stage once the current one has run its course.
+ */
+void PolySynthesizer::advance(SynthesizerVoice &v)
+{
+    while (v.remaining == 0)
+    {
+        v.level = v.target;
+        v.delta = 0;
+
+        switch (v.stage)
+        {
+            case VoiceAttack:
+                v.stage = VoiceDecay;
+                v.target = (v.peak >> 10) * v.instrument.sustain;
+                v.remaining = samplesFromMs(v.instrument.decay);
+                break;
+
+            case VoiceDecay:
+                v.stage = v.level ? VoiceSustain : VoiceIdle;
+                return;
+
+            default:
+                v.stage = VoiceIdle;
+                return;
+        }
+
+        if (v.remaining)
+            v.delta = (v.target - v.level) / (int32_t)v.remaining;
+    }
+}
+
+/**
+ * Adds a run of samples from a voice into the accumulator. Each envelope stage is a linear ramp, so the inner loop
+ * is just a table lookup and a multiply-accumulate per sample.
+ */
+void PolySynthesizer::renderVoice(SynthesizerVoice &v, int32_t *acc, int samples)
+{
+    while (samples > 0 && v.stage != VoiceIdle)
+    {
+        int n = samples;
+        if (v.stage != VoiceSustain && v.remaining < (uint32_t)n)
+            n = v.remaining;
+
+        const uint16_t *table = v.instrument.wavetable;
+        uint32_t phase = v.phase;
+        uint32_t phaseDelta = v.phaseDelta;
+        int32_t level = v.level;
+        int32_t delta = v.delta;
+
+        for (int i = 0; i < n; i++)
+        {
+            acc[i] += ((int32_t)table[phase >> POLY_SYNTHESIZER_PHASE_SHIFT] - 512) * (level >> 20);
+            phase += phaseDelta;
+            level += delta;
+        }
+
+        v.phase = phase;
+        v.level = level;
+
+        if (v.stage != VoiceSustain)
+        {
+            v.remaining -= n;
+            if (v.remaining == 0)
+                advance(v);
+        }
+
+        acc += n;
+        samples -= n;
+    }
+}
+
+/**
+ * Renders the given number of samples, advancing the sample clock and applying any events that fall due.
+ */
+int PolySynthesizer::render(uint16_t *out, int samples)
+{
+    if (samples > accumulatorLength)
+    {
+        int32_t *newAccumulator = (int32_t *)malloc(samples * sizeof(int32_t));
+        if (newAccumulator == NULL)
+            return DEVICE_NO_RESOURCES;
+
+        free(accumulator);
+        accumulator = newAccumulator;
+        accumulatorLength = samples;
+    }
+
+    memset(accumulator, 0, samples * sizeof(int32_t));
+
+    if (callback)
+        callbackPending = callback(callbackArg, clock, samples);
+
+    // Render every voice up to the next event, apply it, and carry on, so each event lands on its exact sample.
+    int position = 0;
+    while (position < samples)
+    {
+        while (eventCount && !before(clock + position, events[0].time))
+        {
+            apply(events[0]);
+
+            eventCount--;
+            for (int i = 0; i < eventCount; i++)
+                events[i] = events[i+1];
+        }
+
+        int end = samples;
+        if (eventCount && (int32_t)(events[0].time - clock) < end)
+            end = events[0].time - clock;
+
+        for (int i = 0; i < POLY_SYNTHESIZER_VOICES; i++)
+            if (voices[i].stage != VoiceIdle)
+                renderVoice(voices[i], &accumulator[position], end - position);
+
+        position = end;
+    }
+
+    clock += samples;
+
+    // Keep the finish times of silent voices close to the clock, so they still compare correctly once it wraps.
+    for (int i = 0; i < POLY_SYNTHESIZER_VOICES; i++)
+        if (voices[i].stage == VoiceIdle && !voices[i].held && before(voices[i].busyUntil, clock))
+            voices[i].busyUntil = clock;
+
+    int bias = isSigned ? 0 : 512;
+    for (int i = 0; i < samples; i++)
+    {
+        int32_t v = ((accumulator[i] >> 10) * amplitude) >> 10;
+#if defined(__ARM_FEATURE_SAT)
+        v = __ssat(v, 10);
+#else
+        if (v < -512) v = -512;
+        if (v > 511) v = 511;
+#endif
+        out[i] = v + bias;
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Starts the rendering fiber, if it is not already running.
+ */
+void PolySynthesizer::start()
+{
+    if (!active)
+    {
+        active = true;
+        create_fiber(begin_playback, this);
+    }
+}
+
+/**
+ * Renders buffers and queues them on the output stream until every voice is silent and no events are pending.
+ */
+void PolySynthesizer::generate()
+{
+    while (eventCount || getActiveVoiceCount() || callbackPending)
+    {
+        ManagedBuffer b(bufferSize);
+
+        if (render((uint16_t *)b.getBytes(), bufferSize / 2) != DEVICE_OK)
+            break;
+
+        buffer = b;
+        output.pullRequest();
+    }
+
+    active = false;
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, if available.
+ */
+ManagedBuffer PolySynthesizer::pull()
+{
+    ManagedBuffer out = buffer;
+    buffer = ManagedBuffer();
+    return out;
+}
+
+/**
+ * Describes the data this synthesizer provides: 10 bit samples in 16 bit words, at the current sample rate.
+ */
+DataStreamFormat PolySynthesizer::getFormat()
+{
+    return DataStreamFormat(2, 10, isSigned, 1, sampleRate);
+}
+
+/**
+ * Define the volume of the output.
+ */
+int PolySynthesizer::setVolume(int volume)
+{
+    if (volume < 0 || volume > 1024)
+        return DEVICE_INVALID_PARAMETER;
+
+    amplitude = volume;
+    return DEVICE_OK;
+}
+
+/**
+ * Define the size of the audio buffers to generate.
+ */
+int PolySynthesizer::setBufferSize(int size)
+{
+    if (size <= 0 || (size & 1))
+        return DEVICE_INVALID_PARAMETER;
+
+    bufferSize = size;
+    return DEVICE_OK;
+}
+
+/**
+ * Determine the sample rate currently in use by this synthesizer.
+ */
+int PolySynthesizer::getSampleRate()
+{
+    return sampleRate;
+}
+
+/**
+ * Change the sample rate used by this synthesizer.
+ */
+int PolySynthesizer::setSampleRate(int sampleRate)
+{
+    if (sampleRate <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->sampleRate = sampleRate;
+    return DEVICE_OK;
+}
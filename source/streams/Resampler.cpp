@@ -0,0 +1,374 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Resampler.h"
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+#include <math.h>
+
+#if defined(__ARM_FEATURE_DSP) || defined(__ARM_FEATURE_SAT)
+#include <arm_acle.h>
+#endif
+
+using namespace codal;
+
+// The fraction of the Nyquist frequency passed by the anti-aliasing filter, leaving room for its transition band.
+#define RESAMPLER_CUTOFF                        0.9f
+
+/**
+ * Computes one output sample: the dot product of taps Q15 coefficients with the input samples at x.
+ */
+static inline int16_t resampler_filter(const int16_t *h, const int16_t *x, int taps)
+{
+    int32_t acc = 1 << 14;
+
+#if defined(__ARM_FEATURE_DSP)
+    // Two multiply-accumulates per instruction. taps is always even, and coefficients are word aligned.
+    const int32_t *hp = (const int32_t *)h;
+
+    for (int k = taps >> 1; k > 0; k--)
+    {
+        int32_t xv;
+        memcpy(&xv, x, 4);
+        acc = __smlad(*hp++, xv, acc);
+        x += 2;
+    }
+#else
+    for (int k = 0; k < taps; k++)
+        acc += h[k] * x[k];
+#endif
+
+    acc >>= 15;
+
+#if defined(__ARM_FEATURE_SAT)
+    return __ssat(acc, 16);
+#else
+    if (acc > 32767) acc = 32767;
+    if (acc < -32768) acc = -32768;
+    return acc;
+#endif
+}
+
+/**
+ * Constructor.
+ *
+ * @param source the component to receive data from. If its format does not give its sample rate, use setInputRate().
+ * @param outputRate the sample rate to convert to, in Hz.
+ * @param quality the number of filter taps to use. One of the RESAMPLER_QUALITY_ values.
+ */
+Resampler::Resampler(DataSource &source, int outputRate, int quality) : input(source, DataStreamFormat(2, 16, true))
+{
+    this->downStream = NULL;
+    this->coefficients = NULL;
+    this->work = NULL;
+    this->workLength = 0;
+    this->historyLength = 0;
+    this->position = 0;
+    this->positionRemainder = 0;
+    this->step = 0;
+    this->stepRemainder = 0;
+    this->taps = quality;
+    this->outputRate = outputRate;
+
+    // Take our input rate and channels from our upstream component, and follow any later change to them in pull().
+    // Its sample encoding is handled by our converter.
+    DataStreamFormat format = source.getFormat();
+    this->upstreamRate = format.sampleRate;
+    this->inputRate = format.sampleRate;
+    this->supported = !format.isKnown() || format.channels == 1;
+
+    input.connect(*this);
+    configure();
+}
+
+/**
+ * Destructor.
+ */
+Resampler::~Resampler()
+{
+    free(coefficients);
+    free(work);
+}
+
+/**
+ * Defines the sample rate of the incoming data. This holds until the sample rate reported by the upstream component changes.
+ *
+ * @param rate The sample rate, in Hz.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int Resampler::setInputRate(int rate)
+{
+    if (rate <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    inputRate = rate;
+    return configure();
+}
+
+/**
+ * Defines the sample rate to convert to.
+ *
+ * @param rate The sample rate, in Hz.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int Resampler::setOutputRate(int rate)
+{
+    if (rate <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    outputRate = rate;
+    return configure();
+}
+
+/**
+ * Selects the trade off between conversion quality and CPU cost.
+ *
+ * @param quality the number of filter taps to use per output sample.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int Resampler::setQuality(int quality)
+{
+    if (quality < 2 || quality > 64 || (quality & 1))
+        return DEVICE_INVALID_PARAMETER;
+
+    taps = quality;
+    return configure();
+}
+
+int Resampler::getInputRate()
+{
+    return inputRate;
+}
+
+int Resampler::getOutputRate()
+{
+    return outputRate;
+}
+
+int Resampler::getQuality()
+{
+    return taps;
+}
+
+/**
+ * Determines if the format of the upstream component can be resampled.
+ *
+ * @return true if the upstream component provides mono data, or does not describe its format. false otherwise.
+ */
+bool Resampler::isSupported()
+{
+    return supported;
+}
+
+/**
+ * Recomputes the filter and step for the current rates and quality.
+ */
+int Resampler::configure()
+{
+    if (taps < 2 || taps > 64 || (taps & 1))
+        taps = RESAMPLER_QUALITY_MEDIUM;
+
+    // Until we know both rates, pass data through unchanged.
+    step = 0;
+
+    if (inputRate <= 0 || outputRate <= 0)
+        return DEVICE_OK;
+
+    int16_t *h = (int16_t *) malloc(RESAMPLER_PHASES * taps * sizeof(int16_t));
+    if (h == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    free(coefficients);
+    coefficients = h;
+
+    // When reducing the sample rate, the filter must also remove content above the new Nyquist frequency.
+    float cutoff = RESAMPLER_CUTOFF * (outputRate < inputRate ? (float)outputRate / (float)inputRate : 1.0f);
+    float weights[64];
+
+    for (int p = 0; p < RESAMPLER_PHASES; p++)
+    {
+        float f = (float)p / RESAMPLER_PHASES;
+        float sum = 0.0f;
+
+        for (int k = 0; k < taps; k++)
+        {
+            // Distance of this tap from the point being interpolated, in input samples.
+            float d = (float)(k - (taps / 2 - 1)) - f;
+            float w;
+
+            if (taps == 2)
+            {
+                // Linear interpolation.
+                w = 1.0f - fabsf(d);
+            }
+            else
+            {
+                float x = PI * d * cutoff;
+                float u = (d + taps / 2) / taps;
+
+                w = (x == 0.0f ? 1.0f : sinf(x) / x) * (0.42f - 0.5f * cosf(2 * PI * u) + 0.08f * cosf(4 * PI * u));
+            }
+
+            weights[k] = w;
+            sum += w;
+        }
+
+        // Normalise each phase to unity gain, so that a constant input gives a constant output.
+        for (int k = 0; k < taps; k++)
+        {
+            int v = (int)floorf(weights[k] * 32768.0f / sum + 0.5f);
+            h[p * taps + k] = (int16_t) max(-32768, min(32767, v));
+        }
+    }
+
+    // Track the part of the step that does not fit in 16.16 fixed point separately, so the conversion ratio is exact.
+    step = (uint32_t)(((uint64_t)inputRate << 16) / outputRate);
+    stepRemainder = (uint32_t)(((uint64_t)inputRate << 16) % outputRate);
+
+    // Restart with a history of silence, so that the filter delay is constant from the first sample.
+    if (workLength < taps)
+    {
+        free(work);
+        work = (int16_t *) malloc(taps * sizeof(int16_t));
+        workLength = work ? taps : 0;
+    }
+
+    historyLength = min(taps - 1, workLength);
+    memset(work, 0, historyLength * sizeof(int16_t));
+    position = 0;
+    positionRemainder = 0;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, at our output sample rate.
+ */
+ManagedBuffer Resampler::pull()
+{
+    ManagedBuffer in = input.pull();
+    DataStreamFormat format = input.getFormat();
+
+    supported = !format.isKnown() || format.channels == 1;
+
+    if (format.sampleRate && format.sampleRate != upstreamRate)
+    {
+        upstreamRate = format.sampleRate;
+        setInputRate(upstreamRate);
+    }
+
+    // Interleaved channels would be filtered together, so refuse them rather than provide noise.
+    if (!supported)
+        return ManagedBuffer();
+
+    if (step == 0 || (step == 0x10000 && inputRate == outputRate))
+        return in;
+
+    int inSamples = in.length() / 2;
+    int available = historyLength + inSamples;
+
+    // Make room for the new samples after those carried over from the last buffer.
+    if (available > workLength)
+    {
+        int16_t *w = (int16_t *) malloc(available * sizeof(int16_t));
+        if (w == NULL)
+            return ManagedBuffer();
+
+        memcpy(w, work, historyLength * sizeof(int16_t));
+        free(work);
+        work = w;
+        workLength = available;
+    }
+
+    memcpy(&work[historyLength], in.getBytes(), inSamples * sizeof(int16_t));
+
+    // Determine the most output samples that can be computed from the input we have.
+    int outSamples = 0;
+    uint32_t last = (uint32_t)(available - taps) << 16;
+
+    if (available >= taps && position <= last)
+        outSamples = (last - position) / step + 1;
+
+    ManagedBuffer out(outSamples * 2);
+    int16_t *o = (int16_t *) out.getBytes();
+    int16_t *end = o + outSamples;
+
+    while (o < end && position <= last)
+    {
+        int phase = (position >> (16 - RESAMPLER_PHASES_BITS)) & (RESAMPLER_PHASES - 1);
+
+        *o++ = resampler_filter(&coefficients[phase * taps], &work[position >> 16], taps);
+
+        position += step;
+        positionRemainder += stepRemainder;
+        if (positionRemainder >= (uint32_t)outputRate)
+        {
+            positionRemainder -= outputRate;
+            position++;
+        }
+    }
+
+    // The rounding carried in positionRemainder may mean one fewer sample was possible than estimated.
+    if (o < end)
+        out.truncate((o - (int16_t *) out.getBytes()) * 2);
+
+    // Carry over the samples still needed for the next output. When reducing the rate, the next output may lie
+    // beyond the end of this buffer, in which case position continues to count into the next one.
+    int consumed = min((int)(position >> 16), available);
+
+    historyLength = available - consumed;
+    memmove(work, &work[consumed], historyLength * sizeof(int16_t));
+    position -= (uint32_t)consumed << 16;
+
+    return out;
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int Resampler::pullRequest()
+{
+    if (downStream)
+        return downStream->pullRequest();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void Resampler::connect(DataSink &sink)
+{
+    this->downStream = &sink;
+}
+
+/**
+ * Describes the data this component provides: signed 16 bit mono samples at the output rate.
+ */
+DataStreamFormat Resampler::getFormat()
+{
+    return DataStreamFormat(2, 16, true, 1, outputRate);
+}
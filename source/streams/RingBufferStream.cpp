@@ -0,0 +1,472 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "RingBufferStream.h"
+#include "CodalCompat.h"
+#include "CodalFiber.h"
+#include "ErrorNo.h"
+#include "Event.h"
+
+using namespace codal;
+
+/**
+ * Maps a read or write position onto an index into the buffer.
+ * Positions run over twice the capacity, so that a full stream can be distinguished from an empty one.
+ */
+static inline int ring_index(int position, int capacity)
+{
+    return position >= capacity ? position - capacity : position;
+}
+
+/**
+ * Moves a read or write position forward by the given number of bytes.
+ */
+static inline int ring_advance(int position, int size, int capacity)
+{
+    position += size;
+    return position >= 2 * capacity ? position - 2 * capacity : position;
+}
+
+/**
+ * Constructor.
+ * Creates an empty RingBufferStream.
+ *
+ * @param upstream the component that will normally feed this stream with data.
+ * @param capacity the maximum number of bytes the stream can hold.
+ * @param id The id to use for the message bus when transmitting events.
+ */
+RingBufferStream::RingBufferStream(DataSource &upstream, int capacity, uint16_t id)
+{
+    this->id = id;
+    this->buffer = (uint8_t *) malloc(capacity);
+
+    // If the buffer cannot be allocated, behave as a stream that is always full, and report it through getCapacity().
+    this->capacity = buffer == NULL ? 0 : capacity;
+    this->readPosition = 0;
+    this->writePosition = 0;
+    this->lowWatermark = -1;
+    this->highWatermark = this->capacity + 1;
+    this->preferredBufferSize = 0;
+    this->writers = 0;
+    this->overruns = 0;
+    this->pullRequestEventCode = 0;
+    this->spaceAvailableEventCode = allocateNotifyEvent();
+    this->isBlocking = true;
+
+    this->downStream = NULL;
+    this->upStream = &upstream;
+}
+
+/**
+ * Destructor.
+ * Removes all resources held by the instance.
+ */
+RingBufferStream::~RingBufferStream()
+{
+    free(buffer);
+}
+
+/**
+ * Determines the value of the given byte in the stream.
+ *
+ * @param position The index of the byte to read, relative to the oldest byte in the stream.
+ * @return The value of the byte at the given position, or DEVICE_INVALID_PARAMETER.
+ */
+int RingBufferStream::get(int position)
+{
+    if (position < 0 || position >= length())
+        return DEVICE_INVALID_PARAMETER;
+
+    return buffer[ring_index(ring_advance(readPosition, position, capacity), capacity)];
+}
+
+/**
+ * Sets the byte at the given index to value provided.
+ *
+ * @param position The index of the byte to change, relative to the oldest byte in the stream.
+ * @param value The new value of the byte (0-255).
+ * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER.
+ */
+int RingBufferStream::set(int position, uint8_t value)
+{
+    if (position < 0 || position >= length())
+        return DEVICE_INVALID_PARAMETER;
+
+    buffer[ring_index(ring_advance(readPosition, position, capacity), capacity)] = value;
+    return DEVICE_OK;
+}
+
+/**
+ * Gets number of bytes that are ready to be consumed in this stream.
+ * @return The size in bytes.
+ */
+int RingBufferStream::length()
+{
+    int l = writePosition - readPosition;
+    return l < 0 ? l + 2 * capacity : l;
+}
+
+/**
+ * Gets number of bytes that can be added to this stream before it is full.
+ * @return The size in bytes.
+ */
+int RingBufferStream::space()
+{
+    return capacity - length();
+}
+
+/**
+ * Gets the maximum number of bytes this stream can hold.
+ * @return The size in bytes, or zero if the buffer could not be allocated.
+ */
+int RingBufferStream::getCapacity()
+{
+    return capacity;
+}
+
+/**
+ * Determines if the stream can accept any more data.
+ *
+ * @return true if the stream is full, false otherwise.
+ */
+bool RingBufferStream::full()
+{
+    return length() == capacity;
+}
+
+/**
+ * Provides direct access to the oldest data in the stream.
+ *
+ * @param size Set to the number of contiguous bytes available at the returned address.
+ * @return A pointer to the oldest byte in the stream.
+ */
+uint8_t *RingBufferStream::getReadWindow(int &size)
+{
+    int start = ring_index(readPosition, capacity);
+
+    size = min(length(), capacity - start);
+    return &buffer[start];
+}
+
+/**
+ * Removes the given number of bytes from the start of the stream.
+ *
+ * @param size The number of bytes to remove.
+ * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if fewer than size bytes are held.
+ */
+int RingBufferStream::consume(int size)
+{
+    if (size < 0 || size > length())
+        return DEVICE_INVALID_PARAMETER;
+
+    readPosition = ring_advance(readPosition, size, capacity);
+    spaceAvailable();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Provides direct access to the free space at the end of the stream.
+ *
+ * @param size Set to the number of contiguous bytes available at the returned address.
+ * @return A pointer to the first free byte in the stream.
+ */
+uint8_t *RingBufferStream::getWriteWindow(int &size)
+{
+    int start = ring_index(writePosition, capacity);
+
+    size = min(space(), capacity - start);
+    return &buffer[start];
+}
+
+/**
+ * Adds the given number of bytes, previously written via getWriteWindow(), to the end of the stream.
+ *
+ * @param size The number of bytes to add.
+ * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if there is not space for size bytes.
+ */
+int RingBufferStream::commit(int size)
+{
+    if (size < 0 || size > space())
+        return DEVICE_INVALID_PARAMETER;
+
+    writePosition = ring_advance(writePosition, size, capacity);
+    dataAvailable();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Copies data onto the end of the stream.
+ *
+ * @param data The data to add.
+ * @param size The number of bytes to add.
+ * @return The number of bytes added, which may be less than size if the stream is full.
+ */
+int RingBufferStream::write(const uint8_t *data, int size)
+{
+    int written = 0;
+
+    // At most two copies are needed: up to the end of the buffer, and then from its start.
+    while (written < size)
+    {
+        int window;
+        uint8_t *dst = getWriteWindow(window);
+
+        if (window == 0)
+            break;
+
+        window = min(window, size - written);
+        memcpy(dst, data + written, window);
+        writePosition = ring_advance(writePosition, window, capacity);
+        written += window;
+    }
+
+    if (written)
+        dataAvailable();
+
+    return written;
+}
+
+/**
+ * Copies data from the start of the stream, removing it from the stream.
+ *
+ * @param data The location to copy the data to.
+ * @param size The maximum number of bytes to copy.
+ * @return The number of bytes copied.
+ */
+int RingBufferStream::read(uint8_t *data, int size)
+{
+    int copied = 0;
+
+    while (copied < size)
+    {
+        int window;
+        uint8_t *src = getReadWindow(window);
+
+        if (window == 0)
+            break;
+
+        window = min(window, size - copied);
+        memcpy(data + copied, src, window);
+        readPosition = ring_advance(readPosition, window, capacity);
+        copied += window;
+    }
+
+    if (copied)
+        spaceAvailable();
+
+    return copied;
+}
+
+/**
+ * Defines the levels at which RING_BUFFER_STREAM_EVT_LOW_WATERMARK and RING_BUFFER_STREAM_EVT_HIGH_WATERMARK events are raised.
+ *
+ * @param low The low watermark, in bytes.
+ * @param high The high watermark, in bytes.
+ * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the watermarks are out of range.
+ */
+int RingBufferStream::setWatermarks(int low, int high)
+{
+    if (low < 0 || high > capacity || low >= high)
+        return DEVICE_INVALID_PARAMETER;
+
+    lowWatermark = low;
+    highWatermark = high;
+    status &= ~(RING_BUFFER_STREAM_HIGH_WATERMARK_PASSED | RING_BUFFER_STREAM_LOW_WATERMARK_PASSED);
+
+    // Only report reaching the low watermark after the high watermark has been reached, whatever the current level.
+    status |= RING_BUFFER_STREAM_LOW_WATERMARK_PASSED;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the number of bytes that have been dropped because the stream was full.
+ */
+uint32_t RingBufferStream::getOverruns()
+{
+    return overruns;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void RingBufferStream::connect(DataSink &sink)
+{
+    this->downStream = &sink;
+}
+
+/**
+ * Removes the downstream component of this stream.
+ */
+void RingBufferStream::disconnect()
+{
+    this->downStream = NULL;
+}
+
+/**
+ * Determine the maximum number of bytes delivered in each buffer by pull().
+ * @return the current preferred buffer size for this stream. Zero means all available data.
+ */
+int RingBufferStream::getPreferredBufferSize()
+{
+    return preferredBufferSize;
+}
+
+/**
+ * Define the maximum number of bytes delivered in each buffer by pull().
+ * @param size The number of bytes, or zero to deliver all available data.
+ */
+void RingBufferStream::setPreferredBufferSize(int size)
+{
+    this->preferredBufferSize = size;
+}
+
+/**
+ * Determines if this stream acts in a synchronous, blocking mode or asynchronous mode.
+ */
+void RingBufferStream::setBlocking(bool isBlocking)
+{
+    this->isBlocking = isBlocking;
+
+    // If this is the first time async mode has been used on this stream, allocate the necessary resources.
+    if (!isBlocking && this->pullRequestEventCode == 0)
+    {
+        this->pullRequestEventCode = allocateNotifyEvent();
+
+        if(EventModel::defaultEventBus)
+            EventModel::defaultEventBus->listen(DEVICE_ID_NOTIFY, pullRequestEventCode, this, &RingBufferStream::onDeferredPullRequest);
+    }
+}
+
+/**
+ * Provide the next available data to our downstream caller, as a ManagedBuffer of up to getPreferredBufferSize() bytes.
+ */
+ManagedBuffer RingBufferStream::pull()
+{
+    int size = length();
+
+    if (preferredBufferSize > 0)
+        size = min(size, preferredBufferSize);
+
+    if (size == 0)
+        return ManagedBuffer();
+
+    ManagedBuffer out(size);
+    read(out.getBytes(), size);
+
+    return out;
+}
+
+/**
+ * Copy the next buffer from our upstream component into the stream.
+ */
+int RingBufferStream::pullRequest()
+{
+    // If we're defined as non-blocking and no space is available, then there's nothing we can do.
+    if (full() && this->isBlocking == false)
+        return DEVICE_NO_RESOURCES;
+
+    ManagedBuffer b = upStream->pull();
+    int size = b.length();
+
+    // In blocking mode, wait until the whole buffer fits.
+    if (this->isBlocking)
+    {
+        while (size <= capacity && space() < size)
+        {
+            fiber_wake_on_event(DEVICE_ID_NOTIFY, spaceAvailableEventCode);
+            writers++;
+            schedule();
+            writers--;
+        }
+    }
+
+    int written = write(b.getBytes(), size);
+
+    if (written < size)
+    {
+        overruns += size - written;
+        Event(id, RING_BUFFER_STREAM_EVT_OVERRUN);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Describes the data this stream provides, which is the data provided by its upstream component.
+ */
+DataStreamFormat RingBufferStream::getFormat()
+{
+    return upStream->getFormat();
+}
+
+/**
+ * Raise any watermark events due, and tell our downstream component that data is available.
+ */
+void RingBufferStream::dataAvailable()
+{
+    if (!(status & RING_BUFFER_STREAM_HIGH_WATERMARK_PASSED) && length() >= highWatermark)
+    {
+        status |= RING_BUFFER_STREAM_HIGH_WATERMARK_PASSED;
+        status &= ~RING_BUFFER_STREAM_LOW_WATERMARK_PASSED;
+        Event(id, RING_BUFFER_STREAM_EVT_HIGH_WATERMARK);
+    }
+
+    if (downStream != NULL)
+    {
+        if (this->isBlocking)
+            downStream->pullRequest();
+        else
+            Event(DEVICE_ID_NOTIFY, pullRequestEventCode);
+    }
+}
+
+/**
+ * Raise any watermark events due, and wake any writers waiting for space.
+ */
+void RingBufferStream::spaceAvailable()
+{
+    if (!(status & RING_BUFFER_STREAM_LOW_WATERMARK_PASSED) && length() <= lowWatermark)
+    {
+        status |= RING_BUFFER_STREAM_LOW_WATERMARK_PASSED;
+        status &= ~RING_BUFFER_STREAM_HIGH_WATERMARK_PASSED;
+        Event(id, RING_BUFFER_STREAM_EVT_LOW_WATERMARK);
+    }
+
+    if (writers)
+        Event(DEVICE_ID_NOTIFY_ONE, spaceAvailableEventCode);
+}
+
+/**
+ * Issue a deferred pull request to our downstream component, if one has been registered.
+ */
+void RingBufferStream::onDeferredPullRequest(Event)
+{
+    if (downStream != NULL)
+        downStream->pullRequest();
+}
@@ -0,0 +1,194 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "StreamConverter.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+/**
+ * Reads the sample at the given address, returning it as a signed value.
+ */
+static inline int32_t read_sample(const uint8_t *p, const DataStreamFormat &format)
+{
+    int32_t v;
+
+    switch (format.sampleSize)
+    {
+        case 1:
+            v = format.isSigned ? (int32_t)*(const int8_t *)p : (int32_t)*p;
+            break;
+
+        case 2:
+            v = format.isSigned ? (int32_t)*(const int16_t *)p : (int32_t)*(const uint16_t *)p;
+            break;
+
+        default:
+            v = *(const int32_t *)p;
+            break;
+    }
+
+    if (!format.isSigned)
+        v -= 1 << (format.sampleBits - 1);
+
+    return v;
+}
+
+/**
+ * Stores a signed value at the given address, in the given format.
+ */
+static inline void write_sample(uint8_t *p, int32_t v, const DataStreamFormat &format)
+{
+    if (!format.isSigned)
+        v += 1 << (format.sampleBits - 1);
+
+    switch (format.sampleSize)
+    {
+        case 1:
+            *p = (uint8_t)v;
+            break;
+
+        case 2:
+            *(uint16_t *)p = (uint16_t)v;
+            break;
+
+        default:
+            *(int32_t *)p = v;
+            break;
+    }
+}
+
+/**
+ * Constructor.
+ *
+ * @param source the component to receive data from.
+ * @param format the sample encoding to convert the data into.
+ */
+StreamConverter::StreamConverter(DataSource &source, DataStreamFormat format) : upstream(source)
+{
+    this->downStream = NULL;
+    this->outputFormat = format;
+
+    // Read our input format as we connect, so that getFormat() is accurate before any data flows. pull() refreshes it.
+    this->inputFormat = source.getFormat();
+
+    source.connect(*this);
+}
+
+/**
+ * Destructor.
+ */
+StreamConverter::~StreamConverter()
+{
+}
+
+/**
+ * Determines if this converter is currently modifying the data passing through it.
+ */
+bool StreamConverter::isConverting()
+{
+    return inputFormat.isKnown() && outputFormat.isKnown() && !inputFormat.sameEncoding(outputFormat);
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, converted to our output format.
+ */
+ManagedBuffer StreamConverter::pull()
+{
+    ManagedBuffer in = upstream.pull();
+
+    // Our upstream component may have been reconfigured since we connected.
+    inputFormat = upstream.getFormat();
+
+    // Formats with a sample size of zero, such as ADPCM, are unknown and so never converted: sampleSize is not zero below.
+    if (!isConverting())
+        return in;
+
+    int samples = in.length() / inputFormat.sampleSize;
+    int shift = outputFormat.sampleBits - inputFormat.sampleBits;
+
+    // Convert in place if the samples do not grow and no other component can see the buffer, otherwise into a new buffer.
+    ManagedBuffer out = (outputFormat.sampleSize <= inputFormat.sampleSize && !in.isShared()) ? in : ManagedBuffer(samples * outputFormat.sampleSize);
+
+    const uint8_t *src = in.getBytes();
+    uint8_t *dst = out.getBytes();
+
+    for (int i = 0; i < samples; i++)
+    {
+        int32_t v = read_sample(src, inputFormat);
+
+        if (shift > 0)
+            v <<= shift;
+        else
+            v >>= -shift;
+
+        write_sample(dst, v, outputFormat);
+
+        src += inputFormat.sampleSize;
+        dst += outputFormat.sampleSize;
+    }
+
+    if (out.length() != samples * outputFormat.sampleSize)
+        out.truncate(samples * outputFormat.sampleSize);
+
+    return out;
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int StreamConverter::pullRequest()
+{
+    if (downStream)
+        return downStream->pullRequest();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void StreamConverter::connect(DataSink &sink)
+{
+    this->downStream = &sink;
+}
+
+/**
+ * Describes the data this converter provides.
+ */
+DataStreamFormat StreamConverter::getFormat()
+{
+    DataStreamFormat format = inputFormat;
+
+    if (outputFormat.isKnown())
+    {
+        format.sampleSize = outputFormat.sampleSize;
+        format.sampleBits = outputFormat.sampleBits;
+        format.isSigned = outputFormat.isSigned;
+    }
+
+    return format;
+}
@@ -25,13 +25,62 @@ DEALINGS IN THE SOFTWARE.
 #include "StreamNormalizer.h"
 #include "ErrorNo.h"
 #include "CodalDmesg.h"
+#include "CodalCompat.h"
+
+#if defined(__ARM_FEATURE_DSP) || defined(__ARM_FEATURE_SAT)
+#include <arm_acle.h>
+#endif
 
 using namespace codal;
 
+// The smallest automatic gain, in Q16 (1/64x).
+#define STREAM_NORMALIZER_AGC_MINIMUM_GAIN      1024
+
+/**
+ * Multiplies a sample by a Q16 gain.
+ */
+static inline int32_t apply_gain(int32_t gain, int32_t sample)
+{
+#if defined(__ARM_FEATURE_DSP)
+    return __smulwb(gain, sample);
+#else
+    return (int32_t)(((int64_t)gain * sample) >> 16);
+#endif
+}
+
+static inline int16_t saturate16(int32_t v)
+{
+#if defined(__ARM_FEATURE_SAT)
+    return (int16_t)__ssat(v, 16);
+#else
+    return (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+#endif
+}
+
 StreamNormalizer::StreamNormalizer(DataSource &source, int gain) : upstream(source), output(*this)
 {
     this->gain = gain;
     this->zeroOffset = 0;
+    this->status = 0;
+    this->target = STREAM_NORMALIZER_AGC_DEFAULT_TARGET;
+    this->maximumGain = STREAM_NORMALIZER_AGC_DEFAULT_MAXIMUM_GAIN;
+    this->gateThreshold = 0;
+    this->agcGain = gain << 6;
+    this->envelope = 0;
+    this->gateGain = 32767;
+    this->lookahead = NULL;
+    this->lookaheadLength = 0;
+    this->lookaheadPosition = 0;
+
+    // Time constants are converted to samples at the rate of our upstream component, and again by pullRequest() if it changes.
+    this->sampleRate = source.getFormat().sampleRate;
+    if (this->sampleRate <= 0)
+        this->sampleRate = STREAM_NORMALIZER_DEFAULT_SAMPLE_RATE;
+
+    this->attackTime = STREAM_NORMALIZER_AGC_DEFAULT_ATTACK;
+    this->releaseTime = STREAM_NORMALIZER_AGC_DEFAULT_RELEASE;
+    this->attackShift = timeToShift(attackTime);
+    this->releaseShift = timeToShift(releaseTime);
 
     // Register with our upstream component
     source.connect(*this);
@@ -45,67 +94,330 @@ ManagedBuffer StreamNormalizer::pull()
     return buffer;
 }
 
+/**
+ * Describes the data this component provides: signed 16 bit samples, at the rate and channel count of its upstream component.
+ * Buffers in any other encoding cannot be normalized, and are passed on unchanged in their original format.
+ */
+DataStreamFormat StreamNormalizer::getFormat()
+{
+    DataStreamFormat format = upstream.getFormat();
+
+    if (!format.isInt16())
+        return format;
+
+    return DataStreamFormat(2, 16, true, format.channels, format.sampleRate);
+}
+
+/**
+ * Converts a time into the log2 of a number of samples, for use as a time constant.
+ */
+int StreamNormalizer::timeToShift(int ms)
+{
+    int samples = (ms * sampleRate + 500) / 1000;
+    int shift = 0;
+
+    // Round to the nearest power of two.
+    while (shift < 20 && (1 << shift) + (1 << shift) / 2 <= samples)
+        shift++;
+
+    return shift;
+}
+
+/**
+ * Applies automatic gain control to a block of samples, in place.
+ *
+ * @return the sum of the unprocessed samples.
+ */
+int StreamNormalizer::processAutomaticGain(int16_t *data, int samples)
+{
+    int z = 0;
+    int32_t g = agcGain;
+    int32_t env = envelope;
+    int32_t gate = gateGain;
+    int32_t limit = maximumGain << 6;
+    int position = lookaheadPosition;
+
+    for (int i = 0; i < samples; i++)
+    {
+        z += data[i];
+
+        int32_t x = max(-32768, min(32767, data[i] - zeroOffset));
+        int32_t a = min(abs(x), 32767);
+
+        // Track the peak envelope of the input: jump up to each new peak, then decay at the release rate.
+        env = max(a, env - (env >> releaseShift));
+
+        // Feedback control: pull the gain down quickly while the output envelope is over the target,
+        // and let it recover slowly otherwise. The noise gate holds the gain, so that silence is not amplified.
+        if (apply_gain(g, env) > target)
+        {
+            g -= g >> attackShift;
+            g = max(g, STREAM_NORMALIZER_AGC_MINIMUM_GAIN);
+        }
+        else if (env >= gateThreshold)
+        {
+            g += (g >> releaseShift) + 1;
+            g = min(g, limit);
+        }
+
+        // Fade the gate in at the attack rate, and out at the release rate.
+        if (env >= gateThreshold)
+            gate += (32767 - gate) >> attackShift;
+        else
+            gate -= gate >> releaseShift;
+
+        // Output the sample that entered the lookahead delay line the longest time ago.
+        if (lookaheadLength)
+        {
+            int32_t delayed = lookahead[position];
+            lookahead[position] = (int16_t)x;
+            x = delayed;
+
+            if (++position == lookaheadLength)
+                position = 0;
+        }
+
+        // The gate is Q15, so scale the product back up to Q16.
+        int32_t effective = apply_gain(g, gate) << 1;
+
+        data[i] = saturate16(apply_gain(effective, x));
+    }
+
+    agcGain = g;
+    envelope = env;
+    gateGain = gate;
+    lookaheadPosition = position;
+    gain = g >> 6;
+
+    return z;
+}
+
 /**
  * Callback provided when data is ready.
  */
 int StreamNormalizer::pullRequest()
 {
     int z = 0;
-    int minimum = 0;
-    int maximum = 0;
-    int s;
-    int16_t result;
 
     buffer = upstream.pull();
+    DataStreamFormat format = upstream.getFormat();
 
-    int16_t *data = (int16_t *) &buffer[0];
-    int samples = buffer.length() / 2;
-
-    for (int i=0; i < samples; i++)
+    // Pass on anything we cannot normalize untouched. getFormat() describes it as such.
+    if (!format.isInt16())
     {
-        z += *data;
+        output.pullRequest();
+        return DEVICE_OK;
+    }
 
-        s = (int) *data;
-        s = s - zeroOffset;
-        s = s * gain;
-        s = s / 1024;
+    if (format.sampleRate && (int)format.sampleRate != sampleRate)
+    {
+        sampleRate = format.sampleRate;
+        attackShift = timeToShift(attackTime);
+        releaseShift = timeToShift(releaseTime);
+    }
 
-        result = (int16_t)s;
+    // Buffers are processed in place, so those that are read only or also referenced elsewhere must be copied first.
+    if (buffer.isShared())
+        buffer = ManagedBuffer(buffer.getBytes(), buffer.length());
 
-        if (s < minimum)
-            minimum = s;
+    int16_t *data = (int16_t *) &buffer[0];
+    int samples = buffer.length() / 2;
 
-        if (s > maximum)
-            maximum = s;
+    if (samples == 0)
+        return DEVICE_OK;
 
-        *data = result;
-        data++;
+    if (status & STREAM_NORMALIZER_AGC_ENABLED)
+    {
+        z = processAutomaticGain(data, samples);
+    }
+    else
+    {
+        for (int i=0; i < samples; i++)
+        {
+            z += data[i];
+            data[i] = saturate16(((data[i] - zeroOffset) * gain) >> 10);
+        }
     }
 
     z = z / samples;
     zeroOffset = z;
-    //DMESG("[Z: %d] [R: %d]", zeroOffset, maximum - minimum);
 
     output.pullRequest();
     return DEVICE_OK;
 }
 
+/**
+ * Applies a fixed gain, disabling automatic gain control.
+ *
+ * @param gain the gain to apply, in 1024ths of a unit.
+ *
+ * @return DEVICE_OK.
+ */
 int
 StreamNormalizer::setGain(int gain)
 {
+    disableAutomaticGain();
+
     this->gain = gain;
     return DEVICE_OK;
 }
 
+/**
+ * Determines the gain being applied, in 1024ths of a unit. When automatic gain control is enabled,
+ * this is the gain at the end of the last buffer processed.
+ */
 int
 StreamNormalizer::getGain()
 {
     return gain;
 }
 
+/**
+ * Enables automatic gain control. The gain is continually adapted so that the peak level of the output approaches the
+ * given target, falling quickly (the attack) when the signal grows and rising slowly (the release) when it fades.
+ * The output is delayed by a short lookahead, so that the gain falls before a sudden peak is output rather than after.
+ * This is STREAM_NORMALIZER_AGC_DEFAULT_LOOKAHEAD, unless setLookahead() has already been called.
+ *
+ * @param target the peak amplitude to aim for.
+ * @param maximumGain the largest gain to apply, in 1024ths of a unit. At most STREAM_NORMALIZER_AGC_MAXIMUM_GAIN.
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES if the request fails.
+ */
+int
+StreamNormalizer::enableAutomaticGain(int target, int maximumGain)
+{
+    if (target <= 0 || target > 32767 || maximumGain <= 0 || maximumGain > STREAM_NORMALIZER_AGC_MAXIMUM_GAIN)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Respect any lookahead already chosen, including none at all.
+    if (!(status & STREAM_NORMALIZER_LOOKAHEAD_CONFIGURED))
+    {
+        int result = setLookahead(STREAM_NORMALIZER_AGC_DEFAULT_LOOKAHEAD);
+        if (result != DEVICE_OK)
+            return result;
+    }
+
+    this->target = target;
+    this->maximumGain = maximumGain;
+
+    // Start from the current fixed gain, so that enabling the AGC does not cause a jump in level.
+    this->agcGain = max(STREAM_NORMALIZER_AGC_MINIMUM_GAIN, min(gain, maximumGain) << 6);
+    this->status |= STREAM_NORMALIZER_AGC_ENABLED;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Disables automatic gain control, leaving the current gain in place as a fixed gain.
+ *
+ * @return DEVICE_OK.
+ */
+int
+StreamNormalizer::disableAutomaticGain()
+{
+    status &= ~STREAM_NORMALIZER_AGC_ENABLED;
+    return DEVICE_OK;
+}
+
+/**
+ * Defines how quickly the automatic gain falls when the signal exceeds the target.
+ * Times are rounded to a power of two number of samples.
+ *
+ * @param ms the time taken for the gain to fall by a factor of e, in milliseconds.
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the request fails.
+ */
+int
+StreamNormalizer::setAttack(int ms)
+{
+    if (ms < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    attackTime = ms;
+    attackShift = timeToShift(ms);
+    return DEVICE_OK;
+}
+
+/**
+ * Defines how quickly the automatic gain rises, and the envelope decays, as the signal fades.
+ * Times are rounded to a power of two number of samples.
+ *
+ * @param ms the time taken for the gain to rise by a factor of e, in milliseconds.
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the request fails.
+ */
+int
+StreamNormalizer::setRelease(int ms)
+{
+    if (ms < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    releaseTime = ms;
+    releaseShift = timeToShift(ms);
+    return DEVICE_OK;
+}
+
+/**
+ * Defines how far ahead the automatic gain control looks for peaks. The output is delayed by this amount.
+ *
+ * @param ms the lookahead time, in milliseconds, or zero to disable lookahead.
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES if the request fails.
+ */
+int
+StreamNormalizer::setLookahead(int ms)
+{
+    if (ms < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    int length = (ms * sampleRate + 500) / 1000;
+    int16_t *delay = NULL;
+
+    if (length)
+    {
+        delay = (int16_t *) malloc(length * sizeof(int16_t));
+        if (delay == NULL)
+            return DEVICE_NO_RESOURCES;
+
+        memset(delay, 0, length * sizeof(int16_t));
+    }
+
+    // pullRequest() may run in interrupt context, so swap in the new delay line atomically, and only then free the old one.
+    target_disable_irq();
+    int16_t *old = lookahead;
+    lookahead = delay;
+    lookaheadLength = length;
+    lookaheadPosition = 0;
+    status |= STREAM_NORMALIZER_LOOKAHEAD_CONFIGURED;
+    target_enable_irq();
+
+    free(old);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the level below which the signal is treated as noise. While the input is below this level the automatic
+ * gain is held, and the output is faded out. The gate fades back in at the attack rate when the signal returns.
+ *
+ * @param threshold the input peak amplitude below which the gate closes, or zero to disable the gate.
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the request fails.
+ */
+int
+StreamNormalizer::setNoiseGate(int threshold)
+{
+    if (threshold < 0 || threshold > 32767)
+        return DEVICE_INVALID_PARAMETER;
+
+    gateThreshold = threshold;
+    return DEVICE_OK;
+}
+
 /**
  * Destructor.
  */
 StreamNormalizer::~StreamNormalizer()
 {
+    free(lookahead);
 }
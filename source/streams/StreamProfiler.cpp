@@ -0,0 +1,251 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "StreamProfiler.h"
+#include "CodalDmesg.h"
+#include "ErrorNo.h"
+#include "Timer.h"
+
+using namespace codal;
+
+StreamProfiler *StreamProfiler::profilers = NULL;
+StreamProfiler *StreamProfiler::active = NULL;
+
+/**
+ * Constructor.
+ *
+ * @param source the component to receive data from.
+ * @param name a name for this point in the pipeline, used by dump(). The string is not copied.
+ */
+StreamProfiler::StreamProfiler(DataSource &source, const char *name) : upstream(source)
+{
+    this->downStream = NULL;
+    this->name = name;
+
+#if CONFIG_ENABLED(CODAL_STREAM_PROFILING)
+    this->requestTime = 0;
+    this->requested = false;
+    this->nested = 0;
+    resetProfile();
+#endif
+
+    // Add ourselves to the end of the list, so that dump() lists profilers in the order they were created.
+    this->next = NULL;
+
+    StreamProfiler **p = &profilers;
+    while (*p)
+        p = &(*p)->next;
+
+    *p = this;
+
+    source.connect(*this);
+}
+
+/**
+ * Destructor.
+ */
+StreamProfiler::~StreamProfiler()
+{
+    for (StreamProfiler **p = &profilers; *p; p = &(*p)->next)
+    {
+        if (*p == this)
+        {
+            *p = next;
+            break;
+        }
+    }
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, measuring the time taken to produce it.
+ */
+ManagedBuffer StreamProfiler::pull()
+{
+#if CONFIG_ENABLED(CODAL_STREAM_PROFILING)
+    CODAL_TIMESTAMP start = system_timer_current_time_us();
+
+    if (requested)
+    {
+        uint32_t latency = (uint32_t)(start - requestTime);
+
+        profile.serviced++;
+        profile.totalLatency += latency;
+        if (latency > profile.maximumLatency)
+            profile.maximumLatency = latency;
+
+        requested = false;
+    }
+
+    // Track which profiler is running, so that nested profilers can report the time they account for.
+    StreamProfiler *parent = active;
+    uint32_t outerNested = nested;
+
+    active = this;
+    nested = 0;
+
+    ManagedBuffer b = upstream.pull();
+
+    uint32_t elapsed = (uint32_t)(system_timer_current_time_us() - start);
+    uint32_t self = elapsed > nested ? elapsed - nested : 0;
+
+    active = parent;
+    nested = outerNested;
+
+    if (parent)
+        parent->nested += elapsed;
+
+    profile.pulls++;
+    profile.bytes += b.length();
+    profile.totalTime += self;
+    if (self > profile.maximumTime)
+        profile.maximumTime = self;
+
+    return b;
+#else
+    return upstream.pull();
+#endif
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int StreamProfiler::pullRequest()
+{
+#if CONFIG_ENABLED(CODAL_STREAM_PROFILING)
+    profile.pullRequests++;
+
+    // Measure latency from the first outstanding request, so that a slow consumer is not hidden by later requests.
+    if (requested)
+    {
+        profile.missed++;
+    }
+    else
+    {
+        requestTime = system_timer_current_time_us();
+        requested = true;
+    }
+#endif
+
+    if (downStream)
+        return downStream->pullRequest();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void StreamProfiler::connect(DataSink &sink)
+{
+    downStream = &sink;
+}
+
+/**
+ * Describes the data this component provides, which is the data provided by its upstream component.
+ */
+DataStreamFormat StreamProfiler::getFormat()
+{
+    return upstream.getFormat();
+}
+
+/**
+ * Determines the name given to this profiler.
+ */
+const char *StreamProfiler::getName()
+{
+    return name;
+}
+
+/**
+ * Retrieves a snapshot of the activity recorded by this profiler.
+ *
+ * @param profile the structure to fill in.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if CODAL_STREAM_PROFILING is not enabled.
+ */
+int StreamProfiler::getProfile(StreamProfile *profile)
+{
+#if CONFIG_ENABLED(CODAL_STREAM_PROFILING)
+    if (profile == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    target_disable_irq();
+    *profile = this->profile;
+    target_enable_irq();
+
+    return DEVICE_OK;
+#else
+    (void)profile;
+    return DEVICE_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * Clears the activity recorded by this profiler.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if CODAL_STREAM_PROFILING is not enabled.
+ */
+int StreamProfiler::resetProfile()
+{
+#if CONFIG_ENABLED(CODAL_STREAM_PROFILING)
+    target_disable_irq();
+    memset(&profile, 0, sizeof(profile));
+    target_enable_irq();
+
+    return DEVICE_OK;
+#else
+    return DEVICE_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * Writes the activity recorded by every profiler to DMESG, one line per profiler.
+ */
+void StreamProfiler::dump()
+{
+#if CONFIG_ENABLED(CODAL_STREAM_PROFILING) && DEVICE_DMESG_BUFFER_SIZE > 0
+    for (StreamProfiler *p = profilers; p; p = p->next)
+    {
+        StreamProfile s;
+        p->getProfile(&s);
+
+        // Pulls made without a preceding pullRequest() have no latency, so latency is averaged over serviced requests only.
+        DMESG("%s: req %d pull %d bytes %d time %d/%d us latency %d/%d us missed %d", p->name ? p->name : "?",
+              s.pullRequests, s.pulls, s.bytes,
+              s.pulls ? s.totalTime / s.pulls : 0, s.maximumTime,
+              s.serviced ? s.totalLatency / s.serviced : 0, s.maximumLatency, s.missed);
+    }
+#endif
+}
+
+/**
+ * Clears the activity recorded by every profiler.
+ */
+void StreamProfiler::resetAll()
+{
+    for (StreamProfiler *p = profilers; p; p = p->next)
+        p->resetProfile();
+}
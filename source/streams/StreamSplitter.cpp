@@ -0,0 +1,300 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "StreamSplitter.h"
+#include "CodalComponent.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+SplitterChannel::SplitterChannel(StreamSplitter &parent, bool blocking)
+{
+    this->next = NULL;
+    this->parent = &parent;
+    this->output = NULL;
+    this->pending = false;
+    this->blocking = blocking;
+    this->dropped = 0;
+    this->stalls = 0;
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller. This is the buffer shared by every channel,
+ * so ManagedBuffer::isShared() is true until the last channel has pulled it, and it must not be modified until then.
+ */
+ManagedBuffer SplitterChannel::pull()
+{
+    ManagedBuffer b = buffer;
+
+    // Drop our reference, so that the buffer is released as soon as the last channel has finished with it.
+    buffer = ManagedBuffer();
+    pending = false;
+
+    // If we were the last channel holding back upstream, resume delivery. This is deferred rather than done here,
+    // so that our sink finishes processing this buffer before it is offered the next.
+    if (blocking && parent->requestsPending && parent->ready())
+        Event(DEVICE_ID_NOTIFY, parent->pullRequestEventCode);
+
+    return b;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void SplitterChannel::connect(DataSink &sink)
+{
+    output = &sink;
+}
+
+/**
+ * Removes the downstream component of this channel. It is no longer offered data, and the channel may then be destroyed.
+ */
+void SplitterChannel::disconnect()
+{
+    bool wasPending = pending;
+
+    output = NULL;
+    buffer = ManagedBuffer();
+    pending = false;
+
+    // A blocking channel that had not pulled its last buffer may have been holding back upstream.
+    if (wasPending && blocking && parent->requestsPending && parent->ready())
+        Event(DEVICE_ID_NOTIFY, parent->pullRequestEventCode);
+}
+
+/**
+ * Describes the data this channel provides, which is the data provided by the splitter's upstream component.
+ */
+DataStreamFormat SplitterChannel::getFormat()
+{
+    return parent->upstream.getFormat();
+}
+
+/**
+ * Determines if this channel holds back data from upstream until it has consumed the last buffer.
+ */
+bool SplitterChannel::isBlocking()
+{
+    return blocking;
+}
+
+/**
+ * Determines the number of buffers this channel missed because it had not pulled the previous buffer in time.
+ * Only non-blocking channels drop buffers.
+ */
+uint32_t SplitterChannel::getDropCount()
+{
+    return dropped;
+}
+
+/**
+ * Determines the number of times this channel held back data from upstream because it had not pulled the previous
+ * buffer. This identifies the slowest consumer on a splitter. Only blocking channels stall.
+ */
+uint32_t SplitterChannel::getStallCount()
+{
+    return stalls;
+}
+
+/**
+ * Resets the drop and stall counts to zero.
+ */
+void SplitterChannel::resetCounters()
+{
+    dropped = 0;
+    stalls = 0;
+}
+
+/**
+ * Constructor.
+ *
+ * @param source the component to receive data from.
+ */
+StreamSplitter::StreamSplitter(DataSource &source) : upstream(source)
+{
+    this->channels = NULL;
+    this->requestsPending = 0;
+    this->pullRequestEventCode = allocateNotifyEvent();
+
+    if (EventModel::defaultEventBus)
+        EventModel::defaultEventBus->listen(DEVICE_ID_NOTIFY, pullRequestEventCode, this, &StreamSplitter::onDeferredPullRequest);
+
+    source.connect(*this);
+}
+
+/**
+ * Destructor. Deletes every channel, so any components connected to them must already have been destroyed.
+ */
+StreamSplitter::~StreamSplitter()
+{
+    if (EventModel::defaultEventBus)
+        EventModel::defaultEventBus->ignore(DEVICE_ID_NOTIFY, pullRequestEventCode, this, &StreamSplitter::onDeferredPullRequest);
+
+    while (channels)
+    {
+        SplitterChannel *c = channels;
+        channels = c->next;
+        delete c;
+    }
+}
+
+/**
+ * Adds an output to this splitter.
+ *
+ * @param blocking true if the pace of the splitter should be limited by this channel, or false if it may drop buffers instead.
+ * @return the new channel, or NULL if there is insufficient memory.
+ */
+SplitterChannel *StreamSplitter::createChannel(bool blocking)
+{
+    SplitterChannel *c = new SplitterChannel(*this, blocking);
+
+    if (c == NULL)
+        return NULL;
+
+    // Append, so that channels are offered data in the order they were created.
+    SplitterChannel **p = &channels;
+    while (*p)
+        p = &(*p)->next;
+
+    *p = c;
+
+    return c;
+}
+
+/**
+ * Removes and deletes an output of this splitter.
+ * The channel must first be disconnected, as its downstream component would otherwise be left holding a reference to it.
+ *
+ * @param channel the channel to remove.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the channel does not belong to this splitter,
+ * or DEVICE_BUSY if it is still connected to a downstream component.
+ */
+int StreamSplitter::destroyChannel(SplitterChannel *channel)
+{
+    for (SplitterChannel **p = &channels; *p; p = &(*p)->next)
+    {
+        if (*p == channel)
+        {
+            if (channel->output)
+                return DEVICE_BUSY;
+
+            *p = channel->next;
+            delete channel;
+
+            // The channel may have been the one holding back upstream.
+            if (requestsPending && ready())
+                Event(DEVICE_ID_NOTIFY, pullRequestEventCode);
+
+            return DEVICE_OK;
+        }
+    }
+
+    return DEVICE_INVALID_PARAMETER;
+}
+
+/**
+ * Determines if every blocking channel has pulled its last buffer.
+ */
+bool StreamSplitter::ready()
+{
+    for (SplitterChannel *c = channels; c; c = c->next)
+        if (c->blocking && c->pending)
+            return false;
+
+    return true;
+}
+
+/**
+ * Pulls a buffer from upstream, and offers it to every connected channel.
+ */
+int StreamSplitter::deliver()
+{
+    ManagedBuffer b = upstream.pull();
+
+    // Hand every channel a reference to the same buffer. Channels without a sink are skipped, so that they do not hold back the others.
+    for (SplitterChannel *c = channels; c; c = c->next)
+    {
+        if (c->output == NULL)
+            continue;
+
+        if (c->pending)
+            c->dropped++;
+
+        c->buffer = b;
+        c->pending = true;
+    }
+
+    // Release our own reference, so that the last channel to pull the buffer holds the only one, and may modify it.
+    b = ManagedBuffer();
+
+    SplitterChannel *next;
+    for (SplitterChannel *c = channels; c; c = next)
+    {
+        // Save next in case the sink removes this channel.
+        next = c->next;
+
+        if (c->output)
+            c->output->pullRequest();
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int StreamSplitter::pullRequest()
+{
+    // Leave the data upstream until every blocking channel has caught up. Upstream components then see the backpressure
+    // of the slowest consumer, as they would if it were connected to them directly.
+    if (!ready())
+    {
+        for (SplitterChannel *c = channels; c; c = c->next)
+            if (c->blocking && c->pending)
+                c->stalls++;
+
+        // Upstream expects one pull() for each pullRequest(), so count them all. A queuing upstream would otherwise be left
+        // holding the extra buffers.
+        requestsPending++;
+        return DEVICE_BUSY;
+    }
+
+    return deliver();
+}
+
+/**
+ * Delivers the data that was held back by a blocking channel, one buffer per held pullRequest, once that channel
+ * has caught up.
+ */
+void StreamSplitter::onDeferredPullRequest(Event)
+{
+    // Stop if a channel falls behind again. Its next pull() raises another event to resume.
+    while (requestsPending && ready())
+    {
+        requestsPending--;
+        deliver();
+    }
+}
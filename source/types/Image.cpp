@@ -33,6 +33,7 @@ DEALINGS IN THE SOFTWARE.
 #include "Image.h"
 #include "BitmapFont.h"
 #include "CodalCompat.h"
+#include "CodalHeapAllocator.h"
 #include "ManagedString.h"
 #include "ErrorNo.h"
 
@@ -293,7 +294,7 @@ void Image::init(const int16_t x, const int16_t y, const uint8_t *bitmap)
 
 
     // Create a copy of the array
-    ptr = (ImageData*)malloc(sizeof(ImageData) + x * y);
+    ptr = (ImageData*)device_malloc_region(sizeof(ImageData) + x * y, DEVICE_HEAP_PLACEMENT_IMAGE);
     REF_COUNTED_INIT(ptr);
     ptr->width = x;
     ptr->height = y;
@@ -93,6 +93,39 @@ ManagedBuffer::ManagedBuffer(uint8_t *data, int length)
     this->init(data, length);
 }
 
+/**
+ * Constructor.
+ * Creates a new ManagedBuffer of the given size, using storage from the given Arena rather than the heap.
+ * If the arena has insufficient space, the buffer is allocated from the heap as normal.
+ *
+ * @param length The length of the buffer to create.
+ * @param arena The Arena to allocate storage from.
+ *
+ * Example:
+ * @code
+ * ArenaScope scope(scratch);
+ * ManagedBuffer p(16, scratch);   // Creates a ManagedBuffer 16 bytes long in the scratch arena.
+ * @endcode
+ */
+ManagedBuffer::ManagedBuffer(int length, Arena &arena)
+{
+    if (length <= 0) {
+        initEmpty();
+        return;
+    }
+
+    ptr = (BufferData *) arena.alloc(sizeof(BufferData) + length);
+
+    if (ptr == NULL) {
+        init(NULL, length);
+        return;
+    }
+
+    REF_COUNTED_INIT(ptr);
+    ptr->length = length;
+    memset(ptr->payload, 0, length);
+}
+
 /**
  * Copy Constructor.
  * Add ourselves as a reference to an existing ManagedBuffer.
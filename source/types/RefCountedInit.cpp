@@ -25,6 +25,7 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalConfig.h"
 #include "CodalDevice.h"
 #include "RefCounted.h"
+#include "CodalArena.h"
 
 using namespace codal;
 // These two are placed in a separate file, so that they can be overriden by user code.
@@ -34,6 +35,10 @@ using namespace codal;
   */
 void RefCounted::destroy()
 {
+    // Objects allocated from an Arena are reclaimed when that arena is released.
+    if (Arena::owner(this))
+        return;
+
     free(this);
 }
 